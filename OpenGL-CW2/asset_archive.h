@@ -0,0 +1,392 @@
+#ifndef ASSET_ARCHIVE_H
+#define ASSET_ARCHIVE_H
+
+#include "content_hash.h"
+#include "mapped_file.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+using namespace std;
+
+// every shader, model and texture packed into one file that is mapped once at startup. layout: header, table of
+// contents sorted by name hash, name strings, then each asset's bytes aligned so it can be handed out in place.
+// entries that shrink enough are stored LZ4 block compressed and decompressed when opened
+const char assetArchiveMagic[8] = { 'C', 'W', '2', 'P', 'A', 'C', 'K', 0 };
+const uint32_t assetArchiveVersion = 1;
+const uint64_t assetArchiveAlignment = 64;
+const char* const assetArchiveDefaultPath = "assets.pak";
+
+enum AssetCompression : uint32_t {
+    assetStored = 0,
+    assetLz4 = 1,
+};
+
+struct AssetArchiveHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t entryCount;
+    uint64_t entriesOffset;
+    uint64_t stringsOffset;
+    uint64_t stringsSize;
+    uint64_t fileSize;
+};
+
+struct AssetArchiveEntry {
+    // of the name, the table is sorted by it
+    uint64_t nameHash;
+    // into the string table, the name is nul terminated
+    uint32_t nameOffset;
+    uint32_t compression;
+    // of the stored bytes from the start of the archive
+    uint64_t offset;
+    uint64_t storedSize;
+    // once decompressed
+    uint64_t size;
+    // HashBytes of the decompressed bytes, what HashFileContents gives for the loose file
+    uint64_t contentHash;
+};
+
+// the name assets are looked up by: forward slashes, no "./" segments, lower case like the file systems the
+// paths were written for
+inline string AssetKey(string path)
+{
+    replace(path.begin(), path.end(), '\\', '/');
+    for (size_t dot; (dot = path.find("/./")) != string::npos;)
+        path.erase(dot, 2);
+    while (path.compare(0, 2, "./") == 0)
+        path.erase(0, 2);
+    for (char& c : path)
+        c = (char)tolower((unsigned char)c);
+    return path;
+}
+
+namespace lz4
+{
+    const size_t minimumMatch = 4;
+    // the format ends every block with literals, the last match has to start this far from the end
+    const size_t lastLiterals = 5;
+    const size_t matchLimit = 12;
+    const int hashBits = 14;
+
+    inline void writeLength(size_t length, vector<unsigned char>& output)
+    {
+        for (; length >= 255; length -= 255)
+            output.push_back(255);
+        output.push_back((unsigned char)length);
+    }
+
+    inline void writeSequence(const unsigned char* literals, size_t literalCount, size_t matchLength, size_t offset, vector<unsigned char>& output)
+    {
+        size_t extraMatch = matchLength ? matchLength - minimumMatch : 0;
+        output.push_back((unsigned char)((min(literalCount, (size_t)15) << 4) | min(extraMatch, (size_t)15)));
+        if (literalCount >= 15)
+            writeLength(literalCount - 15, output);
+        output.insert(output.end(), literals, literals + literalCount);
+        if (!matchLength)
+            return;
+        output.push_back((unsigned char)(offset & 0xFF));
+        output.push_back((unsigned char)(offset >> 8));
+        if (extraMatch >= 15)
+            writeLength(extraMatch - 15, output);
+    }
+
+    // one LZ4 block, greedy matching through a hash table of the last position each 4 bytes were seen at
+    inline void compress(const unsigned char* source, size_t size, vector<unsigned char>& output)
+    {
+        output.clear();
+        output.reserve(size + size / 255 + 16);
+        vector<size_t> table((size_t)1 << hashBits, SIZE_MAX);
+        size_t anchor = 0;
+        size_t i = 0;
+        while (i + matchLimit <= size)
+        {
+            uint32_t word;
+            memcpy(&word, source + i, sizeof(word));
+            size_t slot = (word * 2654435761u) >> (32 - hashBits);
+            size_t candidate = table[slot];
+            table[slot] = i;
+            if (candidate == SIZE_MAX || i - candidate > 65535 || memcmp(source + candidate, source + i, minimumMatch) != 0)
+            {
+                i++;
+                continue;
+            }
+
+            size_t length = minimumMatch;
+            while (i + length < size - lastLiterals && source[candidate + length] == source[i + length])
+                length++;
+            while (i > anchor && candidate > 0 && source[i - 1] == source[candidate - 1])
+            {
+                i--;
+                candidate--;
+                length++;
+            }
+            writeSequence(source + anchor, i - anchor, length, i - candidate, output);
+            i += length;
+            anchor = i;
+        }
+        writeSequence(source + anchor, size - anchor, 0, 0, output);
+    }
+
+    inline bool readLength(const unsigned char* source, size_t sourceSize, size_t& in, size_t& length)
+    {
+        unsigned char next;
+        do
+        {
+            if (in >= sourceSize)
+                return false;
+            next = source[in++];
+            length += next;
+        } while (next == 255);
+        return true;
+    }
+
+    // false if the block is damaged or does not decompress to exactly size bytes
+    inline bool decompress(const unsigned char* source, size_t sourceSize, unsigned char* output, size_t size)
+    {
+        size_t in = 0;
+        size_t out = 0;
+        while (in < sourceSize)
+        {
+            unsigned char token = source[in++];
+            size_t literalCount = token >> 4;
+            if (literalCount == 15 && !readLength(source, sourceSize, in, literalCount))
+                return false;
+            if (literalCount > sourceSize - in || literalCount > size - out)
+                return false;
+            memcpy(output + out, source + in, literalCount);
+            in += literalCount;
+            out += literalCount;
+            // the last sequence is literals only
+            if (in == sourceSize)
+                break;
+
+            if (sourceSize - in < 2)
+                return false;
+            size_t offset = source[in] | (size_t)source[in + 1] << 8;
+            in += 2;
+            size_t length = token & 15;
+            if (length == 15 && !readLength(source, sourceSize, in, length))
+                return false;
+            length += minimumMatch;
+            if (offset == 0 || offset > out || length > size - out)
+                return false;
+            const unsigned char* match = output + out - offset;
+            if (offset >= length)
+                memcpy(output + out, match, length);
+            else
+            {
+                // overlapping, repeats the last offset bytes
+                for (size_t k = 0; k < length; k++)
+                    output[out + k] = match[k];
+            }
+            out += length;
+        }
+        return out == size;
+    }
+}
+
+// the bytes of one asset, valid while this is alive: a view straight into the mounted archive, a mapping of the
+// loose file, or the decompressed copy of a compressed entry
+class AssetData
+{
+public:
+    AssetData() {}
+
+    AssetData(AssetData&&) = default;
+    AssetData& operator=(AssetData&&) = default;
+    AssetData(const AssetData&) = delete;
+    AssetData& operator=(const AssetData&) = delete;
+
+    explicit operator bool() const
+    {
+        return bytes != NULL;
+    }
+
+    const unsigned char* Data() const
+    {
+        return bytes;
+    }
+
+    size_t Size() const
+    {
+        return size;
+    }
+
+    bool FromArchive() const
+    {
+        return fromArchive;
+    }
+
+private:
+    friend class AssetArchive;
+    friend AssetData OpenAsset(const string& path);
+
+    const unsigned char* bytes = NULL;
+    size_t size = 0;
+    bool fromArchive = false;
+    unique_ptr<MappedFile> mapping;
+    vector<unsigned char> decompressed;
+};
+
+// the mounted archive, process wide. mount it before anything loads, lookups are then safe from any thread
+class AssetArchive
+{
+public:
+    static AssetArchive& Get()
+    {
+        static AssetArchive archive;
+        return archive;
+    }
+
+    // maps the archive in place of any mounted before, false (and the loose files are used) if it is missing or damaged
+    bool Mount(const string& path)
+    {
+        Unmount();
+        if (!file.Open(path))
+            return false;
+        const unsigned char* data = file.Data();
+        size_t size = file.Size();
+        if (size < sizeof(AssetArchiveHeader))
+            return fail(path);
+        const AssetArchiveHeader* candidate = (const AssetArchiveHeader*)data;
+        if (memcmp(candidate->magic, assetArchiveMagic, sizeof(assetArchiveMagic)) != 0 || candidate->version != assetArchiveVersion
+            || candidate->fileSize != size || candidate->entriesOffset > size
+            || (size - candidate->entriesOffset) / sizeof(AssetArchiveEntry) < candidate->entryCount
+            || candidate->stringsOffset > size || size - candidate->stringsOffset < candidate->stringsSize
+            || candidate->stringsSize == 0 || data[candidate->stringsOffset + candidate->stringsSize - 1] != 0)
+            return fail(path);
+        const AssetArchiveEntry* table = (const AssetArchiveEntry*)(data + candidate->entriesOffset);
+        for (uint32_t i = 0; i < candidate->entryCount; i++)
+            if (table[i].nameOffset >= candidate->stringsSize || table[i].offset > size || size - table[i].offset < table[i].storedSize
+                || (table[i].compression == assetStored && table[i].storedSize != table[i].size) || table[i].compression > assetLz4)
+                return fail(path);
+
+        header = candidate;
+        entries = table;
+        strings = (const char*)data + candidate->stringsOffset;
+        return true;
+    }
+
+    void Unmount()
+    {
+        header = NULL;
+        entries = NULL;
+        strings = NULL;
+        file.Close();
+    }
+
+    bool IsMounted() const
+    {
+        return header != NULL;
+    }
+
+    size_t EntryCount() const
+    {
+        return header ? header->entryCount : 0;
+    }
+
+    const AssetArchiveEntry& Entry(size_t index) const
+    {
+        return entries[index];
+    }
+
+    const char* Name(const AssetArchiveEntry& entry) const
+    {
+        return strings + entry.nameOffset;
+    }
+
+    // the entry for a path, null if nothing is mounted or the archive does not have it
+    const AssetArchiveEntry* Find(const string& path) const
+    {
+        if (!header)
+            return NULL;
+        string key = AssetKey(path);
+        uint64_t hash = HashBytes(key.data(), key.size());
+        const AssetArchiveEntry* end = entries + header->entryCount;
+        const AssetArchiveEntry* entry = lower_bound(entries, end, hash, [](const AssetArchiveEntry& e, uint64_t h) { return e.nameHash < h; });
+        for (; entry != end && entry->nameHash == hash; entry++)
+            if (key == strings + entry->nameOffset)
+                return entry;
+        return NULL;
+    }
+
+    // the entry's bytes, in place when it is stored uncompressed
+    AssetData Open(const AssetArchiveEntry& entry) const
+    {
+        AssetData asset;
+        const unsigned char* stored = file.Data() + entry.offset;
+        if (entry.compression == assetStored)
+            asset.bytes = stored;
+        else
+        {
+            asset.decompressed.resize((size_t)entry.size);
+            if (!lz4::decompress(stored, (size_t)entry.storedSize, asset.decompressed.data(), asset.decompressed.size()))
+            {
+                cout << "ERROR::ASSET_ARCHIVE::DAMAGED_ENTRY: " << Name(entry) << endl;
+                return AssetData();
+            }
+            asset.bytes = asset.decompressed.data();
+        }
+        asset.size = (size_t)entry.size;
+        asset.fromArchive = true;
+        // an empty entry still opens
+        static const unsigned char empty = 0;
+        if (!asset.size)
+            asset.bytes = &empty;
+        return asset;
+    }
+
+private:
+    MappedFile file;
+    const AssetArchiveHeader* header = NULL;
+    const AssetArchiveEntry* entries = NULL;
+    const char* strings = NULL;
+
+    AssetArchive() {}
+
+    bool fail(const string& path)
+    {
+        cout << "ERROR::ASSET_ARCHIVE::INVALID: " << path << ", using the loose files" << endl;
+        file.Close();
+        return false;
+    }
+};
+
+// a shader, model or texture file: from the mounted archive when it has the path, otherwise the loose file mapped.
+// false when neither exists
+inline AssetData OpenAsset(const string& path)
+{
+    if (const AssetArchiveEntry* entry = AssetArchive::Get().Find(path))
+        return AssetArchive::Get().Open(*entry);
+    AssetData asset;
+    asset.mapping.reset(new MappedFile());
+    if (!asset.mapping->Open(path))
+        return AssetData();
+    asset.bytes = asset.mapping->Data();
+    asset.size = asset.mapping->Size();
+    return asset;
+}
+
+inline bool AssetExists(const string& path)
+{
+    return AssetArchive::Get().Find(path) || ifstream(path, ios::binary).good();
+}
+
+// HashFileContents for an asset, the archive has it already so nothing is read
+inline bool HashAsset(const string& path, uint64_t& hash)
+{
+    if (const AssetArchiveEntry* entry = AssetArchive::Get().Find(path))
+    {
+        hash = entry->contentHash;
+        return true;
+    }
+    return HashFileContents(path, hash);
+}
+#endif
@@ -0,0 +1,97 @@
+#ifndef ASSET_IO_SYSTEM_H
+#define ASSET_IO_SYSTEM_H
+
+#include <assimp/IOStream.hpp>
+#include <assimp/IOSystem.hpp>
+
+#include "asset_archive.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+using namespace std;
+
+// read only Assimp stream over an asset's bytes, in the archive or a mapped loose file, nothing is copied until
+// the importer reads it
+class AssetIOStream : public Assimp::IOStream
+{
+public:
+    explicit AssetIOStream(AssetData&& asset) : asset(move(asset)) {}
+
+    size_t Read(void* buffer, size_t size, size_t count) override
+    {
+        if (!size)
+            return 0;
+        count = min(count, (asset.Size() - position) / size);
+        memcpy(buffer, asset.Data() + position, size * count);
+        position += size * count;
+        return count;
+    }
+
+    size_t Write(const void*, size_t, size_t) override
+    {
+        return 0;
+    }
+
+    aiReturn Seek(size_t offset, aiOrigin origin) override
+    {
+        size_t target;
+        if (origin == aiOrigin_SET)
+            target = offset;
+        else if (origin == aiOrigin_CUR)
+            target = position + offset;
+        else
+            target = asset.Size() - offset;
+        if (target > asset.Size())
+            return aiReturn_FAILURE;
+        position = target;
+        return aiReturn_SUCCESS;
+    }
+
+    size_t Tell() const override
+    {
+        return position;
+    }
+
+    size_t FileSize() const override
+    {
+        return asset.Size();
+    }
+
+    void Flush() override {}
+
+private:
+    AssetData asset;
+    size_t position = 0;
+};
+
+// lets the importer open a model and the files it refers to (materials, textures) through OpenAsset
+class AssetIOSystem : public Assimp::IOSystem
+{
+public:
+    bool Exists(const char* file) const override
+    {
+        return AssetExists(file);
+    }
+
+    char getOsSeparator() const override
+    {
+        return '/';
+    }
+
+    Assimp::IOStream* Open(const char* file, const char* mode = "rb") override
+    {
+        if (strchr(mode, 'w') || strchr(mode, 'a'))
+            return NULL;
+        AssetData asset = OpenAsset(file);
+        if (!asset)
+            return NULL;
+        return new AssetIOStream(move(asset));
+    }
+
+    void Close(Assimp::IOStream* stream) override
+    {
+        delete stream;
+    }
+};
+#endif
@@ -0,0 +1,319 @@
+#ifndef ASSET_MANAGER_H
+#define ASSET_MANAGER_H
+
+#include <glm/glm.hpp>
+
+#include "frame_scheduler.h"
+#include "impostor.h"
+#include "model.h"
+#include "resource_cache.h"
+#include "skeletal_animation.h"
+#include "texture_streamer.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+// a model instance switches to a coarser level of detail once that level's error would cover less than this many
+// pixels, and back to a finer one as soon as the current level's error grows past it
+const float modelLodPixelError = 1.0f;
+// coarser levels have to get this much under the limit first, so an instance near the switch doesn't flicker
+const float modelLodHysteresis = 0.25f;
+// a model with a baked impostor is drawn as it once the model covers fewer pixels across than this, under the
+// impostor's frame size so the frames are never magnified. it has to get modelLodHysteresis under it first too
+const float modelImpostorPixels = 96.0f;
+
+// a placed copy of a shared model: the model's GPU data plus this object's own transform
+class ModelInstance
+{
+public:
+    glm::mat4 transform = glm::mat4(1.0f);
+    // level of detail the instance is drawn at, and whether it is far enough to be drawn as its impostor instead,
+    // chosen by SelectLod
+    unsigned int lod = 0;
+    bool impostor = false;
+
+    ModelInstance() {}
+
+    explicit ModelInstance(const shared_ptr<Model>& model) : model(model) {}
+
+    bool IsDrawable() const
+    {
+        return model && model->IsDrawable();
+    }
+
+    // picks the level of detail from how many pixels its error covers at the instance's distance from the camera,
+    // and the impostor from how many the whole model covers.
+    // pixelsPerUnit is the size on screen of one unit at distance 1: viewport height / (2 tan(fov / 2))
+    void SelectLod(const glm::vec3& cameraPosition, float pixelsPerUnit)
+    {
+        if (!IsDrawable())
+            return;
+        selectImpostor(cameraPosition, pixelsPerUnit);
+        const vector<float>& errors = model->lodErrors;
+        if (errors.size() < 2)
+        {
+            lod = 0;
+            return;
+        }
+        float scale = maxScale();
+        BoundingVolume world = WorldBounds();
+        // to the nearest point of the bounding sphere, inside it everything is full detail
+        float distance = glm::length(cameraPosition - world.center) - world.radius;
+        if (distance <= 0.0f)
+        {
+            lod = 0;
+            return;
+        }
+        float pixelsPerError = scale * pixelsPerUnit / distance;
+
+        lod = min(lod, (unsigned int)errors.size() - 1);
+        while (lod > 0 && errors[lod] * pixelsPerError > modelLodPixelError)
+            lod--;
+        while (lod + 1 < errors.size() && errors[lod + 1] * pixelsPerError < modelLodPixelError * (1.0f - modelLodHysteresis))
+            lod++;
+    }
+
+    // tells the texture streamer how much detail the model's textures need at the instance's size on screen, for the
+    // point of the bounding sphere nearest the camera, nothing while it is drawn as its impostor. same pixelsPerUnit
+    // as SelectLod
+    void RequestTextures(const glm::vec3& cameraPosition, float pixelsPerUnit) const
+    {
+        if (!IsDrawable() || impostor)
+            return;
+        BoundingVolume world = WorldBounds();
+        float distance = glm::length(cameraPosition - world.center) - world.radius;
+        float pixelsPerModelUnit = distance > 0.0f ? maxScale() * pixelsPerUnit / distance : FLT_MAX;
+        for (const Mesh& mesh : model->meshes)
+        {
+            if (mesh.uvDensity <= 0.0f)
+                continue;
+            for (const Texture& texture : mesh.textures)
+                TextureStreamer::Get().Request(texture.id, pixelsPerModelUnit / mesh.uvDensity);
+        }
+    }
+
+    // plays one of the model's clips from its start, looping or holding its last pose. false if the model (loaded
+    // so far) has no such clip
+    bool Play(const string& name, bool loop = true)
+    {
+        return IsDrawable() && Play(model->FindClip(name), loop);
+    }
+
+    bool Play(int index, bool loop = true)
+    {
+        if (!IsDrawable() || index < 0 || index >= (int)model->clips.size())
+            return false;
+        clip = index;
+        clipTime = 0.0f;
+        looping = loop;
+        return true;
+    }
+
+    bool IsPlaying() const
+    {
+        return clip >= 0;
+    }
+
+    // stops the clip where it is, the pose stays
+    void Stop()
+    {
+        clip = -1;
+    }
+
+    // moves the playing clip on by seconds and poses the instance's nodes and bone palette with it. touches no GL
+    // state and nothing shared, so different instances can be animated at the same time (AnimateInstances)
+    void Animate(float seconds)
+    {
+        if (clip < 0 || !IsDrawable())
+            return;
+        const AnimationClip& playing = model->clips[clip];
+        clipTime += seconds;
+        if (looping && playing.duration > 0.0f)
+            clipTime = fmod(clipTime, playing.duration);
+        NodeHierarchy* nodes = Pose();
+        SampleClip(playing, clipTime, looping, *nodes);
+        nodes->Update();
+        ComputeBonePalette(model->bones, *nodes, palette);
+    }
+
+    // draws at the selected level of detail with the instance's transform and pose, nothing until the model has
+    // finished loading. only the nodes changed since the last draw, and those under them, are multiplied again,
+    // and the bone palette only when any were. with a cull view the hidden clusters of models loaded with their
+    // cluster bounds are left out. an instance selected for its impostor is queued to the ImpostorRenderer instead,
+    // in the model's imported pose
+    void Draw(Shader& shader, const ClusterCullView* cull = NULL)
+    {
+        if (!IsDrawable())
+            return;
+        if (impostor && model->impostor)
+        {
+            ImpostorRenderer::Get().Add(model->impostor, transform);
+            return;
+        }
+        if (posed && pose.Update() && !model->bones.empty())
+            ComputeBonePalette(model->bones, pose, palette);
+        model->Draw(shader, transform, lod, posed ? &pose : NULL, palette.empty() ? NULL : &palette, cull);
+    }
+
+    // the model's bounds in the imported pose moved by the instance's transform. use TransformBounds directly to
+    // move many instances of one model at once
+    BoundingVolume WorldBounds() const
+    {
+        BoundingVolume world;
+        if (model)
+            TransformBounds(model->bounds, &transform, 1, &world);
+        return world;
+    }
+
+    // the instance's own copy of the model's node tree, made on first use, for moving its parts (a turret) without
+    // moving those of other instances. set local matrices, the world matrices follow at the next Draw
+    NodeHierarchy* Pose()
+    {
+        if (!IsDrawable())
+            return NULL;
+        if (!posed)
+        {
+            pose = model->nodes;
+            posed = true;
+        }
+        return &pose;
+    }
+
+    const shared_ptr<Model>& GetModel() const
+    {
+        return model;
+    }
+
+private:
+    shared_ptr<Model> model;
+    NodeHierarchy pose;
+    bool posed = false;
+    // the skinning matrices of the pose, empty until the instance is posed
+    vector<glm::mat4> palette;
+    int clip = -1;
+    float clipTime = 0.0f;
+    bool looping = true;
+
+    void selectImpostor(const glm::vec3& cameraPosition, float pixelsPerUnit)
+    {
+        if (!model->impostor)
+        {
+            impostor = false;
+            return;
+        }
+        BoundingVolume world = WorldBounds();
+        float distance = glm::length(cameraPosition - world.center);
+        float pixels = distance > world.radius ? 2.0f * world.radius * pixelsPerUnit / distance : FLT_MAX;
+        impostor = pixels < modelImpostorPixels * (impostor ? 1.0f : 1.0f - modelLodHysteresis);
+    }
+
+    // of the transform's axes, how much it enlarges the model at most
+    float maxScale() const
+    {
+        return max(glm::length(glm::vec3(transform[0])), max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+    }
+};
+
+// samples the clips of many instances on the thread pool, each one poses only its own nodes and palette. the palettes
+// are uploaded as the instances are drawn
+inline void AnimateInstances(ModelInstance* const* instances, size_t count, float seconds)
+{
+    ThreadPool::Get().ParallelFor(count, [&](size_t i)
+    {
+        instances[i]->Animate(seconds);
+    });
+}
+
+// process wide registry of loaded models. the same file is loaded once and shared by every instance of it,
+// a model is unloaded once CollectUnused finds no instance referring to it
+class AssetManager
+{
+public:
+    static AssetManager& Get()
+    {
+        static AssetManager manager;
+        return manager;
+    }
+
+    // the model for a file, loaded asynchronously through the scheduler the first time it is asked for.
+    // keepCpuData keeps the meshes' vertices and indices on the CPU, clusterBounds the bounds of clusters of their
+    // triangles. the first load of a file decides
+    shared_ptr<Model> LoadModel(const string& path, FrameScheduler& scheduler, bool keepCpuData = false, bool clusterBounds = false)
+    {
+        string key = normalisePath(path);
+        auto found = models.find(key);
+        if (found != models.end())
+        {
+            modelHits++;
+            return found->second;
+        }
+        auto model = make_shared<Model>(key, scheduler, false, keepCpuData, clusterBounds);
+        models[key] = model;
+        return model;
+    }
+
+    ModelInstance Instantiate(const string& path, FrameScheduler& scheduler, bool keepCpuData = false, bool clusterBounds = false)
+    {
+        return ModelInstance(LoadModel(path, scheduler, keepCpuData, clusterBounds));
+    }
+
+    // unloads models without instances, then GPU resources nothing refers to. context thread only
+    void CollectUnused()
+    {
+        for (auto it = models.begin(); it != models.end();)
+        {
+            // a model still loading has scheduled uploads pointing at it
+            if (it->second.use_count() == 1 && !it->second->IsLoading())
+            {
+                it->second->Release();
+                it = models.erase(it);
+            }
+            else
+                ++it;
+        }
+        ResourceCache::Get().CollectUnused();
+    }
+
+    void PrintReport() const
+    {
+        cout << "Asset manager: " << models.size() << " models, " << modelHits << " loads shared an already loaded model" << endl;
+        for (const auto& entry : models)
+        {
+            cout << "  " << entry.first << ": " << entry.second->meshes.size() << " meshes, " << entry.second->CpuBytes() / 1024 << " KB of CPU copies kept, "
+                 << entry.second->releasedCpuBytes / 1024 << " KB freed after upload" << endl;
+            const ClusterCullStats& culled = entry.second->cullStats;
+            if (culled.triangles)
+                cout << "    cluster culling left out " << culled.RejectionRate() * 100.0f << "% of " << culled.triangles << " triangles ("
+                     << culled.frustumRejected * 100.0 / culled.triangles << "% outside the frustum, " << culled.coneRejected * 100.0 / culled.triangles
+                     << "% facing away)" << endl;
+            if (entry.second->impostor)
+                cout << "    impostor of " << entry.second->impostor->frames * entry.second->impostor->frames << " frames, "
+                     << entry.second->impostor->Bytes() / 1024 << " KB" << endl;
+        }
+        ResourceCache::Get().PrintReport();
+    }
+
+private:
+    unordered_map<string, shared_ptr<Model>> models;
+    size_t modelHits = 0;
+
+    // one spelling per file: forward slashes, no "./" segments
+    static string normalisePath(string path)
+    {
+        replace(path.begin(), path.end(), '\\', '/');
+        for (size_t dot; (dot = path.find("/./")) != string::npos;)
+            path.erase(dot, 2);
+        while (path.compare(0, 2, "./") == 0)
+            path.erase(0, 2);
+        return path;
+    }
+};
+#endif
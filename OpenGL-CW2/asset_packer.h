@@ -0,0 +1,232 @@
+#ifndef ASSET_PACKER_H
+#define ASSET_PACKER_H
+
+#include "asset_archive.h"
+#include "cache_file.h"
+#include "thread_pool.h"
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifdef APIENTRY
+#undef APIENTRY
+#endif
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// an entry is only kept compressed when that saves at least this fraction of it, everything else (the already
+// compressed images) is stored as is and opened in place
+const float assetPackMinimumSaving = 0.125f;
+
+namespace pack
+{
+    inline bool endsWith(const string& text, const string& suffix)
+    {
+        return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+
+    // the caches are made from the assets on the machine that runs the game, they don't go in the archive
+    inline bool skipped(const string& path)
+    {
+        return endsWith(path, ".meshcache") || endsWith(path, ".texcache") || endsWith(path, ".tmp") || endsWith(path, ".pak");
+    }
+
+    // the files under path, or path itself if it is a file
+    inline void listFiles(const string& path, vector<string>& files)
+    {
+#ifdef _WIN32
+        DWORD attributes = GetFileAttributesA(path.c_str());
+        if (attributes == INVALID_FILE_ATTRIBUTES)
+            return;
+        if (!(attributes & FILE_ATTRIBUTE_DIRECTORY))
+        {
+            files.push_back(path);
+            return;
+        }
+        WIN32_FIND_DATAA found;
+        HANDLE search = FindFirstFileA((path + "/*").c_str(), &found);
+        if (search == INVALID_HANDLE_VALUE)
+            return;
+        do
+        {
+            string name = found.cFileName;
+            if (name != "." && name != "..")
+                listFiles(path + "/" + name, files);
+        } while (FindNextFileA(search, &found));
+        FindClose(search);
+#else
+        struct stat info;
+        if (stat(path.c_str(), &info) != 0)
+            return;
+        if (!S_ISDIR(info.st_mode))
+        {
+            files.push_back(path);
+            return;
+        }
+        DIR* directory = opendir(path.c_str());
+        if (!directory)
+            return;
+        while (dirent* found = readdir(directory))
+        {
+            string name = found->d_name;
+            if (name != "." && name != "..")
+                listFiles(path + "/" + name, files);
+        }
+        closedir(directory);
+#endif
+    }
+
+    inline bool readFile(const string& path, vector<unsigned char>& bytes)
+    {
+        ifstream file(path, ios::binary | ios::ate);
+        if (!file)
+            return false;
+        bytes.resize((size_t)file.tellg());
+        file.seekg(0);
+        file.read((char*)bytes.data(), bytes.size());
+        return (bool)file;
+    }
+
+    inline uint64_t alignOffset(uint64_t offset)
+    {
+        return (offset + assetArchiveAlignment - 1) & ~(assetArchiveAlignment - 1);
+    }
+}
+
+// packs every file under the given files and directories into one archive, named by their paths as given
+// (run from the directory the game runs in). files are read and compressed on the thread pool
+inline bool PackAssets(const string& archivePath, const vector<string>& inputs)
+{
+    vector<string> files;
+    for (const string& input : inputs)
+        pack::listFiles(input, files);
+    files.erase(remove_if(files.begin(), files.end(), pack::skipped), files.end());
+    // read under their own names, stored under their keys
+    sort(files.begin(), files.end(), [](const string& a, const string& b) { return AssetKey(a) < AssetKey(b); });
+    files.erase(unique(files.begin(), files.end(), [](const string& a, const string& b) { return AssetKey(a) == AssetKey(b); }), files.end());
+    vector<string> keys;
+    for (const string& file : files)
+        keys.push_back(AssetKey(file));
+    if (files.empty())
+    {
+        cout << "Nothing to pack" << endl;
+        return false;
+    }
+
+    vector<AssetArchiveEntry> entries(files.size());
+    vector<vector<unsigned char>> contents(files.size());
+    vector<char> readable(files.size(), 0);
+    ThreadPool::Get().ParallelFor(files.size(), [&](size_t i)
+    {
+        vector<unsigned char> bytes;
+        if (!pack::readFile(files[i], bytes))
+            return;
+        readable[i] = 1;
+        AssetArchiveEntry& entry = entries[i];
+        memset(&entry, 0, sizeof(entry));
+        entry.nameHash = HashBytes(keys[i].data(), keys[i].size());
+        entry.size = bytes.size();
+        entry.contentHash = HashBytes(bytes.data(), bytes.size());
+        entry.compression = assetStored;
+        if (!bytes.empty())
+        {
+            vector<unsigned char> compressed;
+            lz4::compress(bytes.data(), bytes.size(), compressed);
+            if (compressed.size() <= bytes.size() * (1.0f - assetPackMinimumSaving))
+            {
+                entry.compression = assetLz4;
+                bytes.swap(compressed);
+            }
+        }
+        entry.storedSize = bytes.size();
+        contents[i].swap(bytes);
+    });
+    for (size_t i = 0; i < files.size(); i++)
+        if (!readable[i])
+        {
+            cout << "Could not read " << files[i] << endl;
+            return false;
+        }
+
+    string strings;
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        entries[i].nameOffset = (uint32_t)strings.size();
+        strings.append(keys[i].c_str(), keys[i].size() + 1);
+    }
+    vector<size_t> order(files.size());
+    for (size_t i = 0; i < order.size(); i++)
+        order[i] = i;
+    sort(order.begin(), order.end(), [&](size_t a, size_t b) { return entries[a].nameHash < entries[b].nameHash; });
+
+    AssetArchiveHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, assetArchiveMagic, sizeof(assetArchiveMagic));
+    header.version = assetArchiveVersion;
+    header.entryCount = (uint32_t)entries.size();
+    header.entriesOffset = sizeof(AssetArchiveHeader);
+    header.stringsOffset = header.entriesOffset + entries.size() * sizeof(AssetArchiveEntry);
+    header.stringsSize = strings.size();
+    // the blobs go in name order, files of one directory next to each other
+    uint64_t offset = pack::alignOffset(header.stringsOffset + strings.size());
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        entries[i].offset = offset;
+        offset = pack::alignOffset(offset + entries[i].storedSize);
+    }
+    header.fileSize = offset;
+
+    uint64_t totalSize = 0, totalStored = 0;
+    // written under a temporary name of its own so a half written archive is never opened
+    string temporaryPath = TemporaryCachePath(archivePath);
+    bool complete;
+    {
+        ofstream file(temporaryPath, ios::binary | ios::trunc);
+        if (!file)
+            return false;
+        file.write((const char*)&header, sizeof(header));
+        for (size_t i : order)
+            file.write((const char*)&entries[i], sizeof(AssetArchiveEntry));
+        file.write(strings.data(), strings.size());
+        static const char padding[assetArchiveAlignment] = {};
+        uint64_t written = header.stringsOffset + strings.size();
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            file.write(padding, entries[i].offset - written);
+            file.write((const char*)contents[i].data(), contents[i].size());
+            written = entries[i].offset + contents[i].size();
+            totalSize += entries[i].size;
+            totalStored += entries[i].storedSize;
+        }
+        file.write(padding, header.fileSize - written);
+        complete = (bool)file;
+    }
+    if (!complete)
+    {
+        remove(temporaryPath.c_str());
+        return false;
+    }
+    if (!CommitCacheFile(temporaryPath, archivePath))
+        return false;
+    cout << "Packed " << entries.size() << " files into " << archivePath << ": " << totalSize / 1024 << " KB, "
+         << totalStored / 1024 << " KB stored" << endl;
+    return true;
+}
+#endif
@@ -0,0 +1,165 @@
+#ifndef BOUNDING_VOLUME_H
+#define BOUNDING_VOLUME_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+using namespace std;
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define BOUNDING_VOLUME_SSE 1
+#endif
+
+// axis aligned box and bounding sphere of the same points. plain data so it can be stored as is in the mesh cache
+struct BoundingVolume {
+    glm::vec3 boxMin;
+    glm::vec3 boxMax;
+    glm::vec3 center;
+    float radius;
+
+    BoundingVolume() : boxMin(0.0f), boxMax(0.0f), center(0.0f), radius(0.0f) {}
+};
+
+// bounds of count points, each stride bytes after the last. the sphere is Ritter's (start from the two most distant
+// of the extreme points along the axes, grow to take in every point outside), or the one around the box if smaller
+inline BoundingVolume BoundPoints(const void* points, size_t count, size_t stride)
+{
+    BoundingVolume bounds;
+    if (count == 0)
+        return bounds;
+    auto point = [points, stride](size_t i) -> const glm::vec3& { return *(const glm::vec3*)((const unsigned char*)points + i * stride); };
+
+    size_t lowest[3] = { 0, 0, 0 }, highest[3] = { 0, 0, 0 };
+    bounds.boxMin = bounds.boxMax = point(0);
+    for (size_t i = 1; i < count; i++)
+    {
+        const glm::vec3& p = point(i);
+        for (int axis = 0; axis < 3; axis++)
+        {
+            if (p[axis] < bounds.boxMin[axis])
+            {
+                bounds.boxMin[axis] = p[axis];
+                lowest[axis] = i;
+            }
+            if (p[axis] > bounds.boxMax[axis])
+            {
+                bounds.boxMax[axis] = p[axis];
+                highest[axis] = i;
+            }
+        }
+    }
+
+    int widest = 0;
+    float widestDistance = -1.0f;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        glm::vec3 span = point(highest[axis]) - point(lowest[axis]);
+        float distance = glm::dot(span, span);
+        if (distance > widestDistance)
+        {
+            widestDistance = distance;
+            widest = axis;
+        }
+    }
+    glm::vec3 center = (point(lowest[widest]) + point(highest[widest])) * 0.5f;
+    float radius = sqrt(widestDistance) * 0.5f;
+    for (size_t i = 0; i < count; i++)
+    {
+        glm::vec3 offset = point(i) - center;
+        float distance = glm::length(offset);
+        if (distance > radius)
+        {
+            // move the centre towards the point just far enough to take it in
+            float grown = (radius + distance) * 0.5f;
+            center += offset * ((grown - radius) / distance);
+            radius = grown;
+        }
+    }
+
+    glm::vec3 boxCenter = (bounds.boxMin + bounds.boxMax) * 0.5f;
+    float boxRadius = glm::length(bounds.boxMax - bounds.boxMin) * 0.5f;
+    bounds.center = radius < boxRadius ? center : boxCenter;
+    bounds.radius = min(radius, boxRadius);
+    return bounds;
+}
+
+// the union of two volumes, the sphere around both spheres
+inline BoundingVolume MergeBounds(const BoundingVolume& a, const BoundingVolume& b)
+{
+    BoundingVolume merged;
+    merged.boxMin = glm::min(a.boxMin, b.boxMin);
+    merged.boxMax = glm::max(a.boxMax, b.boxMax);
+    glm::vec3 offset = b.center - a.center;
+    float distance = glm::length(offset);
+    if (distance + b.radius <= a.radius)
+    {
+        merged.center = a.center;
+        merged.radius = a.radius;
+    }
+    else if (distance + a.radius <= b.radius)
+    {
+        merged.center = b.center;
+        merged.radius = b.radius;
+    }
+    else
+    {
+        merged.radius = (distance + a.radius + b.radius) * 0.5f;
+        merged.center = a.center + offset * ((merged.radius - a.radius) / distance);
+    }
+    return merged;
+}
+
+// moves local bounds to world space under count transforms: the box through the absolute value of each matrix
+// (Arvo), the sphere scaled by the largest axis scale. one instance per iteration, its xyz in one SSE register
+inline void TransformBounds(const BoundingVolume& local, const glm::mat4* transforms, size_t count, BoundingVolume* world)
+{
+    glm::vec3 boxCenter = (local.boxMin + local.boxMax) * 0.5f;
+    glm::vec3 boxExtent = (local.boxMax - local.boxMin) * 0.5f;
+#ifdef BOUNDING_VOLUME_SSE
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    for (size_t i = 0; i < count; i++)
+    {
+        const float* m = &transforms[i][0][0];
+        __m128 c0 = _mm_loadu_ps(m), c1 = _mm_loadu_ps(m + 4), c2 = _mm_loadu_ps(m + 8), c3 = _mm_loadu_ps(m + 12);
+        __m128 center = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(boxCenter.x)), _mm_mul_ps(c1, _mm_set1_ps(boxCenter.y))),
+                                   _mm_add_ps(_mm_mul_ps(c2, _mm_set1_ps(boxCenter.z)), c3));
+        __m128 extent = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signMask, c0), _mm_set1_ps(boxExtent.x)),
+                                              _mm_mul_ps(_mm_andnot_ps(signMask, c1), _mm_set1_ps(boxExtent.y))),
+                                   _mm_mul_ps(_mm_andnot_ps(signMask, c2), _mm_set1_ps(boxExtent.z)));
+        __m128 sphere = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(local.center.x)), _mm_mul_ps(c1, _mm_set1_ps(local.center.y))),
+                                   _mm_add_ps(_mm_mul_ps(c2, _mm_set1_ps(local.center.z)), c3));
+        float low[4], high[4], moved[4];
+        _mm_storeu_ps(low, _mm_sub_ps(center, extent));
+        _mm_storeu_ps(high, _mm_add_ps(center, extent));
+        _mm_storeu_ps(moved, sphere);
+
+        BoundingVolume& result = world[i];
+        result.boxMin = glm::vec3(low[0], low[1], low[2]);
+        result.boxMax = glm::vec3(high[0], high[1], high[2]);
+        result.center = glm::vec3(moved[0], moved[1], moved[2]);
+        // largest squared length of the three axis columns
+        float column0 = m[0] * m[0] + m[1] * m[1] + m[2] * m[2];
+        float column1 = m[4] * m[4] + m[5] * m[5] + m[6] * m[6];
+        float column2 = m[8] * m[8] + m[9] * m[9] + m[10] * m[10];
+        result.radius = local.radius * sqrt(max(column0, max(column1, column2)));
+    }
+#else
+    for (size_t i = 0; i < count; i++)
+    {
+        const glm::mat4& m = transforms[i];
+        glm::mat3 absolute(glm::abs(glm::vec3(m[0])), glm::abs(glm::vec3(m[1])), glm::abs(glm::vec3(m[2])));
+        glm::vec3 center = glm::vec3(m * glm::vec4(boxCenter, 1.0f));
+        glm::vec3 extent = absolute * boxExtent;
+        BoundingVolume& result = world[i];
+        result.boxMin = center - extent;
+        result.boxMax = center + extent;
+        result.center = glm::vec3(m * glm::vec4(local.center, 1.0f));
+        float scale = max(glm::length(glm::vec3(m[0])), max(glm::length(glm::vec3(m[1])), glm::length(glm::vec3(m[2]))));
+        result.radius = local.radius * scale;
+    }
+#endif
+}
+#endif
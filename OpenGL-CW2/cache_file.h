@@ -0,0 +1,57 @@
+#ifndef CACHE_FILE_H
+#define CACHE_FILE_H
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+// glad defines APIENTRY too, windows.h gives it the same value
+#ifdef APIENTRY
+#undef APIENTRY
+#endif
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <atomic>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <thread>
+using namespace std;
+
+// caches are written whole under a name of their own and then moved over the old file in one step, so a reader
+// only ever maps a complete cache, and processes or threads writing the same cache at once don't share a
+// temporary file
+
+// a temporary name next to path no other writer uses: the process, the thread and a count
+inline string TemporaryCachePath(const string& path)
+{
+    static atomic<unsigned int> counter{ 0 };
+#ifdef _WIN32
+    unsigned long process = (unsigned long)GetCurrentProcessId();
+#else
+    unsigned long process = (unsigned long)getpid();
+#endif
+    size_t thread = hash<std::thread::id>()(this_thread::get_id());
+    return path + "." + to_string(process) + "." + to_string(thread % 1000000) + "." + to_string(counter++) + ".tmp";
+}
+
+// moves a written temporary file over path, replacing what is there without it ever being missing. the temporary
+// file is removed if that fails
+inline bool CommitCacheFile(const string& temporaryPath, const string& path)
+{
+#ifdef _WIN32
+    bool moved = MoveFileExA(temporaryPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    bool moved = rename(temporaryPath.c_str(), path.c_str()) == 0;
+#endif
+    if (!moved)
+        remove(temporaryPath.c_str());
+    return moved;
+}
+#endif
@@ -0,0 +1,95 @@
+#ifndef CLUSTER_BENCHMARK_H
+#define CLUSTER_BENCHMARK_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "cluster_culling.h"
+#include "mesh_clusters.h"
+#include "mesh_optimizer.h"
+#include "mesh_simplify.h"
+#include "obj_loader.h"
+#include "thread_pool.h"
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// cameras around the model at these multiples of its bounding radius, inside it first, each at every heading and height
+const float clusterBenchmarkDistances[] = { 0.75f, 1.5f, 4.0f };
+const int clusterBenchmarkHeadings = 24;
+const float clusterBenchmarkHeights[] = { 0.0f, 30.0f };
+
+// imports each OBJ file the way Model does up to the cluster bounds, then culls its clusters for cameras looking at it
+// from all round (with the game's projection) and prints what share of the triangles each distance leaves out and
+// how long culling the whole model takes
+inline void BenchmarkClusterCulling(const vector<string>& files)
+{
+    glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 100.0f);
+    for (const string& path : files)
+    {
+        vector<MeshData> meshes;
+        if (!IsObjPath(path) || !LoadObj(path, meshes))
+        {
+            cout << "Could not load " << path << ", the cluster benchmark takes OBJ files" << endl;
+            continue;
+        }
+        ThreadPool::Get().ParallelFor(meshes.size(), [&](size_t m)
+        {
+            OptimizeMeshData(meshes[m]);
+            GenerateMeshLods(meshes[m]);
+            ComputeMeshBounds(meshes[m]);
+            BuildMeshClusters(meshes[m]);
+        });
+        BoundingVolume bounds = meshes.empty() ? BoundingVolume() : meshes[0].bounds;
+        size_t clusters = 0, triangles = 0;
+        for (size_t m = 0; m < meshes.size(); m++)
+        {
+            bounds = m ? MergeBounds(bounds, meshes[m].bounds) : bounds;
+            clusters += meshes[m].clusters.size();
+            for (const MeshCluster& cluster : meshes[m].clusters)
+                triangles += cluster.indexCount / 3;
+        }
+        cout << "Cluster culling " << path << ": " << meshes.size() << " meshes, " << clusters << " clusters of "
+             << (clusters ? (float)triangles / clusters : 0.0f) << " triangles on average" << endl;
+
+        vector<ClusterDrawList> drawLists(meshes.size());
+        vector<ClusterCullStats> meshStats(meshes.size());
+        for (float distance : clusterBenchmarkDistances)
+        {
+            ClusterCullStats total;
+            size_t ranges = 0, views = 0;
+            double cullMs = 0.0;
+            for (float height : clusterBenchmarkHeights)
+                for (int heading = 0; heading < clusterBenchmarkHeadings; heading++)
+                {
+                    float yaw = glm::radians(360.0f * heading / clusterBenchmarkHeadings), pitch = glm::radians(height);
+                    glm::vec3 direction(cos(pitch) * sin(yaw), sin(pitch), cos(pitch) * cos(yaw));
+                    glm::vec3 camera = bounds.center + direction * bounds.radius * distance;
+                    ClusterCullView view(projection * glm::lookAt(camera, bounds.center, glm::vec3(0.0f, 1.0f, 0.0f)), camera);
+
+                    auto start = chrono::steady_clock::now();
+                    meshStats.assign(meshes.size(), ClusterCullStats());
+                    ThreadPool::Get().ParallelFor(meshes.size(), [&](size_t m)
+                    {
+                        CullClusters(meshes[m].clusters, glm::mat4(1.0f), view, drawLists[m], meshStats[m]);
+                    });
+                    cullMs += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+                    for (size_t m = 0; m < meshes.size(); m++)
+                    {
+                        total.Add(meshStats[m]);
+                        ranges += drawLists[m].indexCounts.size();
+                    }
+                    views++;
+                }
+            cout << "  at " << distance << " radii: " << total.RejectionRate() * 100.0f << "% of the triangles left out ("
+                 << (total.triangles ? total.frustumRejected * 100.0 / total.triangles : 0.0) << "% outside the frustum, "
+                 << (total.triangles ? total.coneRejected * 100.0 / total.triangles : 0.0) << "% facing away), "
+                 << (float)ranges / views << " draw ranges, " << cullMs * 1000.0 / views << " us to cull" << endl;
+        }
+    }
+}
+#endif
@@ -0,0 +1,79 @@
+#ifndef CLUSTER_CULLING_H
+#define CLUSTER_CULLING_H
+
+#include <glm/glm.hpp>
+
+#include "frustum.h"
+#include "mesh.h"
+
+#include <vector>
+using namespace std;
+
+// the camera clusters are culled against, in world space
+struct ClusterCullView {
+    glm::mat4 viewProjection;
+    glm::vec3 cameraPosition;
+
+    ClusterCullView(const glm::mat4& viewProjection, const glm::vec3& cameraPosition) : viewProjection(viewProjection), cameraPosition(cameraPosition) {}
+};
+
+// clusters and triangles culled so far, and why
+struct ClusterCullStats {
+    size_t clusters = 0;
+    size_t triangles = 0;
+    size_t frustumRejected = 0;
+    size_t coneRejected = 0;
+
+    void Add(const ClusterCullStats& other)
+    {
+        clusters += other.clusters;
+        triangles += other.triangles;
+        frustumRejected += other.frustumRejected;
+        coneRejected += other.coneRejected;
+    }
+
+    // share of the triangles that were not drawn
+    float RejectionRate() const
+    {
+        return triangles ? (float)(frustumRejected + coneRejected) / triangles : 0.0f;
+    }
+};
+
+// culls the clusters of a mesh placed by placement: the ones outside the frustum, and the ones whose every triangle
+// faces away from the camera (which back face culling would throw away anyway). works in the mesh's own space, the
+// frustum planes and the camera are moved into it, so there is nothing to transform per cluster. the cone test is
+// left out for mirroring placements, they turn the triangles round
+inline void CullClusters(const vector<MeshCluster>& clusters, const glm::mat4& placement, const ClusterCullView& view, ClusterDrawList& visible, ClusterCullStats& stats)
+{
+    visible.Clear();
+    Frustum frustum(view.viewProjection * placement);
+    glm::vec3 camera = glm::vec3(glm::inverse(placement) * glm::vec4(view.cameraPosition, 1.0f));
+    bool cones = glm::determinant(glm::mat3(placement)) > 0.0f;
+    for (const MeshCluster& cluster : clusters)
+    {
+        size_t triangles = cluster.indexCount / 3;
+        stats.clusters++;
+        stats.triangles += triangles;
+        const BoundingVolume& bounds = cluster.bounds;
+        if (!frustum.IntersectsSphere(bounds.center, bounds.radius) || !frustum.IntersectsBox(bounds.boxMin, bounds.boxMax))
+        {
+            stats.frustumRejected += triangles;
+            continue;
+        }
+        glm::vec3 toCluster = bounds.center - camera;
+        float distance = glm::length(toCluster);
+        if (cones && glm::dot(toCluster, cluster.coneAxis) >= cluster.coneCutoff * distance + bounds.radius)
+        {
+            stats.coneRejected += triangles;
+            continue;
+        }
+        if (!visible.indexCounts.empty() && visible.firstIndices.back() + (uint32_t)visible.indexCounts.back() == cluster.firstIndex)
+            visible.indexCounts.back() += (GLsizei)cluster.indexCount;
+        else
+        {
+            visible.firstIndices.push_back(cluster.firstIndex);
+            visible.indexCounts.push_back((GLsizei)cluster.indexCount);
+        }
+    }
+}
+#endif
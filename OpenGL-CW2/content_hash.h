@@ -0,0 +1,39 @@
+#ifndef CONTENT_HASH_H
+#define CONTENT_HASH_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+using namespace std;
+
+// hashes the on-disk caches use to tell whether their source changed, and content deduplication
+const uint64_t fnvOffsetBasis = 14695981039346656037ull;
+
+// 64 bit FNV-1a, chained by passing the previous hash in
+inline uint64_t HashBytes(const void* data, size_t size, uint64_t hash = fnvOffsetBasis)
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// hash of the whole file, false if it cannot be read
+inline bool HashFileContents(const string& path, uint64_t& hash)
+{
+    ifstream file(path, ios::binary);
+    if (!file)
+        return false;
+    hash = fnvOffsetBasis;
+    char buffer[65536];
+    while (file)
+    {
+        file.read(buffer, sizeof(buffer));
+        hash = HashBytes(buffer, (size_t)file.gcount(), hash);
+    }
+    return true;
+}
+#endif
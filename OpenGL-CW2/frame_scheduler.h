@@ -0,0 +1,232 @@
+#ifndef FRAME_SCHEDULER_H
+#define FRAME_SCHEDULER_H
+
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+// main thread work (GL uploads and anything else that has to run on the context thread) spread over
+// frames within a millisecond budget. the budget is whatever the measured frame leaves of the target
+// frame time, so a heavy frame gets less scheduled work and a light one more
+class FrameScheduler
+{
+public:
+    // frame time to stay under, 60 fps
+    float targetFrameMs = 1000.0f / 60.0f;
+    // scheduled work always gets at least this much per frame so queues keep draining, and never more than the maximum
+    float minBudgetMs = 1.0f;
+    float maxBudgetMs = 8.0f;
+
+    // counters since start up
+    struct Stats {
+        size_t itemsRun = 0;
+        // sum over frames of the items left queued at the end of the frame
+        size_t itemsDeferred = 0;
+        size_t framesDeferred = 0;
+        // frames whose scheduled work went over the budget, and the worst overrun
+        size_t overruns = 0;
+        float worstOverrunMs = 0.0f;
+        size_t frames = 0;
+    };
+
+    // queues main thread work. higher priorities run first, equal ones in submission order.
+    // estimates are corrected per category: once items of a category have run, their estimates are scaled by
+    // how far off the earlier ones were
+    void Schedule(const string& category, int priority, float estimatedMs, function<void()> work)
+    {
+        WorkItem item;
+        item.category = category;
+        item.priority = priority;
+        item.estimatedMs = estimatedMs;
+        item.sequence = sequenceCounter++;
+        item.work = move(work);
+        queue.push_back(move(item));
+        push_heap(queue.begin(), queue.end(), RunsLater());
+    }
+
+    // runs background() on the thread pool, then queues complete(result) for the main thread once it is done
+    template<class F, class G>
+    void ScheduleAsync(const string& category, int priority, float estimatedMs, F background, G complete)
+    {
+        typedef decltype(background()) Result;
+        auto job = make_shared<future<Result>>(ThreadPool::Get().Submit(move(background)));
+        WorkItem item;
+        item.category = category;
+        item.priority = priority;
+        item.estimatedMs = estimatedMs;
+        item.ready = [job]() { return job->wait_for(chrono::seconds(0)) == future_status::ready; };
+        item.work = [job, complete]() mutable
+        {
+            Result result = job->get();
+            complete(result);
+        };
+        waiting.push_back(move(item));
+    }
+
+    // runs queued work until this frame's budget is used up, call once at the start of the frame
+    void RunFrame()
+    {
+        auto start = chrono::steady_clock::now();
+        frameStart = start;
+        stats.frames++;
+
+        promoteFinished();
+
+        budgetMs = min(max(targetFrameMs - averageFrameMs, minBudgetMs), maxBudgetMs);
+        spentMs = 0.0f;
+        bool ranAny = false;
+        while (!queue.empty())
+        {
+            // the first item always runs, otherwise one bigger than the budget would never get a turn
+            if (ranAny && spentMs + estimateOf(queue.front()) > budgetMs)
+                break;
+            runTop();
+            ranAny = true;
+            spentMs = elapsedMs(start);
+        }
+
+        if (spentMs > budgetMs)
+        {
+            stats.overruns++;
+            stats.worstOverrunMs = max(stats.worstOverrunMs, spentMs - budgetMs);
+        }
+        if (!queue.empty())
+        {
+            stats.itemsDeferred += queue.size();
+            stats.framesDeferred++;
+        }
+    }
+
+    // call before swapping buffers, measures the frame's own work without the scheduled work or waiting for vsync
+    void EndFrame()
+    {
+        float frameMs = max(elapsedMs(frameStart) - spentMs, 0.0f);
+        averageFrameMs = averageFrameMs == 0.0f ? frameMs : averageFrameMs * 0.9f + frameMs * 0.1f;
+    }
+
+    // runs everything queued, ignoring the budget. for loading before the first frame
+    void Flush()
+    {
+        promoteFinished();
+        while (!queue.empty())
+            runTop();
+    }
+
+    size_t Queued() const
+    {
+        return queue.size() + waiting.size();
+    }
+
+    float BudgetMs() const
+    {
+        return budgetMs;
+    }
+
+    const Stats& GetStats() const
+    {
+        return stats;
+    }
+
+    void PrintReport() const
+    {
+        cout << "Frame scheduler: " << stats.itemsRun << " items run over " << stats.frames << " frames" << endl;
+        cout << "  deferred: " << stats.itemsDeferred << " item frames in " << stats.framesDeferred << " frames" << endl;
+        cout << "  budget overruns: " << stats.overruns << " (worst " << stats.worstOverrunMs << " ms)" << endl;
+        for (const auto& cost : costs)
+            cout << "  " << cost.first << ": " << cost.second.averageMs << " ms per item, " << cost.second.ratio << "x its estimate" << endl;
+    }
+
+private:
+    struct WorkItem {
+        string category;
+        int priority = 0;
+        float estimatedMs = 0.0f;
+        unsigned long long sequence = 0;
+        function<void()> work;
+        // set for items still waiting on a background job
+        function<bool()> ready;
+    };
+
+    struct RunsLater {
+        bool operator()(const WorkItem& a, const WorkItem& b) const
+        {
+            if (a.priority != b.priority)
+                return a.priority < b.priority;
+            return a.sequence > b.sequence;
+        }
+    };
+
+    // a heap by RunsLater, the next item to run at the front
+    vector<WorkItem> queue;
+    vector<WorkItem> waiting;
+    unsigned long long sequenceCounter = 0;
+    // running averages of each category's measured cost and of measured over estimated cost
+    struct CategoryCost {
+        float averageMs = 0.0f;
+        float ratio = 1.0f;
+        bool measured = false;
+    };
+    unordered_map<string, CategoryCost> costs;
+
+    chrono::steady_clock::time_point frameStart = chrono::steady_clock::now();
+    float averageFrameMs = 0.0f;
+    float budgetMs = 0.0f;
+    float spentMs = 0.0f;
+    Stats stats;
+
+    static float elapsedMs(chrono::steady_clock::time_point since)
+    {
+        return chrono::duration<float, milli>(chrono::steady_clock::now() - since).count();
+    }
+
+    float estimateOf(const WorkItem& item) const
+    {
+        auto found = costs.find(item.category);
+        return found == costs.end() ? item.estimatedMs : item.estimatedMs * found->second.ratio;
+    }
+
+    // background jobs that finished join the queue
+    void promoteFinished()
+    {
+        for (auto it = waiting.begin(); it != waiting.end();)
+        {
+            if (it->ready())
+            {
+                it->sequence = sequenceCounter++;
+                queue.push_back(move(*it));
+                push_heap(queue.begin(), queue.end(), RunsLater());
+                it = waiting.erase(it);
+            }
+            else
+                ++it;
+        }
+    }
+
+    void runTop()
+    {
+        // moved out of the back once the heap has put it there, the job's captures are freed as soon as it has run
+        pop_heap(queue.begin(), queue.end(), RunsLater());
+        WorkItem item = move(queue.back());
+        queue.pop_back();
+        auto start = chrono::steady_clock::now();
+        item.work();
+        float ms = elapsedMs(start);
+        stats.itemsRun++;
+
+        CategoryCost& cost = costs[item.category];
+        float ratio = item.estimatedMs > 0.0f ? ms / item.estimatedMs : 1.0f;
+        cost.averageMs = cost.measured ? cost.averageMs * 0.8f + ms * 0.2f : ms;
+        cost.ratio = cost.measured ? cost.ratio * 0.8f + ratio * 0.2f : ratio;
+        cost.measured = true;
+    }
+};
+#endif
@@ -0,0 +1,408 @@
+#ifndef GEOMETRY_ARENA_H
+#define GEOMETRY_ARENA_H
+
+#include <glad/glad.h>
+
+#include "gl_staging.h"
+#include "vertex_format.h"
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+// free ranges of a buffer, in elements. first fit, a freed range is merged with free neighbours
+class RangeAllocator
+{
+public:
+    size_t Capacity() const
+    {
+        return capacity;
+    }
+
+    bool Allocate(size_t count, size_t& offset)
+    {
+        for (auto it = free.begin(); it != free.end(); ++it)
+        {
+            if (it->second < count)
+                continue;
+            offset = it->first;
+            size_t remaining = it->second - count;
+            free.erase(it);
+            if (remaining)
+                free[offset + count] = remaining;
+            return true;
+        }
+        return false;
+    }
+
+    void Free(size_t offset, size_t count)
+    {
+        if (count == 0)
+            return;
+        auto next = free.lower_bound(offset);
+        if (next != free.end() && offset + count == next->first)
+        {
+            count += next->second;
+            next = free.erase(next);
+        }
+        if (next != free.begin())
+        {
+            auto previous = prev(next);
+            if (previous->first + previous->second == offset)
+            {
+                previous->second += count;
+                return;
+            }
+        }
+        free[offset] = count;
+    }
+
+    // adds the space past the old capacity
+    void Grow(size_t newCapacity)
+    {
+        size_t oldCapacity = capacity;
+        capacity = newCapacity;
+        Free(oldCapacity, newCapacity - oldCapacity);
+    }
+
+    // everything below used is taken, the rest is one free range
+    void Reset(size_t used)
+    {
+        free.clear();
+        if (used < capacity)
+            free[used] = capacity - used;
+    }
+
+    size_t FreeCount() const
+    {
+        size_t total = 0;
+        for (const auto& range : free)
+            total += range.second;
+        return total;
+    }
+
+    size_t LargestFree() const
+    {
+        size_t largest = 0;
+        for (const auto& range : free)
+            largest = max(largest, range.second);
+        return largest;
+    }
+
+    size_t Fragments() const
+    {
+        return free.size();
+    }
+
+private:
+    size_t capacity = 0;
+    map<size_t, size_t> free;
+};
+
+// process wide vertex and index storage. every vertex layout gets one large VBO and EBO with one VAO, meshes
+// are ranges in them drawn with glDrawElementsBaseVertex, so consecutive draws of any mesh with the same
+// layout never switch VAO. handles stay valid when the buffers grow or are compacted. context thread only
+class GeometryArena
+{
+public:
+    // starting size of a layout's buffers, they double when full
+    size_t initialVertexBytes = 4 << 20;
+    size_t initialIndexBytes = 2 << 20;
+    // compaction kicks in when this share of a buffer is free but split up so the largest hole is under half of it
+    float defragmentFreeShare = 0.25f;
+
+    static GeometryArena& Get()
+    {
+        static GeometryArena arena;
+        return arena;
+    }
+
+    // copies vertices and indices (in the format's index type) into the buffers for the format's layout. either
+    // may be empty, a range with only indices can be drawn with the vertices of others through DrawShared.
+    // staged uploads copy through a mapping of the range. returns the handle, 0 for nothing to store
+    unsigned int Allocate(const VertexFormat& format, const void* vertexData, size_t vertexCount, const void* indexData, size_t indexCount, bool staged = false)
+    {
+        if (vertexCount == 0 && indexCount == 0)
+            return 0;
+        unsigned int poolIndex = poolFor(format);
+        Pool& pool = pools[poolIndex];
+
+        Allocation allocation;
+        allocation.pool = poolIndex;
+        allocation.vertexCount = vertexCount;
+        allocation.indexCount = indexCount;
+        if (vertexCount && !pool.vertexSpace.Allocate(vertexCount, allocation.vertexOffset))
+        {
+            growVertices(pool, vertexCount);
+            pool.vertexSpace.Allocate(vertexCount, allocation.vertexOffset);
+        }
+        if (indexCount && !pool.indexSpace.Allocate(indexCount, allocation.indexOffset))
+        {
+            growIndices(pool, indexCount);
+            pool.indexSpace.Allocate(indexCount, allocation.indexOffset);
+        }
+
+        size_t stride = pool.layout.stride, indexSize = pool.layout.IndexSize();
+        glBindBuffer(GL_COPY_WRITE_BUFFER, pool.vbo);
+        upload(allocation.vertexOffset * stride, vertexCount * stride, vertexData, staged);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, pool.ebo);
+        upload(allocation.indexOffset * indexSize, indexCount * indexSize, indexData, staged);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        unsigned int handle = nextHandle++;
+        allocations[handle] = allocation;
+        pool.allocations++;
+        return handle;
+    }
+
+    // returns the ranges to the free lists. the data is only overwritten by later allocations
+    void Free(unsigned int handle)
+    {
+        auto found = allocations.find(handle);
+        if (found == allocations.end())
+            return;
+        const Allocation& allocation = found->second;
+        Pool& pool = pools[allocation.pool];
+        pool.vertexSpace.Free(allocation.vertexOffset, allocation.vertexCount);
+        pool.indexSpace.Free(allocation.indexOffset, allocation.indexCount);
+        pool.allocations--;
+        allocations.erase(found);
+    }
+
+    // draws the range's indices over its own vertices. leaves the layout's VAO bound
+    void Draw(unsigned int handle)
+    {
+        DrawShared(handle, handle);
+    }
+
+    // draws the indices of one range over the vertices of another of the same layout, for meshes that share
+    // their index pattern (terrain chunks)
+    void DrawShared(unsigned int vertexHandle, unsigned int indexHandle)
+    {
+        auto vertices = allocations.find(vertexHandle);
+        auto indices = allocations.find(indexHandle);
+        if (vertices == allocations.end() || indices == allocations.end() || indices->second.indexCount == 0)
+            return;
+        const Pool& pool = pools[vertices->second.pool];
+        glBindVertexArray(pool.vao);
+        glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei)indices->second.indexCount, pool.layout.indexType,
+            (void*)(indices->second.indexOffset * pool.layout.IndexSize()), (GLint)vertices->second.vertexOffset);
+    }
+
+    // draws part of the range's indices over its own vertices, one level of detail of a mesh
+    void DrawRange(unsigned int handle, size_t firstIndex, size_t indexCount)
+    {
+        auto found = allocations.find(handle);
+        if (found == allocations.end() || indexCount == 0 || firstIndex + indexCount > found->second.indexCount)
+            return;
+        const Pool& pool = pools[found->second.pool];
+        glBindVertexArray(pool.vao);
+        glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei)indexCount, pool.layout.indexType,
+            (void*)((found->second.indexOffset + firstIndex) * pool.layout.IndexSize()), (GLint)found->second.vertexOffset);
+    }
+
+    // draws several parts of the range's indices over its own vertices with one call, what is left of a mesh once
+    // its hidden clusters are culled
+    void DrawRanges(unsigned int handle, const uint32_t* firstIndices, const GLsizei* indexCounts, size_t rangeCount)
+    {
+        auto found = allocations.find(handle);
+        if (found == allocations.end() || rangeCount == 0)
+            return;
+        const Pool& pool = pools[found->second.pool];
+        multiOffsets.resize(rangeCount);
+        multiBaseVertices.assign(rangeCount, (GLint)found->second.vertexOffset);
+        for (size_t i = 0; i < rangeCount; i++)
+        {
+            if (firstIndices[i] + (size_t)indexCounts[i] > found->second.indexCount)
+                return;
+            multiOffsets[i] = (const void*)((found->second.indexOffset + firstIndices[i]) * pool.layout.IndexSize());
+        }
+        glBindVertexArray(pool.vao);
+        glMultiDrawElementsBaseVertex(GL_TRIANGLES, indexCounts, pool.layout.indexType, multiOffsets.data(), (GLsizei)rangeCount, multiBaseVertices.data());
+    }
+
+    // compacts the buffers of layouts whose free space has broken up, moving the live ranges to the front
+    // with GPU side copies. cheap to call every frame when there is nothing to do
+    void Defragment()
+    {
+        for (Pool& pool : pools)
+        {
+            if (fragmented(pool.vertexSpace) || fragmented(pool.indexSpace))
+                compact(pool);
+        }
+    }
+
+    void PrintReport() const
+    {
+        cout << "Geometry arena: " << pools.size() << " vertex layouts, " << allocations.size() << " ranges, " << compactions << " compactions" << endl;
+        for (const Pool& pool : pools)
+        {
+            size_t stride = pool.layout.stride, indexSize = pool.layout.IndexSize();
+            cout << "  stride " << stride << ": " << pool.allocations << " ranges, vertices "
+                 << (pool.vertexSpace.Capacity() - pool.vertexSpace.FreeCount()) * stride / 1024 << "/" << pool.vertexSpace.Capacity() * stride / 1024 << " KB in "
+                 << pool.vertexSpace.Fragments() << " free ranges, indices "
+                 << (pool.indexSpace.Capacity() - pool.indexSpace.FreeCount()) * indexSize / 1024 << "/" << pool.indexSpace.Capacity() * indexSize / 1024 << " KB in "
+                 << pool.indexSpace.Fragments() << " free ranges" << endl;
+        }
+    }
+
+private:
+    struct Pool {
+        VertexFormat layout;
+        unsigned int vao = 0, vbo = 0, ebo = 0;
+        RangeAllocator vertexSpace, indexSpace;
+        size_t allocations = 0;
+    };
+
+    // offsets and counts in vertices and indices
+    struct Allocation {
+        unsigned int pool = 0;
+        size_t vertexOffset = 0, vertexCount = 0;
+        size_t indexOffset = 0, indexCount = 0;
+    };
+
+    vector<Pool> pools;
+    unordered_map<unsigned int, Allocation> allocations;
+    unsigned int nextHandle = 1;
+    size_t compactions = 0;
+    // scratch arrays of DrawRanges
+    vector<const void*> multiOffsets;
+    vector<GLint> multiBaseVertices;
+
+    unsigned int poolFor(const VertexFormat& format)
+    {
+        for (size_t i = 0; i < pools.size(); i++)
+            if (SameVertexLayout(pools[i].layout, format))
+                return (unsigned int)i;
+
+        Pool pool;
+        pool.layout = format;
+        pool.layout.positionScale = glm::vec3(1.0f);
+        pool.layout.positionOffset = glm::vec3(0.0f);
+        glGenVertexArrays(1, &pool.vao);
+        pool.vbo = createBuffer(0, 0, initialVertexBytes / format.stride * format.stride);
+        pool.ebo = createBuffer(0, 0, initialIndexBytes);
+        pool.vertexSpace.Grow(initialVertexBytes / format.stride);
+        pool.indexSpace.Grow(initialIndexBytes / format.IndexSize());
+        bindBuffers(pool);
+        pools.push_back(pool);
+        return (unsigned int)(pools.size() - 1);
+    }
+
+    // a new buffer of the given size holding the first copyBytes of the old one, which is deleted
+    static unsigned int createBuffer(unsigned int old, size_t copyBytes, size_t bytes)
+    {
+        unsigned int buffer;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, bytes, NULL, GL_STATIC_DRAW);
+        if (old)
+        {
+            glBindBuffer(GL_COPY_READ_BUFFER, old);
+            if (copyBytes)
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, copyBytes);
+            glBindBuffer(GL_COPY_READ_BUFFER, 0);
+            glDeleteBuffers(1, &old);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        return buffer;
+    }
+
+    // the VAO refers to the buffers themselves, so it is pointed at them again whenever they are replaced
+    static void bindBuffers(const Pool& pool)
+    {
+        glBindVertexArray(pool.vao);
+        glBindBuffer(GL_ARRAY_BUFFER, pool.vbo);
+        SetVertexAttributes(pool.layout);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pool.ebo);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    static void upload(size_t offset, size_t bytes, const void* data, bool staged)
+    {
+        if (bytes == 0 || !data)
+            return;
+        if (staged)
+            StagedBufferSubData(GL_COPY_WRITE_BUFFER, offset, bytes, data);
+        else
+            glBufferSubData(GL_COPY_WRITE_BUFFER, offset, bytes, data);
+    }
+
+    static void growVertices(Pool& pool, size_t needed)
+    {
+        size_t stride = pool.layout.stride;
+        size_t capacity = max(pool.vertexSpace.Capacity() * 2, pool.vertexSpace.Capacity() + needed);
+        pool.vbo = createBuffer(pool.vbo, pool.vertexSpace.Capacity() * stride, capacity * stride);
+        pool.vertexSpace.Grow(capacity);
+        bindBuffers(pool);
+    }
+
+    static void growIndices(Pool& pool, size_t needed)
+    {
+        size_t indexSize = pool.layout.IndexSize();
+        size_t capacity = max(pool.indexSpace.Capacity() * 2, pool.indexSpace.Capacity() + needed);
+        pool.ebo = createBuffer(pool.ebo, pool.indexSpace.Capacity() * indexSize, capacity * indexSize);
+        pool.indexSpace.Grow(capacity);
+        bindBuffers(pool);
+    }
+
+    bool fragmented(const RangeAllocator& space) const
+    {
+        size_t freeCount = space.FreeCount();
+        return space.Fragments() > 1 && freeCount >= space.Capacity() * defragmentFreeShare && space.LargestFree() * 2 < freeCount;
+    }
+
+    // copies every live range of the pool into fresh buffers of the same size, packed from the start
+    void compact(Pool& pool)
+    {
+        unsigned int poolIndex = (unsigned int)(&pool - &pools[0]);
+        vector<Allocation*> live;
+        for (auto& entry : allocations)
+            if (entry.second.pool == poolIndex)
+                live.push_back(&entry.second);
+
+        size_t stride = pool.layout.stride, indexSize = pool.layout.IndexSize();
+        unsigned int vbo = createBuffer(0, 0, pool.vertexSpace.Capacity() * stride);
+        unsigned int ebo = createBuffer(0, 0, pool.indexSpace.Capacity() * indexSize);
+
+        // in offset order, so ranges keep their relative placement
+        sort(live.begin(), live.end(), [](const Allocation* a, const Allocation* b) { return a->vertexOffset < b->vertexOffset; });
+        size_t vertexEnd = 0;
+        glBindBuffer(GL_COPY_READ_BUFFER, pool.vbo);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, vbo);
+        for (Allocation* allocation : live)
+        {
+            if (allocation->vertexCount)
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, allocation->vertexOffset * stride, vertexEnd * stride, allocation->vertexCount * stride);
+            allocation->vertexOffset = vertexEnd;
+            vertexEnd += allocation->vertexCount;
+        }
+        sort(live.begin(), live.end(), [](const Allocation* a, const Allocation* b) { return a->indexOffset < b->indexOffset; });
+        size_t indexEnd = 0;
+        glBindBuffer(GL_COPY_READ_BUFFER, pool.ebo);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, ebo);
+        for (Allocation* allocation : live)
+        {
+            if (allocation->indexCount)
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, allocation->indexOffset * indexSize, indexEnd * indexSize, allocation->indexCount * indexSize);
+            allocation->indexOffset = indexEnd;
+            indexEnd += allocation->indexCount;
+        }
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        glDeleteBuffers(1, &pool.vbo);
+        glDeleteBuffers(1, &pool.ebo);
+        pool.vbo = vbo;
+        pool.ebo = ebo;
+        pool.vertexSpace.Reset(vertexEnd);
+        pool.indexSpace.Reset(indexEnd);
+        bindBuffers(pool);
+        compactions++;
+    }
+};
+#endif
@@ -0,0 +1,58 @@
+#ifndef GL_STAGING_H
+#define GL_STAGING_H
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <cstring>
+
+// uploads through mapped buffers. GL 3.3 has no persistent mapping, so each upload maps a freshly
+// orphaned store with GL_MAP_INVALIDATE_BUFFER_BIT: the copy goes straight into driver owned memory and
+// never waits for the GPU to finish with the previous contents
+
+// fills the buffer bound to target with bytes of data through a mapping
+inline void StagedBufferData(GLenum target, size_t bytes, const void* data, GLenum usage)
+{
+    glBufferData(target, bytes, NULL, usage);
+    if (bytes == 0)
+        return;
+    void* destination = glMapBufferRange(target, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (destination)
+    {
+        memcpy(destination, data, bytes);
+        // false means the store was lost while mapped (mode switch), fall back to a plain upload
+        if (glUnmapBuffer(target) == GL_TRUE)
+            return;
+    }
+    glBufferData(target, bytes, data, usage);
+}
+
+// fills part of the buffer bound to target through a mapping of just that range. the range is invalidated
+// rather than the whole store, the rest of the buffer may still be in use
+inline void StagedBufferSubData(GLenum target, size_t offset, size_t bytes, const void* data)
+{
+    if (bytes == 0)
+        return;
+    void* destination = glMapBufferRange(target, offset, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+    if (destination)
+    {
+        memcpy(destination, data, bytes);
+        if (glUnmapBuffer(target) == GL_TRUE)
+            return;
+    }
+    glBufferSubData(target, offset, bytes, data);
+}
+
+// copies pixels into a pixel unpack buffer and leaves it bound, so the following glTexImage2D/glTexSubImage2D
+// call with a NULL (offset 0) pointer transfers from it asynchronously. unbind with UnbindPixelStaging
+inline void StagePixels(unsigned int pixelBuffer, size_t bytes, const void* pixels)
+{
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixelBuffer);
+    StagedBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, pixels, GL_STREAM_DRAW);
+}
+
+inline void UnbindPixelStaging()
+{
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+#endif
@@ -0,0 +1,124 @@
+#ifndef HEADLESS_CONTEXT_H
+#define HEADLESS_CONTEXT_H
+
+#include <glad/glad.h>
+
+#ifdef _WIN32
+#include <glfw3.h>
+#else
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include <cstddef>
+
+// a GL 3.3 core context without a window, for baking assets in a pipeline with no display or GPU: EGL's
+// surfaceless platform (Mesa's llvmpipe when there is no GPU), on Windows GLFW's null platform with OSMesa and
+// failing that a hidden window. there is no default framebuffer, everything renders into framebuffer objects
+class HeadlessContext
+{
+public:
+    HeadlessContext() {}
+    HeadlessContext(const HeadlessContext&) = delete;
+    HeadlessContext& operator=(const HeadlessContext&) = delete;
+
+    ~HeadlessContext()
+    {
+        Destroy();
+    }
+
+    // makes the context current on this thread and loads the GL functions
+    bool Create()
+    {
+#ifdef _WIN32
+        glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+        if (glfwInit())
+        {
+            hints();
+            glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+            window = glfwCreateWindow(1, 1, "Headless", NULL, NULL);
+            if (!window)
+                glfwTerminate();
+        }
+        if (!window)
+        {
+            glfwInitHint(GLFW_PLATFORM, GLFW_ANY_PLATFORM);
+            if (!glfwInit())
+                return false;
+            hints();
+            glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+            window = glfwCreateWindow(1, 1, "Headless", NULL, NULL);
+            if (!window)
+            {
+                glfwTerminate();
+                return false;
+            }
+        }
+        glfwMakeContextCurrent(window);
+        return gladLoadGLLoader((GLADloadproc)glfwGetProcAddress) != 0;
+#else
+        PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (getPlatformDisplay)
+            display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+        if (display == EGL_NO_DISPLAY)
+            display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        EGLint major, minor;
+        if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor) || !eglBindAPI(EGL_OPENGL_API))
+            return false;
+        const EGLint configAttributes[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+        EGLConfig config = NULL;
+        EGLint configs = 0;
+        eglChooseConfig(display, configAttributes, &config, 1, &configs);
+        const EGLint contextAttributes[] = {
+            EGL_CONTEXT_MAJOR_VERSION, 3, EGL_CONTEXT_MINOR_VERSION, 3,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT, EGL_NONE
+        };
+        // without a surface no config is needed (EGL_KHR_no_config_context) when the display offers none
+        context = eglCreateContext(display, configs ? config : (EGLConfig)0, EGL_NO_CONTEXT, contextAttributes);
+        if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+            return false;
+        return gladLoadGLLoader((GLADloadproc)eglGetProcAddress) != 0;
+#endif
+    }
+
+    void Destroy()
+    {
+#ifdef _WIN32
+        if (window)
+        {
+            glfwDestroyWindow(window);
+            glfwTerminate();
+            window = NULL;
+        }
+#else
+        if (context != EGL_NO_CONTEXT)
+        {
+            eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            eglDestroyContext(display, context);
+            context = EGL_NO_CONTEXT;
+        }
+        if (display != EGL_NO_DISPLAY)
+        {
+            eglTerminate(display);
+            display = EGL_NO_DISPLAY;
+        }
+#endif
+    }
+
+private:
+#ifdef _WIN32
+    GLFWwindow* window = NULL;
+
+    static void hints()
+    {
+        glfwDefaultWindowHints();
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    }
+#else
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLContext context = EGL_NO_CONTEXT;
+#endif
+};
+#endif
@@ -0,0 +1,348 @@
+#ifndef IMPOSTOR_H
+#define IMPOSTOR_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "asset_archive.h"
+#include "cache_file.h"
+#include "shader_m.h"
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+using namespace std;
+
+// an impostor is a model rendered from impostorFrames x impostorFrames directions spread over the whole sphere by an
+// octahedral mapping, each frame impostorFrameSize pixels square, into one atlas of albedo (alpha is coverage) and
+// one of depth. far away the model is drawn as a camera facing quad that blends the frames nearest the view
+const unsigned int impostorFrames = 8;
+const unsigned int impostorFrameSize = 128;
+
+// the impostor cache file: header, then the albedo atlas (RGBA8, rows bottom up) and the depth atlas (R8, 0 the
+// front of the bounding sphere towards the frame's camera, 1 its back). baked offline, packed with the models
+const uint32_t impostorCacheMagic = 0x504D4949; // "IIMP"
+const uint32_t impostorCacheVersion = 1;
+
+struct ImpostorCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    // hash of the model file the atlas was rendered from
+    uint64_t sourceHash;
+    uint32_t frames;
+    uint32_t frameSize;
+    // bounding sphere the frames were rendered around, in model space
+    float center[3];
+    float radius;
+};
+
+// the pixels of an impostor, baked or read back from its cache
+struct ImpostorBake {
+    unsigned int frames = 0;
+    unsigned int frameSize = 0;
+    glm::vec3 center = glm::vec3(0.0f);
+    float radius = 0.0f;
+    vector<unsigned char> albedo;
+    vector<unsigned char> depth;
+
+    unsigned int AtlasSize() const
+    {
+        return frames * frameSize;
+    }
+};
+
+inline string ImpostorCachePath(const string& sourcePath)
+{
+    return sourcePath + ".impostor";
+}
+
+// from the asset archive or the loose file, false without one made from these exact source bytes
+inline bool ReadImpostorCache(const string& cachePath, uint64_t sourceHash, ImpostorBake& bake)
+{
+    AssetData file = OpenAsset(cachePath);
+    if (!file || file.Size() < sizeof(ImpostorCacheHeader))
+        return false;
+    ImpostorCacheHeader header;
+    memcpy(&header, file.Data(), sizeof(header));
+    size_t texels = (size_t)header.frames * header.frameSize * header.frames * header.frameSize;
+    if (header.magic != impostorCacheMagic || header.version != impostorCacheVersion || header.sourceHash != sourceHash
+        || header.radius <= 0.0f || file.Size() != sizeof(header) + texels * 5)
+        return false;
+    bake.frames = header.frames;
+    bake.frameSize = header.frameSize;
+    bake.center = glm::vec3(header.center[0], header.center[1], header.center[2]);
+    bake.radius = header.radius;
+    const unsigned char* pixels = file.Data() + sizeof(header);
+    bake.albedo.assign(pixels, pixels + texels * 4);
+    bake.depth.assign(pixels + texels * 4, pixels + texels * 5);
+    return true;
+}
+
+inline bool WriteImpostorCache(const string& cachePath, uint64_t sourceHash, const ImpostorBake& bake)
+{
+    ImpostorCacheHeader header;
+    header.magic = impostorCacheMagic;
+    header.version = impostorCacheVersion;
+    header.sourceHash = sourceHash;
+    header.frames = bake.frames;
+    header.frameSize = bake.frameSize;
+    header.center[0] = bake.center.x;
+    header.center[1] = bake.center.y;
+    header.center[2] = bake.center.z;
+    header.radius = bake.radius;
+
+    // written under a temporary name of its own so a half written cache is never picked up
+    string temporaryPath = TemporaryCachePath(cachePath);
+    bool complete;
+    {
+        ofstream file(temporaryPath, ios::binary | ios::trunc);
+        if (!file)
+            return false;
+        file.write((const char*)&header, sizeof(header));
+        file.write((const char*)bake.albedo.data(), bake.albedo.size());
+        file.write((const char*)bake.depth.data(), bake.depth.size());
+        complete = (bool)file;
+    }
+    if (!complete)
+    {
+        remove(temporaryPath.c_str());
+        return false;
+    }
+    return CommitCacheFile(temporaryPath, cachePath);
+}
+
+// the octahedral mapping between directions and the [0, 1] square of frames: the upper hemisphere (y up) is the
+// inner diamond, the lower one folded over the corners. impostor.vert has the same functions
+namespace octahedral
+{
+    inline glm::vec2 encode(glm::vec3 direction)
+    {
+        direction /= fabs(direction.x) + fabs(direction.y) + fabs(direction.z);
+        glm::vec2 p(direction.x, direction.z);
+        if (direction.y < 0.0f)
+            p = glm::vec2((1.0f - fabs(p.y)) * (p.x >= 0.0f ? 1.0f : -1.0f), (1.0f - fabs(p.x)) * (p.y >= 0.0f ? 1.0f : -1.0f));
+        return p * 0.5f + 0.5f;
+    }
+
+    inline glm::vec3 decode(glm::vec2 uv)
+    {
+        glm::vec2 p = uv * 2.0f - 1.0f;
+        glm::vec3 direction(p.x, 1.0f - fabs(p.x) - fabs(p.y), p.y);
+        if (direction.y < 0.0f)
+        {
+            direction.x = (1.0f - fabs(p.y)) * (p.x >= 0.0f ? 1.0f : -1.0f);
+            direction.z = (1.0f - fabs(p.x)) * (p.y >= 0.0f ? 1.0f : -1.0f);
+        }
+        return glm::normalize(direction);
+    }
+
+    // direction from the model towards the camera of frame (x, y)
+    inline glm::vec3 frameDirection(unsigned int x, unsigned int y, unsigned int frames)
+    {
+        return decode(glm::vec2((x + 0.5f) / frames, (y + 0.5f) / frames));
+    }
+
+    // screen right and up of a camera looking back along direction, as glm::lookAt makes them with y up (z near
+    // the poles)
+    inline void frameBasis(const glm::vec3& direction, glm::vec3& right, glm::vec3& up)
+    {
+        glm::vec3 worldUp = fabs(direction.y) > 0.999f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        right = glm::normalize(glm::cross(worldUp, direction));
+        up = glm::cross(direction, right);
+    }
+}
+
+// an impostor on the GPU, owned by its model. context thread only
+struct ImpostorAtlas {
+    unsigned int albedo = 0;
+    unsigned int depth = 0;
+    unsigned int frames = 0;
+    unsigned int frameSize = 0;
+    glm::vec3 center = glm::vec3(0.0f);
+    float radius = 0.0f;
+
+    ImpostorAtlas() {}
+    ImpostorAtlas(const ImpostorAtlas&) = delete;
+    ImpostorAtlas& operator=(const ImpostorAtlas&) = delete;
+
+    ~ImpostorAtlas()
+    {
+        if (albedo)
+            glDeleteTextures(1, &albedo);
+        if (depth)
+            glDeleteTextures(1, &depth);
+    }
+
+    // the albedo gets mipmaps for the distance, depth is only read where the albedo has coverage
+    void Upload(const ImpostorBake& bake)
+    {
+        frames = bake.frames;
+        frameSize = bake.frameSize;
+        center = bake.center;
+        radius = bake.radius;
+        GLsizei size = (GLsizei)bake.AtlasSize();
+        glGenTextures(1, &albedo);
+        glGenTextures(1, &depth);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glBindTexture(GL_TEXTURE_2D, albedo);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, bake.albedo.data());
+        // down to frames of 4 pixels, coarser levels would blend neighbouring frames into each other
+        int levels = 0;
+        while ((frameSize >> (levels + 1)) >= 4)
+            levels++;
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels);
+        glGenerateMipmap(GL_TEXTURE_2D);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D, depth);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, size, size, 0, GL_RED, GL_UNSIGNED_BYTE, bake.depth.data());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    }
+
+    size_t Bytes() const
+    {
+        size_t texels = (size_t)frames * frameSize * frames * frameSize;
+        // the albedo's mipmaps add a third
+        return texels * 4 * 4 / 3 + texels;
+    }
+};
+
+// per instance data, streamed to the GPU as five vec4 attributes
+struct ImpostorInstance {
+    glm::mat4 transform;
+    // from the model's center towards the camera in model space, unused w
+    glm::vec4 direction;
+};
+
+// draws the impostors of far away model instances, one instanced draw of a quad per atlas. instances are queued
+// during the frame (ModelInstance::Draw) and drawn together at the end of it. context thread only
+class ImpostorRenderer
+{
+public:
+    static ImpostorRenderer& Get()
+    {
+        static ImpostorRenderer renderer;
+        return renderer;
+    }
+
+    void Add(const shared_ptr<ImpostorAtlas>& atlas, const glm::mat4& transform)
+    {
+        Batch* batch = NULL;
+        for (Batch& candidate : batches)
+            if (candidate.atlas == atlas)
+                batch = &candidate;
+        if (!batch)
+        {
+            batches.push_back(Batch());
+            batch = &batches.back();
+            batch->atlas = atlas;
+        }
+        ImpostorInstance instance;
+        instance.transform = transform;
+        batch->instances.push_back(instance);
+    }
+
+    // draws and empties the queue. the caller has the impostor shader bound with view and projection set
+    void Draw(Shader& shader, const glm::vec3& cameraPosition)
+    {
+        if (batches.empty())
+            return;
+        if (!VAO)
+            setup();
+
+        shader.setInt("impostorAlbedo", 0);
+        shader.setInt("impostorDepth", 1);
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        for (Batch& batch : batches)
+        {
+            const ImpostorAtlas& atlas = *batch.atlas;
+            for (ImpostorInstance& instance : batch.instances)
+            {
+                glm::vec3 camera = glm::vec3(glm::inverse(instance.transform) * glm::vec4(cameraPosition, 1.0f)) - atlas.center;
+                float length = glm::length(camera);
+                instance.direction = glm::vec4(length > 0.0f ? camera / length : glm::vec3(0.0f, 1.0f, 0.0f), 0.0f);
+            }
+            // orphan last frame's storage instead of waiting for the GPU to finish with it
+            glBufferData(GL_ARRAY_BUFFER, batch.instances.size() * sizeof(ImpostorInstance), NULL, GL_STREAM_DRAW);
+            glBufferSubData(GL_ARRAY_BUFFER, 0, batch.instances.size() * sizeof(ImpostorInstance), batch.instances.data());
+
+            shader.setVec3("impostorCenter", atlas.center);
+            shader.setFloat("impostorRadius", atlas.radius);
+            shader.setInt("impostorFrames", (int)atlas.frames);
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, atlas.depth);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, atlas.albedo);
+            glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, (GLsizei)batch.instances.size());
+            instancesDrawn += batch.instances.size();
+            drawCalls++;
+        }
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        batches.clear();
+    }
+
+    void PrintReport() const
+    {
+        cout << "Impostors: " << instancesDrawn << " instances drawn as impostors in " << drawCalls << " instanced draws" << endl;
+    }
+
+private:
+    struct Batch {
+        shared_ptr<ImpostorAtlas> atlas;
+        vector<ImpostorInstance> instances;
+    };
+
+    vector<Batch> batches;
+    unsigned int VAO = 0;
+    unsigned int quadVBO = 0;
+    unsigned int instanceVBO = 0;
+    size_t instancesDrawn = 0;
+    size_t drawCalls = 0;
+
+    ImpostorRenderer() {}
+
+    void setup()
+    {
+        // the quad's corners, scaled to the bounding sphere in impostor.vert
+        const float corners[] = { -1.0f, -1.0f, 1.0f, -1.0f, -1.0f, 1.0f, 1.0f, 1.0f };
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &quadVBO);
+        glGenBuffers(1, &instanceVBO);
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+
+        // per instance transform (one column per location) and direction
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        for (int column = 0; column < 4; column++)
+        {
+            glEnableVertexAttribArray(1 + column);
+            glVertexAttribPointer(1 + column, 4, GL_FLOAT, GL_FALSE, sizeof(ImpostorInstance), (void*)(offsetof(ImpostorInstance, transform) + column * sizeof(glm::vec4)));
+            glVertexAttribDivisor(1 + column, 1);
+        }
+        glEnableVertexAttribArray(5);
+        glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, sizeof(ImpostorInstance), (void*)offsetof(ImpostorInstance, direction));
+        glVertexAttribDivisor(5, 1);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+};
+#endif
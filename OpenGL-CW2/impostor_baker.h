@@ -0,0 +1,177 @@
+#ifndef IMPOSTOR_BAKER_H
+#define IMPOSTOR_BAKER_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "asset_archive.h"
+#include "impostor.h"
+#include "model.h"
+#include "resource_cache.h"
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// empty texels take the colour of a covered neighbour this many texels out from the silhouette, so filtering and
+// mipmaps at the edge of the model don't blend in the clear colour
+const int impostorDilation = 4;
+
+namespace impostorbake
+{
+    // spreads the colour of covered texels into the empty ones around them, within each frame. alpha stays as it was
+    inline void dilate(ImpostorBake& bake)
+    {
+        const int size = (int)bake.AtlasSize();
+        const int frameSize = (int)bake.frameSize;
+        vector<unsigned char> filled(size * size), next;
+        for (int i = 0; i < size * size; i++)
+            filled[i] = bake.albedo[i * 4 + 3] != 0;
+        const int offsets[4][2] = { { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 } };
+        for (int pass = 0; pass < impostorDilation; pass++)
+        {
+            next = filled;
+            for (int y = 0; y < size; y++)
+                for (int x = 0; x < size; x++)
+                {
+                    int i = y * size + x;
+                    if (filled[i])
+                        continue;
+                    for (const int* offset : offsets)
+                    {
+                        int nx = x + offset[0], ny = y + offset[1];
+                        // the neighbour has to be in the same frame
+                        if (nx < 0 || ny < 0 || nx >= size || ny >= size || nx / frameSize != x / frameSize || ny / frameSize != y / frameSize)
+                            continue;
+                        int n = ny * size + nx;
+                        if (!filled[n])
+                            continue;
+                        memcpy(&bake.albedo[i * 4], &bake.albedo[n * 4], 3);
+                        next[i] = 1;
+                        break;
+                    }
+                }
+            filled.swap(next);
+        }
+    }
+}
+
+// renders a loaded model, in its imported pose at full detail, from every frame's direction into a new impostor.
+// shader is vertex.vert with impostor_bake.frag. context thread only, leaves framebuffer 0 bound and the viewport
+// on the last frame
+inline bool BakeImpostor(Model& model, Shader& shader, ImpostorBake& bake)
+{
+    if (!model.IsDrawable() || model.bounds.radius <= 0.0f)
+        return false;
+    bake.frames = impostorFrames;
+    bake.frameSize = impostorFrameSize;
+    bake.center = model.bounds.center;
+    // a little past the sphere so the silhouette never touches the edge of a frame
+    bake.radius = model.bounds.radius * 1.02f;
+    const GLsizei size = (GLsizei)bake.AtlasSize();
+    const GLsizei frameSize = (GLsizei)bake.frameSize;
+
+    // albedo and depth as two colour attachments, plus a depth buffer for the depth test
+    unsigned int framebuffer, textures[2], depthBuffer;
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glGenTextures(2, textures);
+    const GLint internalFormats[2] = { GL_RGBA8, GL_R8 };
+    const GLenum formats[2] = { GL_RGBA, GL_RED };
+    for (int i = 0; i < 2; i++)
+    {
+        glBindTexture(GL_TEXTURE_2D, textures[i]);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormats[i], size, size, 0, formats[i], GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, textures[i], 0);
+    }
+    glGenRenderbuffers(1, &depthBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, size, size);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+    const GLenum drawBuffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    glDrawBuffers(2, drawBuffers);
+
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    if (complete)
+    {
+        glEnable(GL_DEPTH_TEST);
+        glEnable(GL_SCISSOR_TEST);
+        shader.use();
+        // orthographic through the bounding sphere, from a camera two radii out: depth 0 at its front, 1 at its back
+        shader.setMat4("projection", glm::ortho(-bake.radius, bake.radius, -bake.radius, bake.radius, bake.radius, 3.0f * bake.radius));
+        const float empty[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        const float back[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+        for (unsigned int y = 0; y < bake.frames; y++)
+            for (unsigned int x = 0; x < bake.frames; x++)
+            {
+                glViewport(x * frameSize, y * frameSize, frameSize, frameSize);
+                glScissor(x * frameSize, y * frameSize, frameSize, frameSize);
+                glClearBufferfv(GL_COLOR, 0, empty);
+                glClearBufferfv(GL_COLOR, 1, back);
+                glClear(GL_DEPTH_BUFFER_BIT);
+                glm::vec3 direction = octahedral::frameDirection(x, y, bake.frames);
+                glm::vec3 right, up;
+                octahedral::frameBasis(direction, right, up);
+                shader.setMat4("view", glm::lookAt(bake.center + direction * 2.0f * bake.radius, bake.center, up));
+                model.Draw(shader, glm::mat4(1.0f));
+            }
+        glDisable(GL_SCISSOR_TEST);
+
+        bake.albedo.resize((size_t)size * size * 4);
+        bake.depth.resize((size_t)size * size);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadBuffer(GL_COLOR_ATTACHMENT0);
+        glReadPixels(0, 0, size, size, GL_RGBA, GL_UNSIGNED_BYTE, bake.albedo.data());
+        glReadBuffer(GL_COLOR_ATTACHMENT1);
+        glReadPixels(0, 0, size, size, GL_RED, GL_UNSIGNED_BYTE, bake.depth.data());
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteTextures(2, textures);
+    glDeleteRenderbuffers(1, &depthBuffer);
+    if (!complete)
+        return false;
+    impostorbake::dilate(bake);
+    return true;
+}
+
+// loads a model file, bakes its impostor and writes it next to the file, where the model's loads pick it up
+inline bool BakeImpostorFile(const string& path, Shader& shader)
+{
+    auto start = chrono::steady_clock::now();
+    uint64_t sourceHash = 0;
+    if (!HashAsset(path, sourceHash))
+    {
+        cout << "Could not read " << path << endl;
+        return false;
+    }
+    Model model(path);
+    ImpostorBake bake;
+    bool baked = BakeImpostor(model, shader, bake);
+    model.Release();
+    ResourceCache::Get().CollectUnused();
+    if (!baked)
+    {
+        cout << "Could not bake the impostor of " << path << endl;
+        return false;
+    }
+    string cachePath = ImpostorCachePath(path);
+    if (!WriteImpostorCache(cachePath, sourceHash, bake))
+    {
+        cout << "Could not write " << cachePath << endl;
+        return false;
+    }
+    cout << "Baked " << cachePath << ": " << bake.frames * bake.frames << " frames of " << bake.frameSize << " pixels, "
+         << (bake.albedo.size() + bake.depth.size()) / 1024 << " KB in " << chrono::duration<double, milli>(chrono::steady_clock::now() - start).count()
+         << " ms" << endl;
+    return true;
+}
+#endif
@@ -0,0 +1,351 @@
+#ifndef LOAD_BENCHMARK_H
+#define LOAD_BENCHMARK_H
+
+#include <glad/glad.h>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifdef APIENTRY
+#undef APIENTRY
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "asset_archive.h"
+#include "asset_packer.h"
+#include "load_profiler.h"
+#include "model.h"
+#include "resource_cache.h"
+#include "shader_m.h"
+#include "texture_loader.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+using namespace std;
+
+// measured runs of each scenario, after one that is thrown away to get the scenario's caches into place
+const int loadBenchmarkRuns = 5;
+
+// what a benchmark run loads, start up's models, textures and shader programs by default
+struct LoadBenchmarkAssets {
+    vector<string> models;
+    vector<string> textures;
+    // vertex and fragment file of each program
+    vector<pair<string, string>> shaders;
+};
+
+namespace loadbench
+{
+    // the derived caches (mesh and texture) there or not, and the operating system's page cache holding the files or not
+    struct Scenario {
+        const char* name;
+        bool assetCaches;
+        bool pageCache;
+    };
+
+    struct Run {
+        double totalMs = 0.0;
+        map<string, LoadProfiler::Stage> stages;
+    };
+
+    // drops what the page cache holds of a file and adds how much of it is still there afterwards. false when that
+    // can't be told (the file is missing, or on Windows)
+    inline bool evictFile(const string& path, size_t& residentBytes, size_t& bytes)
+    {
+#ifdef _WIN32
+        // a handle without buffering makes the file system flush the file and purge its cached pages
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_FLAG_NO_BUFFERING, NULL);
+        if (file != INVALID_HANDLE_VALUE)
+            CloseHandle(file);
+        return false;
+#else
+        int descriptor = open(path.c_str(), O_RDONLY);
+        if (descriptor < 0)
+            return false;
+        // pages the loads wrote (the caches) have to be on the disk before they can be dropped
+        fdatasync(descriptor);
+        posix_fadvise(descriptor, 0, 0, POSIX_FADV_DONTNEED);
+        struct stat info;
+        bool known = fstat(descriptor, &info) == 0;
+        size_t size = known ? (size_t)info.st_size : 0;
+        if (known && size > 0)
+        {
+            // mapping the file doesn't read it, mincore tells which of its pages are in memory
+            void* view = mmap(NULL, size, PROT_READ, MAP_SHARED, descriptor, 0);
+            size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+            vector<unsigned char> resident((size + pageSize - 1) / pageSize);
+            known = view != MAP_FAILED && mincore(view, size, resident.data()) == 0;
+            if (view != MAP_FAILED)
+                munmap(view, size);
+            for (size_t p = 0; known && p < resident.size(); p++)
+                if (resident[p] & 1)
+                    residentBytes += min(pageSize, size - p * pageSize);
+            bytes += size;
+        }
+        close(descriptor);
+        return known;
+#endif
+    }
+
+    // every file the assets are made from, with the caches that are there now
+    inline vector<string> assetFiles(const LoadBenchmarkAssets& assets)
+    {
+        vector<string> files;
+        for (const string& model : assets.models)
+        {
+            size_t slash = model.find_last_of('/');
+            pack::listFiles(slash == string::npos ? model : model.substr(0, slash), files);
+        }
+        for (const string& texture : assets.textures)
+        {
+            pack::listFiles(texture, files);
+            pack::listFiles(TextureCachePath(texture), files);
+        }
+        for (const auto& shader : assets.shaders)
+        {
+            pack::listFiles(shader.first, files);
+            pack::listFiles(shader.second, files);
+        }
+        sort(files.begin(), files.end());
+        files.erase(unique(files.begin(), files.end()), files.end());
+        return files;
+    }
+
+    inline void deleteCaches(const LoadBenchmarkAssets& assets)
+    {
+        for (const string& file : assetFiles(assets))
+            if (pack::endsWith(file, ".meshcache") || pack::endsWith(file, ".texcache"))
+                remove(file.c_str());
+    }
+
+    // loads everything the way start up does, but on this thread and without streaming, until the GL has finished
+    inline double loadAll(const LoadBenchmarkAssets& assets)
+    {
+        auto start = chrono::steady_clock::now();
+        vector<unsigned int> programs, textures;
+        for (const auto& shader : assets.shaders)
+            programs.push_back(Shader(shader.first.c_str(), shader.second.c_str()).ID);
+        for (const string& texture : assets.textures)
+            textures.push_back(UploadTexture(*LoadTextureImage(texture), texture));
+        vector<unique_ptr<Model>> models;
+        for (const string& model : assets.models)
+            models.emplace_back(new Model(model));
+        {
+            // uploads and compiles the driver put off until now
+            ProfileScope scope("gl finish");
+            glFinish();
+        }
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+        for (unique_ptr<Model>& model : models)
+            model->Release();
+        ResourceCache::Get().CollectUnused();
+        glDeleteTextures((GLsizei)textures.size(), textures.data());
+        for (unsigned int program : programs)
+            glDeleteProgram(program);
+        return ms;
+    }
+
+    inline string jsonString(const string& text)
+    {
+        ostringstream out;
+        out << '"';
+        for (char c : text)
+        {
+            if (c == '"' || c == '\\')
+                out << '\\' << c;
+            else if ((unsigned char)c < 0x20)
+                out << "\\u" << hex << setw(4) << setfill('0') << (int)c << dec << setfill(' ');
+            else
+                out << c;
+        }
+        out << '"';
+        return out.str();
+    }
+
+    inline double median(vector<double> values)
+    {
+        sort(values.begin(), values.end());
+        size_t n = values.size();
+        return n % 2 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2.0;
+    }
+
+    // min, median, mean and max of a value over the runs
+    inline void writeSummary(ostream& out, const vector<double>& values)
+    {
+        out << "{ \"min\": " << *min_element(values.begin(), values.end()) << ", \"median\": " << median(values) << ", \"mean\": "
+            << accumulate(values.begin(), values.end(), 0.0) / values.size() << ", \"max\": " << *max_element(values.begin(), values.end()) << " }";
+    }
+
+    inline void writeStringList(ostream& out, const vector<string>& items)
+    {
+        out << "[";
+        for (size_t i = 0; i < items.size(); i++)
+            out << (i ? ", " : "") << jsonString(items[i]);
+        out << "]";
+    }
+}
+
+// loads the assets over and over with the derived caches missing or there and the files out of the page cache or in it,
+// timing every stage of the loads, and writes a JSON report to diff between builds. stage times are added up over
+// the threads that ran them, so with the thread pool busy they can come to more than the run's wall clock total.
+// the driver's own shader cache stays warm after the first run, for cold compiles turn it off (with Mesa
+// MESA_SHADER_CACHE_DISABLE=true). needs a current GL context and no asset archive mounted, so the loose files are
+// what gets evicted
+inline bool BenchmarkAssetLoading(LoadBenchmarkAssets assets, int runs, const string& reportPath)
+{
+    // a default asset list may name files this checkout doesn't have
+    vector<string> missing;
+    auto available = [&](const string& path)
+    {
+        if (OpenAsset(path))
+            return true;
+        missing.push_back(path);
+        return false;
+    };
+    assets.models.erase(remove_if(assets.models.begin(), assets.models.end(), [&](const string& path) { return !available(path); }), assets.models.end());
+    assets.textures.erase(remove_if(assets.textures.begin(), assets.textures.end(), [&](const string& path) { return !available(path); }), assets.textures.end());
+    assets.shaders.erase(remove_if(assets.shaders.begin(), assets.shaders.end(), [&](const pair<string, string>& shader)
+    {
+        bool vertex = available(shader.first);
+        return !(available(shader.second) && vertex);
+    }), assets.shaders.end());
+    for (const string& path : missing)
+        cout << "Leaving out " << path << ", it could not be opened" << endl;
+    runs = max(runs, 1);
+
+    const loadbench::Scenario scenarios[] = {
+        { "import, cold page cache", false, false },
+        { "import, warm page cache", false, true },
+        { "asset caches, cold page cache", true, false },
+        { "asset caches, warm page cache", true, true },
+    };
+    LoadProfiler::Get().Enable(true);
+    ostringstream report;
+    report << fixed << setprecision(3);
+    report << "{" << endl << "  \"benchmark\": \"asset loading\"," << endl << "  \"runs\": " << runs << "," << endl;
+    const char* renderer = (const char*)glGetString(GL_RENDERER);
+    report << "  \"renderer\": " << loadbench::jsonString(renderer ? renderer : "") << "," << endl;
+    report << "  \"workerThreads\": " << ThreadPool::Get().Size() << "," << endl;
+    report << "  \"models\": ";
+    loadbench::writeStringList(report, assets.models);
+    report << "," << endl << "  \"textures\": ";
+    loadbench::writeStringList(report, assets.textures);
+    report << "," << endl << "  \"shaders\": [";
+    for (size_t s = 0; s < assets.shaders.size(); s++)
+        report << (s ? ", " : "") << "[" << loadbench::jsonString(assets.shaders[s].first) << ", " << loadbench::jsonString(assets.shaders[s].second) << "]";
+    report << "]," << endl << "  \"missing\": ";
+    loadbench::writeStringList(report, missing);
+    report << "," << endl << "  \"scenarios\": [" << endl;
+
+    cout << "Asset loading, median of " << runs << " runs:" << endl;
+    for (size_t s = 0; s < sizeof(scenarios) / sizeof(scenarios[0]); s++)
+    {
+        const loadbench::Scenario& scenario = scenarios[s];
+        vector<loadbench::Run> results;
+        size_t residentBytes = 0, evictedBytes = 0;
+        bool residencyKnown = true;
+        for (int run = -1; run < runs; run++)
+        {
+            if (!scenario.assetCaches)
+                loadbench::deleteCaches(assets);
+            if (!scenario.pageCache)
+                for (const string& file : loadbench::assetFiles(assets))
+                    residencyKnown = loadbench::evictFile(file, residentBytes, evictedBytes) && residencyKnown;
+            LoadProfiler::Get().Take();
+            double ms = loadbench::loadAll(assets);
+            if (run < 0)
+            {
+                // the first run only puts the caches in place (or warms the process), its eviction isn't counted
+                residentBytes = evictedBytes = 0;
+                continue;
+            }
+            loadbench::Run result;
+            result.totalMs = ms;
+            result.stages = LoadProfiler::Get().Take();
+            results.push_back(move(result));
+        }
+
+        // every stage any run had, a run that skipped it counts as 0
+        map<string, vector<double>> stageMs;
+        map<string, size_t> stageCalls;
+        vector<double> totals;
+        for (const loadbench::Run& result : results)
+        {
+            totals.push_back(result.totalMs);
+            for (const auto& stage : result.stages)
+            {
+                stageMs[stage.first];
+                stageCalls[stage.first] = max(stageCalls[stage.first], stage.second.calls);
+            }
+        }
+        for (auto& stage : stageMs)
+            for (const loadbench::Run& result : results)
+            {
+                auto found = result.stages.find(stage.first);
+                stage.second.push_back(found != result.stages.end() ? found->second.ms : 0.0);
+            }
+
+        report << "    {" << endl << "      \"name\": " << loadbench::jsonString(scenario.name) << "," << endl
+               << "      \"assetCaches\": " << (scenario.assetCaches ? "true" : "false") << "," << endl
+               << "      \"pageCache\": " << (scenario.pageCache ? "\"warm\"" : "\"cold\"") << "," << endl;
+        // how well the eviction worked, file systems like tmpfs can't drop their pages
+        if (!scenario.pageCache && residencyKnown)
+            report << "      \"residentAfterEviction\": " << (evictedBytes ? (double)residentBytes / evictedBytes : 0.0) << "," << endl;
+        else if (!scenario.pageCache)
+            report << "      \"residentAfterEviction\": null," << endl;
+        report << "      \"totalMs\": ";
+        loadbench::writeSummary(report, totals);
+        report << "," << endl << "      \"stages\": {" << endl;
+        size_t written = 0;
+        for (const auto& stage : stageMs)
+        {
+            report << "        " << loadbench::jsonString(stage.first) << ": { \"calls\": " << stageCalls[stage.first] << ", \"ms\": ";
+            loadbench::writeSummary(report, stage.second);
+            report << " }" << (++written < stageMs.size() ? "," : "") << endl;
+        }
+        report << "      }" << endl << "    }" << (s + 1 < sizeof(scenarios) / sizeof(scenarios[0]) ? "," : "") << endl;
+
+        cout << "  " << scenario.name << ": " << loadbench::median(totals) << " ms";
+        if (!scenario.pageCache && residencyKnown && evictedBytes)
+            cout << " (" << 100.0 * residentBytes / evictedBytes << "% of the files still resident after eviction)";
+        cout << endl;
+        for (const auto& stage : stageMs)
+            cout << "    " << stage.first << ": " << loadbench::median(stage.second) << " ms" << endl;
+    }
+    report << "  ]" << endl << "}" << endl;
+    LoadProfiler::Get().Enable(false);
+
+    ofstream file(reportPath, ios::binary | ios::trunc);
+    file << report.str();
+    if (!file)
+    {
+        cout << "Could not write " << reportPath << endl;
+        return false;
+    }
+    cout << "Wrote " << reportPath << endl;
+    return true;
+}
+#endif
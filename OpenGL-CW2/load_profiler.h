@@ -0,0 +1,91 @@
+#ifndef LOAD_PROFILER_H
+#define LOAD_PROFILER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <string>
+using namespace std;
+
+// time spent in each stage of asset loading (import, decode, upload, compile ...), added up over every thread that
+// ran it. off unless something measuring the loads turns it on, a stage then costs a flag check
+class LoadProfiler
+{
+public:
+    struct Stage {
+        double ms = 0.0;
+        size_t calls = 0;
+    };
+
+    static LoadProfiler& Get()
+    {
+        static LoadProfiler profiler;
+        return profiler;
+    }
+
+    void Enable(bool on)
+    {
+        enabled.store(on, memory_order_relaxed);
+    }
+
+    bool Enabled() const
+    {
+        return enabled.load(memory_order_relaxed);
+    }
+
+    void Add(const char* stage, double ms)
+    {
+        lock_guard<mutex> lock(stagesMutex);
+        Stage& total = stages[stage];
+        total.ms += ms;
+        total.calls++;
+    }
+
+    // the stages measured since the last call, by name
+    map<string, Stage> Take()
+    {
+        lock_guard<mutex> lock(stagesMutex);
+        map<string, Stage> taken;
+        taken.swap(stages);
+        return taken;
+    }
+
+private:
+    atomic<bool> enabled{ false };
+    mutex stagesMutex;
+    map<string, Stage> stages;
+};
+
+// times the rest of the enclosing block (or until End) as one call of a stage, when the profiler is on
+class ProfileScope
+{
+public:
+    explicit ProfileScope(const char* stage) : stage(LoadProfiler::Get().Enabled() ? stage : NULL)
+    {
+        if (this->stage)
+            start = chrono::steady_clock::now();
+    }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+    ~ProfileScope()
+    {
+        End();
+    }
+
+    void End()
+    {
+        if (!stage)
+            return;
+        LoadProfiler::Get().Add(stage, chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+        stage = NULL;
+    }
+
+private:
+    const char* stage;
+    chrono::steady_clock::time_point start;
+};
+#endif
@@ -17,6 +17,16 @@
 
 #include "shader_m.h"
 #include "model.h"
+#include "asset_manager.h"
+#include "asset_packer.h"
+#include "cluster_benchmark.h"
+#include "obj_benchmark.h"
+#include "geometry_arena.h"
+#include "headless_context.h"
+#include "impostor_baker.h"
+#include "load_benchmark.h"
+#include "terrain_volume.h"
+#include "terrain_world.h"
 
 #include <iostream>
 
@@ -41,13 +51,10 @@ vec3 cratePosition2 = vec3(-2.0f, -2.0f, -3.0f);
 float crateSpeed = 0.005f;
 bool moveUp = true;
 
-//Procedural generation
-const int renderDistance = 128;
-const int mapSize = renderDistance * renderDistance;
-
-const int squaresRow = renderDistance - 1;
-const int trianglesPerSquare = 2;
-const int triangleGrid = squaresRow * squaresRow * trianglesPerSquare;
+//Volumetric terrain
+bool volumetricTerrainActive = false;
+bool blastRequested = false;
+const float blastRadius = 1.5f;
 
 //Camera
 bool cameraMovementActive = false;
@@ -61,8 +68,86 @@ float deltaTime = 0.0f;	//Time between current frame and last frame
 float lastFrame = 0.0f;
 
 
-int main()
+int main(int argc, char** argv)
 {
+    //"--pack [archive] [files and directories...]" packs the assets into one archive instead of running the game
+    if (argc > 1 && string(argv[1]) == "--pack")
+    {
+        string archivePath = argc > 2 ? argv[2] : assetArchiveDefaultPath;
+        vector<string> inputs(argv + std::min(argc, 3), argv + argc);
+        if (inputs.empty())
+            inputs = { "shaders", "tank", "crate", "signature.jpg" };
+        return PackAssets(archivePath, inputs) ? 0 : 1;
+    }
+    //"--bench-obj [files...]" times the OBJ loader against Assimp
+    if (argc > 1 && string(argv[1]) == "--bench-obj")
+    {
+        vector<string> files(argv + 2, argv + argc);
+        if (files.empty())
+            files.push_back("tank/m26.obj");
+        BenchmarkObjLoader(files);
+        return 0;
+    }
+    //"--bench-clusters [files...]" measures how much of a model cluster culling leaves out from all round
+    if (argc > 1 && string(argv[1]) == "--bench-clusters")
+    {
+        vector<string> files(argv + 2, argv + argc);
+        if (files.empty())
+            files.push_back("tank/m26.obj");
+        BenchmarkClusterCulling(files);
+        return 0;
+    }
+    //"--bake-impostors [models...]" renders the models' impostors without a window or GPU, for the asset pipeline
+    if (argc > 1 && string(argv[1]) == "--bake-impostors")
+    {
+        vector<string> files(argv + 2, argv + argc);
+        if (files.empty())
+            files = { "tank/m26.obj", "crate/box_FBX.fbx" };
+        HeadlessContext context;
+        if (!context.Create())
+        {
+            std::cout << "Could not create a headless OpenGL context" << std::endl;
+            return 1;
+        }
+        DetectTextureCompression();
+        //Lowercase so the loose shaders are found on case sensitive file systems too
+        Shader bakeShader("shaders/vertex.vert", "shaders/impostor_bake.frag");
+        SkinPaletteBuffer::Get().Attach(bakeShader.ID);
+        bool baked = true;
+        for (const string& file : files)
+            baked = BakeImpostorFile(file, bakeShader) && baked;
+        glDeleteProgram(bakeShader.ID);
+        return baked ? 0 : 1;
+    }
+    //"--bench-loading [report] [runs]" times every stage of loading start up's assets, cold and warm, into a JSON report
+    if (argc > 1 && string(argv[1]) == "--bench-loading")
+    {
+        string reportPath = argc > 2 ? argv[2] : "load_benchmark.json";
+        int runs = argc > 3 ? atoi(argv[3]) : loadBenchmarkRuns;
+        HeadlessContext context;
+        if (!context.Create())
+        {
+            std::cout << "Could not create a headless OpenGL context" << std::endl;
+            return 1;
+        }
+        DetectTextureCompression();
+        LoadBenchmarkAssets assets;
+        assets.models = { "tank/m26.obj", "crate/box_FBX.fbx" };
+        assets.textures = { "signature.jpg" };
+        //Lowercase so the loose shaders are found on case sensitive file systems too
+        assets.shaders = {
+            { "shaders/vertex.vert", "shaders/fragment.frag" },
+            { "shaders/terrain.vert", "shaders/terrain.frag" },
+            { "shaders/scatter.vert", "shaders/scatter.frag" },
+            { "shaders/impostor.vert", "shaders/impostor.frag" }
+        };
+        return BenchmarkAssetLoading(assets, runs, reportPath) ? 0 : 1;
+    }
+
+    //Shaders, models and textures come from the packed archive when there is one, otherwise from the loose files
+    if (AssetArchive::Get().Mount(assetArchiveDefaultPath))
+        std::cout << "Mounted " << assetArchiveDefaultPath << ": " << AssetArchive::Get().EntryCount() << " assets" << std::endl;
+
     //Initialize GLFW and set up OpenGL
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
@@ -96,14 +181,27 @@ int main()
     //Enable depth testing
     glEnable(GL_DEPTH_TEST);
 
+    //Check which block compressed texture formats the driver takes before any texture loads
+    DetectTextureCompression();
+
     //Compile shaders into a program using a prewritten header file from : "https://learnopengl.com/code_viewer_gh.php?code=includes/learnopengl/shader.h"
     Shader shaderProgram("Shaders/vertex.vert", "Shaders/fragment.frag");
+    //Skinned meshes read their bones from the palette uniform buffer
+    SkinPaletteBuffer::Get().Attach(shaderProgram.ID);
     //==========================
 
     //Compile shaders into a program using a prewritten header file from : "https://learnopengl.com/code_viewer_gh.php?code=includes/learnopengl/shader.h"
     Shader terrainShader("Shaders/terrain.vert", "Shaders/terrain.frag");
     //==========================
 
+    //Instanced trees, rocks and shrubs on the terrain
+    Shader scatterShader("Shaders/scatter.vert", "Shaders/scatter.frag");
+    //==========================
+
+    //Far away models drawn as billboards from their baked impostors
+    Shader impostorShader("Shaders/impostor.vert", "Shaders/impostor.frag");
+    //==========================
+
     // Cube vertices with texture coordinates
     float cubeVertices[] = {
         // Positions          // Texture Coordinates
@@ -166,122 +264,32 @@ int main()
     int biomeSeed = rand() % 100;
     BiomeNoise.SetSeed(biomeSeed);
 
-    //Terrain
-    GLfloat terrainVertices[mapSize][6];
-    float drawingStartPosition = 1.0f;
-    float columnVerticesOffset = drawingStartPosition;
-    float rowVerticesOffset = drawingStartPosition;
-
-    int rowIndex = 0;
-
-    //Biome colours and terrain height
-    int i = 0;
-    for (int y = 0; y < renderDistance; y++) {
-        for (int x = 0; x < renderDistance; x++) {
-            terrainVertices[i][1] = TerrainNoise.GetNoise((float)x, (float)y);
-
-            float biomeValue = BiomeNoise.GetNoise((float)x, (float)y);
-            if (biomeValue <= -0.75f) { 
-                //Swamp
-                terrainVertices[i][3] = 0.0f;
-                terrainVertices[i][4] = 0.4f;
-                terrainVertices[i][5] = 0.0f;
-            }
-            else 
-            {
-                //Desert
-                terrainVertices[i][3] = 0.9f;
-                terrainVertices[i][4] = 0.9f;
-                terrainVertices[i][5] = 0.1f;
-            }
-
-            i++;
-        }
-    }
-
-    //Set biome colours based on Y values, and terrain verices set up
-    for (int i = 0; i < mapSize; i++) {
-        //vertices
-        terrainVertices[i][0] = columnVerticesOffset;
-        terrainVertices[i][2] = rowVerticesOffset;
-
-        //Rocks
-        if (terrainVertices[i][1] >= (4.0f / 8.0f)) {
-            terrainVertices[i][3] = 0.2f;
-            terrainVertices[i][4] = 0.2f;
-            terrainVertices[i][5] = 0.2f;
-        }
-        //Planes
-        else if (terrainVertices[i][1] >= (1.0f / 8.0f)) {
-            terrainVertices[i][3] = 0.2f;
-            terrainVertices[i][4] = 1.0f;
-            terrainVertices[i][5] = 0.2f;
-        }
-
-        columnVerticesOffset -= 0.0625f;
-        rowIndex++;
-        if (rowIndex == renderDistance) {
-            rowIndex = 0;
-            columnVerticesOffset = drawingStartPosition;
-            rowVerticesOffset -= 0.0625f;
-        }
-    }
-    
-    //Set up the terrain indices
-    GLuint terrainIndices[triangleGrid][3];
-    int columnIndicesOffset = 0;
-    int rowIndicesOffset = 0;
-    rowIndex = 0;
-
-    for (int i = 0; i < triangleGrid - 1; i += 2) {
-        terrainIndices[i][0] = columnIndicesOffset + rowIndicesOffset;
-        terrainIndices[i][2] = renderDistance + columnIndicesOffset + rowIndicesOffset;
-        terrainIndices[i][1] = 1 + columnIndicesOffset + rowIndicesOffset;
-        terrainIndices[i + 1][0] = 1 + columnIndicesOffset + rowIndicesOffset;
-        terrainIndices[i + 1][2] = renderDistance + columnIndicesOffset + rowIndicesOffset;
-        terrainIndices[i + 1][1] = 1 + renderDistance + columnIndicesOffset + rowIndicesOffset;
-        columnIndicesOffset += 1;
-        rowIndex++;
-        if (rowIndex == squaresRow) {
-            rowIndex = 0;
-            columnIndicesOffset = 0;
-            rowIndicesOffset += renderDistance;
-        }
-    }
-
-    unsigned int terrainVAO, terrainVBO, terrainEBO;
-    glGenVertexArrays(1, &terrainVAO);
-    glGenBuffers(1, &terrainVBO);
-    glGenBuffers(1, &terrainEBO);
-
-    glBindVertexArray(terrainVAO);
+    //Main thread work (GL uploads) is spread over frames within a per frame time budget
+    FrameScheduler frameScheduler;
 
-    glBindBuffer(GL_ARRAY_BUFFER, terrainVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(terrainVertices), terrainVertices, GL_STATIC_DRAW);
+    //Volumetric terrain, streamed in around the tank while the mode is active
+    VolumeTerrain volumeTerrain(TerrainNoise, BiomeNoise, terrainSeed, frameScheduler);
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, terrainEBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(terrainIndices), terrainIndices, GL_STATIC_DRAW);
+    //Heightfield terrain, generated in chunks around the tank and compressed once out of range
+    TerrainWorld terrainWorld(TerrainNoise, BiomeNoise, frameScheduler);
 
-    //Position attribute
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
+    //The terrain model matrix never changes
+    glm::mat4 terrainModel = glm::mat4(1.0f);
+    terrainModel = glm::translate(terrainModel, glm::vec3(7.0f, -1.0f, 7.0f)); //Position the terrain near and under the tank
+    terrainModel = glm::scale(terrainModel, glm::vec3(5.0f, 5.0f, 5.0f)); //Scale the terrain
+    glm::mat4 terrainWorldToLocal = glm::inverse(terrainModel);
 
-    //Colour attribute
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-    glBindVertexArray(0);
+    //Generate the chunks around the tank before the first frame
+    terrainWorld.Prime(glm::vec3(terrainWorldToLocal * glm::vec4(tankPosition, 1.0f)));
 
     //Create and generate texture object for the Signature Cube ====
     unsigned int signatureTexture;
     glGenTextures(1, &signatureTexture);
-    glBindTexture(GL_TEXTURE_2D, signatureTexture);
-    //Load the signature.jpg texture and generate the mipmaps
-    int width, height, nrChannels;
-    unsigned char* data = stbi_load("signature.jpg", &width, &height, &nrChannels, 0);
-    if (data)
+    //Load the signature.jpg texture with its mipmaps, filtered on the worker threads and cached with the texture
+    shared_ptr<DecodedImage> signatureImage = LoadTextureImage("signature.jpg");
+    if (signatureImage->mips)
     {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
+        UploadTextureInto(signatureTexture, *signatureImage, "signature.jpg");
     }
     //If this failed, ouput an error message
     else
@@ -289,37 +297,23 @@ int main()
         std::cout << "Could not load the texture for the Signature Cube" << std::endl;
     }
     //Free memory
-    stbi_image_free(data);
-
-    unsigned int cubeVAO, cubeVBO, cubeEBO;
-    glGenVertexArrays(1, &cubeVAO);
-    glGenBuffers(1, &cubeVBO);
-    glGenBuffers(1, &cubeEBO);
-
-    glBindVertexArray(cubeVAO);
-
-    glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(cubeVertices), cubeVertices, GL_STATIC_DRAW);
-
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, cubeEBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(cubeIndices), cubeIndices, GL_STATIC_DRAW);
-
-    // Position attribute
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-
-    // Texture coordinate attribute
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-
-    glBindVertexArray(0);
-
-    //Load the tank model
-    Model tank("tank/m26.obj");
+    signatureImage.reset();
+
+    //The cube goes in the geometry arena like every other static mesh
+    //Position, then the texture coordinates, at the locations every model's vertex format uses
+    VertexFormat cubeFormat;
+    cubeFormat.Add(ATTRIBUTE_POSITION, 3, GL_FLOAT, false);
+    cubeFormat.Add(ATTRIBUTE_TEXCOORDS, 2, GL_FLOAT, false);
+    unsigned int cubeGeometry = GeometryArena::Get().Allocate(cubeFormat, cubeVertices, sizeof(cubeVertices) / (5 * sizeof(float)), cubeIndices, sizeof(cubeIndices) / sizeof(unsigned int));
+
+    //Load the models in the background, each one appears once its uploads have gone through the scheduler
+    //Objects are instances of shared models, so both crates use one copy of the crate's meshes and textures
+    //Load the tank model, keeping the bounds of its clusters of triangles to cull them
+    ModelInstance tank = AssetManager::Get().Instantiate("tank/m26.obj", frameScheduler, false, true);
     //Load the crate model
-    Model crate("crate/box_FBX.fbx");
+    ModelInstance crate = AssetManager::Get().Instantiate("crate/box_FBX.fbx", frameScheduler);
     //Load the 2nd crate model
-    Model crate2("crate/box_FBX.fbx");
+    ModelInstance crate2 = AssetManager::Get().Instantiate("crate/box_FBX.fbx", frameScheduler);
     
     //Render loop!
     while (!glfwWindowShouldClose(window))
@@ -329,6 +323,9 @@ int main()
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
 
+        //Run the scheduled uploads that fit in this frame's budget
+        frameScheduler.RunFrame();
+
         crateRotationAngle += 0.5f;
 
         if (moveUp) {
@@ -347,6 +344,13 @@ int main()
         //Keyboard user input
         processInput(window);
 
+        //Pose the models' skeletons on the worker threads, a model's first clip loops once it has loaded
+        ModelInstance* animatedInstances[] = { &tank, &crate, &crate2 };
+        for (ModelInstance* instance : animatedInstances)
+            if (!instance->IsPlaying())
+                instance->Play(0);
+        AnimateInstances(animatedInstances, sizeof(animatedInstances) / sizeof(animatedInstances[0]), deltaTime);
+
         //Reset screen and buffers
         glClearColor(0.1f, 0.1f, 0.4f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -354,6 +358,10 @@ int main()
         //Set up view and projection matrices
         glm::mat4 projection = glm::perspective(glm::radians(90.0f), (float)800 / (float)800, 0.1f, 100.0f);
         glm::mat4 view = camera.GetViewMatrix();
+        //Pixels one unit covers at distance 1, for picking the models' levels of detail
+        float lodPixelsPerUnit = 800.0f / (2.0f * tan(glm::radians(90.0f) * 0.5f));
+        //Clusters of the models outside the view or facing away are not drawn
+        ClusterCullView cullView(projection * view, camera.Position);
 
         //Signature Cube rendering ====
         shaderProgram.use();
@@ -367,14 +375,17 @@ int main()
         cubeModel = glm::translate(cubeModel, glm::vec3(0.0f, -6.0f, 0.0f)); // Position the cube below the ground
         cubeModel = glm::scale(cubeModel, glm::vec3(2.0f, 2.0f, 2.0f)); // Scale the cube
         shaderProgram.setMat4("model", cubeModel);
+        //The cube's positions are plain floats, models set their own dequantization
+        shaderProgram.setVec3("positionScale", glm::vec3(1.0f));
+        shaderProgram.setVec3("positionOffset", glm::vec3(0.0f));
+        shaderProgram.setBool("skinned", false);
 
         //Bind the texture for the cube
         glActiveTexture(GL_TEXTURE0);
         glBindTexture(GL_TEXTURE_2D, signatureTexture);
 
-        //Bind the VAO and draw the cube
-        glBindVertexArray(cubeVAO);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+        //Draw the cube from the geometry arena
+        GeometryArena::Get().Draw(cubeGeometry);
 
         //Terrain rendering ====
         terrainShader.use();
@@ -382,15 +393,36 @@ int main()
         terrainShader.setMat4("view", view);
         terrainShader.setMat4("projection", projection);
 
-        //Set the model matrix for the cube
-        glm::mat4 terrainModel = glm::mat4(1.0f);
-        terrainModel = glm::translate(terrainModel, glm::vec3(7.0f, -1.0f, 7.0f)); //Position the terrain near and under the tank
-        terrainModel = glm::scale(terrainModel, glm::vec3(5.0f, 5.0f, 5.0f)); //Scale the terrain
+        //Set the model matrix for the terrain
         terrainShader.setMat4("model", terrainModel);
 
-        //Bind the VAO and draw the terrain
-        glBindVertexArray(terrainVAO);
-        glDrawElements(GL_TRIANGLES, mapSize*32, GL_UNSIGNED_INT, 0);
+        //Stream chunks around whatever the player controls
+        glm::vec3 streamingFocus = cameraMovementActive ? camera.Position : tankPosition;
+
+        if (volumetricTerrainActive) {
+            volumeTerrain.Update(streamingFocus);
+            if (blastRequested) {
+                volumeTerrain.Blast(tankPosition, blastRadius);
+                blastRequested = false;
+            }
+
+            //Volume chunks are stored in voxel units
+            glm::mat4 volumeModel = glm::scale(glm::mat4(1.0f), glm::vec3(volumeTerrain.voxelSize));
+            terrainShader.setMat4("model", volumeModel);
+            terrainShader.setBool("bakedLighting", false);
+            volumeTerrain.Draw();
+        }
+        else {
+            //Chunks are streamed in the terrain's local space
+            terrainWorld.Update(glm::vec3(terrainWorldToLocal * glm::vec4(streamingFocus, 1.0f)));
+            terrainWorld.Draw(terrainShader);
+
+            //Vegetation and rocks of the active chunks
+            scatterShader.use();
+            scatterShader.setMat4("view", view);
+            scatterShader.setMat4("projection", projection);
+            terrainWorld.DrawScatter(scatterShader, terrainModel, projection * view, camera.Position);
+        }
 
         //Tank model ====
         shaderProgram.use();
@@ -402,9 +434,11 @@ int main()
         glm::mat4 tankModel = glm::mat4(1.0f);
         tankModel = glm::translate(tankModel, tankPosition);
         tankModel = glm::rotate(tankModel, glm::radians(tankRotationAngle), glm::vec3(0.0f, 1.0f, 0.0f)); // Rotate the tank
-        shaderProgram.setMat4("model", tankModel);
+        tank.transform = tankModel;
+        tank.SelectLod(camera.Position, lodPixelsPerUnit);
+        tank.RequestTextures(camera.Position, lodPixelsPerUnit);
         //Draw the tank model
-        tank.Draw(shaderProgram);
+        tank.Draw(shaderProgram, &cullView);
 
         shaderProgram.setMat4("projection", projection);
         shaderProgram.setMat4("view", view);
@@ -413,9 +447,11 @@ int main()
         crateModel = glm::translate(crateModel, cratePosition);
         crateModel = glm::rotate(crateModel, glm::radians(crateRotationAngle), glm::vec3(0.0f, 1.0f, 0.0f)); // Rotate the crate
         crateModel = glm::scale(crateModel, glm::vec3(0.050f, 0.050f, 0.050f)); // Scale the crate
-        shaderProgram.setMat4("model", crateModel);
+        crate.transform = crateModel;
+        crate.SelectLod(camera.Position, lodPixelsPerUnit);
+        crate.RequestTextures(camera.Position, lodPixelsPerUnit);
         //Draw the crate model
-        crate.Draw(shaderProgram);
+        crate.Draw(shaderProgram, &cullView);
 
         shaderProgram.setMat4("projection", projection);
         shaderProgram.setMat4("view", view);
@@ -424,20 +460,50 @@ int main()
         crateModel2 = glm::translate(crateModel2, cratePosition2);
         crateModel2 = glm::rotate(crateModel2, glm::radians(0.0f), glm::vec3(0.0f, 1.0f, 0.0f)); // Rotate the crate
         crateModel2 = glm::scale(crateModel2, glm::vec3(0.050f, 0.050f, 0.050f)); // Scale the crate
-        shaderProgram.setMat4("model", crateModel2);
+        crate2.transform = crateModel2;
+        crate2.SelectLod(camera.Position, lodPixelsPerUnit);
+        crate2.RequestTextures(camera.Position, lodPixelsPerUnit);
         //Draw the other crate model
-        crate2.Draw(shaderProgram);
+        crate2.Draw(shaderProgram, &cullView);
+
+        //Models far enough to be queued as impostors, one instanced draw per model ====
+        impostorShader.use();
+        impostorShader.setMat4("projection", projection);
+        impostorShader.setMat4("view", view);
+        ImpostorRenderer::Get().Draw(impostorShader, camera.Position);
+
+        //Stream in the texture levels the models asked for, within the VRAM budget
+        TextureStreamer::Get().Update(frameScheduler);
+
+        //Free the models and GPU resources nothing refers to any more
+        AssetManager::Get().CollectUnused();
+        //Compact the shared vertex and index buffers once freed meshes have left them full of holes
+        GeometryArena::Get().Defragment();
 
         //Draw the screen and process input
+        //Measure the frame before waiting for the swap so the next budget can be worked out
+        frameScheduler.EndFrame();
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
 
+    //How much memory the terrain chunks took
+    terrainWorld.PrintMemoryReport();
+    //How the scheduled work fit into the frames
+    frameScheduler.PrintReport();
+    //How many models, meshes and textures were shared
+    AssetManager::Get().PrintReport();
+    GeometryArena::Get().PrintReport();
+    TextureStreamer::Get().PrintReport();
+    ImpostorRenderer::Get().PrintReport();
+
     //Clean up the resources used for the window
     glfwTerminate();
     //Delete the shader program
     glDeleteProgram(shaderProgram.ID);
     glDeleteProgram(terrainShader.ID);
+    glDeleteProgram(scatterShader.ID);
+    glDeleteProgram(impostorShader.ID);
     //Exit code
     return 0;
 }
@@ -500,6 +566,30 @@ void processInput(GLFWwindow* window)
         cKeyWasPressed = false;
     }
 
+    //Volumetric terrain toggle
+    static bool vKeyWasPressed = false;
+    if (glfwGetKey(window, GLFW_KEY_V) == GLFW_PRESS) {
+        if (!vKeyWasPressed) {
+            volumetricTerrainActive = !volumetricTerrainActive;
+            vKeyWasPressed = true;
+        }
+    }
+    else {
+        vKeyWasPressed = false;
+    }
+
+    //Blast a crater under the tank
+    static bool fKeyWasPressed = false;
+    if (glfwGetKey(window, GLFW_KEY_F) == GLFW_PRESS) {
+        if (!fKeyWasPressed && volumetricTerrainActive) {
+            blastRequested = true;
+        }
+        fKeyWasPressed = true;
+    }
+    else {
+        fKeyWasPressed = false;
+    }
+
     //Camera movement ====
     if (cameraMovementActive) {
         if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
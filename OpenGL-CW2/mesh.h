@@ -6,8 +6,14 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include "bounding_volume.h"
+#include "geometry_arena.h"
 #include "shader2.h"
+#include "vertex_format.h"
 
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
 #include <string>
 #include <vector>
 using namespace std;
@@ -37,28 +43,407 @@ struct Texture {
     string path;
 };
 
+// levels of detail a mesh can have, the full mesh included
+const unsigned int maxMeshLods = 4;
+
+// one level of detail: a range of the mesh's indices drawn over its shared vertices. error is how far the
+// simplified surface may be from the full one, in the mesh's units
+struct MeshLod {
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    float error;
+};
+
+// bounds and normal cone of a range of the mesh's full detail indices, for culling parts of a mesh. every triangle's
+// normal is within the cone around coneAxis; coneCutoff is the sine of its widest angle, 1 for a cone that can't be
+// culled. the cluster faces away from a camera where dot(normalize(center - camera), coneAxis) >= coneCutoff + radius / distance
+struct MeshCluster {
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    BoundingVolume bounds;
+    glm::vec3 coneAxis;
+    float coneCutoff;
+};
+
+// index ranges of a mesh's full detail level left to draw once its hidden clusters are culled, neighbouring ranges
+// merged into one. empty when nothing is left
+struct ClusterDrawList {
+    vector<uint32_t> firstIndices;
+    vector<GLsizei>  indexCounts;
+
+    void Clear()
+    {
+        firstIndices.clear();
+        indexCounts.clear();
+    }
+};
+
+// CPU side arrays of a mesh before it is uploaded. built without a GL context so model loads can run on
+// worker threads: the importer fills the full vertices, PackMeshData converts them to the mesh's slim
+// layout, and the packed arrays are what gets cached and uploaded
+struct MeshData {
+    vector<Vertex>        vertices;
+    vector<unsigned int>  indices;
+    bool                  hasTexCoords = false;
+    // packed arrays in format's layout, owned or pointing into a mapped mesh cache
+    VertexFormat          format;
+    size_t                vertexCount = 0;
+    size_t                indexCount = 0;
+    vector<unsigned char> packedVertices;
+    vector<unsigned char> packedIndices;
+    const unsigned char*  mappedVertices = NULL;
+    const unsigned char*  mappedIndices = NULL;
+    // texture type and path, the ids are only known once uploaded
+    vector<Texture>       textures;
+    // ranges of indices, level 0 first, empty when the indices are all one level
+    vector<MeshLod>       lods;
+    // node of the model's hierarchy the mesh hangs from
+    unsigned int          node = 0;
+    // extents of the vertices in the mesh's own space, and of each cluster of its triangles
+    BoundingVolume        bounds;
+    vector<MeshCluster>   clusters;
+    // texture coordinate units per unit of the mesh's space, 0 without texture coordinates
+    float                 uvDensity = 0.0f;
+    // hash of the packed arrays and their format, identical meshes share their GL buffers
+    uint64_t              contentHash = 0;
+
+    const unsigned char* VertexData() const { return mappedVertices ? mappedVertices : (packedVertices.empty() ? NULL : &packedVertices[0]); }
+    size_t VertexCount() const { return vertexCount; }
+    size_t VertexBytes() const { return vertexCount * format.stride; }
+    const unsigned char* IndexData() const { return mappedIndices ? mappedIndices : (packedIndices.empty() ? NULL : &packedIndices[0]); }
+    size_t IndexCount() const { return indexCount; }
+    size_t IndexBytes() const { return indexCount * format.IndexSize(); }
+
+    // heap memory of the owned arrays, a mapped cache isn't counted
+    size_t CpuBytes() const
+    {
+        return vertices.capacity() * sizeof(Vertex) + indices.capacity() * sizeof(unsigned int) + packedVertices.capacity() + packedIndices.capacity();
+    }
+
+    // frees the arrays once uploaded, the counts and format stay valid
+    void ReleaseCpuData()
+    {
+        vector<Vertex>().swap(vertices);
+        vector<unsigned int>().swap(indices);
+        vector<unsigned char>().swap(packedVertices);
+        vector<unsigned char>().swap(packedIndices);
+        mappedVertices = mappedIndices = NULL;
+    }
+};
+
+// the layout of the full Vertex struct, for meshes built from Vertex arrays directly
+inline VertexFormat FullVertexFormat()
+{
+    VertexFormat format;
+    format.Add(ATTRIBUTE_POSITION, 3, GL_FLOAT, false);
+    format.Add(ATTRIBUTE_NORMAL, 3, GL_FLOAT, false);
+    format.Add(ATTRIBUTE_TEXCOORDS, 2, GL_FLOAT, false);
+    format.Add(ATTRIBUTE_TANGENT, 3, GL_FLOAT, false);
+    format.Add(ATTRIBUTE_BITANGENT, 3, GL_FLOAT, false);
+    // the ids are never negative, read as the shader's unsigned uvec4
+    format.Add(ATTRIBUTE_BONE_IDS, MAX_BONE_INFLUENCE, GL_UNSIGNED_INT, false, true);
+    format.Add(ATTRIBUTE_BONE_WEIGHTS, MAX_BONE_INFLUENCE, GL_FLOAT, false);
+    return format;
+}
+
+// keeps the MAX_BONE_INFLUENCE strongest bones of a vertex: a weight goes into a free slot or replaces the weakest
+// one if it is stronger
+inline void AddBoneInfluence(Vertex& vertex, int bone, float weight)
+{
+    int weakest = 0;
+    for (int i = 0; i < MAX_BONE_INFLUENCE; i++)
+    {
+        if (vertex.m_Weights[i] == 0.0f)
+        {
+            weakest = i;
+            break;
+        }
+        if (vertex.m_Weights[i] < vertex.m_Weights[weakest])
+            weakest = i;
+    }
+    if (weight > vertex.m_Weights[weakest])
+    {
+        vertex.m_BoneIDs[weakest] = bone;
+        vertex.m_Weights[weakest] = weight;
+    }
+}
+
+// scales a vertex's kept weights to add up to 1, the ones dropped above took some of the total with them
+inline void NormaliseBoneWeights(Vertex& vertex)
+{
+    float total = 0.0f;
+    for (int i = 0; i < MAX_BONE_INFLUENCE; i++)
+        total += vertex.m_Weights[i];
+    if (total <= 0.0f)
+        return;
+    for (int i = 0; i < MAX_BONE_INFLUENCE; i++)
+        vertex.m_Weights[i] /= total;
+}
+
+// bounds of the full vertices
+inline void ComputeMeshBounds(MeshData& mesh)
+{
+    mesh.bounds = mesh.vertices.empty() ? BoundingVolume() : BoundPoints(&mesh.vertices[0].Position, mesh.vertices.size(), sizeof(Vertex));
+}
+
+// how densely the texture coordinates are spread over the surface: the square root of their area over the
+// triangles' area, summed over the full detail triangles
+inline void MeasureUvDensity(MeshData& mesh)
+{
+    mesh.uvDensity = 0.0f;
+    if (!mesh.hasTexCoords)
+        return;
+    size_t fullIndices = mesh.lods.empty() ? mesh.indices.size() : mesh.lods[0].indexCount;
+    double uvArea = 0.0, area = 0.0;
+    for (size_t i = 0; i + 2 < fullIndices; i += 3)
+    {
+        const Vertex& a = mesh.vertices[mesh.indices[i]];
+        const Vertex& b = mesh.vertices[mesh.indices[i + 1]];
+        const Vertex& c = mesh.vertices[mesh.indices[i + 2]];
+        glm::vec2 uvEdge1 = b.TexCoords - a.TexCoords, uvEdge2 = c.TexCoords - a.TexCoords;
+        uvArea += fabs(uvEdge1.x * uvEdge2.y - uvEdge1.y * uvEdge2.x) * 0.5;
+        area += glm::length(glm::cross(b.Position - a.Position, c.Position - a.Position)) * 0.5;
+    }
+    if (area > 0.0 && uvArea > 0.0)
+        mesh.uvDensity = (float)sqrt(uvArea / area);
+}
+
+// picks the smallest layout the mesh needs and converts its full vertices and indices to it, then drops them:
+//  positions: unorm16 over the mesh bounds when quantizing (8 bytes), otherwise floats (12 bytes)
+//  normals: signed normalized 10:10:10 (4 bytes)
+//  texture coordinates: half floats (4 bytes), left out when the mesh has none
+//  tangents: 10:10:10 with the bitangent's handedness in w (4 bytes), only for meshes with a normal map.
+//    the bitangent is cross(normal, tangent.xyz) * tangent.w in the shader
+//  bone ids (4 bytes) and weights (unorm8, 4 bytes), only for meshes with bones. weights are rounded to add up to
+//    exactly 255
+//  indices: 16 bit when every vertex can be addressed with them
+// 16-20 bytes a vertex instead of the full Vertex's 88, 24-28 skinned
+inline void PackMeshData(MeshData& mesh, bool quantizePositions = true)
+{
+    bool tangents = false;
+    for (const Texture& texture : mesh.textures)
+        tangents |= texture.type == "texture_normal";
+    bool skinned = false;
+    for (size_t i = 0; i < mesh.vertices.size() && !skinned; i++)
+        skinned = mesh.vertices[i].m_Weights[0] > 0.0f;
+
+    VertexFormat format;
+    glm::vec3 low(0.0f), high(0.0f);
+    if (!mesh.vertices.empty())
+    {
+        low = high = mesh.vertices[0].Position;
+        for (const Vertex& vertex : mesh.vertices)
+        {
+            low = glm::min(low, vertex.Position);
+            high = glm::max(high, vertex.Position);
+        }
+    }
+    if (quantizePositions)
+    {
+        format.Add(ATTRIBUTE_POSITION, 3, GL_UNSIGNED_SHORT, true);
+        // a flat axis still needs a non zero scale to divide by
+        format.positionScale = glm::max(high - low, glm::vec3(1e-6f));
+        format.positionOffset = low;
+    }
+    else
+        format.Add(ATTRIBUTE_POSITION, 3, GL_FLOAT, false);
+    format.Add(ATTRIBUTE_NORMAL, 4, GL_INT_2_10_10_10_REV, true);
+    if (mesh.hasTexCoords)
+        format.Add(ATTRIBUTE_TEXCOORDS, 2, GL_HALF_FLOAT, false);
+    if (tangents)
+        format.Add(ATTRIBUTE_TANGENT, 4, GL_INT_2_10_10_10_REV, true);
+    if (skinned)
+    {
+        format.Add(ATTRIBUTE_BONE_IDS, MAX_BONE_INFLUENCE, GL_UNSIGNED_BYTE, false, true);
+        format.Add(ATTRIBUTE_BONE_WEIGHTS, MAX_BONE_INFLUENCE, GL_UNSIGNED_BYTE, true);
+    }
+    format.indexType = mesh.vertices.size() <= 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+
+    mesh.packedVertices.assign(mesh.vertices.size() * format.stride, 0);
+    for (size_t i = 0; i < mesh.vertices.size(); i++)
+    {
+        const Vertex& vertex = mesh.vertices[i];
+        unsigned char* destination = &mesh.packedVertices[i * format.stride];
+        if (quantizePositions)
+        {
+            glm::vec3 unit = (vertex.Position - format.positionOffset) / format.positionScale;
+            uint16_t position[3] = { vertexpack::packUnorm16(unit.x), vertexpack::packUnorm16(unit.y), vertexpack::packUnorm16(unit.z) };
+            memcpy(destination + format.attributes[ATTRIBUTE_POSITION].offset, position, sizeof(position));
+        }
+        else
+            memcpy(destination + format.attributes[ATTRIBUTE_POSITION].offset, &vertex.Position, sizeof(vertex.Position));
+
+        uint32_t normal = vertexpack::packNormal(vertex.Normal);
+        memcpy(destination + format.attributes[ATTRIBUTE_NORMAL].offset, &normal, 4);
+        if (mesh.hasTexCoords)
+        {
+            uint16_t texCoords[2] = { vertexpack::toHalf(vertex.TexCoords.x), vertexpack::toHalf(vertex.TexCoords.y) };
+            memcpy(destination + format.attributes[ATTRIBUTE_TEXCOORDS].offset, texCoords, sizeof(texCoords));
+        }
+        if (tangents)
+        {
+            float handedness = glm::dot(glm::cross(vertex.Normal, vertex.Tangent), vertex.Bitangent) < 0.0f ? -1.0f : 1.0f;
+            uint32_t tangent = vertexpack::packNormal(vertex.Tangent, handedness);
+            memcpy(destination + format.attributes[ATTRIBUTE_TANGENT].offset, &tangent, 4);
+        }
+        if (skinned)
+        {
+            uint8_t ids[MAX_BONE_INFLUENCE], weights[MAX_BONE_INFLUENCE];
+            int total = 0, largest = 0;
+            for (int b = 0; b < MAX_BONE_INFLUENCE; b++)
+            {
+                ids[b] = (uint8_t)vertex.m_BoneIDs[b];
+                weights[b] = (uint8_t)(min(max(vertex.m_Weights[b], 0.0f), 1.0f) * 255.0f + 0.5f);
+                total += weights[b];
+                if (weights[b] > weights[largest])
+                    largest = b;
+            }
+            // the rounding is made up on the strongest bone, a vertex's weights mustn't scale it
+            if (total)
+                weights[largest] = (uint8_t)(weights[largest] + 255 - total);
+            memcpy(destination + format.attributes[ATTRIBUTE_BONE_IDS].offset, ids, sizeof(ids));
+            memcpy(destination + format.attributes[ATTRIBUTE_BONE_WEIGHTS].offset, weights, sizeof(weights));
+        }
+    }
+
+    mesh.packedIndices.resize(mesh.indices.size() * format.IndexSize());
+    if (format.indexType == GL_UNSIGNED_SHORT)
+    {
+        for (size_t i = 0; i < mesh.indices.size(); i++)
+        {
+            uint16_t index = (uint16_t)mesh.indices[i];
+            memcpy(&mesh.packedIndices[i * 2], &index, 2);
+        }
+    }
+    else if (!mesh.indices.empty())
+        memcpy(&mesh.packedIndices[0], &mesh.indices[0], mesh.indices.size() * 4);
+
+    mesh.format = format;
+    mesh.vertexCount = mesh.vertices.size();
+    mesh.indexCount = mesh.indices.size();
+    vector<Vertex>().swap(mesh.vertices);
+    vector<unsigned int>().swap(mesh.indices);
+}
+
+// expands packed arrays back to full vertices and 32 bit indices, for code that needs the geometry on the CPU
+// (collision, picking). the bitangent comes from the normal and the tangent's handedness
+inline void UnpackMeshData(const MeshData& mesh, vector<Vertex>& vertices, vector<unsigned int>& indices)
+{
+    const VertexFormat& format = mesh.format;
+    vertices.assign(mesh.VertexCount(), Vertex());
+    for (size_t i = 0; i < vertices.size() && mesh.VertexData(); i++)
+    {
+        const unsigned char* source = mesh.VertexData() + i * format.stride;
+        Vertex& vertex = vertices[i];
+        const VertexAttributeFormat& position = format.attributes[ATTRIBUTE_POSITION];
+        if (position.type == GL_UNSIGNED_SHORT)
+        {
+            uint16_t quantized[3];
+            memcpy(quantized, source + position.offset, sizeof(quantized));
+            vertex.Position = glm::vec3(quantized[0], quantized[1], quantized[2]) / 65535.0f * format.positionScale + format.positionOffset;
+        }
+        else
+            memcpy(&vertex.Position, source + position.offset, sizeof(vertex.Position));
+        uint32_t packed;
+        memcpy(&packed, source + format.attributes[ATTRIBUTE_NORMAL].offset, 4);
+        vertex.Normal = vertexpack::unpackNormal(packed);
+        if (format.attributes[ATTRIBUTE_TEXCOORDS].enabled)
+        {
+            uint16_t texCoords[2];
+            memcpy(texCoords, source + format.attributes[ATTRIBUTE_TEXCOORDS].offset, sizeof(texCoords));
+            vertex.TexCoords = glm::vec2(vertexpack::fromHalf(texCoords[0]), vertexpack::fromHalf(texCoords[1]));
+        }
+        if (format.attributes[ATTRIBUTE_TANGENT].enabled)
+        {
+            memcpy(&packed, source + format.attributes[ATTRIBUTE_TANGENT].offset, 4);
+            vertex.Tangent = vertexpack::unpackNormal(packed);
+            float handedness = (packed >> 31) ? -1.0f : 1.0f;
+            vertex.Bitangent = glm::cross(vertex.Normal, vertex.Tangent) * handedness;
+        }
+        if (format.attributes[ATTRIBUTE_BONE_WEIGHTS].enabled)
+        {
+            uint8_t ids[MAX_BONE_INFLUENCE], weights[MAX_BONE_INFLUENCE];
+            memcpy(ids, source + format.attributes[ATTRIBUTE_BONE_IDS].offset, sizeof(ids));
+            memcpy(weights, source + format.attributes[ATTRIBUTE_BONE_WEIGHTS].offset, sizeof(weights));
+            for (int b = 0; b < MAX_BONE_INFLUENCE; b++)
+            {
+                vertex.m_BoneIDs[b] = ids[b];
+                vertex.m_Weights[b] = weights[b] / 255.0f;
+            }
+        }
+    }
+    // the full detail level only
+    indices.resize(mesh.lods.empty() ? mesh.IndexCount() : mesh.lods[0].indexCount);
+    for (size_t i = 0; i < indices.size() && mesh.IndexData(); i++)
+    {
+        if (format.indexType == GL_UNSIGNED_SHORT)
+        {
+            uint16_t index;
+            memcpy(&index, mesh.IndexData() + i * 2, 2);
+            indices[i] = index;
+        }
+        else
+            memcpy(&indices[i], mesh.IndexData() + i * 4, 4);
+    }
+}
+
 class Mesh {
 public:
-    // mesh Data
+    // mesh Data. the vertices and indices are only kept on the CPU when asked for, the GPU copy is what gets drawn
     vector<Vertex>       vertices;
     vector<unsigned int> indices;
     vector<Texture>      textures;
-    unsigned int VAO;
+    // range of the mesh's vertices and indices in the geometry arena
+    unsigned int geometry;
+    unsigned int indexCount;
+    // how the buffers are laid out, the full Vertex unless built from packed data
+    VertexFormat format;
+    // index ranges of the levels of detail, empty for a mesh with just one
+    vector<MeshLod> lods;
+    // node of the model's hierarchy whose world matrix places the mesh
+    unsigned int node = 0;
+    // extents in the mesh's own space. cluster bounds are only kept when the model was loaded asking for them
+    BoundingVolume bounds;
+    vector<MeshCluster> clusters;
+    // texture coordinate units per unit of the mesh's space, for picking how much of its textures to stream in
+    float uvDensity = 0.0f;
+    // deformed by the bound bone palette in the vertex shader instead of placed by its node, packed meshes with bones only
+    bool skinned = false;
 
-    // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    // constructor, pass the arrays with move to avoid copying them. they are freed after the upload unless keepData is set
+    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, bool keepData = false)
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
+        this->vertices = move(vertices);
+        this->indices = move(indices);
+        this->textures = move(textures);
+        this->indexCount = static_cast<unsigned int>(this->indices.size());
+        this->format = FullVertexFormat();
 
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
-        setupMesh();
+        setupMesh(this->vertices.empty() ? NULL : &this->vertices[0], this->vertices.size(), this->indices.empty() ? NULL : &this->indices[0]);
+        if (!keepData)
+        {
+            vector<Vertex>().swap(this->vertices);
+            vector<unsigned int>().swap(this->indices);
+        }
+    }
+
+    // constructor uploading packed arrays in the given format straight from memory the mesh doesn't keep (MeshData,
+    // a mapped mesh cache), vertices and indices stay empty. staged uploads copy through mapped buffers instead of glBufferSubData
+    Mesh(const void* vertexData, size_t vertexCount, const void* indexData, size_t indexCount, const VertexFormat& format, vector<Texture> textures, bool staged = false)
+    {
+        this->textures = move(textures);
+        this->indexCount = static_cast<unsigned int>(indexCount);
+        this->format = format;
+        setupMesh(vertexData, vertexCount, indexData, staged);
     }
 
-    // render the mesh
-    void Draw(Shader &shader) 
+    // render the mesh, at the given level of detail or the coarsest it has. visible limits it to the ranges of its
+    // clusters that were not culled
+    void Draw(Shader &shader, unsigned int lod = 0, const ClusterDrawList *visible = NULL) 
     {
+        if (visible && visible->indexCounts.empty())
+            return;
         // bind appropriate textures
         unsigned int diffuseNr  = 1;
         unsigned int specularNr = 1;
@@ -85,62 +470,46 @@ public:
             glBindTexture(GL_TEXTURE_2D, textures[i].id);
         }
         
-        // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
+        // undoes position quantization, identity for float positions
+        shader.setVec3("positionScale", format.positionScale);
+        shader.setVec3("positionOffset", format.positionOffset);
+        shader.setBool("skinned", skinned);
+
+        // draw mesh, meshes with the same layout share a VAO so it is left bound for the next one
+        if (visible)
+            GeometryArena::Get().DrawRanges(geometry, visible->firstIndices.data(), visible->indexCounts.data(), visible->indexCounts.size());
+        else if (lods.empty())
+            GeometryArena::Get().Draw(geometry);
+        else
+        {
+            const MeshLod& level = lods[min(lod, (unsigned int)lods.size() - 1)];
+            GeometryArena::Get().DrawRange(geometry, level.firstIndex, level.indexCount);
+        }
 
         // always good practice to set everything back to defaults once configured.
         glActiveTexture(GL_TEXTURE0);
     }
 
+    // CPU memory still held by the mesh
+    size_t CpuBytes() const
+    {
+        return vertices.capacity() * sizeof(Vertex) + indices.capacity() * sizeof(unsigned int);
+    }
+
+    // frees the mesh's range of the arena, copies of this mesh share it. context thread only
+    void Release()
+    {
+        GeometryArena::Get().Free(geometry);
+        geometry = 0;
+        indexCount = 0;
+    }
+
 private:
-    // render data 
-    unsigned int VBO, EBO;
-
-    // initializes all the buffer objects/arrays
-    void setupMesh()
-    {
-        // create buffers/arrays
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
-
-        glBindVertexArray(VAO);
-        // load data into vertex buffers
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        // A great thing about structs is that their memory layout is sequential for all its items.
-        // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
-        // again translates to 3/2 floats which translates to a byte array.
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);  
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-
-        // set the vertex attribute pointers
-        // vertex Positions
-        glEnableVertexAttribArray(0);	
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-        // vertex normals
-        glEnableVertexAttribArray(1);	
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-        // vertex texture coords
-        glEnableVertexAttribArray(2);	
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-        // vertex tangent
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-        // vertex bitangent
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
-		// ids
-		glEnableVertexAttribArray(5);
-		glVertexAttribIPointer(5, 4, GL_INT, sizeof(Vertex), (void*)offsetof(Vertex, m_BoneIDs));
-
-		// weights
-		glEnableVertexAttribArray(6);
-		glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, m_Weights));
-        glBindVertexArray(0);
+
+    // copies the vertices and indices into the geometry arena
+    void setupMesh(const void* vertexData, size_t vertexCount, const void* indexData, bool staged = false)
+    {
+        geometry = GeometryArena::Get().Allocate(format, vertexData, vertexCount, indexData, indexCount, staged);
     }
 };
 #endif
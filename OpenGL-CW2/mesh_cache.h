@@ -0,0 +1,376 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include "cache_file.h"
+#include "content_hash.h"
+#include "mesh.h"
+#include "node_hierarchy.h"
+#include "skeletal_animation.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// binary cache of a model's final, packed vertex and index arrays, written next to the source asset after an
+// Assimp import. layout: header, submesh ranges, texture references, nodes, cluster bounds, bones, animation clips,
+// their channels and keys, string table, then the packed arrays
+// (each 16 byte aligned) so they can go from the mapped file straight into glBufferData
+const uint32_t meshCacheMagic = 0x4843534D; // "MSCH"
+const uint32_t meshCacheVersion = 11;
+
+struct MeshCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    // hash of the source asset's bytes, a different hash means the source changed
+    uint64_t sourceHash;
+    // Assimp post processing flags the arrays were made with
+    uint32_t importFlags;
+    // sizeof(VertexFormat) the ranges were written with
+    uint32_t formatSize;
+    uint32_t meshCount;
+    uint32_t textureCount;
+    uint32_t nodeCount;
+    uint32_t clusterCount;
+    uint32_t boneCount;
+    uint32_t clipCount;
+    uint32_t channelCount;
+    uint32_t keyCount;
+    uint64_t stringsOffset;
+    uint64_t dataOffset;
+    uint64_t fileSize;
+};
+
+// one submesh in its own vertex format, indices are relative to its own first vertex
+struct MeshCacheRange {
+    VertexFormat format;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    // byte offsets of the packed arrays from the start of the file
+    uint64_t vertexOffset;
+    uint64_t indexOffset;
+    // into the texture reference table
+    uint32_t firstTexture;
+    uint32_t textureCount;
+    // levels of detail as ranges of the indices, none for a single level
+    uint32_t lodCount;
+    MeshLod lods[maxMeshLods];
+    // into the node table
+    uint32_t node;
+    BoundingVolume bounds;
+    // into the cluster table
+    uint32_t firstCluster;
+    uint32_t clusterCount;
+    float uvDensity;
+};
+
+// texture of a submesh as offsets of its type and path into the string table
+struct MeshCacheTexture {
+    uint32_t typeOffset;
+    uint32_t pathOffset;
+};
+
+// node of the hierarchy, parents before their children
+struct MeshCacheNode {
+    int32_t parent;
+    uint32_t nameOffset;
+    float local[16];
+};
+
+// bone of the skeleton, the node moving it and its offset matrix
+struct MeshCacheBone {
+    uint32_t node;
+    float offset[16];
+};
+
+// animation clip as its name and ranges of the channel table and the key table, the channels' key indices are
+// relative to the clip's first key
+struct MeshCacheClip {
+    uint32_t nameOffset;
+    float duration;
+    uint32_t firstChannel;
+    uint32_t channelCount;
+    uint32_t firstKey;
+    uint32_t keyCount;
+};
+
+// pointers into a mapped cache file, valid while the mapping is
+struct MeshCacheView {
+    const MeshCacheHeader* header = NULL;
+    const MeshCacheRange* ranges = NULL;
+    const MeshCacheTexture* textures = NULL;
+    const MeshCacheNode* nodes = NULL;
+    const MeshCluster* clusters = NULL;
+    const MeshCacheBone* bones = NULL;
+    const MeshCacheClip* clips = NULL;
+    const AnimationChannel* channels = NULL;
+    const AnimationKey* keys = NULL;
+    const char* strings = NULL;
+};
+
+inline string MeshCachePath(const string& sourcePath)
+{
+    return sourcePath + ".meshcache";
+}
+
+// true if every index is below vertexCount
+template<class Index>
+inline bool cacheIndicesInRange(const Index* indices, uint32_t indexCount, uint32_t vertexCount)
+{
+    for (uint32_t i = 0; i < indexCount; i++)
+        if (indices[i] >= vertexCount)
+            return false;
+    return true;
+}
+
+// checks a mapped cache file against the source hash and import flags and points the view into it
+inline bool ReadMeshCache(const unsigned char* data, size_t size, uint64_t sourceHash, uint32_t importFlags, MeshCacheView& view)
+{
+    if (!data || size < sizeof(MeshCacheHeader))
+        return false;
+    const MeshCacheHeader* header = (const MeshCacheHeader*)data;
+    if (header->magic != meshCacheMagic || header->version != meshCacheVersion || header->fileSize != size
+        || header->sourceHash != sourceHash || header->importFlags != importFlags || header->formatSize != sizeof(VertexFormat))
+        return false;
+    if (header->stringsOffset > header->dataOffset || header->dataOffset > size)
+        return false;
+    // the tables have to end where the strings start. the counts are 32 bit and the records small, so the 64 bit
+    // sizes can't wrap
+    uint64_t tablesEnd = sizeof(MeshCacheHeader) + (uint64_t)header->meshCount * sizeof(MeshCacheRange)
+                       + (uint64_t)header->textureCount * sizeof(MeshCacheTexture) + (uint64_t)header->nodeCount * sizeof(MeshCacheNode)
+                       + (uint64_t)header->clusterCount * sizeof(MeshCluster) + (uint64_t)header->boneCount * sizeof(MeshCacheBone)
+                       + (uint64_t)header->clipCount * sizeof(MeshCacheClip) + (uint64_t)header->channelCount * sizeof(AnimationChannel)
+                       + (uint64_t)header->keyCount * sizeof(AnimationKey);
+    if (tablesEnd != header->stringsOffset)
+        return false;
+    // the string table and its padding run up to the packed data and end in a nul, so every offset into it ends
+    // in a nul too
+    uint64_t stringsSize = header->dataOffset - header->stringsOffset;
+    if (stringsSize && data[header->dataOffset - 1] != 0)
+        return false;
+
+    view.header = header;
+    view.ranges = (const MeshCacheRange*)(data + sizeof(MeshCacheHeader));
+    view.textures = (const MeshCacheTexture*)(view.ranges + header->meshCount);
+    view.nodes = (const MeshCacheNode*)(view.textures + header->textureCount);
+    view.strings = (const char*)(data + header->stringsOffset);
+    view.clusters = (const MeshCluster*)(view.nodes + header->nodeCount);
+    view.bones = (const MeshCacheBone*)(view.clusters + header->clusterCount);
+    view.clips = (const MeshCacheClip*)(view.bones + header->boneCount);
+    view.channels = (const AnimationChannel*)(view.clips + header->clipCount);
+    view.keys = (const AnimationKey*)(view.channels + header->channelCount);
+
+    // names, texture types and paths have to be in the string table, parents before their children
+    for (uint32_t i = 0; i < header->nodeCount; i++)
+        if (view.nodes[i].nameOffset >= stringsSize || view.nodes[i].parent < -1 || view.nodes[i].parent >= (int64_t)i)
+            return false;
+    for (uint32_t i = 0; i < header->textureCount; i++)
+        if (view.textures[i].typeOffset >= stringsSize || view.textures[i].pathOffset >= stringsSize)
+            return false;
+    // bones and channels have to point at nodes, and clips at their own channels and keys
+    for (uint32_t i = 0; i < header->boneCount; i++)
+        if (view.bones[i].node >= header->nodeCount)
+            return false;
+    for (uint32_t i = 0; i < header->clipCount; i++)
+    {
+        const MeshCacheClip& clip = view.clips[i];
+        if (clip.nameOffset >= stringsSize)
+            return false;
+        if ((uint64_t)clip.firstChannel + clip.channelCount > header->channelCount || (uint64_t)clip.firstKey + clip.keyCount > header->keyCount)
+            return false;
+        for (uint32_t c = clip.firstChannel; c < clip.firstChannel + clip.channelCount; c++)
+        {
+            const AnimationChannel& channel = view.channels[c];
+            if (channel.node >= header->nodeCount || !channel.translationCount || !channel.rotationCount || !channel.scaleCount
+                || (uint64_t)channel.firstTranslation + channel.translationCount > clip.keyCount
+                || (uint64_t)channel.firstRotation + channel.rotationCount > clip.keyCount
+                || (uint64_t)channel.firstScale + channel.scaleCount > clip.keyCount)
+                return false;
+        }
+    }
+
+    // every range has to lie inside the packed data, its indices below its vertex count, and its detail levels and
+    // clusters inside its indices, so nothing drawn, bounded or simplified from the cache reads past its arrays
+    for (uint32_t i = 0; i < header->meshCount; i++)
+    {
+        const MeshCacheRange& range = view.ranges[i];
+        uint64_t vertexBytes = (uint64_t)range.vertexCount * range.format.stride;
+        uint64_t indexBytes = (uint64_t)range.indexCount * range.format.IndexSize();
+        if (range.vertexOffset < header->dataOffset || range.vertexOffset > size || vertexBytes > size - range.vertexOffset
+            || range.indexOffset < header->dataOffset || range.indexOffset > size || indexBytes > size - range.indexOffset
+            || (uint64_t)range.firstTexture + range.textureCount > header->textureCount || range.lodCount > maxMeshLods
+            || (header->nodeCount && range.node >= header->nodeCount)
+            || (uint64_t)range.firstCluster + range.clusterCount > header->clusterCount)
+            return false;
+        for (uint32_t l = 0; l < range.lodCount; l++)
+            if ((uint64_t)range.lods[l].firstIndex + range.lods[l].indexCount > range.indexCount)
+                return false;
+        for (uint32_t c = range.firstCluster; c < range.firstCluster + range.clusterCount; c++)
+            if ((uint64_t)view.clusters[c].firstIndex + view.clusters[c].indexCount > range.indexCount)
+                return false;
+        bool indicesValid = range.format.indexType == GL_UNSIGNED_SHORT
+            ? cacheIndicesInRange((const uint16_t*)(data + range.indexOffset), range.indexCount, range.vertexCount)
+            : cacheIndicesInRange((const uint32_t*)(data + range.indexOffset), range.indexCount, range.vertexCount);
+        if (!indicesValid)
+            return false;
+    }
+    return true;
+}
+
+inline uint64_t alignCacheOffset(uint64_t offset)
+{
+    return (offset + 15) & ~15ull;
+}
+
+// writes the meshes' packed arrays with the model's nodes, skeleton and clips, replacing any older cache
+inline bool WriteMeshCache(const string& cachePath, uint64_t sourceHash, uint32_t importFlags, const vector<MeshData>& meshes, const NodeHierarchy& hierarchy,
+                           const vector<SkinBone>& skeleton, const vector<AnimationClip>& animations)
+{
+    vector<MeshCacheRange> ranges;
+    vector<MeshCacheTexture> textures;
+    vector<MeshCacheNode> nodes;
+    vector<MeshCluster> clusters;
+    vector<MeshCacheBone> bones;
+    vector<MeshCacheClip> clips;
+    vector<AnimationChannel> channels;
+    vector<AnimationKey> keys;
+    string strings;
+    for (unsigned int n = 0; n < hierarchy.Size(); n++)
+    {
+        MeshCacheNode node;
+        node.parent = hierarchy.Parent(n);
+        node.nameOffset = (uint32_t)strings.size();
+        strings.append(hierarchy.Name(n).c_str(), hierarchy.Name(n).size() + 1);
+        memcpy(node.local, &hierarchy.Local(n)[0][0], sizeof(node.local));
+        nodes.push_back(node);
+    }
+    for (const MeshData& mesh : meshes)
+    {
+        MeshCacheRange range = MeshCacheRange();
+        range.format = mesh.format;
+        range.vertexCount = (uint32_t)mesh.VertexCount();
+        range.indexCount = (uint32_t)mesh.IndexCount();
+        range.firstTexture = (uint32_t)textures.size();
+        range.textureCount = (uint32_t)mesh.textures.size();
+        range.lodCount = (uint32_t)min(mesh.lods.size(), (size_t)maxMeshLods);
+        for (uint32_t l = 0; l < range.lodCount; l++)
+            range.lods[l] = mesh.lods[l];
+        range.node = mesh.node;
+        range.bounds = mesh.bounds;
+        range.firstCluster = (uint32_t)clusters.size();
+        range.clusterCount = (uint32_t)mesh.clusters.size();
+        range.uvDensity = mesh.uvDensity;
+        clusters.insert(clusters.end(), mesh.clusters.begin(), mesh.clusters.end());
+        for (const Texture& texture : mesh.textures)
+        {
+            MeshCacheTexture reference;
+            reference.typeOffset = (uint32_t)strings.size();
+            strings.append(texture.type.c_str(), texture.type.size() + 1);
+            reference.pathOffset = (uint32_t)strings.size();
+            strings.append(texture.path.c_str(), texture.path.size() + 1);
+            textures.push_back(reference);
+        }
+        ranges.push_back(range);
+    }
+    for (const SkinBone& skinBone : skeleton)
+    {
+        MeshCacheBone bone;
+        bone.node = skinBone.node;
+        memcpy(bone.offset, &skinBone.offset[0][0], sizeof(bone.offset));
+        bones.push_back(bone);
+    }
+    for (const AnimationClip& animation : animations)
+    {
+        MeshCacheClip clip;
+        clip.nameOffset = (uint32_t)strings.size();
+        strings.append(animation.name.c_str(), animation.name.size() + 1);
+        clip.duration = animation.duration;
+        clip.firstChannel = (uint32_t)channels.size();
+        clip.channelCount = (uint32_t)animation.channels.size();
+        clip.firstKey = (uint32_t)keys.size();
+        clip.keyCount = (uint32_t)animation.keys.size();
+        channels.insert(channels.end(), animation.channels.begin(), animation.channels.end());
+        keys.insert(keys.end(), animation.keys.begin(), animation.keys.end());
+        clips.push_back(clip);
+    }
+
+    MeshCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = meshCacheMagic;
+    header.version = meshCacheVersion;
+    header.sourceHash = sourceHash;
+    header.importFlags = importFlags;
+    header.formatSize = sizeof(VertexFormat);
+    header.meshCount = (uint32_t)ranges.size();
+    header.textureCount = (uint32_t)textures.size();
+    header.nodeCount = (uint32_t)nodes.size();
+    header.clusterCount = (uint32_t)clusters.size();
+    header.boneCount = (uint32_t)bones.size();
+    header.clipCount = (uint32_t)clips.size();
+    header.channelCount = (uint32_t)channels.size();
+    header.keyCount = (uint32_t)keys.size();
+    header.stringsOffset = sizeof(MeshCacheHeader) + ranges.size() * sizeof(MeshCacheRange) + textures.size() * sizeof(MeshCacheTexture)
+                         + nodes.size() * sizeof(MeshCacheNode) + clusters.size() * sizeof(MeshCluster) + bones.size() * sizeof(MeshCacheBone)
+                         + clips.size() * sizeof(MeshCacheClip) + channels.size() * sizeof(AnimationChannel) + keys.size() * sizeof(AnimationKey);
+    header.dataOffset = alignCacheOffset(header.stringsOffset + strings.size());
+    uint64_t offset = header.dataOffset;
+    for (size_t i = 0; i < meshes.size(); i++)
+    {
+        ranges[i].vertexOffset = offset;
+        offset = alignCacheOffset(offset + meshes[i].VertexBytes());
+        ranges[i].indexOffset = offset;
+        offset = alignCacheOffset(offset + meshes[i].IndexBytes());
+    }
+    header.fileSize = offset;
+
+    // written under a temporary name of its own so a half written cache is never picked up
+    string temporaryPath = TemporaryCachePath(cachePath);
+    bool complete;
+    {
+        ofstream file(temporaryPath, ios::binary | ios::trunc);
+        if (!file)
+            return false;
+        file.write((const char*)&header, sizeof(header));
+        if (!ranges.empty())
+            file.write((const char*)&ranges[0], ranges.size() * sizeof(MeshCacheRange));
+        if (!textures.empty())
+            file.write((const char*)&textures[0], textures.size() * sizeof(MeshCacheTexture));
+        if (!nodes.empty())
+            file.write((const char*)&nodes[0], nodes.size() * sizeof(MeshCacheNode));
+        if (!clusters.empty())
+            file.write((const char*)&clusters[0], clusters.size() * sizeof(MeshCluster));
+        if (!bones.empty())
+            file.write((const char*)&bones[0], bones.size() * sizeof(MeshCacheBone));
+        if (!clips.empty())
+            file.write((const char*)&clips[0], clips.size() * sizeof(MeshCacheClip));
+        if (!channels.empty())
+            file.write((const char*)&channels[0], channels.size() * sizeof(AnimationChannel));
+        if (!keys.empty())
+            file.write((const char*)&keys[0], keys.size() * sizeof(AnimationKey));
+        file.write(strings.data(), strings.size());
+        static const char padding[16] = {};
+        uint64_t written = header.stringsOffset + strings.size();
+        for (size_t i = 0; i < meshes.size(); i++)
+        {
+            file.write(padding, ranges[i].vertexOffset - written);
+            file.write((const char*)meshes[i].VertexData(), meshes[i].VertexBytes());
+            written = ranges[i].vertexOffset + meshes[i].VertexBytes();
+            file.write(padding, ranges[i].indexOffset - written);
+            file.write((const char*)meshes[i].IndexData(), meshes[i].IndexBytes());
+            written = ranges[i].indexOffset + meshes[i].IndexBytes();
+        }
+        file.write(padding, header.fileSize - written);
+        complete = (bool)file;
+    }
+    if (!complete)
+    {
+        remove(temporaryPath.c_str());
+        return false;
+    }
+    return CommitCacheFile(temporaryPath, cachePath);
+}
+#endif
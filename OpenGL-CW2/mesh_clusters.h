@@ -0,0 +1,224 @@
+#ifndef MESH_CLUSTERS_H
+#define MESH_CLUSTERS_H
+
+#include <glm/glm.hpp>
+
+#include "bounding_volume.h"
+#include "mesh.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <vector>
+using namespace std;
+
+// import stage run after the levels of detail: groups the full detail triangles into clusters of neighbouring,
+// similarly facing triangles and gives each its bounds and normal cone, so the parts of a big mesh that are off
+// screen or face away can be skipped (cluster_culling.h)
+
+// triangles a cluster has at least (unless it runs out of neighbours) and at most
+const unsigned int meshClusterTriangles = 64;
+const unsigned int meshClusterMaxTriangles = 128;
+// past the minimum, a cluster stops growing once its best neighbour faces further than this (cosine) from its
+// average normal, which keeps its cone narrow enough to be culled when it faces away
+const float meshClusterConeSpread = 0.85f;
+// a cluster whose triangles face further apart than this (cosine to the axis) can always be seen from somewhere
+const float meshClusterMinimumConeDot = 0.1f;
+// how much facing a neighbour gives up per cluster radius it lies from the cluster's centre, so clusters stay round
+const float meshClusterDistanceWeight = 0.25f;
+
+namespace meshclusters
+{
+    // triangles using each vertex, as ranges of one array
+    struct VertexTriangles {
+        vector<unsigned int> offsets;
+        vector<unsigned int> triangles;
+    };
+
+    // the first vertex at each vertex's position. vertices split along normal or texture seams are still neighbours
+    inline vector<unsigned int> positionRemap(const vector<Vertex>& vertices)
+    {
+        vector<unsigned int> order(vertices.size()), remap(vertices.size());
+        for (size_t v = 0; v < order.size(); v++)
+            order[v] = (unsigned int)v;
+        auto less = [&](unsigned int a, unsigned int b)
+        {
+            const glm::vec3& p = vertices[a].Position;
+            const glm::vec3& q = vertices[b].Position;
+            return p.x != q.x ? p.x < q.x : (p.y != q.y ? p.y < q.y : p.z < q.z);
+        };
+        sort(order.begin(), order.end(), less);
+        for (size_t i = 0; i < order.size(); i++)
+            remap[order[i]] = i > 0 && vertices[order[i]].Position == vertices[order[i - 1]].Position ? remap[order[i - 1]] : order[i];
+        return remap;
+    }
+
+    inline void buildVertexTriangles(const unsigned int* indices, size_t triangleCount, const vector<unsigned int>& remap, VertexTriangles& adjacency)
+    {
+        adjacency.offsets.assign(remap.size() + 1, 0);
+        for (size_t i = 0; i < triangleCount * 3; i++)
+            adjacency.offsets[remap[indices[i]] + 1]++;
+        for (size_t v = 0; v < remap.size(); v++)
+            adjacency.offsets[v + 1] += adjacency.offsets[v];
+        adjacency.triangles.resize(triangleCount * 3);
+        vector<unsigned int> filled(adjacency.offsets.begin(), adjacency.offsets.end() - 1);
+        for (size_t i = 0; i < triangleCount * 3; i++)
+            adjacency.triangles[filled[remap[indices[i]]]++] = (unsigned int)(i / 3);
+    }
+
+    // bounds and normal cone of the triangles in a range of the indices
+    inline void finishCluster(const MeshData& mesh, const vector<glm::vec3>& normals, MeshCluster& cluster)
+    {
+        vector<glm::vec3> corners(cluster.indexCount);
+        glm::vec3 normalSum(0.0f);
+        for (uint32_t i = 0; i < cluster.indexCount; i++)
+            corners[i] = mesh.vertices[mesh.indices[cluster.firstIndex + i]].Position;
+        for (uint32_t i = 0; i < cluster.indexCount; i += 3)
+            normalSum += normals[(cluster.firstIndex + i) / 3];
+        cluster.bounds = BoundPoints(&corners[0], corners.size(), sizeof(glm::vec3));
+
+        float length = glm::length(normalSum);
+        cluster.coneAxis = length > 0.0f ? normalSum / length : glm::vec3(0.0f, 0.0f, 1.0f);
+        float minimumDot = length > 0.0f ? 1.0f : -1.0f;
+        for (uint32_t i = 0; i < cluster.indexCount; i += 3)
+        {
+            const glm::vec3& normal = normals[(cluster.firstIndex + i) / 3];
+            // degenerate triangles have no side to face away with
+            if (normal != glm::vec3(0.0f))
+                minimumDot = min(minimumDot, glm::dot(normal, cluster.coneAxis));
+        }
+        cluster.coneCutoff = minimumDot < meshClusterMinimumConeDot ? 1.0f : sqrt(max(0.0f, 1.0f - minimumDot * minimumDot));
+    }
+}
+
+// regroups the full detail indices into clusters and fills mesh.clusters. a cluster starts at a neighbour of the
+// last one (or the first triangle left) and grows through triangles sharing a vertex position with it, taking the one facing
+// closest to its average normal and nearest its centre each time. its triangles keep their order from the cache
+// optimiser, the coarser levels after the full one are left as they are. needs the mesh's bounds
+inline void BuildMeshClusters(MeshData& mesh)
+{
+    mesh.clusters.clear();
+    size_t triangleCount = (mesh.lods.empty() ? mesh.indices.size() : mesh.lods[0].indexCount) / 3;
+    if (triangleCount == 0)
+        return;
+    const unsigned int* indices = &mesh.indices[0];
+
+    vector<glm::vec3> normals(triangleCount), centroids(triangleCount);
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        const glm::vec3& a = mesh.vertices[indices[t * 3]].Position;
+        const glm::vec3& b = mesh.vertices[indices[t * 3 + 1]].Position;
+        const glm::vec3& c = mesh.vertices[indices[t * 3 + 2]].Position;
+        glm::vec3 normal = glm::cross(b - a, c - a);
+        float length = glm::length(normal);
+        normals[t] = length > 0.0f ? normal / length : glm::vec3(0.0f);
+        centroids[t] = (a + b + c) / 3.0f;
+    }
+    vector<unsigned int> remap = meshclusters::positionRemap(mesh.vertices);
+    meshclusters::VertexTriangles adjacency;
+    meshclusters::buildVertexTriangles(indices, triangleCount, remap, adjacency);
+
+    // a full cluster on a round surface covers about its share of a sphere around the mesh
+    float expectedRadius = 2.0f * mesh.bounds.radius * sqrt((float)meshClusterMaxTriangles / triangleCount);
+    expectedRadius = expectedRadius > 0.0f ? expectedRadius : 1.0f;
+
+    vector<unsigned char> assigned(triangleCount, 0);
+    // cluster a triangle was last made a candidate of, so candidates are listed once
+    vector<unsigned int> candidateOf(triangleCount, UINT_MAX);
+    vector<unsigned int> ordered, members, candidates;
+    ordered.reserve(triangleCount * 3);
+    size_t firstLeft = 0;
+    for (unsigned int clusterIndex = 0;; clusterIndex++)
+    {
+        unsigned int seed = UINT_MAX;
+        for (unsigned int candidate : candidates)
+            if (!assigned[candidate])
+            {
+                seed = candidate;
+                break;
+            }
+        if (seed == UINT_MAX)
+        {
+            while (firstLeft < triangleCount && assigned[firstLeft])
+                firstLeft++;
+            if (firstLeft == triangleCount)
+                break;
+            seed = (unsigned int)firstLeft;
+        }
+
+        members.clear();
+        candidates.clear();
+        glm::vec3 normalSum(0.0f), centroidSum(0.0f);
+        auto add = [&](unsigned int t)
+        {
+            assigned[t] = 1;
+            members.push_back(t);
+            normalSum += normals[t];
+            centroidSum += centroids[t];
+            for (int k = 0; k < 3; k++)
+            {
+                unsigned int v = remap[indices[t * 3 + k]];
+                for (unsigned int a = adjacency.offsets[v]; a < adjacency.offsets[v + 1]; a++)
+                {
+                    unsigned int neighbour = adjacency.triangles[a];
+                    if (!assigned[neighbour] && candidateOf[neighbour] != clusterIndex)
+                    {
+                        candidateOf[neighbour] = clusterIndex;
+                        candidates.push_back(neighbour);
+                    }
+                }
+            }
+        };
+        add(seed);
+
+        while (members.size() < meshClusterMaxTriangles)
+        {
+            float axisLength = glm::length(normalSum);
+            glm::vec3 axis = axisLength > 0.0f ? normalSum / axisLength : glm::vec3(0.0f);
+            glm::vec3 center = centroidSum / (float)members.size();
+            size_t kept = 0;
+            unsigned int best = UINT_MAX;
+            float bestScore = -1e30f, bestFacing = 0.0f;
+            for (unsigned int candidate : candidates)
+            {
+                if (assigned[candidate])
+                    continue;
+                candidates[kept++] = candidate;
+                float facing = axisLength > 0.0f && normals[candidate] != glm::vec3(0.0f) ? glm::dot(normals[candidate], axis) : 1.0f;
+                float score = facing - meshClusterDistanceWeight * glm::length(centroids[candidate] - center) / expectedRadius;
+                if (score > bestScore)
+                {
+                    bestScore = score;
+                    bestFacing = facing;
+                    best = candidate;
+                }
+            }
+            candidates.resize(kept);
+            if (best == UINT_MAX || (members.size() >= meshClusterTriangles && bestFacing < meshClusterConeSpread))
+                break;
+            add(best);
+        }
+
+        // cache order within the cluster
+        sort(members.begin(), members.end());
+        MeshCluster cluster;
+        cluster.firstIndex = (uint32_t)ordered.size();
+        cluster.indexCount = (uint32_t)members.size() * 3;
+        for (unsigned int t : members)
+            ordered.insert(ordered.end(), indices + t * 3, indices + t * 3 + 3);
+        mesh.clusters.push_back(cluster);
+    }
+
+    copy(ordered.begin(), ordered.end(), mesh.indices.begin());
+    // the triangle normals follow the new order
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        const glm::vec3& a = mesh.vertices[indices[t * 3]].Position;
+        glm::vec3 normal = glm::cross(mesh.vertices[indices[t * 3 + 1]].Position - a, mesh.vertices[indices[t * 3 + 2]].Position - a);
+        float length = glm::length(normal);
+        normals[t] = length > 0.0f ? normal / length : glm::vec3(0.0f);
+    }
+    for (MeshCluster& cluster : mesh.clusters)
+        meshclusters::finishCluster(mesh, normals, cluster);
+}
+#endif
@@ -0,0 +1,321 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <glm/glm.hpp>
+
+#include "mesh.h"
+#include "mesh_cache.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+using namespace std;
+
+// import stage run on a mesh's full vertices before they are packed: welds identical vertices, orders the
+// triangles for the post-transform vertex cache and then for overdraw, and finally orders the vertices by
+// first use so fetches walk the vertex buffer forwards
+
+// size of the FIFO cache ACMR is measured against, about what current GPUs reuse across a batch
+const unsigned int meshCacheSimulationSize = 16;
+
+// vertices, indices and average cache miss ratio (vertex shader runs per triangle) of a mesh
+struct MeshShape {
+    size_t vertices = 0;
+    size_t indices = 0;
+    float acmr = 0.0f;
+};
+
+struct MeshOptimizeStats {
+    MeshShape before;
+    MeshShape after;
+};
+
+namespace meshoptimize
+{
+    // vertex shader runs per triangle with a FIFO post-transform cache, 3 is no reuse at all, 0.5 the best a
+    // regular grid can do
+    inline float acmr(const vector<unsigned int>& indices, size_t vertexCount, unsigned int cacheSize = meshCacheSimulationSize)
+    {
+        if (indices.size() < 3)
+            return 0.0f;
+        // a vertex is in the cache while it was added within the last cacheSize misses
+        vector<size_t> addedAt(vertexCount, 0);
+        size_t misses = 0;
+        for (unsigned int index : indices)
+        {
+            if (addedAt[index] == 0 || misses - addedAt[index] >= cacheSize)
+                addedAt[index] = ++misses;
+        }
+        return (float)misses / (float)(indices.size() / 3);
+    }
+
+    // merges bitwise identical vertices. Vertex has no padding and the importer zeroes what it doesn't fill
+    inline void weld(vector<Vertex>& vertices, vector<unsigned int>& indices)
+    {
+        size_t tableSize = 1;
+        while (tableSize < vertices.size() * 2)
+            tableSize <<= 1;
+        const unsigned int empty = ~0u;
+        vector<unsigned int> table(tableSize, empty);
+        vector<unsigned int> remap(vertices.size());
+        vector<Vertex> unique;
+        unique.reserve(vertices.size());
+        for (size_t i = 0; i < vertices.size(); i++)
+        {
+            size_t slot = (size_t)HashBytes(&vertices[i], sizeof(Vertex)) & (tableSize - 1);
+            while (table[slot] != empty && memcmp(&unique[table[slot]], &vertices[i], sizeof(Vertex)) != 0)
+                slot = (slot + 1) & (tableSize - 1);
+            if (table[slot] == empty)
+            {
+                table[slot] = (unsigned int)unique.size();
+                unique.push_back(vertices[i]);
+            }
+            remap[i] = table[slot];
+        }
+        for (unsigned int& index : indices)
+            index = remap[index];
+        vertices.swap(unique);
+    }
+
+    // Tom Forsyth's linear speed vertex cache optimisation: greedily emits the triangle whose vertices score
+    // highest, recently used vertices and vertices with few triangles left score high
+    const int forsythCacheSize = 32;
+
+    inline float forsythScore(int cachePosition, int liveTriangles)
+    {
+        if (liveTriangles == 0)
+            return -1.0f;
+        float score = 0.0f;
+        if (cachePosition >= 0)
+        {
+            // the last triangle's vertices get a fixed score so the next triangle doesn't just reuse an edge
+            if (cachePosition < 3)
+                score = 0.75f;
+            else
+                score = pow(1.0f - (float)(cachePosition - 3) / (forsythCacheSize - 3), 1.5f);
+        }
+        // finishing off vertices with few triangles left frees them from the cache
+        return score + 2.0f / sqrt((float)liveTriangles);
+    }
+
+    inline void optimizeVertexCache(vector<unsigned int>& indices, size_t vertexCount)
+    {
+        size_t triangleCount = indices.size() / 3;
+        if (triangleCount == 0)
+            return;
+
+        // triangles of each vertex, as ranges into one array
+        vector<unsigned int> liveTriangles(vertexCount, 0);
+        for (unsigned int index : indices)
+            liveTriangles[index]++;
+        vector<unsigned int> firstTriangle(vertexCount + 1, 0);
+        for (size_t v = 0; v < vertexCount; v++)
+            firstTriangle[v + 1] = firstTriangle[v] + liveTriangles[v];
+        vector<unsigned int> vertexTriangles(indices.size());
+        vector<unsigned int> filled(firstTriangle.begin(), firstTriangle.end() - 1);
+        for (size_t i = 0; i < indices.size(); i++)
+            vertexTriangles[filled[indices[i]]++] = (unsigned int)(i / 3);
+
+        vector<int> cachePosition(vertexCount, -1);
+        vector<float> vertexScore(vertexCount);
+        for (size_t v = 0; v < vertexCount; v++)
+            vertexScore[v] = forsythScore(-1, liveTriangles[v]);
+
+        vector<char> emitted(triangleCount, 0);
+        vector<unsigned int> result;
+        result.reserve(indices.size());
+        // one slot past the cache size to hold what gets pushed out
+        vector<unsigned int> cache, nextCache;
+        cache.reserve(forsythCacheSize + 3);
+        nextCache.reserve(forsythCacheSize + 3);
+        size_t cursor = 0;
+        long best = -1;
+
+        for (size_t emittedCount = 0; emittedCount < triangleCount; emittedCount++)
+        {
+            // nothing in the cache has triangles left, start over at the next unused triangle
+            if (best < 0)
+            {
+                while (emitted[cursor])
+                    cursor++;
+                best = (long)cursor;
+            }
+
+            unsigned int* triangle = &indices[best * 3];
+            emitted[best] = 1;
+            result.insert(result.end(), triangle, triangle + 3);
+
+            // the emitted triangle's vertices move to the front of the LRU cache
+            nextCache.assign(triangle, triangle + 3);
+            for (unsigned int vertex : cache)
+                if (vertex != triangle[0] && vertex != triangle[1] && vertex != triangle[2])
+                    nextCache.push_back(vertex);
+            for (int k = 0; k < 3; k++)
+            {
+                unsigned int vertex = triangle[k];
+                unsigned int* begin = &vertexTriangles[firstTriangle[vertex]];
+                unsigned int* end = begin + liveTriangles[vertex];
+                *find(begin, end, (unsigned int)best) = *(end - 1);
+                liveTriangles[vertex]--;
+            }
+
+            // rescore the vertices that moved and the triangles using them, the best of those goes next
+            best = -1;
+            float bestScore = -1.0f;
+            for (size_t i = 0; i < nextCache.size(); i++)
+            {
+                unsigned int vertex = nextCache[i];
+                cachePosition[vertex] = i < (size_t)forsythCacheSize ? (int)i : -1;
+                vertexScore[vertex] = forsythScore(cachePosition[vertex], liveTriangles[vertex]);
+            }
+            for (size_t i = 0; i < nextCache.size(); i++)
+            {
+                unsigned int vertex = nextCache[i];
+                for (unsigned int j = 0; j < liveTriangles[vertex]; j++)
+                {
+                    unsigned int t = vertexTriangles[firstTriangle[vertex] + j];
+                    float score = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+                    if (score > bestScore)
+                    {
+                        bestScore = score;
+                        best = (long)t;
+                    }
+                }
+            }
+            if (nextCache.size() > (size_t)forsythCacheSize)
+                nextCache.resize(forsythCacheSize);
+            cache.swap(nextCache);
+        }
+        indices.swap(result);
+    }
+
+    // splits the cache ordered triangles into clusters at points where the cache starts over (or reuse is still
+    // close to the whole mesh's), then draws outward facing clusters first so they occlude the rest. threshold
+    // is how much worse than the input ACMR the result may get
+    inline void optimizeOverdraw(vector<unsigned int>& indices, const vector<Vertex>& vertices, float threshold = 1.05f)
+    {
+        size_t triangleCount = indices.size() / 3;
+        if (triangleCount < 2)
+            return;
+        float targetAcmr = acmr(indices, vertices.size()) * threshold;
+
+        vector<size_t> clusterStarts(1, 0);
+        vector<size_t> addedAt(vertices.size(), 0);
+        size_t misses = 0, clusterMisses = 0;
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            int triangleMisses = 0;
+            for (int k = 0; k < 3; k++)
+            {
+                unsigned int index = indices[t * 3 + k];
+                if (addedAt[index] == 0 || misses - addedAt[index] >= meshCacheSimulationSize)
+                {
+                    addedAt[index] = ++misses;
+                    triangleMisses++;
+                }
+            }
+            size_t clusterTriangles = t - clusterStarts.back();
+            // a triangle missing on all three vertices restarts the cache anyway; splitting where the cluster's reuse
+            // is already good enough costs little
+            bool hardBoundary = triangleMisses == 3 && clusterTriangles > 0;
+            bool softBoundary = clusterTriangles >= 64 && (float)clusterMisses / clusterTriangles <= targetAcmr;
+            if (hardBoundary || softBoundary)
+            {
+                clusterStarts.push_back(t);
+                clusterMisses = 0;
+            }
+            clusterMisses += triangleMisses;
+        }
+        if (clusterStarts.size() < 2)
+            return;
+        clusterStarts.push_back(triangleCount);
+
+        glm::vec3 meshCenter(0.0f);
+        for (const Vertex& vertex : vertices)
+            meshCenter += vertex.Position;
+        meshCenter /= (float)max<size_t>(vertices.size(), 1);
+
+        // clusters facing away from the centre are on the outside and drawn first
+        size_t clusterCount = clusterStarts.size() - 1;
+        vector<float> sortKey(clusterCount);
+        for (size_t c = 0; c < clusterCount; c++)
+        {
+            glm::vec3 centroid(0.0f), normal(0.0f);
+            float area = 0.0f;
+            for (size_t t = clusterStarts[c]; t < clusterStarts[c + 1]; t++)
+            {
+                const glm::vec3& a = vertices[indices[t * 3]].Position;
+                const glm::vec3& b = vertices[indices[t * 3 + 1]].Position;
+                const glm::vec3& d = vertices[indices[t * 3 + 2]].Position;
+                glm::vec3 weighted = glm::cross(b - a, d - a);
+                float triangleArea = glm::length(weighted);
+                centroid += (a + b + d) * (triangleArea / 3.0f);
+                normal += weighted;
+                area += triangleArea;
+            }
+            centroid = area > 0.0f ? centroid / area : vertices[indices[clusterStarts[c] * 3]].Position;
+            float normalLength = glm::length(normal);
+            sortKey[c] = normalLength > 0.0f ? glm::dot(centroid - meshCenter, normal / normalLength) : 0.0f;
+        }
+        vector<size_t> order(clusterCount);
+        for (size_t c = 0; c < clusterCount; c++)
+            order[c] = c;
+        stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sortKey[a] > sortKey[b]; });
+
+        vector<unsigned int> result;
+        result.reserve(indices.size());
+        for (size_t c : order)
+            result.insert(result.end(), indices.begin() + clusterStarts[c] * 3, indices.begin() + clusterStarts[c + 1] * 3);
+        indices.swap(result);
+    }
+
+    // renumbers the vertices in the order the indices first use them, dropping unused ones
+    inline void optimizeVertexFetch(vector<Vertex>& vertices, vector<unsigned int>& indices)
+    {
+        const unsigned int unused = ~0u;
+        vector<unsigned int> remap(vertices.size(), unused);
+        vector<Vertex> ordered;
+        ordered.reserve(vertices.size());
+        for (unsigned int& index : indices)
+        {
+            if (remap[index] == unused)
+            {
+                remap[index] = (unsigned int)ordered.size();
+                ordered.push_back(vertices[index]);
+            }
+            index = remap[index];
+        }
+        vertices.swap(ordered);
+    }
+}
+
+// runs the whole stage on a mesh's full vertices, before PackMeshData
+inline MeshOptimizeStats OptimizeMeshData(MeshData& mesh)
+{
+    MeshOptimizeStats stats;
+    stats.before.vertices = mesh.vertices.size();
+    stats.before.indices = mesh.indices.size();
+    stats.before.acmr = meshoptimize::acmr(mesh.indices, mesh.vertices.size());
+
+    // PackMeshData drops the tangents of meshes without a normal map, they mustn't keep vertices apart
+    bool tangents = false;
+    for (const Texture& texture : mesh.textures)
+        tangents |= texture.type == "texture_normal";
+    if (!tangents)
+    {
+        for (Vertex& vertex : mesh.vertices)
+            vertex.Tangent = vertex.Bitangent = glm::vec3(0.0f);
+    }
+
+    meshoptimize::weld(mesh.vertices, mesh.indices);
+    meshoptimize::optimizeVertexCache(mesh.indices, mesh.vertices.size());
+    meshoptimize::optimizeOverdraw(mesh.indices, mesh.vertices);
+    meshoptimize::optimizeVertexFetch(mesh.vertices, mesh.indices);
+
+    stats.after.vertices = mesh.vertices.size();
+    stats.after.indices = mesh.indices.size();
+    stats.after.acmr = meshoptimize::acmr(mesh.indices, mesh.vertices.size());
+    return stats;
+}
+#endif
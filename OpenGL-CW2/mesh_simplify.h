@@ -0,0 +1,507 @@
+#ifndef MESH_SIMPLIFY_H
+#define MESH_SIMPLIFY_H
+
+#include <glm/glm.hpp>
+
+#include "mesh.h"
+#include "mesh_optimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+// import stage run after OptimizeMeshData: builds coarser levels of detail by quadric error edge collapse
+// (Garland and Heckbert). a collapse moves every vertex at one position onto a neighbouring position's vertices,
+// so each level reuses the mesh's vertex buffer and only adds indices. UV seams and open borders only move along
+// themselves, so they keep their shape and textures don't tear. hard (normal only) edges may collapse, the moved
+// corners take the normal of the target vertex on their own side
+
+// each level aims for this share of the previous level's triangles
+const float meshLodReduction = 0.5f;
+// a level is only kept when it gets rid of at least this share of the previous level's triangles
+const float meshLodMinimumReduction = 0.2f;
+// meshes with fewer triangles aren't worth simplifying any further
+const size_t meshLodMinimumTriangles = 64;
+// largest error a collapse may add, as a share of the mesh's size
+const float meshLodMaximumError = 0.05f;
+// how much a difference in normals and texture coordinates counts against a collapse, next to the distance
+const float meshLodAttributeWeight = 0.5f;
+
+struct MeshLodStats {
+    vector<size_t> triangles;
+};
+
+namespace meshsimplify
+{
+    // symmetric quadric p'Ap + 2b'p + c summed over planes, weight is the summed area so error() is an average
+    // squared distance rather than growing with the number of planes
+    struct Quadric {
+        double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+        double b0 = 0, b1 = 0, b2 = 0, c = 0;
+        double weight = 0;
+
+        void AddPlane(const glm::dvec3& normal, double distance, double planeWeight)
+        {
+            a00 += normal.x * normal.x * planeWeight; a01 += normal.x * normal.y * planeWeight; a02 += normal.x * normal.z * planeWeight;
+            a11 += normal.y * normal.y * planeWeight; a12 += normal.y * normal.z * planeWeight; a22 += normal.z * normal.z * planeWeight;
+            b0 += normal.x * distance * planeWeight; b1 += normal.y * distance * planeWeight; b2 += normal.z * distance * planeWeight;
+            c += distance * distance * planeWeight;
+            weight += planeWeight;
+        }
+
+        void Add(const Quadric& other)
+        {
+            a00 += other.a00; a01 += other.a01; a02 += other.a02; a11 += other.a11; a12 += other.a12; a22 += other.a22;
+            b0 += other.b0; b1 += other.b1; b2 += other.b2; c += other.c;
+            weight += other.weight;
+        }
+
+        double Error(const glm::dvec3& p) const
+        {
+            double error = p.x * (a00 * p.x + 2.0 * (a01 * p.y + a02 * p.z + b0)) + p.y * (a11 * p.y + 2.0 * (a12 * p.z + b1))
+                         + p.z * (a22 * p.z + 2.0 * b2) + c;
+            return weight > 0.0 ? fabs(error) / weight : 0.0;
+        }
+    };
+
+    // border and seam edges are held in place by a plane through them at right angles to their triangle,
+    // weighted more heavily than the surface so a collapse can't pull them inwards
+    const double boundaryWeight = 10.0;
+
+    inline uint64_t edgeKey(unsigned int a, unsigned int b)
+    {
+        return a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+    }
+
+    // distance from p to the closest point of triangle abc (Ericson, Real-Time Collision Detection 5.1.5)
+    inline double pointTriangleDistance(const glm::dvec3& p, const glm::dvec3& a, const glm::dvec3& b, const glm::dvec3& c)
+    {
+        glm::dvec3 ab = b - a, ac = c - a, ap = p - a;
+        double d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+        if (d1 <= 0.0 && d2 <= 0.0)
+            return glm::length(ap);
+        glm::dvec3 bp = p - b;
+        double d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+        if (d3 >= 0.0 && d4 <= d3)
+            return glm::length(bp);
+        double vc = d1 * d4 - d3 * d2;
+        if (vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0)
+            return glm::length(ap - ab * (d1 / (d1 - d3)));
+        glm::dvec3 cp = p - c;
+        double d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+        if (d6 >= 0.0 && d5 <= d6)
+            return glm::length(cp);
+        double vb = d5 * d2 - d1 * d6;
+        if (vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0)
+            return glm::length(ap - ac * (d2 / (d2 - d6)));
+        double va = d3 * d6 - d5 * d4;
+        if (va <= 0.0 && d4 - d3 >= 0.0 && d5 - d6 >= 0.0)
+            return glm::length(bp - (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6))));
+        double denominator = 1.0 / (va + vb + vc);
+        return glm::length(ap - ab * (vb * denominator) - ac * (vc * denominator));
+    }
+
+    struct Collapse {
+        unsigned int from;
+        unsigned int to;
+        double cost;
+    };
+}
+
+// simplifies one mesh step by step, keeping the quadrics between calls so every level continues from the last.
+// works in a copy of the positions scaled to a unit box, errors come back in the mesh's own units
+class MeshSimplifier
+{
+public:
+    MeshSimplifier(const vector<Vertex>& vertices, const vector<unsigned int>& indices) : vertices(vertices), indices(indices)
+    {
+        glm::vec3 low(0.0f), high(0.0f);
+        if (!vertices.empty())
+        {
+            low = high = vertices[0].Position;
+            for (const Vertex& vertex : vertices)
+            {
+                low = glm::min(low, vertex.Position);
+                high = glm::max(high, vertex.Position);
+            }
+        }
+        glm::vec3 size = high - low;
+        extent = max(max(size.x, size.y), max(size.z, 1e-6f));
+
+        // vertices at the same position are wedges of one position, they collapse together. sorted by position, then
+        // by texture coordinates
+        vector<unsigned int> order(vertices.size());
+        for (size_t i = 0; i < order.size(); i++)
+            order[i] = (unsigned int)i;
+        sort(order.begin(), order.end(), [&vertices](unsigned int a, unsigned int b)
+        {
+            const glm::vec3 &p = vertices[a].Position, &q = vertices[b].Position;
+            const glm::vec2 &s = vertices[a].TexCoords, &t = vertices[b].TexCoords;
+            return p.x != q.x ? p.x < q.x : (p.y != q.y ? p.y < q.y : (p.z != q.z ? p.z < q.z : (s.x != t.x ? s.x < t.x : s.y < t.y)));
+        });
+        positionOf.assign(vertices.size(), 0);
+        texturedOf.assign(vertices.size(), 0);
+        unsigned int textured = 0;
+        for (size_t i = 0; i < order.size(); i++)
+        {
+            const Vertex& vertex = vertices[order[i]];
+            if (i == 0 || vertex.Position != vertices[order[i - 1]].Position)
+            {
+                positions.push_back(glm::dvec3((vertex.Position - low) / extent));
+                wedges.push_back(vector<unsigned int>());
+            }
+            if (i > 0 && (vertex.Position != vertices[order[i - 1]].Position || vertex.TexCoords != vertices[order[i - 1]].TexCoords))
+                textured++;
+            positionOf[order[i]] = (unsigned int)(positions.size() - 1);
+            texturedOf[order[i]] = textured;
+            wedges.back().push_back(order[i]);
+        }
+        collapsedInto.resize(positions.size());
+        for (size_t p = 0; p < positions.size(); p++)
+            collapsedInto[p] = (unsigned int)p;
+        buildQuadrics();
+    }
+
+    size_t TriangleCount() const
+    {
+        return indices.size() / 3;
+    }
+
+    const vector<unsigned int>& Indices() const
+    {
+        return indices;
+    }
+
+    // collapses edges, cheapest first, until the triangle count is down to target or every remaining collapse
+    // would cost more than maxError (a share of the mesh's size). returns the error of the result in mesh units
+    float Simplify(size_t targetTriangles, float maxError)
+    {
+        double maxCost = (double)maxError * maxError;
+        while (TriangleCount() > targetTriangles)
+        {
+            if (collapsePass(targetTriangles, maxCost) == 0)
+                break;
+        }
+        return (float)(measureError() * extent);
+    }
+
+private:
+    const vector<Vertex>& vertices;
+    vector<unsigned int> indices;
+    float extent = 1.0f;
+    vector<glm::dvec3> positions;
+    vector<unsigned int> positionOf;
+    // vertices with the same position and texture coordinates share an id, they differ only in normal
+    vector<unsigned int> texturedOf;
+    vector<vector<unsigned int>> wedges;
+    vector<meshsimplify::Quadric> quadrics;
+    // the position each one was collapsed onto, itself while it is still there
+    vector<unsigned int> collapsedInto;
+
+    // per pass adjacency: the triangles around each position, and how many triangles share each position edge
+    vector<unsigned int> triangleStart;
+    vector<unsigned int> triangleList;
+    unordered_map<uint64_t, int> edgeTriangles;
+    vector<unsigned char> border;
+
+    glm::dvec3 triangleNormal(const glm::dvec3& a, const glm::dvec3& b, const glm::dvec3& c) const
+    {
+        return glm::cross(b - a, c - a);
+    }
+
+    void buildQuadrics()
+    {
+        quadrics.assign(positions.size(), meshsimplify::Quadric());
+        // edges used by one triangle only once hard edges are ignored: open borders, and the edges along a UV seam
+        unordered_map<uint64_t, int> texturedEdges;
+        for (size_t t = 0; t < indices.size(); t += 3)
+            for (int e = 0; e < 3; e++)
+                texturedEdges[meshsimplify::edgeKey(texturedOf[indices[t + e]], texturedOf[indices[t + (e + 1) % 3]])]++;
+
+        for (size_t t = 0; t < indices.size(); t += 3)
+        {
+            unsigned int p[3] = { positionOf[indices[t]], positionOf[indices[t + 1]], positionOf[indices[t + 2]] };
+            glm::dvec3 normal = triangleNormal(positions[p[0]], positions[p[1]], positions[p[2]]);
+            double area = glm::length(normal);
+            if (area < 1e-12)
+                continue;
+            normal /= area;
+            meshsimplify::Quadric plane;
+            plane.AddPlane(normal, -glm::dot(normal, positions[p[0]]), area * 0.5);
+            for (int k = 0; k < 3; k++)
+                quadrics[p[k]].Add(plane);
+
+            for (int e = 0; e < 3; e++)
+            {
+                if (texturedEdges[meshsimplify::edgeKey(texturedOf[indices[t + e]], texturedOf[indices[t + (e + 1) % 3]])] != 1)
+                    continue;
+                const glm::dvec3 &a = positions[p[e]], &b = positions[p[(e + 1) % 3]];
+                glm::dvec3 edge = b - a;
+                double length = glm::length(edge);
+                if (length < 1e-12)
+                    continue;
+                glm::dvec3 side = glm::normalize(glm::cross(edge, normal));
+                meshsimplify::Quadric boundary;
+                boundary.AddPlane(side, -glm::dot(side, a), length * length * meshsimplify::boundaryWeight);
+                quadrics[p[e]].Add(boundary);
+                quadrics[p[(e + 1) % 3]].Add(boundary);
+            }
+        }
+    }
+
+    void buildAdjacency()
+    {
+        triangleStart.assign(positions.size() + 1, 0);
+        for (unsigned int index : indices)
+            triangleStart[positionOf[index] + 1]++;
+        for (size_t p = 0; p < positions.size(); p++)
+            triangleStart[p + 1] += triangleStart[p];
+        triangleList.assign(indices.size(), 0);
+        vector<unsigned int> fill(triangleStart.begin(), triangleStart.end() - 1);
+        for (size_t i = 0; i < indices.size(); i++)
+            triangleList[fill[positionOf[indices[i]]]++] = (unsigned int)(i / 3);
+
+        edgeTriangles.clear();
+        edgeTriangles.reserve(indices.size());
+        for (size_t t = 0; t < indices.size(); t += 3)
+            for (int e = 0; e < 3; e++)
+                edgeTriangles[meshsimplify::edgeKey(positionOf[indices[t + e]], positionOf[indices[t + (e + 1) % 3]])]++;
+        border.assign(positions.size(), 0);
+        for (const auto& entry : edgeTriangles)
+        {
+            if (entry.second == 1)
+            {
+                border[(unsigned int)(entry.first >> 32)] = 1;
+                border[(unsigned int)entry.first] = 1;
+            }
+        }
+    }
+
+    // the vertex at position to that wedge takes the place of: one with the texture coordinates found across an edge
+    // from a vertex with the wedge's own, and of those the closest normal. ~0u if there is none, the wedge would
+    // have to take texture coordinates from across a UV seam
+    unsigned int partner(unsigned int wedge, unsigned int from, unsigned int to) const
+    {
+        unsigned int textured = ~0u;
+        for (unsigned int i = triangleStart[from]; i < triangleStart[from + 1] && textured == ~0u; i++)
+        {
+            const unsigned int* triangle = &indices[triangleList[i] * 3];
+            if (texturedOf[triangle[0]] != texturedOf[wedge] && texturedOf[triangle[1]] != texturedOf[wedge] && texturedOf[triangle[2]] != texturedOf[wedge])
+                continue;
+            for (int k = 0; k < 3; k++)
+                if (positionOf[triangle[k]] == to)
+                    textured = texturedOf[triangle[k]];
+        }
+        unsigned int best = ~0u;
+        float bestAlignment = -2.0f;
+        for (unsigned int candidate : wedges[to])
+        {
+            float alignment = glm::dot(vertices[candidate].Normal, vertices[wedge].Normal);
+            if (texturedOf[candidate] == textured && alignment > bestAlignment)
+            {
+                best = candidate;
+                bestAlignment = alignment;
+            }
+        }
+        return best;
+    }
+
+    // cost of moving position from onto position to, negative when the collapse isn't allowed
+    double collapseCost(unsigned int from, unsigned int to) const
+    {
+        // border positions only slide along the border
+        if (border[from])
+        {
+            auto found = edgeTriangles.find(meshsimplify::edgeKey(from, to));
+            if (found == edgeTriangles.end() || found->second != 1)
+                return -1.0;
+        }
+        double cost = quadrics[from].Error(positions[to]);
+        double lengthSquared = glm::dot(positions[to] - positions[from], positions[to] - positions[from]);
+        for (unsigned int wedge : wedges[from])
+        {
+            unsigned int target = partner(wedge, from, to);
+            if (target == ~0u)
+                return -1.0;
+            const Vertex &a = vertices[wedge], &b = vertices[target];
+            glm::vec3 normal = a.Normal - b.Normal;
+            glm::vec2 texCoords = a.TexCoords - b.TexCoords;
+            cost += (glm::dot(normal, normal) + glm::dot(texCoords, texCoords)) * lengthSquared * meshLodAttributeWeight;
+        }
+        return cost;
+    }
+
+    // the triangles around from that stay, mustn't turn over or collapse to slivers when it moves to to
+    bool keepsOrientation(unsigned int from, unsigned int to) const
+    {
+        for (unsigned int i = triangleStart[from]; i < triangleStart[from + 1]; i++)
+        {
+            const unsigned int* triangle = &indices[triangleList[i] * 3];
+            glm::dvec3 before[3], after[3];
+            bool removed = false;
+            for (int k = 0; k < 3; k++)
+            {
+                unsigned int p = positionOf[triangle[k]];
+                removed |= p == to;
+                before[k] = positions[p];
+                after[k] = p == from ? positions[to] : positions[p];
+            }
+            if (removed)
+                continue;
+            glm::dvec3 normalBefore = triangleNormal(before[0], before[1], before[2]);
+            glm::dvec3 normalAfter = triangleNormal(after[0], after[1], after[2]);
+            if (glm::dot(normalBefore, normalAfter) <= 0.25 * glm::length(normalBefore) * glm::length(normalAfter))
+                return false;
+        }
+        return true;
+    }
+
+    unsigned int survivor(unsigned int position)
+    {
+        while (collapsedInto[position] != position)
+        {
+            collapsedInto[position] = collapsedInto[collapsedInto[position]];
+            position = collapsedInto[position];
+        }
+        return position;
+    }
+
+    // how far the surface is from the original: the largest distance of an original position from the triangles
+    // around the one it was collapsed onto, or from that position itself when a whole part has gone. quadric costs
+    // are averages over many planes and underestimate this
+    double measureError()
+    {
+        buildAdjacency();
+        double largest = 0.0;
+        for (unsigned int p = 0; p < positions.size(); p++)
+        {
+            unsigned int kept = survivor(p);
+            if (kept == p)
+                continue;
+            double distance = glm::length(positions[p] - positions[kept]);
+            for (unsigned int i = triangleStart[kept]; i < triangleStart[kept + 1]; i++)
+            {
+                const unsigned int* triangle = &indices[triangleList[i] * 3];
+                distance = min(distance, meshsimplify::pointTriangleDistance(positions[p], positions[positionOf[triangle[0]]],
+                    positions[positionOf[triangle[1]]], positions[positionOf[triangle[2]]]));
+            }
+            largest = max(largest, distance);
+        }
+        return largest;
+    }
+
+    // one round of independent collapses, no two touching the same triangles. returns how many were done
+    size_t collapsePass(size_t targetTriangles, double maxCost)
+    {
+        buildAdjacency();
+        vector<meshsimplify::Collapse> candidates;
+        candidates.reserve(indices.size() * 2);
+        for (size_t t = 0; t < indices.size(); t += 3)
+        {
+            for (int e = 0; e < 3; e++)
+            {
+                unsigned int a = positionOf[indices[t + e]], b = positionOf[indices[t + (e + 1) % 3]];
+                // an edge inside the surface is visited from both its triangles, once is enough
+                if (a == b || (a > b && edgeTriangles[meshsimplify::edgeKey(a, b)] > 1))
+                    continue;
+                double cost = collapseCost(a, b);
+                if (cost >= 0.0 && cost <= maxCost)
+                    candidates.push_back({ a, b, cost });
+                cost = collapseCost(b, a);
+                if (cost >= 0.0 && cost <= maxCost)
+                    candidates.push_back({ b, a, cost });
+            }
+        }
+        sort(candidates.begin(), candidates.end(), [](const meshsimplify::Collapse& a, const meshsimplify::Collapse& b) { return a.cost < b.cost; });
+
+        vector<unsigned int> remap(vertices.size());
+        for (size_t i = 0; i < remap.size(); i++)
+            remap[i] = (unsigned int)i;
+        vector<unsigned char> touched(positions.size(), 0);
+        size_t triangles = TriangleCount();
+        size_t collapses = 0;
+        for (const meshsimplify::Collapse& collapse : candidates)
+        {
+            if (triangles <= targetTriangles)
+                break;
+            if (touched[collapse.from] || touched[collapse.to] || !keepsOrientation(collapse.from, collapse.to))
+                continue;
+            for (unsigned int wedge : wedges[collapse.from])
+                remap[wedge] = partner(wedge, collapse.from, collapse.to);
+            // the neighbourhood changes shape, its costs are out of date until the next pass
+            for (unsigned int i = triangleStart[collapse.from]; i < triangleStart[collapse.from + 1]; i++)
+            {
+                const unsigned int* triangle = &indices[triangleList[i] * 3];
+                bool removed = false;
+                for (int k = 0; k < 3; k++)
+                {
+                    touched[positionOf[triangle[k]]] = 1;
+                    removed |= positionOf[triangle[k]] == collapse.to;
+                }
+                triangles -= removed ? 1 : 0;
+            }
+            quadrics[collapse.to].Add(quadrics[collapse.from]);
+            wedges[collapse.from].clear();
+            collapsedInto[collapse.from] = collapse.to;
+            collapses++;
+        }
+
+        // drop the triangles that lost an edge
+        size_t kept = 0;
+        for (size_t t = 0; t < indices.size(); t += 3)
+        {
+            unsigned int a = remap[indices[t]], b = remap[indices[t + 1]], c = remap[indices[t + 2]];
+            if (positionOf[a] == positionOf[b] || positionOf[b] == positionOf[c] || positionOf[a] == positionOf[c])
+                continue;
+            indices[kept++] = a;
+            indices[kept++] = b;
+            indices[kept++] = c;
+        }
+        indices.resize(kept);
+        return collapses;
+    }
+};
+
+// appends up to maxMeshLods - 1 simplified levels to the mesh's indices, each cache optimized, and records the
+// ranges in mesh.lods (level 0 is the mesh itself). meshes too small to gain anything keep just level 0
+inline MeshLodStats GenerateMeshLods(MeshData& mesh)
+{
+    MeshLodStats stats;
+    mesh.lods.clear();
+    MeshLod base;
+    base.firstIndex = 0;
+    base.indexCount = (uint32_t)mesh.indices.size();
+    base.error = 0.0f;
+    mesh.lods.push_back(base);
+    stats.triangles.push_back(mesh.indices.size() / 3);
+    if (mesh.indices.size() / 3 < meshLodMinimumTriangles * 2)
+        return stats;
+
+    MeshSimplifier simplifier(mesh.vertices, mesh.indices);
+    vector<unsigned int> levels;
+    size_t previous = simplifier.TriangleCount();
+    while (mesh.lods.size() < maxMeshLods && previous > meshLodMinimumTriangles)
+    {
+        size_t target = max(meshLodMinimumTriangles, (size_t)(previous * meshLodReduction));
+        float error = simplifier.Simplify(target, meshLodMaximumError);
+        if (simplifier.TriangleCount() > previous * (1.0f - meshLodMinimumReduction))
+            break;
+        vector<unsigned int> level = simplifier.Indices();
+        meshoptimize::optimizeVertexCache(level, mesh.vertices.size());
+
+        MeshLod lod;
+        lod.firstIndex = (uint32_t)(mesh.indices.size() + levels.size());
+        lod.indexCount = (uint32_t)level.size();
+        lod.error = error;
+        mesh.lods.push_back(lod);
+        levels.insert(levels.end(), level.begin(), level.end());
+        previous = simplifier.TriangleCount();
+        stats.triangles.push_back(previous);
+    }
+    mesh.indices.insert(mesh.indices.end(), levels.begin(), levels.end());
+    return stats;
+}
+#endif
@@ -10,9 +10,30 @@
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
+#include "asset_io_system.h"
+#include "cluster_culling.h"
+#include "frame_scheduler.h"
+#include "impostor.h"
+#include "load_profiler.h"
+#include "mapped_file.h"
 #include "mesh.h"
+#include "mesh_cache.h"
+#include "mesh_clusters.h"
+#include "mesh_optimizer.h"
+#include "mesh_simplify.h"
+#include "node_hierarchy.h"
+#include "obj_loader.h"
+#include "resource_cache.h"
 #include "shader2.h"
+#include "skeletal_animation.h"
+#include "texture_loader.h"
+#include "texture_streamer.h"
+#include "thread_pool.h"
 
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <memory>
 #include <string>
 #include <fstream>
 #include <sstream>
@@ -23,78 +44,642 @@ using namespace std;
 
 unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false);
 
+// everything a model load produces before the GL uploads, built on whichever thread runs the load
+struct ModelLoadData {
+    vector<MeshData> meshes;
+    // the scene's node tree, each mesh refers to the node it was found under
+    NodeHierarchy nodes;
+    // bones the skinned meshes' vertices refer to, by the same index as their names while importing
+    vector<SkinBone> bones;
+    vector<string> boneNames;
+    vector<AnimationClip> clips;
+    // decoded textures by path relative to the model's directory
+    map<string, shared_ptr<DecodedImage>> images;
+    // hashes of the texture files by the same paths, instead of the images when the textures are streamed
+    map<string, uint64_t> fileHashes;
+    // the impostor baked from the same source bytes, when there is one
+    shared_ptr<ImpostorBake> impostor;
+    // a warm load's meshes point into this mapping, it stays open until they are uploaded
+    unique_ptr<MappedFile> cache;
+    bool loaded = false;
+    bool fromCache = false;
+    // what made the meshes on a cold load
+    const char* importer = "Assimp";
+};
+
 class Model 
 {
 public:
     // model data 
-    vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
     vector<Mesh>    meshes;
+    // the node tree in its imported pose, instances copy it to move parts of their own
+    NodeHierarchy   nodes;
+    // the skeleton of the skinned meshes, the animations of the nodes, and the bone palette of the imported pose
+    vector<SkinBone>      bones;
+    vector<AnimationClip> clips;
+    vector<glm::mat4>     bindPalette;
     string directory;
     bool gammaCorrection;
+    // how long the last load took (until drawable), and whether it came from the mesh cache instead of an import
+    double loadSeconds = 0.0;
+    bool loadedFromCache = false;
+    const char* importer = "Assimp";
+    // CPU copies freed once the load's uploads were done: mesh arrays and decoded pixels
+    size_t releasedCpuBytes = 0;
+    // box and sphere around every mesh in the imported pose, in model space
+    BoundingVolume bounds;
+    // per level of detail, the largest error of any mesh drawn at it in model units. level 0 is exact
+    vector<float> lodErrors;
+    // what culling the clusters of the meshes has saved over every draw so far
+    ClusterCullStats cullStats;
+    // the model seen from all round for far away instances, NULL until its baked atlas is uploaded or without one
+    shared_ptr<ImpostorAtlas> impostor;
 
     // constructor, expects a filepath to a 3D model.
-    Model(string const &path, bool gamma = false) : gammaCorrection(gamma)
+    // keepCpuData keeps each mesh's vertices and indices on the CPU after the upload (collision, picking),
+    // otherwise they are freed once on the GPU. clusterBounds keeps the bounds of every cluster of each mesh's triangles
+    Model(string const &path, bool gamma = false, bool keepCpuData = false, bool clusterBounds = false) : gammaCorrection(gamma), keepCpuData(keepCpuData), clusterBounds(clusterBounds)
     {
         loadModel(path);
     }
 
-    // draws the model, and thus all its meshes
-    void Draw(Shader &shader)
+    // asynchronous constructor: reading, parsing, vertex conversion and texture decoding run on the thread pool and
+    // the GL uploads are handed to the scheduler. nothing is drawn until IsDrawable(), the model must not move until then
+    Model(string const &path, FrameScheduler &scheduler, bool gamma = false, bool keepCpuData = false, bool clusterBounds = false)
+        : gammaCorrection(gamma), keepCpuData(keepCpuData), clusterBounds(clusterBounds)
+    {
+        loadStart = chrono::steady_clock::now();
+        loading = true;
+        // retrieve the directory path of the filepath
+        directory = path.substr(0, path.find_last_of('/'));
+        string modelDirectory = directory;
+        FrameScheduler *uploads = &scheduler;
+        scheduler.ScheduleAsync("model load", 0, 0.1f,
+            [path, modelDirectory]() { return loadData(path, modelDirectory, true); },
+            [this, path, uploads](shared_ptr<ModelLoadData> data) { finishLoad(path, data, uploads); });
+    }
+
+    // true once every mesh and texture is on the GPU
+    bool IsDrawable() const
+    {
+        return drawable;
+    }
+
+    // an asynchronous load still has work in flight that refers to this model
+    bool IsLoading() const
+    {
+        return loading;
+    }
+
+    // drops the model's meshes and textures, the resource cache deletes them once nothing else shares them
+    void Release()
+    {
+        meshes.clear();
+        sharedMeshes.clear();
+        sharedTextures.clear();
+        impostor.reset();
+        drawable = false;
+    }
+
+    // CPU memory the meshes still hold, only non zero when keeping CPU data
+    size_t CpuBytes() const
+    {
+        size_t bytes = 0;
+        for (const Mesh &mesh : meshes)
+            bytes += mesh.CpuBytes();
+        return bytes;
+    }
+
+    unsigned int LodCount() const
+    {
+        return lodErrors.empty() ? 1 : (unsigned int)lodErrors.size();
+    }
+
+    // index of the clip with this name, -1 if the model has none
+    int FindClip(const string &name) const
+    {
+        for (size_t i = 0; i < clips.size(); i++)
+            if (clips[i].name == name)
+                return (int)i;
+        return -1;
+    }
+
+    // draws the model, and thus all its meshes, at a level of detail. meshes with fewer levels use their coarsest.
+    // every mesh is placed by transform times the world matrix of its node, in pose or the imported one. skinned
+    // meshes are deformed by palette instead (the imported pose's without one), their bones' nodes already place them.
+    // with a cull view, meshes drawn at full detail that kept their cluster bounds leave out the clusters outside the
+    // frustum or facing away, culled for all meshes in parallel before anything is drawn
+    void Draw(Shader &shader, const glm::mat4 &transform, unsigned int lod = 0, const NodeHierarchy *pose = NULL, const vector<glm::mat4> *palette = NULL,
+              const ClusterCullView *cull = NULL)
     {
+        if (!drawable)
+            return;
+        const NodeHierarchy &hierarchy = pose ? *pose : nodes;
+        placements.resize(meshes.size());
+        for(unsigned int i = 0; i < meshes.size(); i++)
+        {
+            if (meshes[i].skinned)
+                placements[i] = transform;
+            else
+                nodes::multiply(transform, hierarchy.World(meshes[i].node), placements[i]);
+        }
+        if (cull)
+        {
+            drawLists.resize(meshes.size());
+            meshCullStats.assign(meshes.size(), ClusterCullStats());
+            ThreadPool::Get().ParallelFor(meshes.size(), [&](size_t i)
+            {
+                if (cullable(meshes[i], lod))
+                    CullClusters(meshes[i].clusters, placements[i], *cull, drawLists[i], meshCullStats[i]);
+            });
+            for (const ClusterCullStats &stats : meshCullStats)
+                cullStats.Add(stats);
+        }
+
+        bool paletteBound = false;
         for(unsigned int i = 0; i < meshes.size(); i++)
-            meshes[i].Draw(shader);
+        {
+            // one palette for every skinned mesh of the model
+            if (meshes[i].skinned && !paletteBound)
+            {
+                const vector<glm::mat4> &bonePalette = palette ? *palette : bindPalette;
+                SkinPaletteBuffer::Get().Bind(bonePalette.data(), bonePalette.size());
+                paletteBound = true;
+            }
+            shader.setMat4("model", placements[i]);
+            meshes[i].Draw(shader, lod, cull && cullable(meshes[i], lod) ? &drawLists[i] : NULL);
+        }
     }
     
 private:
+    bool drawable = false;
+    bool loading = false;
+    bool keepCpuData = false;
+    bool clusterBounds = false;
+    chrono::steady_clock::time_point loadStart;
+    // references into the resource cache, which owns the GL objects
+    vector<shared_ptr<Mesh>> sharedMeshes;
+    vector<shared_ptr<SharedTexture>> sharedTextures;
+    // per mesh scratch of Draw
+    vector<glm::mat4> placements;
+    vector<ClusterDrawList> drawLists;
+    vector<ClusterCullStats> meshCullStats;
+
+    // the cluster bounds cover the full detail level in the imported shape, not a coarser level or a skinned pose
+    static bool cullable(const Mesh &mesh, unsigned int lod)
+    {
+        return !mesh.clusters.empty() && !mesh.skinned && (lod == 0 || mesh.lods.empty());
+    }
+
     // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
     void loadModel(string const &path)
     {
-        // read file via ASSIMP
-        Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
-        // check for errors
-        if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
+        loadStart = chrono::steady_clock::now();
+        // retrieve the directory path of the filepath
+        directory = path.substr(0, path.find_last_of('/'));
+        finishLoad(path, loadData(path, directory, false), NULL);
+    }
+
+    // everything up to the GL uploads, touches no GL state so it can run on a worker
+    // streamTextures leaves the texture files to the texture streamer, only their hashes are read
+    static shared_ptr<ModelLoadData> loadData(string const &path, string const &directory, bool streamTextures)
+    {
+        auto data = make_shared<ModelLoadData>();
+        // tangents are only calculated afterwards, for models with a normal map. a vertex keeps its 4 strongest bones
+        const unsigned int importFlags = aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_JoinIdenticalVertices | aiProcess_LimitBoneWeights;
+
+        // the cache is only valid for the exact bytes of the source it was made from
+        ProfileScope hashing("model hash");
+        uint64_t sourceHash = 0;
+        bool hashed = HashAsset(path, sourceHash);
+        hashing.End();
+        if (hashed)
+        {
+            ProfileScope scope("impostor read");
+            auto impostor = make_shared<ImpostorBake>();
+            if (ReadImpostorCache(ImpostorCachePath(path), sourceHash, *impostor))
+                data->impostor = impostor;
+        }
+        if (hashed && loadFromCache(MeshCachePath(path), sourceHash, importFlags, *data))
+        {
+            data->fromCache = true;
+            vector<string> paths = texturePaths(data->meshes);
+            decodeTextures(directory, paths, *data, function<void()>(), streamTextures);
+        }
+        else if (IsObjPath(path))
+        {
+            // the OBJ loader already gives one mesh per material, hanging from a single root node
+            data->importer = "the OBJ loader";
+            ProfileScope parsing("obj parse");
+            if (!LoadObj(path, data->meshes))
+                return data;
+            parsing.End();
+            data->nodes.Add(path.substr(path.find_last_of('/') + 1), -1, glm::mat4(1.0f));
+            vector<string> paths = texturePaths(data->meshes);
+            decodeTextures(directory, paths, *data, [&]()
+            {
+                optimizeMeshes(path, *data);
+            }, streamTextures);
+
+            writeCache(path, sourceHash, importFlags, *data, hashed);
+        }
+        else
+        {
+            // read file via ASSIMP, out of the asset archive when it has it
+            ProfileScope importing("assimp import");
+            Assimp::Importer importer;
+            importer.SetIOHandler(new AssetIOSystem());
+            const aiScene* scene = importer.ReadFile(path, importFlags);
+            // check for errors
+            if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
+            {
+                cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
+                return data;
+            }
+            if (needsTangents(scene))
+                scene = importer.ApplyPostProcessing(aiProcess_CalcTangentSpace);
+            importing.End();
+
+            // decode the material textures while ASSIMP's root node is processed recursively
+            vector<string> paths = materialTexturePaths(scene);
+            decodeTextures(directory, paths, *data, [&]()
+            {
+                ProfileScope converting("mesh conversion");
+                processNode(scene->mRootNode, -1, scene, *data);
+                resolveBones(*data);
+                processAnimations(scene, *data);
+                converting.End();
+                optimizeMeshes(path, *data);
+            }, streamTextures);
+
+            writeCache(path, sourceHash, importFlags, *data, hashed);
+        }
+        ProfileScope hashingMeshes("mesh hash");
+        for (MeshData &mesh : data->meshes)
+        {
+            mesh.contentHash = HashBytes(&mesh.format, sizeof(VertexFormat));
+            mesh.contentHash = HashBytes(mesh.VertexData(), mesh.VertexBytes(), mesh.contentHash);
+            mesh.contentHash = HashBytes(mesh.IndexData(), mesh.IndexBytes(), mesh.contentHash);
+        }
+        data->loaded = true;
+        return data;
+    }
+
+    // any material with a normal map, the only thing the tangents are for
+    static bool needsTangents(const aiScene *scene)
+    {
+        for(unsigned int m = 0; m < scene->mNumMaterials; m++)
+            if (scene->mMaterials[m]->GetTextureCount(aiTextureType_HEIGHT) || scene->mMaterials[m]->GetTextureCount(aiTextureType_NORMALS))
+                return true;
+        return false;
+    }
+
+    // welds, reorders, simplifies into levels of detail and packs every imported mesh in parallel, reporting what it changed
+    static void optimizeMeshes(string const &path, ModelLoadData &data)
+    {
+        ProfileScope scope("mesh optimize");
+        vector<MeshOptimizeStats> stats(data.meshes.size());
+        vector<MeshLodStats> lodStats(data.meshes.size());
+        ThreadPool::Get().ParallelFor(data.meshes.size(), [&](size_t m)
+        {
+            stats[m] = OptimizeMeshData(data.meshes[m]);
+            lodStats[m] = GenerateMeshLods(data.meshes[m]);
+            ComputeMeshBounds(data.meshes[m]);
+            BuildMeshClusters(data.meshes[m]);
+            MeasureUvDensity(data.meshes[m]);
+            PackMeshData(data.meshes[m]);
+        });
+        ostringstream report;
+        report << "Optimized " << path << ":" << endl;
+        for (size_t m = 0; m < stats.size(); m++)
         {
-            cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
+            report << "  mesh " << m << ": vertices " << stats[m].before.vertices << " -> " << stats[m].after.vertices
+                   << ", indices " << stats[m].before.indices << " -> " << stats[m].after.indices
+                   << ", ACMR " << stats[m].before.acmr << " -> " << stats[m].after.acmr << ", LOD triangles";
+            for (size_t l = 0; l < lodStats[m].triangles.size(); l++)
+                report << (l ? " / " : " ") << lodStats[m].triangles[l];
+            report << endl;
+        }
+        cout << report.str();
+    }
+
+    // saves what an import made for the next load, when the source could be hashed
+    static void writeCache(const string &path, uint64_t sourceHash, unsigned int importFlags, const ModelLoadData &data, bool hashed)
+    {
+        if (!hashed)
             return;
+        ProfileScope scope("mesh cache write");
+        if (!WriteMeshCache(MeshCachePath(path), sourceHash, importFlags, data.meshes, data.nodes, data.bones, data.clips))
+            cout << "Could not write the mesh cache for " << path << endl;
+    }
+
+    // maps the cache and points the meshes into the mapping, false if it is missing or stale
+    static bool loadFromCache(const string &cachePath, uint64_t sourceHash, unsigned int importFlags, ModelLoadData &data)
+    {
+        ProfileScope scope("mesh cache read");
+        data.cache.reset(new MappedFile());
+        MeshCacheView view;
+        if (!data.cache->Open(cachePath) || !ReadMeshCache(data.cache->Data(), data.cache->Size(), sourceHash, importFlags, view))
+        {
+            data.cache.reset();
+            return false;
         }
-        // retrieve the directory path of the filepath
-        directory = path.substr(0, path.find_last_of('/'));
 
-        // process ASSIMP's root node recursively
-        processNode(scene->mRootNode, scene);
+        for (uint32_t n = 0; n < view.header->nodeCount; n++)
+        {
+            glm::mat4 local;
+            memcpy(&local[0][0], view.nodes[n].local, sizeof(view.nodes[n].local));
+            data.nodes.Add(view.strings + view.nodes[n].nameOffset, view.nodes[n].parent, local);
+        }
+        for (uint32_t b = 0; b < view.header->boneCount; b++)
+        {
+            SkinBone bone;
+            bone.node = view.bones[b].node;
+            memcpy(&bone.offset[0][0], view.bones[b].offset, sizeof(view.bones[b].offset));
+            data.bones.push_back(bone);
+        }
+        for (uint32_t c = 0; c < view.header->clipCount; c++)
+        {
+            const MeshCacheClip &cached = view.clips[c];
+            AnimationClip clip;
+            clip.name = view.strings + cached.nameOffset;
+            clip.duration = cached.duration;
+            clip.channels.assign(view.channels + cached.firstChannel, view.channels + cached.firstChannel + cached.channelCount);
+            clip.keys.assign(view.keys + cached.firstKey, view.keys + cached.firstKey + cached.keyCount);
+            data.clips.push_back(move(clip));
+        }
+        for (uint32_t i = 0; i < view.header->meshCount; i++)
+        {
+            const MeshCacheRange& range = view.ranges[i];
+            MeshData mesh;
+            mesh.node = range.node;
+            mesh.bounds = range.bounds;
+            mesh.uvDensity = range.uvDensity;
+            mesh.clusters.assign(view.clusters + range.firstCluster, view.clusters + range.firstCluster + range.clusterCount);
+            mesh.format = range.format;
+            mesh.vertexCount = range.vertexCount;
+            mesh.indexCount = range.indexCount;
+            mesh.mappedVertices = data.cache->Data() + range.vertexOffset;
+            mesh.mappedIndices = data.cache->Data() + range.indexOffset;
+            mesh.lods.assign(range.lods, range.lods + range.lodCount);
+            for (uint32_t t = 0; t < range.textureCount; t++)
+            {
+                const MeshCacheTexture& reference = view.textures[range.firstTexture + t];
+                Texture texture;
+                texture.id = 0;
+                texture.type = view.strings + reference.typeOffset;
+                texture.path = view.strings + reference.pathOffset;
+                mesh.textures.push_back(texture);
+            }
+            data.meshes.push_back(move(mesh));
+        }
+        return true;
+    }
+
+    // decodes (or loads the compressed texture cache of) every path in parallel, alongside an optional other job (the geometry conversion).
+    // streamed only hashes the files. files some other model already has on the GPU are skipped
+    static void decodeTextures(const string &directory, const vector<string> &paths, ModelLoadData &data, function<void()> alongside, bool streamed)
+    {
+        vector<shared_ptr<DecodedImage>> images(paths.size());
+        vector<uint64_t> hashes(paths.size(), 0);
+        // the pool hands out indices in order, so the other job starts first
+        ThreadPool::Get().ParallelFor(paths.size() + 1, [&](size_t i)
+        {
+            if (i == 0)
+            {
+                if (alongside)
+                    alongside();
+                return;
+            }
+            string filename = directory + '/' + paths[i - 1];
+            if (ResourceCache::Get().FindTexture(filename))
+                return;
+            if (streamed)
+            {
+                // a file that can't be read still needs a key of its own
+                if (!HashAsset(filename, hashes[i - 1]))
+                    hashes[i - 1] = HashBytes(filename.data(), filename.size());
+            }
+            else
+                images[i - 1] = LoadTextureImage(filename);
+        });
+        for (size_t i = 0; i < paths.size(); i++)
+        {
+            if (images[i])
+                data.images[paths[i]] = images[i];
+            if (hashes[i])
+                data.fileHashes[paths[i]] = hashes[i];
+        }
+    }
+
+    // creates the GL objects, straight away or through the scheduler. the model becomes drawable after the last mesh
+    // upload, streamed textures follow on their own
+    void finishLoad(string const &path, shared_ptr<ModelLoadData> data, FrameScheduler *scheduler)
+    {
+        if (!data->loaded)
+        {
+            loading = false;
+            return;
+        }
+        loadedFromCache = data->fromCache;
+        importer = data->importer;
+        nodes = data->nodes;
+        nodes.Update();
+        bones = data->bones;
+        clips = move(data->clips);
+        ComputeBonePalette(bones, nodes, bindPalette);
+        bool staged = scheduler != NULL;
+        auto queue = [scheduler](const char *category, float estimatedMs, function<void()> work)
+        {
+            if (scheduler)
+                scheduler->Schedule(category, 0, estimatedMs, work);
+            else
+                work();
+        };
+        // what the packed layouts save over uploading the full Vertex and 32 bit indices
+        size_t packedBytes = 0, fullBytes = 0;
+        for (const MeshData &mesh : data->meshes)
+        {
+            packedBytes += mesh.VertexBytes() + mesh.IndexBytes();
+            fullBytes += mesh.VertexCount() * sizeof(Vertex) + mesh.IndexCount() * sizeof(unsigned int);
+            releasedCpuBytes += mesh.CpuBytes();
+        }
+        for (const auto &image : data->images)
+            if (image.second)
+                releasedCpuBytes += image.second->Bytes();
+        if (data->impostor)
+            releasedCpuBytes += data->impostor->albedo.size() + data->impostor->depth.size();
+        measureModel(*data);
+
+        for (size_t m = 0; m < data->meshes.size(); m++)
+        {
+            // texture names come from the resource cache up front, so the meshes can refer to them before the pixels arrive
+            vector<Texture> textures;
+            for (const Texture &reference : data->meshes[m].textures)
+            {
+                Texture texture = reference;
+                texture.id = acquireTexture(reference, *data, queue, scheduler);
+                textures.push_back(texture);
+            }
+
+            const MeshData &mesh = data->meshes[m];
+            float estimatedMs = 0.05f + (float)(mesh.VertexBytes() + mesh.IndexBytes()) / 2.0e6f;
+            queue("model mesh upload", estimatedMs, [this, data, m, textures, staged]()
+            {
+                // identical geometry (the same file loaded twice, repeated parts) shares one set of buffers
+                ProfileScope scope("mesh upload");
+                MeshData &mesh = data->meshes[m];
+                shared_ptr<Mesh> shared = ResourceCache::Get().FindMesh(mesh.contentHash);
+                if (!shared)
+                {
+                    shared = make_shared<Mesh>(mesh.VertexData(), mesh.VertexCount(), mesh.IndexData(), mesh.IndexCount(), mesh.format, vector<Texture>(), staged);
+                    shared->lods = mesh.lods;
+                    ResourceCache::Get().AddMesh(mesh.contentHash, shared);
+                }
+                sharedMeshes.push_back(shared);
+                Mesh instance = *shared;
+                instance.textures = textures;
+                instance.node = mesh.node;
+                instance.bounds = mesh.bounds;
+                instance.uvDensity = mesh.uvDensity;
+                instance.skinned = mesh.format.attributes[ATTRIBUTE_BONE_WEIGHTS].enabled != 0;
+                if (clusterBounds)
+                    instance.clusters = mesh.clusters;
+                if (keepCpuData)
+                    UnpackMeshData(mesh, instance.vertices, instance.indices);
+                meshes.push_back(move(instance));
+                // on the GPU now, the CPU arrays are not needed any more
+                mesh.ReleaseCpuData();
+            });
+        }
+
+        if (data->impostor)
+        {
+            float estimatedMs = 0.1f + (float)(data->impostor->albedo.size() + data->impostor->depth.size()) / 1.0e6f;
+            queue("model impostor upload", estimatedMs, [this, data]()
+            {
+                ProfileScope scope("impostor upload");
+                impostor = make_shared<ImpostorAtlas>();
+                impostor->Upload(*data->impostor);
+                data->impostor.reset();
+            });
+        }
+
+        // queued last with the same priority, so it runs after every upload above
+        queue("model ready", 0.01f, [this, path, packedBytes, fullBytes]()
+        {
+            drawable = true;
+            loading = false;
+            loadSeconds = chrono::duration<double>(chrono::steady_clock::now() - loadStart).count();
+            cout << "Loaded " << path << (loadedFromCache ? " from the mesh cache (warm)" : string(" with ") + importer + " (cold)") << " in " << loadSeconds * 1000.0 << " ms, "
+                 << packedBytes / 1024 << " KB of geometry (" << fullBytes / 1024 << " KB unpacked), "
+                 << releasedCpuBytes / 1024 << " KB of CPU copies freed after upload, " << CpuBytes() / 1024 << " KB kept" << endl;
+        });
+    }
+
+    // bounds and per level errors of the whole model in its imported pose, each mesh's bounds placed by its node
+    void measureModel(const ModelLoadData &data)
+    {
+        size_t levels = 1;
+        for (size_t m = 0; m < data.meshes.size(); m++)
+        {
+            const MeshData &mesh = data.meshes[m];
+            BoundingVolume placed;
+            TransformBounds(mesh.bounds, &nodes.World(mesh.node), 1, &placed);
+            bounds = m ? MergeBounds(bounds, placed) : placed;
+            levels = max(levels, mesh.lods.size());
+        }
+        lodErrors.assign(levels, 0.0f);
+        for (const MeshData &mesh : data.meshes)
+            for (size_t l = 0; l < levels && !mesh.lods.empty(); l++)
+                lodErrors[l] = max(lodErrors[l], mesh.lods[min(l, mesh.lods.size() - 1)].error);
+    }
+
+    // GL name of a texture of the model, shared with every other model using the same file or pixels.
+    // a texture new to the cache gets its upload queued, or with a scheduler is handed to the texture streamer
+    template<class Queue>
+    unsigned int acquireTexture(const Texture &reference, ModelLoadData &data, Queue &queue, FrameScheduler *scheduler)
+    {
+        const string &path = reference.path;
+        string filename = this->directory + '/' + path;
+        shared_ptr<SharedTexture> shared = ResourceCache::Get().FindTexture(filename);
+        bool created = false;
+        if (!shared && scheduler)
+        {
+            // shared by file contents, the pixels aren't known yet. the model doesn't wait for it: it is drawn grey
+            // until the streamer has loaded the file and uploaded its smallest levels
+            auto hash = data.fileHashes.find(path);
+            shared = ResourceCache::Get().AcquireTexture(filename, hash != data.fileHashes.end() ? hash->second : HashBytes(filename.data(), filename.size()), created);
+            if (created)
+                TextureStreamer::Get().Load(shared, filename, *scheduler);
+        }
+        else if (!shared)
+        {
+            shared_ptr<DecodedImage> &image = data.images[path];
+            // another model had it when the decodes ran, but it has been released since
+            if (!image)
+                image = LoadTextureImage(filename);
+            shared = ResourceCache::Get().AcquireTexture(filename, image->contentHash, created);
+            if (created)
+            {
+                // the upload job becomes the only owner, the pixels are freed as soon as it has run
+                shared_ptr<DecodedImage> pixels = move(image);
+                unsigned int id = shared->id;
+                float estimatedMs = 0.05f + (float)pixels->Bytes() / 1.0e6f;
+                queue("model texture upload", estimatedMs, [this, id, pixels, path]()
+                {
+                    UploadTextureInto(id, *pixels, path);
+                });
+            }
+            image.reset();
+        }
+        sharedTextures.push_back(shared);
+        return shared->id;
     }
 
     // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-    void processNode(aiNode *node, const aiScene *scene)
+    // the node goes into the flat hierarchy first, so parents always come before their children
+    static void processNode(aiNode *node, int parent, const aiScene *scene, ModelLoadData &data)
     {
+        unsigned int index = data.nodes.Add(node->mName.C_Str(), parent, toGlm(node->mTransformation));
+
         // process each mesh located at the current node
         for(unsigned int i = 0; i < node->mNumMeshes; i++)
         {
             // the node object only contains indices to index the actual objects in the scene. 
             // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
             aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            data.meshes.push_back(processMesh(mesh, scene, data));
+            data.meshes.back().node = index;
+            if (mesh->mNumBones)
+                bindUnweightedVertices(data.meshes.back(), index, data);
         }
         // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
         for(unsigned int i = 0; i < node->mNumChildren; i++)
         {
-            processNode(node->mChildren[i], scene);
+            processNode(node->mChildren[i], (int)index, scene, data);
         }
 
     }
 
-    Mesh processMesh(aiMesh *mesh, const aiScene *scene)
+    // ASSIMP's matrices are row major, glm's column major
+    static glm::mat4 toGlm(const aiMatrix4x4 &m)
+    {
+        return glm::mat4(m.a1, m.b1, m.c1, m.d1, m.a2, m.b2, m.c2, m.d2, m.a3, m.b3, m.c3, m.d3, m.a4, m.b4, m.c4, m.d4);
+    }
+
+    static MeshData processMesh(aiMesh *mesh, const aiScene *scene, ModelLoadData &model)
     {
         // data to fill
-        vector<Vertex> vertices;
-        vector<unsigned int> indices;
-        vector<Texture> textures;
+        MeshData data;
+        vector<Vertex> &vertices = data.vertices;
+        vector<unsigned int> &indices = data.indices;
+        vector<Texture> &textures = data.textures;
 
         // walk through each of the mesh's vertices
         for(unsigned int i = 0; i < mesh->mNumVertices; i++)
         {
-            Vertex vertex;
+            Vertex vertex = Vertex(); // zeroes the bone slots too, so identical meshes hash the same
             glm::vec3 vector; // we declare a placeholder vector since assimp uses its own vector class that doesn't directly convert to glm's vec3 class so we transfer the data to this placeholder glm::vec3 first.
             // positions
             vector.x = mesh->mVertices[i].x;
@@ -112,12 +697,19 @@ private:
             // texture coordinates
             if(mesh->mTextureCoords[0]) // does the mesh contain texture coordinates?
             {
+                data.hasTexCoords = true;
                 glm::vec2 vec;
                 // a vertex can contain up to 8 different texture coordinates. We thus make the assumption that we won't 
                 // use models where a vertex can have multiple texture coordinates so we always take the first set (0).
                 vec.x = mesh->mTextureCoords[0][i].x; 
                 vec.y = mesh->mTextureCoords[0][i].y;
                 vertex.TexCoords = vec;
+            }
+            else
+                vertex.TexCoords = glm::vec2(0.0f, 0.0f);
+            // only calculated for models with a normal map
+            if (mesh->mTangents && mesh->mBitangents)
+            {
                 // tangent
                 vector.x = mesh->mTangents[i].x;
                 vector.y = mesh->mTangents[i].y;
@@ -129,8 +721,6 @@ private:
                 vector.z = mesh->mBitangents[i].z;
                 vertex.Bitangent = vector;
             }
-            else
-                vertex.TexCoords = glm::vec2(0.0f, 0.0f);
 
             vertices.push_back(vertex);
         }
@@ -142,6 +732,26 @@ private:
             for(unsigned int j = 0; j < face.mNumIndices; j++)
                 indices.push_back(face.mIndices[j]);        
         }
+        // bone weights, the strongest MAX_BONE_INFLUENCE of each vertex. bones are numbered across the whole model,
+        // so all of its skinned meshes read one palette
+        for(unsigned int b = 0; b < mesh->mNumBones; b++)
+        {
+            const aiBone *bone = mesh->mBones[b];
+            int id = boneIndex(bone, model);
+            if (id < 0)
+                continue;
+            for(unsigned int w = 0; w < bone->mNumWeights; w++)
+            {
+                const aiVertexWeight &weight = bone->mWeights[w];
+                if (weight.mVertexId < vertices.size())
+                    AddBoneInfluence(vertices[weight.mVertexId], id, weight.mWeight);
+            }
+        }
+        if (mesh->mNumBones)
+        {
+            for (Vertex &vertex : vertices)
+                NormaliseBoneWeights(vertex);
+        }
         // process materials
         aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];    
         // we assume a convention for sampler names in the shaders. Each diffuse texture should be named
@@ -164,82 +774,204 @@ private:
         std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
         textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
         
-        // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        // return the extracted mesh data, it is packed on the worker and uploaded on the GL thread
+        return data;
     }
 
-    // checks all material textures of a given type and loads the textures if they're not loaded yet.
+    // index of a bone in the model's skeleton, added the first time a mesh refers to it. meshes sharing a bone are
+    // expected to share its offset, as they do when they are skinned in one space. -1 once the palette is full
+    static int boneIndex(const aiBone *bone, ModelLoadData &data)
+    {
+        string name = bone->mName.C_Str();
+        for (size_t i = 0; i < data.boneNames.size(); i++)
+            if (data.boneNames[i] == name)
+                return (int)i;
+        if (data.bones.size() == maxSkinBones)
+        {
+            cout << "More than " << maxSkinBones << " bones, " << name << " is left out of the skeleton" << endl;
+            return -1;
+        }
+        SkinBone skinBone;
+        skinBone.node = 0;
+        skinBone.offset = toGlm(bone->mOffsetMatrix);
+        data.bones.push_back(skinBone);
+        data.boneNames.push_back(name);
+        return (int)data.bones.size() - 1;
+    }
+
+    // a skinned mesh's vertices no bone has any weight on would be skinned by nothing and collapse to the origin.
+    // they follow the mesh's node instead, as they would in a mesh without bones, through a bone of their own with
+    // an identity offset
+    static void bindUnweightedVertices(MeshData &mesh, unsigned int node, ModelLoadData &data)
+    {
+        int id = -1;
+        for (Vertex &vertex : mesh.vertices)
+        {
+            if (vertex.m_Weights[0] > 0.0f)
+                continue;
+            if (id < 0)
+            {
+                // the bones of this kind have no name, resolveBones leaves them at their node
+                for (size_t b = 0; b < data.bones.size() && id < 0; b++)
+                    if (data.boneNames[b].empty() && data.bones[b].node == node)
+                        id = (int)b;
+                if (id < 0 && data.bones.size() == maxSkinBones)
+                {
+                    cout << "More than " << maxSkinBones << " bones, the unweighted vertices of a mesh under " << data.nodes.Name(node) << " are left out of the skeleton" << endl;
+                    return;
+                }
+                if (id < 0)
+                {
+                    SkinBone skinBone;
+                    skinBone.node = node;
+                    skinBone.offset = glm::mat4(1.0f);
+                    data.bones.push_back(skinBone);
+                    data.boneNames.push_back(string());
+                    id = (int)data.bones.size() - 1;
+                }
+            }
+            for (int i = 0; i < MAX_BONE_INFLUENCE; i++)
+            {
+                vertex.m_BoneIDs[i] = 0;
+                vertex.m_Weights[i] = 0.0f;
+            }
+            vertex.m_BoneIDs[0] = id;
+            vertex.m_Weights[0] = 1.0f;
+        }
+    }
+
+    // points the bones at their nodes once the whole tree is in the hierarchy
+    static void resolveBones(ModelLoadData &data)
+    {
+        for (size_t b = 0; b < data.bones.size(); b++)
+        {
+            if (data.boneNames[b].empty())
+                continue;
+            int node = data.nodes.Find(data.boneNames[b]);
+            if (node < 0)
+                cout << "No node moves the bone " << data.boneNames[b] << endl;
+            data.bones[b].node = node < 0 ? 0 : (uint32_t)node;
+        }
+    }
+
+    // converts the scene's animations to clips timed in seconds. a channel without keys of some kind holds its
+    // node's imported value for it, so sampling never has to fall back
+    static void processAnimations(const aiScene *scene, ModelLoadData &data)
+    {
+        for(unsigned int a = 0; a < scene->mNumAnimations; a++)
+        {
+            const aiAnimation *animation = scene->mAnimations[a];
+            // Assimp's default when the file doesn't say
+            double ticksPerSecond = animation->mTicksPerSecond > 0.0 ? animation->mTicksPerSecond : 25.0;
+            AnimationClip clip;
+            clip.name = animation->mName.C_Str();
+            clip.duration = (float)(animation->mDuration / ticksPerSecond);
+            auto addKey = [&](double ticks, float x, float y, float z, float w)
+            {
+                AnimationKey key = { (float)(ticks / ticksPerSecond), { x, y, z, w } };
+                clip.keys.push_back(key);
+            };
+            for(unsigned int c = 0; c < animation->mNumChannels; c++)
+            {
+                const aiNodeAnim *keys = animation->mChannels[c];
+                int node = data.nodes.Find(keys->mNodeName.C_Str());
+                const aiNode *sceneNode = scene->mRootNode->FindNode(keys->mNodeName);
+                if (node < 0 || !sceneNode)
+                    continue;
+                aiVector3D bindScale, bindPosition;
+                aiQuaternion bindRotation;
+                sceneNode->mTransformation.Decompose(bindScale, bindRotation, bindPosition);
+
+                AnimationChannel channel;
+                channel.node = (uint32_t)node;
+                channel.firstTranslation = (uint32_t)clip.keys.size();
+                for(unsigned int k = 0; k < keys->mNumPositionKeys; k++)
+                {
+                    const aiVector3D &value = keys->mPositionKeys[k].mValue;
+                    addKey(keys->mPositionKeys[k].mTime, value.x, value.y, value.z, 0.0f);
+                }
+                if (!keys->mNumPositionKeys)
+                    addKey(0.0, bindPosition.x, bindPosition.y, bindPosition.z, 0.0f);
+                channel.translationCount = (uint32_t)clip.keys.size() - channel.firstTranslation;
+                channel.firstRotation = (uint32_t)clip.keys.size();
+                for(unsigned int k = 0; k < keys->mNumRotationKeys; k++)
+                {
+                    const aiQuaternion &value = keys->mRotationKeys[k].mValue;
+                    addKey(keys->mRotationKeys[k].mTime, value.x, value.y, value.z, value.w);
+                }
+                if (!keys->mNumRotationKeys)
+                    addKey(0.0, bindRotation.x, bindRotation.y, bindRotation.z, bindRotation.w);
+                channel.rotationCount = (uint32_t)clip.keys.size() - channel.firstRotation;
+                channel.firstScale = (uint32_t)clip.keys.size();
+                for(unsigned int k = 0; k < keys->mNumScalingKeys; k++)
+                {
+                    const aiVector3D &value = keys->mScalingKeys[k].mValue;
+                    addKey(keys->mScalingKeys[k].mTime, value.x, value.y, value.z, 0.0f);
+                }
+                if (!keys->mNumScalingKeys)
+                    addKey(0.0, bindScale.x, bindScale.y, bindScale.z, 0.0f);
+                channel.scaleCount = (uint32_t)clip.keys.size() - channel.firstScale;
+                clip.channels.push_back(channel);
+            }
+            data.clips.push_back(move(clip));
+        }
+    }
+
+    // collects the texture references of a material for the given type, the textures are loaded later.
     // the required info is returned as a Texture struct.
-    vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName)
+    static vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName)
     {
         vector<Texture> textures;
         for(unsigned int i = 0; i < mat->GetTextureCount(type); i++)
         {
             aiString str;
             mat->GetTexture(type, i, &str);
-            // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-            bool skip = false;
-            for(unsigned int j = 0; j < textures_loaded.size(); j++)
+            Texture texture;
+            texture.id = 0;
+            texture.type = typeName;
+            texture.path = str.C_Str();
+            textures.push_back(texture);
+        }
+        return textures;
+    }
+
+    // paths of the textures of every material with one of the texture types processMesh uses, once each
+    static vector<string> materialTexturePaths(const aiScene *scene)
+    {
+        const aiTextureType types[] = { aiTextureType_DIFFUSE, aiTextureType_SPECULAR, aiTextureType_HEIGHT, aiTextureType_AMBIENT };
+        vector<string> paths;
+        for(unsigned int m = 0; m < scene->mNumMaterials; m++)
+        {
+            for(aiTextureType type : types)
             {
-                if(std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
+                for(unsigned int i = 0; i < scene->mMaterials[m]->GetTextureCount(type); i++)
                 {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                    break;
+                    aiString str;
+                    scene->mMaterials[m]->GetTexture(type, i, &str);
+                    if (find(paths.begin(), paths.end(), string(str.C_Str())) == paths.end())
+                        paths.push_back(str.C_Str());
                 }
             }
-            if(!skip)
-            {   // if texture hasn't been loaded already, load it
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecessary load duplicate textures.
-            }
         }
-        return textures;
+        return paths;
     }
-};
 
+    static vector<string> texturePaths(const vector<MeshData> &meshes)
+    {
+        vector<string> paths;
+        for (const MeshData &mesh : meshes)
+            for (const Texture &texture : mesh.textures)
+                if (find(paths.begin(), paths.end(), texture.path) == paths.end())
+                    paths.push_back(texture.path);
+        return paths;
+    }
+};
 
 unsigned int TextureFromFile(const char *path, const string &directory, bool gamma)
 {
     string filename = string(path);
     filename = directory + '/' + filename;
 
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
-
-    return textureID;
+    return UploadTexture(*LoadTextureImage(filename), path);
 }
 #endif
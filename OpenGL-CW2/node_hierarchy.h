@@ -0,0 +1,138 @@
+#ifndef NODE_HIERARCHY_H
+#define NODE_HIERARCHY_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+using namespace std;
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define NODE_HIERARCHY_SSE 1
+#endif
+
+namespace nodes
+{
+    // a * b for column major matrices: every column of the result is the columns of a weighted by a column of b
+    inline void multiply(const glm::mat4& a, const glm::mat4& b, glm::mat4& result)
+    {
+#ifdef NODE_HIERARCHY_SSE
+        const float* left = &a[0][0];
+        const float* right = &b[0][0];
+        float* output = &result[0][0];
+        __m128 a0 = _mm_loadu_ps(left), a1 = _mm_loadu_ps(left + 4), a2 = _mm_loadu_ps(left + 8), a3 = _mm_loadu_ps(left + 12);
+        for (int column = 0; column < 4; column++)
+        {
+            const float* weights = right + column * 4;
+            __m128 sum = _mm_add_ps(_mm_mul_ps(a0, _mm_set1_ps(weights[0])), _mm_mul_ps(a1, _mm_set1_ps(weights[1])));
+            sum = _mm_add_ps(sum, _mm_add_ps(_mm_mul_ps(a2, _mm_set1_ps(weights[2])), _mm_mul_ps(a3, _mm_set1_ps(weights[3]))));
+            _mm_storeu_ps(output + column * 4, sum);
+        }
+#else
+        result = a * b;
+#endif
+    }
+}
+
+// a model's node tree as flat arrays, every parent before its children, so world matrices are brought up to date
+// with one pass in order. only nodes whose local matrix changed, and the nodes below them, are multiplied again
+class NodeHierarchy
+{
+public:
+    // adds a node under parent (-1 for a root), which has to be added already. returns its index
+    unsigned int Add(const string& name, int parent, const glm::mat4& local)
+    {
+        unsigned int index = (unsigned int)parents.size();
+        names.push_back(name);
+        parents.push_back(parent < (int)index ? parent : -1);
+        locals.push_back(local);
+        worlds.push_back(local);
+        dirty.push_back(1);
+        firstDirty = min(firstDirty, index);
+        return index;
+    }
+
+    size_t Size() const
+    {
+        return parents.size();
+    }
+
+    int Parent(unsigned int node) const
+    {
+        return parents[node];
+    }
+
+    const string& Name(unsigned int node) const
+    {
+        return names[node];
+    }
+
+    // index of the first node with this name, -1 if there is none
+    int Find(const string& name) const
+    {
+        for (size_t i = 0; i < names.size(); i++)
+            if (names[i] == name)
+                return (int)i;
+        return -1;
+    }
+
+    const glm::mat4& Local(unsigned int node) const
+    {
+        return locals[node];
+    }
+
+    // model space matrix of the node, as of the last Update
+    const glm::mat4& World(unsigned int node) const
+    {
+        return node < worlds.size() ? worlds[node] : identity();
+    }
+
+    void SetLocal(unsigned int node, const glm::mat4& local)
+    {
+        locals[node] = local;
+        dirty[node] = 1;
+        firstDirty = min(firstDirty, node);
+    }
+
+    // recomputes the world matrices of the changed nodes and of everything under them. a node's dirty flag passes
+    // to its children as the pass reaches them, parents come first. returns how many were recomputed
+    size_t Update()
+    {
+        size_t updated = 0;
+        for (size_t i = firstDirty; i < parents.size(); i++)
+        {
+            int parent = parents[i];
+            if (parent >= 0 && dirty[parent])
+                dirty[i] = 1;
+            if (!dirty[i])
+                continue;
+            if (parent >= 0)
+                nodes::multiply(worlds[parent], locals[i], worlds[i]);
+            else
+                worlds[i] = locals[i];
+            updated++;
+        }
+        if (firstDirty < dirty.size())
+            fill(dirty.begin() + firstDirty, dirty.end(), 0);
+        firstDirty = (unsigned int)parents.size();
+        return updated;
+    }
+
+private:
+    vector<int> parents;
+    vector<glm::mat4> locals;
+    vector<glm::mat4> worlds;
+    vector<unsigned char> dirty;
+    vector<string> names;
+    // nothing before this node has changed since the last Update
+    unsigned int firstDirty = 0;
+
+    static const glm::mat4& identity()
+    {
+        static const glm::mat4 matrix(1.0f);
+        return matrix;
+    }
+};
+#endif
@@ -0,0 +1,117 @@
+#ifndef OBJ_BENCHMARK_H
+#define OBJ_BENCHMARK_H
+
+#include <assimp/Importer.hpp>
+#include <assimp/postprocess.h>
+#include <assimp/scene.h>
+
+#include "asset_io_system.h"
+#include "obj_loader.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// the synthetic file is a grid of this many quads a side, with positions, texture coordinates and normals
+const int objBenchmarkGrid = 700;
+const int objBenchmarkRuns = 3;
+
+namespace objbench
+{
+    // a bumpy grid split over two materials, about 1M triangles
+    inline bool writeSyntheticObj(const string& path, int grid)
+    {
+        ofstream file(path, ios::binary | ios::trunc);
+        if (!file)
+            return false;
+        file << "# synthetic benchmark grid\n" << fixed << setprecision(6);
+        for (int y = 0; y <= grid; y++)
+            for (int x = 0; x <= grid; x++)
+                file << "v " << x * 0.1f << ' ' << sin(x * 0.3f) * cos(y * 0.2f) << ' ' << y * 0.1f << '\n';
+        for (int y = 0; y <= grid; y++)
+            for (int x = 0; x <= grid; x++)
+                file << "vt " << (float)x / grid << ' ' << (float)y / grid << '\n';
+        for (int y = 0; y <= grid; y++)
+            for (int x = 0; x <= grid; x++)
+            {
+                glm::vec3 normal = glm::normalize(glm::vec3(-0.3f * cos(x * 0.3f) * cos(y * 0.2f), 1.0f, 0.2f * sin(x * 0.3f) * sin(y * 0.2f)));
+                file << "vn " << normal.x << ' ' << normal.y << ' ' << normal.z << '\n';
+            }
+        for (int half = 0; half < 2; half++)
+        {
+            file << "usemtl half" << half << '\n';
+            for (int y = half * grid / 2; y < (half + 1) * grid / 2; y++)
+                for (int x = 0; x < grid; x++)
+                {
+                    int a = y * (grid + 1) + x + 1, b = a + 1, c = a + grid + 2, d = a + grid + 1;
+                    file << "f " << a << '/' << a << '/' << a << ' ' << b << '/' << b << '/' << b << ' '
+                         << c << '/' << c << '/' << c << ' ' << d << '/' << d << '/' << d << '\n';
+                }
+        }
+        return (bool)file;
+    }
+
+    template<class Work>
+    inline double bestOf(Work work)
+    {
+        double best = 1e30;
+        for (int run = 0; run < objBenchmarkRuns; run++)
+        {
+            auto start = chrono::steady_clock::now();
+            work();
+            best = min(best, chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+        }
+        return best;
+    }
+}
+
+// times the OBJ loader against Assimp's importer (with the post processing Model asks for, to an aiScene) on each
+// file and on a generated one, best of a few runs, and prints the table
+inline void BenchmarkObjLoader(vector<string> files)
+{
+    const string synthetic = "obj_benchmark_grid.obj";
+    if (objbench::writeSyntheticObj(synthetic, objBenchmarkGrid))
+        files.push_back(synthetic);
+    else
+        cout << "Could not write " << synthetic << endl;
+    const unsigned int importFlags = aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_JoinIdenticalVertices | aiProcess_LimitBoneWeights;
+
+    cout << "OBJ loader against Assimp, best of " << objBenchmarkRuns << " runs:" << endl;
+    for (const string& path : files)
+    {
+        ObjLoadStats stats;
+        bool loaded = true;
+        double objMs = objbench::bestOf([&]()
+        {
+            vector<MeshData> meshes;
+            loaded = LoadObj(path, meshes, &stats);
+        });
+        size_t assimpTriangles = 0, assimpVertices = 0;
+        double assimpMs = objbench::bestOf([&]()
+        {
+            Assimp::Importer importer;
+            importer.SetIOHandler(new AssetIOSystem());
+            const aiScene* scene = importer.ReadFile(path, importFlags);
+            assimpTriangles = assimpVertices = 0;
+            for (unsigned int m = 0; scene && m < scene->mNumMeshes; m++)
+            {
+                assimpTriangles += scene->mMeshes[m]->mNumFaces;
+                assimpVertices += scene->mMeshes[m]->mNumVertices;
+            }
+        });
+        if (!loaded)
+            continue;
+        cout << "  " << path << " (" << stats.bytes / 1024 << " KB, " << stats.chunks << " chunks): OBJ loader " << objMs << " ms (parse "
+             << stats.parseMs << " ms, meshes " << stats.buildMs << " ms), " << stats.triangles << " triangles, " << stats.vertices
+             << " vertices; Assimp " << assimpMs << " ms, " << assimpTriangles << " triangles, " << assimpVertices << " vertices, "
+             << assimpMs / max(objMs, 1e-3) << "x" << endl;
+    }
+    remove(synthetic.c_str());
+}
+#endif
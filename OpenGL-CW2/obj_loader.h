@@ -0,0 +1,595 @@
+#ifndef OBJ_LOADER_H
+#define OBJ_LOADER_H
+
+#include <glm/glm.hpp>
+
+#include "asset_archive.h"
+#include "mesh.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+// Wavefront OBJ/MTL loader for .obj models in place of Assimp's generic importer: the file is cut into chunks at
+// line ends that are parsed on the thread pool, then every material's triangles become one MeshData with its face
+// corners deduplicated. the result matches what Model gets from Assimp with Triangulate, GenSmoothNormals,
+// FlipUVs and JoinIdenticalVertices (and CalcTangentSpace for materials with a normal map)
+
+// files are cut into chunks of about this many bytes
+const size_t objChunkBytes = 256 * 1024;
+
+struct ObjLoadStats {
+    size_t bytes = 0;
+    size_t chunks = 0;
+    size_t positions = 0;
+    size_t normals = 0;
+    size_t texCoords = 0;
+    size_t triangles = 0;
+    size_t vertices = 0;
+    double parseMs = 0.0;
+    double buildMs = 0.0;
+};
+
+namespace objparse
+{
+    const int missing = INT_MIN;
+
+    // a face corner's position, texture coordinate and normal, in that order. an index into the whole file, or for
+    // the bits set in relative an index into the chunk it was parsed in that still needs the chunk's base added
+    // (a negative index in the file, which counts back from the last element so far). missing when the face has none
+    struct Corner {
+        int index[3];
+        unsigned char relative;
+    };
+
+    struct MaterialSwitch {
+        size_t firstTriangle;
+        string name;
+    };
+
+    // what one chunk of lines holds, elements counted from the chunk's start
+    struct Chunk {
+        const char* begin = NULL;
+        const char* end = NULL;
+        vector<glm::vec3> positions;
+        vector<glm::vec3> normals;
+        vector<glm::vec2> texCoords;
+        // three per triangle, polygons are split into fans
+        vector<Corner> corners;
+        vector<MaterialSwitch> materials;
+        vector<string> libraries;
+    };
+
+    inline bool isSpace(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    inline const char* skipSpace(const char* p, const char* end)
+    {
+        while (p < end && isSpace(*p))
+            p++;
+        return p;
+    }
+
+    inline const char* skipWord(const char* p, const char* end)
+    {
+        while (p < end && !isSpace(*p))
+            p++;
+        return p;
+    }
+
+    // the next number on the line, 0 if there is none or it doesn't parse
+    template<class Number>
+    inline const char* parseNumber(const char* p, const char* end, Number& value)
+    {
+        p = skipSpace(p, end);
+        // from_chars takes a minus sign but no plus
+        if (p < end && *p == '+')
+            p++;
+        from_chars_result result = from_chars(p, end, value);
+        if (result.ec != errc())
+        {
+            value = 0;
+            return skipWord(p, end);
+        }
+        return result.ptr;
+    }
+
+    // the rest of the line without surrounding whitespace
+    inline string restOfLine(const char* p, const char* end)
+    {
+        p = skipSpace(p, end);
+        while (end > p && isSpace(end[-1]))
+            end--;
+        return string(p, end);
+    }
+
+    inline bool keyword(const char* p, const char* end, const char* word)
+    {
+        size_t length = strlen(word);
+        return (size_t)(end - p) > length && memcmp(p, word, length) == 0 && isSpace(p[length]);
+    }
+
+    inline void parseFace(const char* p, const char* end, Chunk& chunk)
+    {
+        size_t counts[3] = { chunk.positions.size(), chunk.texCoords.size(), chunk.normals.size() };
+        Corner first = Corner(), previous = Corner();
+        int cornerCount = 0;
+        while ((p = skipSpace(p, end)) < end)
+        {
+            Corner corner;
+            corner.relative = 0;
+            corner.index[0] = corner.index[1] = corner.index[2] = missing;
+            const char* start = p;
+            for (int c = 0; c < 3 && p < end; c++)
+            {
+                if (*p == '+')
+                    p++;
+                if (p < end && *p != '/')
+                {
+                    int value = 0;
+                    from_chars_result result = from_chars(p, end, value);
+                    if (result.ec != errc())
+                        break;
+                    p = result.ptr;
+                    if (value > 0)
+                        corner.index[c] = value - 1;
+                    else if (value < 0)
+                    {
+                        corner.index[c] = (int)counts[c] + value;
+                        corner.relative |= 1 << c;
+                    }
+                }
+                if (p >= end || *p != '/')
+                    break;
+                p++;
+            }
+            // anything else in the word is ignored
+            p = skipWord(p, end);
+            if (p == start)
+                p++;
+            if (corner.index[0] == missing)
+                continue;
+
+            if (cornerCount >= 2)
+            {
+                chunk.corners.push_back(first);
+                chunk.corners.push_back(previous);
+                chunk.corners.push_back(corner);
+            }
+            if (cornerCount == 0)
+                first = corner;
+            previous = corner;
+            cornerCount++;
+        }
+    }
+
+    inline void parseChunk(Chunk& chunk)
+    {
+        const char* p = chunk.begin;
+        while (p < chunk.end)
+        {
+            const char* lineEnd = (const char*)memchr(p, '\n', chunk.end - p);
+            if (!lineEnd)
+                lineEnd = chunk.end;
+            p = skipSpace(p, lineEnd);
+            if (lineEnd - p >= 2)
+            {
+                if (p[0] == 'v' && isSpace(p[1]))
+                {
+                    glm::vec3 position;
+                    const char* q = parseNumber(p + 2, lineEnd, position.x);
+                    q = parseNumber(q, lineEnd, position.y);
+                    parseNumber(q, lineEnd, position.z);
+                    chunk.positions.push_back(position);
+                }
+                else if (p[0] == 'v' && p[1] == 'n')
+                {
+                    glm::vec3 normal;
+                    const char* q = parseNumber(p + 2, lineEnd, normal.x);
+                    q = parseNumber(q, lineEnd, normal.y);
+                    parseNumber(q, lineEnd, normal.z);
+                    chunk.normals.push_back(normal);
+                }
+                else if (p[0] == 'v' && p[1] == 't')
+                {
+                    glm::vec2 texCoord;
+                    const char* q = parseNumber(p + 2, lineEnd, texCoord.x);
+                    parseNumber(q, lineEnd, texCoord.y);
+                    chunk.texCoords.push_back(texCoord);
+                }
+                else if (p[0] == 'f' && isSpace(p[1]))
+                    parseFace(p + 2, lineEnd, chunk);
+                else if (keyword(p, lineEnd, "usemtl"))
+                {
+                    MaterialSwitch material;
+                    material.firstTriangle = chunk.corners.size() / 3;
+                    material.name = restOfLine(p + 6, lineEnd);
+                    chunk.materials.push_back(material);
+                }
+                else if (keyword(p, lineEnd, "mtllib"))
+                    chunk.libraries.push_back(restOfLine(p + 6, lineEnd));
+            }
+            p = lineEnd + 1;
+        }
+    }
+
+    // texture references of every material in an MTL file, typed the way Model::processMesh types Assimp's
+    inline void parseMaterials(const AssetData& file, unordered_map<string, vector<Texture>>& materials)
+    {
+        const char* p = (const char*)file.Data();
+        const char* end = p + file.Size();
+        vector<Texture>* current = NULL;
+        while (p < end)
+        {
+            const char* lineEnd = (const char*)memchr(p, '\n', end - p);
+            if (!lineEnd)
+                lineEnd = end;
+            p = skipSpace(p, lineEnd);
+            const char* word = skipWord(p, lineEnd);
+            string name(p, word);
+            for (char& c : name)
+                c = (char)tolower((unsigned char)c);
+            if (name == "newmtl")
+                current = &materials[restOfLine(word, lineEnd)];
+            else if (current)
+            {
+                const char* type = NULL;
+                if (name == "map_kd")
+                    type = "texture_diffuse";
+                else if (name == "map_ks")
+                    type = "texture_specular";
+                else if (name == "map_bump" || name == "bump" || name == "norm")
+                    type = "texture_normal";
+                else if (name == "map_ka")
+                    type = "texture_height";
+                // options (-bm 1.0, ...) come before the file name, the last word on the line
+                const char* last = lineEnd;
+                while (last > word && isSpace(last[-1]))
+                    last--;
+                const char* first = last;
+                while (first > word && !isSpace(first[-1]))
+                    first--;
+                if (type && first < last)
+                {
+                    Texture texture;
+                    texture.id = 0;
+                    texture.type = type;
+                    texture.path = string(first, last);
+                    current->push_back(texture);
+                }
+            }
+            p = lineEnd + 1;
+        }
+    }
+
+    // open addressing map from a corner's indices to its vertex, sized once for every corner of a mesh
+    class CornerTable
+    {
+    public:
+        explicit CornerTable(size_t cornerCount)
+        {
+            size_t capacity = 16;
+            while (capacity < cornerCount * 2)
+                capacity *= 2;
+            mask = capacity - 1;
+            slots.resize(capacity);
+        }
+
+        // the vertex for the corner, next if it is new
+        unsigned int Insert(const Corner& corner, unsigned int next, bool& inserted)
+        {
+            uint64_t hash = (uint32_t)corner.index[0] * 0x9E3779B97F4A7C15ull;
+            hash ^= ((uint32_t)corner.index[1] + 0x632BE59BD9B4E019ull) * 0xC2B2AE3D27D4EB4Full;
+            hash ^= ((uint32_t)corner.index[2] + 0x165667B19E3779F9ull) * 0x94D049BB133111EBull;
+            for (size_t i = (size_t)(hash ^ hash >> 29) & mask;; i = (i + 1) & mask)
+            {
+                Slot& slot = slots[i];
+                if (!slot.used)
+                {
+                    slot.used = true;
+                    memcpy(slot.index, corner.index, sizeof(slot.index));
+                    slot.vertex = next;
+                    inserted = true;
+                    return next;
+                }
+                if (slot.index[0] == corner.index[0] && slot.index[1] == corner.index[1] && slot.index[2] == corner.index[2])
+                {
+                    inserted = false;
+                    return slot.vertex;
+                }
+            }
+        }
+
+    private:
+        struct Slot {
+            int index[3];
+            unsigned int vertex;
+            bool used = false;
+        };
+        vector<Slot> slots;
+        size_t mask;
+    };
+
+    // area weighted face normals summed over every corner at the same position, for corners the file gave none
+    inline void smoothNormals(MeshData& mesh, const vector<int>& positionOf, const vector<char>& hasNormal)
+    {
+        unordered_map<int, glm::vec3> sums;
+        for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+        {
+            const unsigned int* triangle = &mesh.indices[i];
+            glm::vec3 normal = glm::cross(mesh.vertices[triangle[1]].Position - mesh.vertices[triangle[0]].Position,
+                                          mesh.vertices[triangle[2]].Position - mesh.vertices[triangle[0]].Position);
+            for (int k = 0; k < 3; k++)
+                if (!hasNormal[triangle[k]])
+                    sums[positionOf[triangle[k]]] += normal;
+        }
+        for (size_t v = 0; v < mesh.vertices.size(); v++)
+            if (!hasNormal[v])
+            {
+                glm::vec3 sum = sums[positionOf[v]];
+                float length = glm::length(sum);
+                mesh.vertices[v].Normal = length > 0.0f ? sum / length : glm::vec3(0.0f, 1.0f, 0.0f);
+            }
+    }
+
+    // per vertex tangent and bitangent from the texture coordinates, summed over its triangles
+    inline void computeTangents(MeshData& mesh)
+    {
+        for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+        {
+            Vertex* corners[3] = { &mesh.vertices[mesh.indices[i]], &mesh.vertices[mesh.indices[i + 1]], &mesh.vertices[mesh.indices[i + 2]] };
+            glm::vec3 edge1 = corners[1]->Position - corners[0]->Position;
+            glm::vec3 edge2 = corners[2]->Position - corners[0]->Position;
+            glm::vec2 delta1 = corners[1]->TexCoords - corners[0]->TexCoords;
+            glm::vec2 delta2 = corners[2]->TexCoords - corners[0]->TexCoords;
+            float determinant = delta1.x * delta2.y - delta2.x * delta1.y;
+            if (fabs(determinant) < 1e-12f)
+                continue;
+            float inverse = 1.0f / determinant;
+            glm::vec3 tangent = (edge1 * delta2.y - edge2 * delta1.y) * inverse;
+            glm::vec3 bitangent = (edge2 * delta1.x - edge1 * delta2.x) * inverse;
+            for (Vertex* corner : corners)
+            {
+                corner->Tangent += tangent;
+                corner->Bitangent += bitangent;
+            }
+        }
+        for (Vertex& vertex : mesh.vertices)
+        {
+            // made orthogonal to the normal
+            glm::vec3 tangent = vertex.Tangent - vertex.Normal * glm::dot(vertex.Normal, vertex.Tangent);
+            float length = glm::length(tangent);
+            vertex.Tangent = length > 0.0f ? tangent / length : glm::vec3(0.0f);
+            length = glm::length(vertex.Bitangent);
+            vertex.Bitangent = length > 0.0f ? vertex.Bitangent / length : glm::vec3(0.0f);
+        }
+    }
+}
+
+// loads an OBJ file (and the MTL files it names, next to it) into one mesh per material, vertices and indices
+// unpacked for OptimizeMeshData. false with an error printed if it can't be opened or has no triangles
+inline bool LoadObj(const string& path, vector<MeshData>& meshes, ObjLoadStats* stats = NULL)
+{
+    using namespace objparse;
+    auto start = chrono::steady_clock::now();
+    AssetData file = OpenAsset(path);
+    if (!file)
+    {
+        cout << "ERROR::OBJ::FILE_NOT_FOUND: " << path << endl;
+        return false;
+    }
+
+    // chunk boundaries moved forward to the next line
+    const char* text = (const char*)file.Data();
+    const char* textEnd = text + file.Size();
+    size_t chunkCount = file.Size() / objChunkBytes + 1;
+    vector<Chunk> chunks(chunkCount);
+    const char* boundary = text;
+    for (size_t c = 0; c < chunkCount; c++)
+    {
+        chunks[c].begin = boundary;
+        if (c + 1 < chunkCount)
+        {
+            const char* split = max(boundary, text + file.Size() * (c + 1) / chunkCount);
+            const char* lineEnd = (const char*)memchr(split, '\n', textEnd - split);
+            boundary = lineEnd ? lineEnd + 1 : textEnd;
+        }
+        else
+            boundary = textEnd;
+        chunks[c].end = boundary;
+    }
+    ThreadPool::Get().ParallelFor(chunks.size(), [&](size_t c) { parseChunk(chunks[c]); });
+
+    // chunk relative indices become file indices, out of range ones missing
+    vector<size_t> bases[3];
+    size_t totals[3] = { 0, 0, 0 };
+    for (const Chunk& chunk : chunks)
+    {
+        size_t counts[3] = { chunk.positions.size(), chunk.texCoords.size(), chunk.normals.size() };
+        for (int k = 0; k < 3; k++)
+        {
+            bases[k].push_back(totals[k]);
+            totals[k] += counts[k];
+        }
+    }
+    vector<glm::vec3> positions, normals;
+    vector<glm::vec2> texCoords;
+    positions.reserve(totals[0]);
+    texCoords.reserve(totals[1]);
+    normals.reserve(totals[2]);
+    for (const Chunk& chunk : chunks)
+    {
+        positions.insert(positions.end(), chunk.positions.begin(), chunk.positions.end());
+        texCoords.insert(texCoords.end(), chunk.texCoords.begin(), chunk.texCoords.end());
+        normals.insert(normals.end(), chunk.normals.begin(), chunk.normals.end());
+    }
+    ThreadPool::Get().ParallelFor(chunks.size(), [&](size_t c)
+    {
+        for (Corner& corner : chunks[c].corners)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                if (corner.index[k] == missing)
+                    continue;
+                long long index = corner.index[k] + ((corner.relative >> k) & 1 ? (long long)bases[k][c] : 0);
+                corner.index[k] = index >= 0 && index < (long long)totals[k] ? (int)index : missing;
+            }
+        }
+    });
+
+    // every material's triangles, in file order: runs of (chunk, first triangle, end triangle)
+    struct Run {
+        size_t chunk;
+        size_t first;
+        size_t end;
+    };
+    vector<string> materialNames;
+    vector<vector<Run>> runs;
+    vector<string> libraries;
+    size_t current = 0;
+    materialNames.push_back("");
+    runs.emplace_back();
+    for (size_t c = 0; c < chunks.size(); c++)
+    {
+        const Chunk& chunk = chunks[c];
+        libraries.insert(libraries.end(), chunk.libraries.begin(), chunk.libraries.end());
+        size_t triangleCount = chunk.corners.size() / 3;
+        size_t first = 0;
+        for (size_t s = 0; s <= chunk.materials.size(); s++)
+        {
+            size_t end = s < chunk.materials.size() ? chunk.materials[s].firstTriangle : triangleCount;
+            if (end > first)
+                runs[current].push_back(Run{ c, first, end });
+            first = end;
+            if (s < chunk.materials.size())
+            {
+                const string& name = chunk.materials[s].name;
+                current = find(materialNames.begin(), materialNames.end(), name) - materialNames.begin();
+                if (current == materialNames.size())
+                {
+                    materialNames.push_back(name);
+                    runs.emplace_back();
+                }
+            }
+        }
+    }
+    auto parsed = chrono::steady_clock::now();
+
+    unordered_map<string, vector<Texture>> materials;
+    string directory = path.substr(0, path.find_last_of('/') + 1);
+    for (const string& library : libraries)
+    {
+        AssetData materialFile = OpenAsset(directory + library);
+        if (materialFile)
+            parseMaterials(materialFile, materials);
+        else
+            cout << "ERROR::OBJ::MATERIAL_LIBRARY_NOT_FOUND: " << directory + library << endl;
+    }
+
+    // one mesh per material, each built on its own worker
+    vector<MeshData> built(materialNames.size());
+    ThreadPool::Get().ParallelFor(built.size(), [&](size_t m)
+    {
+        MeshData& mesh = built[m];
+        auto found = materials.find(materialNames[m]);
+        if (found != materials.end())
+            mesh.textures = found->second;
+        size_t cornerCount = 0;
+        for (const Run& run : runs[m])
+            cornerCount += (run.end - run.first) * 3;
+        CornerTable lookup(cornerCount);
+        mesh.indices.reserve(cornerCount);
+        vector<int> positionOf;
+        vector<char> hasNormal;
+        bool generateNormals = false;
+        for (const Run& run : runs[m])
+        {
+            const Corner* corners = &chunks[run.chunk].corners[run.first * 3];
+            for (size_t t = 0; t < run.end - run.first; t++, corners += 3)
+            {
+                if (corners[0].index[0] == missing || corners[1].index[0] == missing || corners[2].index[0] == missing)
+                    continue;
+                for (int k = 0; k < 3; k++)
+                {
+                    const Corner& corner = corners[k];
+                    bool inserted;
+                    unsigned int vertexIndex = lookup.Insert(corner, (unsigned int)mesh.vertices.size(), inserted);
+                    if (inserted)
+                    {
+                        Vertex vertex = Vertex();
+                        vertex.Position = positions[corner.index[0]];
+                        if (corner.index[1] != missing)
+                        {
+                            // flipped like aiProcess_FlipUVs
+                            vertex.TexCoords = glm::vec2(texCoords[corner.index[1]].x, 1.0f - texCoords[corner.index[1]].y);
+                            mesh.hasTexCoords = true;
+                        }
+                        if (corner.index[2] != missing)
+                            vertex.Normal = normals[corner.index[2]];
+                        else
+                            generateNormals = true;
+                        mesh.vertices.push_back(vertex);
+                        positionOf.push_back(corner.index[0]);
+                        hasNormal.push_back(corner.index[2] != missing);
+                    }
+                    mesh.indices.push_back(vertexIndex);
+                }
+            }
+        }
+        if (generateNormals)
+            smoothNormals(mesh, positionOf, hasNormal);
+        for (const Texture& texture : mesh.textures)
+            if (texture.type == "texture_normal" && mesh.hasTexCoords)
+            {
+                computeTangents(mesh);
+                break;
+            }
+    });
+
+    size_t triangles = 0, vertices = 0;
+    for (MeshData& mesh : built)
+    {
+        if (mesh.indices.empty())
+            continue;
+        triangles += mesh.indices.size() / 3;
+        vertices += mesh.vertices.size();
+        meshes.push_back(move(mesh));
+    }
+    if (stats)
+    {
+        stats->bytes = file.Size();
+        stats->chunks = chunks.size();
+        stats->positions = totals[0];
+        stats->texCoords = totals[1];
+        stats->normals = totals[2];
+        stats->triangles = triangles;
+        stats->vertices = vertices;
+        stats->parseMs = chrono::duration<double, milli>(parsed - start).count();
+        stats->buildMs = chrono::duration<double, milli>(chrono::steady_clock::now() - parsed).count();
+    }
+    if (!triangles)
+    {
+        cout << "ERROR::OBJ::NO_TRIANGLES: " << path << endl;
+        return false;
+    }
+    return true;
+}
+
+inline bool IsObjPath(const string& path)
+{
+    size_t dot = path.find_last_of('.');
+    return dot != string::npos && AssetKey(path.substr(dot)) == ".obj";
+}
+#endif
@@ -0,0 +1,155 @@
+#ifndef RESOURCE_CACHE_H
+#define RESOURCE_CACHE_H
+
+#include <glad/glad.h>
+
+#include "mesh.h"
+
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+using namespace std;
+
+// a GL texture shared by every model that uses the same file or the same decoded pixels
+struct SharedTexture {
+    unsigned int id = 0;
+    string filename;
+    uint64_t contentHash = 0;
+};
+
+// process wide registry of GPU textures and meshes, looked up by hash. entries are reference counted through
+// the shared_ptrs handed out; CollectUnused deletes the GL objects nobody refers to any more. GL objects are
+// only created and deleted on the context thread, lookups are safe from any thread
+class ResourceCache
+{
+public:
+    struct Stats {
+        size_t textureHits = 0;
+        size_t textureContentHits = 0;
+        size_t textureMisses = 0;
+        size_t meshHits = 0;
+        size_t meshMisses = 0;
+    };
+
+    static ResourceCache& Get()
+    {
+        static ResourceCache cache;
+        return cache;
+    }
+
+    // texture already registered for a file, or null. loaders use it to skip decoding
+    shared_ptr<SharedTexture> FindTexture(const string& filename)
+    {
+        lock_guard<mutex> lock(guard);
+        auto found = texturesByFile.find(filename);
+        return found == texturesByFile.end() ? shared_ptr<SharedTexture>() : found->second;
+    }
+
+    // the texture for a decoded file. an earlier file with identical pixels is reused, otherwise a new GL
+    // name is created and created is set: the caller uploads the pixels into it. context thread only
+    shared_ptr<SharedTexture> AcquireTexture(const string& filename, uint64_t contentHash, bool& created)
+    {
+        lock_guard<mutex> lock(guard);
+        created = false;
+        auto byFile = texturesByFile.find(filename);
+        if (byFile != texturesByFile.end())
+        {
+            stats.textureHits++;
+            return byFile->second;
+        }
+        auto byContent = texturesByContent.find(contentHash);
+        if (byContent != texturesByContent.end())
+        {
+            stats.textureContentHits++;
+            texturesByFile[filename] = byContent->second;
+            return byContent->second;
+        }
+        stats.textureMisses++;
+        auto texture = make_shared<SharedTexture>();
+        glGenTextures(1, &texture->id);
+        texture->filename = filename;
+        texture->contentHash = contentHash;
+        texturesByFile[filename] = texture;
+        texturesByContent[contentHash] = texture;
+        created = true;
+        return texture;
+    }
+
+    // mesh with identical vertex and index arrays, or null
+    shared_ptr<Mesh> FindMesh(uint64_t contentHash)
+    {
+        lock_guard<mutex> lock(guard);
+        auto found = meshes.find(contentHash);
+        if (found == meshes.end())
+        {
+            stats.meshMisses++;
+            return shared_ptr<Mesh>();
+        }
+        stats.meshHits++;
+        return found->second;
+    }
+
+    void AddMesh(uint64_t contentHash, const shared_ptr<Mesh>& mesh)
+    {
+        lock_guard<mutex> lock(guard);
+        meshes[contentHash] = mesh;
+    }
+
+    // deletes the textures and meshes only the cache still refers to. context thread only
+    void CollectUnused()
+    {
+        lock_guard<mutex> lock(guard);
+        for (auto it = meshes.begin(); it != meshes.end();)
+        {
+            if (it->second.use_count() == 1)
+            {
+                it->second->Release();
+                it = meshes.erase(it);
+            }
+            else
+                ++it;
+        }
+        // a texture is referenced once by content and once per file name it was requested under
+        for (auto it = texturesByContent.begin(); it != texturesByContent.end();)
+        {
+            shared_ptr<SharedTexture> texture = it->second;
+            long names = 0;
+            for (const auto& entry : texturesByFile)
+                names += entry.second == texture;
+            // this local copy, the content entry and the file entries
+            if (texture.use_count() == 2 + names)
+            {
+                glDeleteTextures(1, &texture->id);
+                for (auto file = texturesByFile.begin(); file != texturesByFile.end();)
+                {
+                    if (file->second == texture)
+                        file = texturesByFile.erase(file);
+                    else
+                        ++file;
+                }
+                it = texturesByContent.erase(it);
+            }
+            else
+                ++it;
+        }
+    }
+
+    void PrintReport() const
+    {
+        lock_guard<mutex> lock(guard);
+        cout << "Resource cache: " << texturesByContent.size() << " textures, " << meshes.size() << " meshes" << endl;
+        cout << "  textures: " << stats.textureHits << " shared by file, " << stats.textureContentHits << " shared by content, " << stats.textureMisses << " created" << endl;
+        cout << "  meshes: " << stats.meshHits << " shared, " << stats.meshMisses << " created" << endl;
+    }
+
+private:
+    mutable mutex guard;
+    unordered_map<string, shared_ptr<SharedTexture>> texturesByFile;
+    unordered_map<uint64_t, shared_ptr<SharedTexture>> texturesByContent;
+    unordered_map<uint64_t, shared_ptr<Mesh>> meshes;
+    Stats stats;
+};
+#endif
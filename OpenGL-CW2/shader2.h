@@ -4,6 +4,9 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include "asset_archive.h"
+#include "load_profiler.h"
+
 #include <string>
 #include <fstream>
 #include <sstream>
@@ -17,71 +20,48 @@ public:
     // ------------------------------------------------------------------------
     Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
     {
-        // 1. retrieve the vertex/fragment source code from filePath
-        std::string vertexCode;
-        std::string fragmentCode;
-        std::string geometryCode;
-        std::ifstream vShaderFile;
-        std::ifstream fShaderFile;
-        std::ifstream gShaderFile;
-        // ensure ifstream objects can throw exceptions:
-        vShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        fShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        gShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        try 
-        {
-            // open files
-            vShaderFile.open(vertexPath);
-            fShaderFile.open(fragmentPath);
-            std::stringstream vShaderStream, fShaderStream;
-            // read file's buffer contents into streams
-            vShaderStream << vShaderFile.rdbuf();
-            fShaderStream << fShaderFile.rdbuf();		
-            // close file handlers
-            vShaderFile.close();
-            fShaderFile.close();
-            // convert stream into string
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();			
-            // if geometry shader path is present, also load a geometry shader
-            if(geometryPath != nullptr)
-            {
-                gShaderFile.open(geometryPath);
-                std::stringstream gShaderStream;
-                gShaderStream << gShaderFile.rdbuf();
-                gShaderFile.close();
-                geometryCode = gShaderStream.str();
-            }
-        }
-        catch (std::ifstream::failure& e)
-        {
-            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
-        }
-        const char* vShaderCode = vertexCode.c_str();
-        const char * fShaderCode = fragmentCode.c_str();
+        // 1. retrieve the vertex/fragment source code from the asset archive or the loose files, handed to GL
+        // with their lengths straight from the mapping
+        ProfileScope reading("shader read");
+        AssetData vertexFile = OpenAsset(vertexPath);
+        AssetData fragmentFile = OpenAsset(fragmentPath);
+        AssetData geometryFile;
+        if(geometryPath != nullptr)
+            geometryFile = OpenAsset(geometryPath);
+        if (!vertexFile || !fragmentFile || (geometryPath != nullptr && !geometryFile))
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << (!vertexFile ? vertexPath : !fragmentFile ? fragmentPath : geometryPath) << std::endl;
+        const char* vShaderCode = vertexFile ? (const char*)vertexFile.Data() : "";
+        const char * fShaderCode = fragmentFile ? (const char*)fragmentFile.Data() : "";
+        GLint vShaderLength = (GLint)vertexFile.Size();
+        GLint fShaderLength = (GLint)fragmentFile.Size();
+        reading.End();
         // 2. compile shaders
+        ProfileScope compiling("shader compile");
         unsigned int vertex, fragment;
         // vertex shader
         vertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex, 1, &vShaderCode, NULL);
+        glShaderSource(vertex, 1, &vShaderCode, &vShaderLength);
         glCompileShader(vertex);
         checkCompileErrors(vertex, "VERTEX");
         // fragment Shader
         fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
+        glShaderSource(fragment, 1, &fShaderCode, &fShaderLength);
         glCompileShader(fragment);
         checkCompileErrors(fragment, "FRAGMENT");
         // if geometry shader is given, compile geometry shader
         unsigned int geometry;
         if(geometryPath != nullptr)
         {
-            const char * gShaderCode = geometryCode.c_str();
+            const char * gShaderCode = geometryFile ? (const char*)geometryFile.Data() : "";
+            GLint gShaderLength = (GLint)geometryFile.Size();
             geometry = glCreateShader(GL_GEOMETRY_SHADER);
-            glShaderSource(geometry, 1, &gShaderCode, NULL);
+            glShaderSource(geometry, 1, &gShaderCode, &gShaderLength);
             glCompileShader(geometry);
             checkCompileErrors(geometry, "GEOMETRY");
         }
-        // shader Program
+        compiling.End();
+        // shader Program, drivers may leave most of the compiling until the link
+        ProfileScope linking("shader link");
         ID = glCreateProgram();
         glAttachShader(ID, vertex);
         glAttachShader(ID, fragment);
@@ -4,6 +4,9 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include "asset_archive.h"
+#include "load_profiler.h"
+
 #include <string>
 #include <fstream>
 #include <sstream>
@@ -17,49 +20,34 @@ public:
     // ------------------------------------------------------------------------
     Shader(const char* vertexPath, const char* fragmentPath)
     {
-        // 1. retrieve the vertex/fragment source code from filePath
-        std::string vertexCode;
-        std::string fragmentCode;
-        std::ifstream vShaderFile;
-        std::ifstream fShaderFile;
-        // ensure ifstream objects can throw exceptions:
-        vShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        fShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        try 
-        {
-            // open files
-            vShaderFile.open(vertexPath);
-            fShaderFile.open(fragmentPath);
-            std::stringstream vShaderStream, fShaderStream;
-            // read file's buffer contents into streams
-            vShaderStream << vShaderFile.rdbuf();
-            fShaderStream << fShaderFile.rdbuf();		
-            // close file handlers
-            vShaderFile.close();
-            fShaderFile.close();
-            // convert stream into string
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();			
-        }
-        catch (std::ifstream::failure& e)
-        {
-            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
-        }
-        const char* vShaderCode = vertexCode.c_str();
-        const char * fShaderCode = fragmentCode.c_str();
+        // 1. retrieve the vertex/fragment source code from the asset archive or the loose files, handed to GL
+        // with their lengths straight from the mapping
+        ProfileScope reading("shader read");
+        AssetData vertexFile = OpenAsset(vertexPath);
+        AssetData fragmentFile = OpenAsset(fragmentPath);
+        if (!vertexFile || !fragmentFile)
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << (vertexFile ? fragmentPath : vertexPath) << std::endl;
+        const char* vShaderCode = vertexFile ? (const char*)vertexFile.Data() : "";
+        const char * fShaderCode = fragmentFile ? (const char*)fragmentFile.Data() : "";
+        GLint vShaderLength = (GLint)vertexFile.Size();
+        GLint fShaderLength = (GLint)fragmentFile.Size();
+        reading.End();
         // 2. compile shaders
+        ProfileScope compiling("shader compile");
         unsigned int vertex, fragment;
         // vertex shader
         vertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex, 1, &vShaderCode, NULL);
+        glShaderSource(vertex, 1, &vShaderCode, &vShaderLength);
         glCompileShader(vertex);
         checkCompileErrors(vertex, "VERTEX");
         // fragment Shader
         fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
+        glShaderSource(fragment, 1, &fShaderCode, &fShaderLength);
         glCompileShader(fragment);
         checkCompileErrors(fragment, "FRAGMENT");
-        // shader Program
+        compiling.End();
+        // shader Program, drivers may leave most of the compiling until the link
+        ProfileScope linking("shader link");
         ID = glCreateProgram();
         glAttachShader(ID, vertex);
         glAttachShader(ID, fragment);
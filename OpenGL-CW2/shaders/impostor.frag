@@ -0,0 +1,41 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 frameUv[4];
+flat in ivec2 frameCells[4];
+flat in vec4 frameWeights;
+in vec3 worldPosition;
+flat in vec3 depthAxis;
+
+uniform sampler2D impostorAlbedo;
+uniform sampler2D impostorDepth;
+uniform int impostorFrames;
+uniform mat4 view;
+uniform mat4 projection;
+
+void main()
+{
+    vec4 colour = vec4(0.0);
+    float weight = 0.0;
+    float depth = 0.0;
+    float coverage = 0.0;
+    for (int k = 0; k < 4; k++)
+    {
+        //Past the edge of its frame the quad would read the neighbouring one
+        vec2 uv = clamp(frameUv[k], vec2(0.0), vec2(1.0));
+        float w = uv == frameUv[k] ? frameWeights[k] : 0.0;
+        vec2 atlasUv = (vec2(frameCells[k]) + uv) / float(impostorFrames);
+        vec4 texel = texture(impostorAlbedo, atlasUv);
+        colour += texel * w;
+        weight += w;
+        depth += texture(impostorDepth, atlasUv).r * texel.a * w;
+        coverage += texel.a * w;
+    }
+    if (weight <= 0.0 || colour.a < 0.5 * weight)
+        discard;
+
+    //Depth 0 is the front of the bounding sphere, 1 its back, the quad is halfway
+    vec4 clip = projection * view * vec4(worldPosition + depthAxis * (depth / coverage - 0.5), 1.0);
+    gl_FragDepth = clip.z / clip.w * 0.5 + 0.5;
+    FragColor = vec4(colour.rgb / weight, 1.0);
+}
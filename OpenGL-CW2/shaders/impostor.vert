@@ -0,0 +1,76 @@
+#version 330 core
+layout (location = 0) in vec2 aCorner;
+layout (location = 1) in mat4 aTransform;
+layout (location = 5) in vec4 aDirection;
+
+//Where the fragment falls in each of the 4 frames nearest the view, and how much each frame counts
+out vec2 frameUv[4];
+flat out ivec2 frameCells[4];
+flat out vec4 frameWeights;
+out vec3 worldPosition;
+//Across the bounding sphere along the view, from its front to its back, in world units
+flat out vec3 depthAxis;
+
+uniform mat4 view;
+uniform mat4 projection;
+uniform vec3 impostorCenter;
+uniform float impostorRadius;
+uniform int impostorFrames;
+
+//The octahedral mapping and frame cameras of impostor.h
+vec2 signNotZero(vec2 v)
+{
+    return vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+vec2 encode(vec3 direction)
+{
+    direction /= abs(direction.x) + abs(direction.y) + abs(direction.z);
+    vec2 p = direction.xz;
+    if (direction.y < 0.0)
+        p = (1.0 - abs(p.yx)) * signNotZero(p);
+    return p * 0.5 + 0.5;
+}
+
+vec3 decode(vec2 uv)
+{
+    vec2 p = uv * 2.0 - 1.0;
+    vec3 direction = vec3(p.x, 1.0 - abs(p.x) - abs(p.y), p.y);
+    if (direction.y < 0.0)
+        direction.xz = (1.0 - abs(p.yx)) * signNotZero(p);
+    return normalize(direction);
+}
+
+void frameBasis(vec3 direction, out vec3 right, out vec3 up)
+{
+    vec3 worldUp = abs(direction.y) > 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(0.0, 1.0, 0.0);
+    right = normalize(cross(worldUp, direction));
+    up = cross(direction, right);
+}
+
+void main()
+{
+    //A quad through the model's center facing the camera, as big as the bounding sphere
+    vec3 direction = aDirection.xyz;
+    vec3 right, up;
+    frameBasis(direction, right, up);
+    vec3 offset = (right * aCorner.x + up * aCorner.y) * impostorRadius;
+    vec4 world = aTransform * vec4(impostorCenter + offset, 1.0);
+    worldPosition = world.xyz;
+    gl_Position = projection * view * world;
+
+    //Bilinear weights of the frames around the view direction, each frame's camera seeing the quad's point
+    vec2 grid = encode(direction) * float(impostorFrames) - 0.5;
+    vec2 base = floor(grid);
+    vec2 f = grid - base;
+    frameWeights = vec4((1.0 - f.x) * (1.0 - f.y), f.x * (1.0 - f.y), (1.0 - f.x) * f.y, f.x * f.y);
+    for (int k = 0; k < 4; k++)
+    {
+        ivec2 cell = clamp(ivec2(base) + ivec2(k & 1, k >> 1), ivec2(0), ivec2(impostorFrames - 1));
+        vec3 frameRight, frameUp;
+        frameBasis(decode((vec2(cell) + 0.5) / float(impostorFrames)), frameRight, frameUp);
+        frameCells[k] = cell;
+        frameUv[k] = 0.5 + 0.5 * vec2(dot(offset, frameRight), dot(offset, frameUp)) / impostorRadius;
+    }
+    depthAxis = mat3(aTransform) * (-direction * 2.0 * impostorRadius);
+}
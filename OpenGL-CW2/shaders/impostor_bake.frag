@@ -0,0 +1,15 @@
+#version 330 core
+layout (location = 0) out vec4 FragColor;
+layout (location = 1) out float Depth;
+
+in vec2 TexCoords;
+
+uniform sampler2D texture1;
+
+void main()
+{
+    //The colour fragment.frag draws, alpha marks what the model covers
+    FragColor = vec4(texture(texture1, TexCoords).rgb, 1.0);
+    //The bake's projection is orthographic, so window depth is linear through the bounding sphere
+    Depth = gl_FragCoord.z;
+}
@@ -0,0 +1,13 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec3 outColour;
+in vec3 outNormal;
+
+uniform vec3 sunDirection;
+
+void main()
+{
+    float diffuse = max(dot(normalize(outNormal), sunDirection), 0.0);
+    FragColor = vec4(outColour * (0.45 + 0.7 * diffuse), 1.0f);
+}
\ No newline at end of file
@@ -0,0 +1,24 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec3 aColour;
+layout (location = 3) in vec4 aPositionScale;
+layout (location = 4) in vec4 aRotationTint;
+
+out vec3 outColour;
+out vec3 outNormal;
+
+uniform mat4 terrainModel;
+uniform mat4 view;
+uniform mat4 projection;
+
+void main()
+{
+    //Rotate around y and scale in world units, then stand it on its spot of the terrain
+    vec2 r = aRotationTint.xy;
+    vec3 offset = vec3(r.x * aPos.x - r.y * aPos.z, aPos.y, r.y * aPos.x + r.x * aPos.z) * aPositionScale.w;
+    vec3 base = vec3(terrainModel * vec4(aPositionScale.xyz, 1.0));
+    gl_Position = projection * view * vec4(base + offset, 1.0);
+    outColour = aColour * aRotationTint.z;
+    outNormal = vec3(r.x * aNormal.x - r.y * aNormal.z, aNormal.y, r.y * aNormal.x + r.x * aNormal.z);
+}
\ No newline at end of file
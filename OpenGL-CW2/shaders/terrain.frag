@@ -2,8 +2,23 @@
 out vec4 FragColor;
 
 in vec3 outColour;
+in vec2 bakeCoord;
+
+//Baked normal, ambient occlusion and sun visibility
+uniform bool bakedLighting;
+uniform sampler2D normalMap;
+uniform sampler2D lightMap;
+uniform vec3 sunDirection;
 
 void main()
 {    
-    FragColor = vec4(outColour, 1.0f);
+    if (!bakedLighting)
+    {
+        FragColor = vec4(outColour, 1.0f);
+        return;
+    }
+    vec3 normal = normalize(texture(normalMap, bakeCoord).rgb * 2.0 - 1.0);
+    vec2 light = texture(lightMap, bakeCoord).rg;
+    float diffuse = max(dot(normal, sunDirection), 0.0) * light.g;
+    FragColor = vec4(outColour * (0.4 * light.r + 0.8 * diffuse), 1.0f);
 }
\ No newline at end of file
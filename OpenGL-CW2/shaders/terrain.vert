@@ -3,13 +3,22 @@ layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aColour;
 
 out vec3 outColour;
+out vec2 bakeCoord;
 
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
+//Baked lighting lookup, one texel per heightfield sample
+uniform vec2 chunkOrigin;
+uniform float gridSpacing;
+uniform float chunkSamples;
+
 void main()
 {
     gl_Position = projection * view * model * vec4(aPos, 1.0);
     outColour = aColour;
+    //Sample indices grow towards -x/-z from the chunk origin
+    vec2 sampleCoord = (chunkOrigin - aPos.xz) / gridSpacing;
+    bakeCoord = (sampleCoord + 0.5) / chunkSamples;
 }
\ No newline at end of file
@@ -1,16 +1,37 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec2 aTexCoord;
+layout (location = 2) in vec2 aTexCoord;
+layout (location = 5) in uvec4 aBoneIds;
+layout (location = 6) in vec4 aBoneWeights;
 
 out vec2 TexCoords;
 
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
+// undoes the quantization of model positions, (1, 1, 1) and (0, 0, 0) for float positions
+uniform vec3 positionScale;
+uniform vec3 positionOffset;
+
+// has to match maxSkinBones
+const int MAX_BONES = 128;
+// the bone palette of the model being drawn, bound per instance
+layout (std140) uniform BonePalette
+{
+    mat4 bones[MAX_BONES];
+};
+// skinned meshes are moved by up to 4 bones of the palette, model then only places the whole model
+uniform bool skinned;
 
 void main()
 {
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    vec4 position = vec4(aPos * positionScale + positionOffset, 1.0);
+    if (skinned)
+    {
+        mat4 skin = bones[aBoneIds.x] * aBoneWeights.x + bones[aBoneIds.y] * aBoneWeights.y
+                  + bones[aBoneIds.z] * aBoneWeights.z + bones[aBoneIds.w] * aBoneWeights.w;
+        position = skin * position;
+    }
+    gl_Position = projection * view * model * position;
     TexCoords = aTexCoord;
 }
-
@@ -0,0 +1,236 @@
+#ifndef SKELETAL_ANIMATION_H
+#define SKELETAL_ANIMATION_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "node_hierarchy.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+using namespace std;
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define SKELETAL_ANIMATION_SSE 1
+#endif
+
+// bones one model's palette holds, MAX_BONES in vertex.vert has to match. 128 matrices are 8 KB, half the smallest
+// uniform block GL 3.3 allows
+const unsigned int maxSkinBones = 128;
+// uniform buffer binding the BonePalette block reads from
+const unsigned int skinPaletteBinding = 0;
+// palettes the uniform buffer holds before it is orphaned and started again
+const unsigned int skinPaletteSlots = 64;
+
+// a bone of a model's skeleton: the node that moves it, and the matrix from the skinned meshes' space to the bone's
+// own in the bind pose. world(node) * offset moves a vertex with the bone
+struct SkinBone {
+    uint32_t node;
+    glm::mat4 offset;
+};
+
+// one key of a channel, seconds into the clip. translations and scales use xyz, rotations are quaternions as xyzw
+struct AnimationKey {
+    float time;
+    float value[4];
+};
+
+// the keys of one node, as ranges of the clip's keys (sorted by time, at least one of each). plain data so it can
+// go into the mesh cache as is
+struct AnimationChannel {
+    uint32_t node;
+    uint32_t firstTranslation;
+    uint32_t translationCount;
+    uint32_t firstRotation;
+    uint32_t rotationCount;
+    uint32_t firstScale;
+    uint32_t scaleCount;
+};
+
+// an animation of the model's nodes, a node without a channel keeps its local matrix
+struct AnimationClip {
+    string name;
+    // seconds
+    float duration = 0.0f;
+    vector<AnimationChannel> channels;
+    vector<AnimationKey> keys;
+};
+
+namespace animsample
+{
+#ifdef SKELETAL_ANIMATION_SSE
+    inline float dot4(__m128 a, __m128 b)
+    {
+        __m128 product = _mm_mul_ps(a, b);
+        __m128 shuffled = _mm_shuffle_ps(product, product, _MM_SHUFFLE(2, 3, 0, 1));
+        __m128 sums = _mm_add_ps(product, shuffled);
+        shuffled = _mm_movehl_ps(shuffled, sums);
+        return _mm_cvtss_f32(_mm_add_ss(sums, shuffled));
+    }
+#endif
+
+    // value of a key range at time, held before the first key and after the last. the two keys around time are
+    // blended as four lanes at once; rotations take the shorter way round and are normalised again (nlerp, which is
+    // close enough to slerp between keys a frame or so apart)
+    inline void interpolate(const AnimationKey* keys, uint32_t count, float time, bool rotation, float* result)
+    {
+        const AnimationKey* next = upper_bound(keys, keys + count, time, [](float t, const AnimationKey& key) { return t < key.time; });
+        if (next == keys || next == keys + count)
+        {
+            memcpy(result, (next == keys ? next : next - 1)->value, sizeof(float) * 4);
+            return;
+        }
+        const AnimationKey* previous = next - 1;
+        float span = next->time - previous->time;
+        float factor = span > 0.0f ? (time - previous->time) / span : 0.0f;
+#ifdef SKELETAL_ANIMATION_SSE
+        __m128 a = _mm_loadu_ps(previous->value);
+        __m128 b = _mm_loadu_ps(next->value);
+        if (rotation && dot4(a, b) < 0.0f)
+            b = _mm_sub_ps(_mm_setzero_ps(), b);
+        __m128 blended = _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), _mm_set1_ps(factor)));
+        if (rotation)
+        {
+            float length = dot4(blended, blended);
+            if (length > 0.0f)
+                blended = _mm_div_ps(blended, _mm_set1_ps(sqrt(length)));
+        }
+        _mm_storeu_ps(result, blended);
+#else
+        float sign = 1.0f;
+        if (rotation)
+        {
+            float dot = 0.0f;
+            for (int i = 0; i < 4; i++)
+                dot += previous->value[i] * next->value[i];
+            sign = dot < 0.0f ? -1.0f : 1.0f;
+        }
+        float length = 0.0f;
+        for (int i = 0; i < 4; i++)
+        {
+            result[i] = previous->value[i] + (next->value[i] * sign - previous->value[i]) * factor;
+            length += result[i] * result[i];
+        }
+        if (rotation && length > 0.0f)
+            for (int i = 0; i < 4; i++)
+                result[i] /= sqrt(length);
+#endif
+    }
+
+    // translation * rotation * scale
+    inline glm::mat4 compose(const float* translation, const float* rotation, const float* scale)
+    {
+        glm::mat4 local = glm::mat4_cast(glm::quat(rotation[3], rotation[0], rotation[1], rotation[2]));
+        local[0] *= scale[0];
+        local[1] *= scale[1];
+        local[2] *= scale[2];
+        local[3] = glm::vec4(translation[0], translation[1], translation[2], 1.0f);
+        return local;
+    }
+}
+
+// sets the local matrices of the nodes the clip animates to their pose at time seconds into it, wrapped round
+// when looping and held at the end otherwise. the world matrices follow at the hierarchy's next Update
+inline void SampleClip(const AnimationClip& clip, float time, bool loop, NodeHierarchy& pose)
+{
+    if (loop && clip.duration > 0.0f)
+    {
+        time = fmod(time, clip.duration);
+        if (time < 0.0f)
+            time += clip.duration;
+    }
+    else
+        time = min(max(time, 0.0f), clip.duration);
+
+    const AnimationKey* keys = clip.keys.data();
+    for (const AnimationChannel& channel : clip.channels)
+    {
+        if (channel.node >= pose.Size())
+            continue;
+        float translation[4], rotation[4], scale[4];
+        animsample::interpolate(keys + channel.firstTranslation, channel.translationCount, time, false, translation);
+        animsample::interpolate(keys + channel.firstRotation, channel.rotationCount, time, true, rotation);
+        animsample::interpolate(keys + channel.firstScale, channel.scaleCount, time, false, scale);
+        pose.SetLocal(channel.node, animsample::compose(translation, rotation, scale));
+    }
+}
+
+// the matrices the vertex shader skins with, one per bone, from an up to date pose
+inline void ComputeBonePalette(const vector<SkinBone>& bones, const NodeHierarchy& pose, vector<glm::mat4>& palette)
+{
+    palette.resize(bones.size());
+    for (size_t i = 0; i < bones.size(); i++)
+        nodes::multiply(pose.World(bones[i].node), bones[i].offset, palette[i]);
+}
+
+// the uniform buffer skinned draws read their bone palette from. every draw writes its palette to the next slot and
+// binds that range, once the slots run out the buffer is orphaned so the driver never waits on draws still reading
+// it. context thread only
+class SkinPaletteBuffer
+{
+public:
+    static SkinPaletteBuffer& Get()
+    {
+        static SkinPaletteBuffer buffer;
+        return buffer;
+    }
+
+    // points a program's BonePalette block at the palette binding, once after linking
+    void Attach(unsigned int program)
+    {
+        unsigned int block = glGetUniformBlockIndex(program, "BonePalette");
+        if (block != GL_INVALID_INDEX)
+            glUniformBlockBinding(program, block, skinPaletteBinding);
+    }
+
+    // copies up to maxSkinBones matrices into a free slot and binds it for the draws that follow
+    void Bind(const glm::mat4* palette, size_t count)
+    {
+        if (!buffer)
+            create();
+        if (next == skinPaletteSlots)
+        {
+            glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+            glBufferData(GL_UNIFORM_BUFFER, slotBytes * skinPaletteSlots, NULL, GL_STREAM_DRAW);
+            next = 0;
+        }
+        GLintptr offset = (GLintptr)(next++ * slotBytes);
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferSubData(GL_UNIFORM_BUFFER, offset, min(count, (size_t)maxSkinBones) * sizeof(glm::mat4), palette);
+        // the whole block's size is bound, the bones past count are never indexed
+        glBindBufferRange(GL_UNIFORM_BUFFER, skinPaletteBinding, buffer, offset, maxSkinBones * sizeof(glm::mat4));
+        palettesBound++;
+    }
+
+    size_t PalettesBound() const
+    {
+        return palettesBound;
+    }
+
+private:
+    unsigned int buffer = 0;
+    size_t slotBytes = 0;
+    unsigned int next = 0;
+    size_t palettesBound = 0;
+
+    SkinPaletteBuffer() {}
+
+    void create()
+    {
+        GLint alignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        alignment = max(alignment, 1);
+        slotBytes = (maxSkinBones * sizeof(glm::mat4) + alignment - 1) / alignment * alignment;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferData(GL_UNIFORM_BUFFER, slotBytes * skinPaletteSlots, NULL, GL_STREAM_DRAW);
+    }
+};
+#endif
@@ -0,0 +1,145 @@
+#ifndef TERRAIN_H
+#define TERRAIN_H
+
+#include <glm/glm.hpp>
+
+#include "FastNoiseLite.h"
+
+#include <vector>
+using namespace std;
+
+// quads along each edge of a heightfield chunk, neighbouring chunks share their border samples
+const int terrainChunkQuads = 32;
+const int terrainChunkSamples = terrainChunkQuads + 1;
+// local distance between samples and where sample 0 sits, the same layout the single 128x128 grid used
+const float terrainGridSpacing = 0.0625f;
+const float terrainStartPosition = 1.0f;
+
+// heights are stored quantized to 16 bits over the noise range, every chunk dequantizes the same way
+// so shared border samples always agree, whether a chunk was ever compressed or not
+const float terrainHeightMin = -1.0f;
+const float terrainHeightStep = 2.0f / 65535.0f;
+
+enum Biome : unsigned char {
+    BIOME_SWAMP,
+    BIOME_DESERT,
+    BIOME_PLANES,
+    BIOME_ROCKS,
+    BIOME_COUNT
+};
+
+// one square of the heightfield
+struct HeightfieldChunk {
+    glm::ivec2 coord;
+    // terrainChunkSamples^2 noise heights, row major (z then x)
+    vector<float> heights;
+    vector<unsigned char> biomes;
+};
+
+inline unsigned short QuantizeHeight(float height)
+{
+    float q = (height - terrainHeightMin) / terrainHeightStep + 0.5f;
+    if (q < 0.0f)
+        q = 0.0f;
+    if (q > 65535.0f)
+        q = 65535.0f;
+    return (unsigned short)q;
+}
+
+inline float DequantizeHeight(unsigned short q)
+{
+    return terrainHeightMin + q * terrainHeightStep;
+}
+
+// the biome rules the terrain always used: high ground is rock, then grass planes, then swamp or desert
+inline unsigned char ClassifyBiome(float height, float biomeValue)
+{
+    //Rocks
+    if (height >= (4.0f / 8.0f))
+        return BIOME_ROCKS;
+    //Planes
+    if (height >= (1.0f / 8.0f))
+        return BIOME_PLANES;
+    //Swamp
+    if (biomeValue <= -0.75f)
+        return BIOME_SWAMP;
+    //Desert
+    return BIOME_DESERT;
+}
+
+inline glm::vec3 BiomeColour(unsigned char biome)
+{
+    switch (biome)
+    {
+    case BIOME_SWAMP:  return glm::vec3(0.0f, 0.4f, 0.0f);
+    case BIOME_DESERT: return glm::vec3(0.9f, 0.9f, 0.1f);
+    case BIOME_PLANES: return glm::vec3(0.2f, 1.0f, 0.2f);
+    default:           return glm::vec3(0.2f, 0.2f, 0.2f);
+    }
+}
+
+// samples the terrain and biome noise for one chunk. safe to run on a worker thread
+inline void GenerateHeightfieldChunk(const FastNoiseLite& terrainNoise, const FastNoiseLite& biomeNoise, const glm::ivec2& coord, HeightfieldChunk& chunk)
+{
+    chunk.coord = coord;
+    chunk.heights.resize(terrainChunkSamples * terrainChunkSamples);
+    chunk.biomes.resize(terrainChunkSamples * terrainChunkSamples);
+
+    int i = 0;
+    for (int y = 0; y < terrainChunkSamples; y++)
+    {
+        for (int x = 0; x < terrainChunkSamples; x++)
+        {
+            float sampleX = (float)(coord.x * terrainChunkQuads + x);
+            float sampleY = (float)(coord.y * terrainChunkQuads + y);
+            float height = terrainNoise.GetNoise(sampleX, sampleY);
+            chunk.heights[i] = DequantizeHeight(QuantizeHeight(height));
+            chunk.biomes[i] = ClassifyBiome(height, biomeNoise.GetNoise(sampleX, sampleY));
+            i++;
+        }
+    }
+}
+
+// interleaved local position and colour per sample, laid out for the terrain shader
+inline void BuildHeightfieldVertices(const HeightfieldChunk& chunk, vector<float>& vertices)
+{
+    vertices.resize(terrainChunkSamples * terrainChunkSamples * 6);
+    float* out = vertices.data();
+    int i = 0;
+    for (int y = 0; y < terrainChunkSamples; y++)
+    {
+        for (int x = 0; x < terrainChunkSamples; x++)
+        {
+            glm::vec3 colour = BiomeColour(chunk.biomes[i]);
+            out[0] = terrainStartPosition - (chunk.coord.x * terrainChunkQuads + x) * terrainGridSpacing;
+            out[1] = chunk.heights[i];
+            out[2] = terrainStartPosition - (chunk.coord.y * terrainChunkQuads + y) * terrainGridSpacing;
+            out[3] = colour.r;
+            out[4] = colour.g;
+            out[5] = colour.b;
+            out += 6;
+            i++;
+        }
+    }
+}
+
+// triangle indices of a chunk, the same for every chunk so one element buffer is shared
+inline void BuildHeightfieldIndices(vector<unsigned int>& indices)
+{
+    indices.clear();
+    indices.reserve(terrainChunkQuads * terrainChunkQuads * 6);
+    for (int y = 0; y < terrainChunkQuads; y++)
+    {
+        for (int x = 0; x < terrainChunkQuads; x++)
+        {
+            unsigned int corner = y * terrainChunkSamples + x;
+            indices.push_back(corner);
+            indices.push_back(corner + 1);
+            indices.push_back(corner + terrainChunkSamples);
+            indices.push_back(corner + 1);
+            indices.push_back(corner + 1 + terrainChunkSamples);
+            indices.push_back(corner + terrainChunkSamples);
+        }
+    }
+}
+#endif
@@ -0,0 +1,150 @@
+#ifndef TERRAIN_BAKE_H
+#define TERRAIN_BAKE_H
+
+#include <glm/glm.hpp>
+
+#include "FastNoiseLite.h"
+#include "terrain.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define TERRAIN_BAKE_SSE2
+#endif
+
+using namespace std;
+
+// samples around the chunk the horizon searches may look at, heights come straight from the noise
+// so a chunk bakes on its own without waiting for its neighbours
+const int terrainBakeApron = 24;
+// the bake grid is padded on the right so rows can always be processed 4 texels at a time
+const int terrainBakeRowPadding = 3;
+const int terrainBakeGridWidth = terrainChunkSamples + 2 * terrainBakeApron + terrainBakeRowPadding;
+const int terrainBakeGridHeight = terrainChunkSamples + 2 * terrainBakeApron;
+// elevation of the static sun, it shines along the sample grid's diagonal so shadow rays stay on grid points
+const float terrainSunElevation = glm::radians(25.0f);
+
+// baked lighting of one chunk, one texel per heightfield sample
+struct TerrainLightingBake {
+    // RGB8 local space normals
+    vector<unsigned char> normals;
+    // RG8, R ambient occlusion and G sun visibility
+    vector<unsigned char> lighting;
+};
+
+// local (and world, the terrain model matrix only scales uniformly) direction towards the sun.
+// sample indices grow towards -x/-z, the sun sits on the high index side
+inline glm::vec3 TerrainSunDirection()
+{
+    float horizontal = cos(terrainSunElevation) * 0.70710678f;
+    return glm::normalize(glm::vec3(-horizontal, sin(terrainSunElevation), -horizontal));
+}
+
+namespace terrainbake
+{
+    // tallest horizon (as tan of its elevation) seen from 4 neighbouring texels along one grid direction.
+    // the 4 texels are consecutive in a row, so every step reads 4 consecutive heights
+    inline void horizon4(const float* grid, int index, int stepOffset, float stepLength, const int* steps, int stepCount, float* out)
+    {
+#ifdef TERRAIN_BAKE_SSE2
+        __m128 centre = _mm_loadu_ps(grid + index);
+        __m128 best = _mm_setzero_ps();
+        for (int s = 0; s < stepCount; s++)
+        {
+            __m128 h = _mm_loadu_ps(grid + index + steps[s] * stepOffset);
+            __m128 slope = _mm_mul_ps(_mm_sub_ps(h, centre), _mm_set1_ps(1.0f / (steps[s] * stepLength)));
+            best = _mm_max_ps(best, slope);
+        }
+        _mm_storeu_ps(out, best);
+#else
+        for (int lane = 0; lane < 4; lane++)
+        {
+            float centre = grid[index + lane];
+            float best = 0.0f;
+            for (int s = 0; s < stepCount; s++)
+            {
+                float slope = (grid[index + lane + steps[s] * stepOffset] - centre) / (steps[s] * stepLength);
+                best = max(best, slope);
+            }
+            out[lane] = best;
+        }
+#endif
+    }
+
+    inline unsigned char toByte(float v)
+    {
+        v = v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v);
+        return (unsigned char)(v * 255.0f + 0.5f);
+    }
+}
+
+// bakes normals, horizon based ambient occlusion and static sun shadows for a chunk. runs on a worker thread
+inline void BakeTerrainLighting(const FastNoiseLite& terrainNoise, const glm::ivec2& coord, TerrainLightingBake& bake)
+{
+    const int w = terrainBakeGridWidth;
+    const int n = terrainChunkSamples;
+    const int a = terrainBakeApron;
+
+    // heights of the chunk and its apron, in local units
+    vector<float> grid(w * terrainBakeGridHeight);
+    int originX = coord.x * terrainChunkQuads - a;
+    int originY = coord.y * terrainChunkQuads - a;
+    for (int y = 0; y < terrainBakeGridHeight; y++)
+        for (int x = 0; x < w; x++)
+            grid[y * w + x] = terrainNoise.GetNoise((float)(originX + x), (float)(originY + y));
+
+    bake.normals.resize(n * n * 3);
+    bake.lighting.resize(n * n * 2);
+
+    // the 8 grid directions for the occlusion search, the sun shines from the +x +y diagonal
+    static const int directions[8][2] = { {1, 0}, {-1, 0}, {0, 1}, {0, -1}, {1, 1}, {-1, -1}, {1, -1}, {-1, 1} };
+    static const int aoSteps[] = { 1, 2, 3, 4, 6, 8, 12, 16 };
+    static const int aoStepCount = sizeof(aoSteps) / sizeof(aoSteps[0]);
+    int sunSteps[terrainBakeApron];
+    for (int s = 0; s < terrainBakeApron; s++)
+        sunSteps[s] = s + 1;
+    const float sunTan = tan(terrainSunElevation);
+
+    for (int y = 0; y < n; y++)
+    {
+        for (int x = 0; x < n; x += 4)
+        {
+            int index = (y + a) * w + (x + a);
+            float occlusion[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+            float horizon[4];
+            for (int d = 0; d < 8; d++)
+            {
+                float length = terrainGridSpacing * ((directions[d][0] && directions[d][1]) ? 1.41421356f : 1.0f);
+                terrainbake::horizon4(&grid[0], index, directions[d][1] * w + directions[d][0], length, aoSteps, aoStepCount, horizon);
+                // sine of the horizon elevation is the occluded share of that direction
+                for (int lane = 0; lane < 4; lane++)
+                    occlusion[lane] += horizon[lane] / sqrt(1.0f + horizon[lane] * horizon[lane]);
+            }
+            float sunHorizon[4];
+            terrainbake::horizon4(&grid[0], index, w + 1, terrainGridSpacing * 1.41421356f, sunSteps, terrainBakeApron, sunHorizon);
+
+            for (int lane = 0; lane < 4 && x + lane < n; lane++)
+            {
+                int texel = y * n + x + lane;
+                int g = index + lane;
+                // central differences, sample indices grow towards -x/-z in local space
+                float dx = (grid[g + 1] - grid[g - 1]) * 0.5f / terrainGridSpacing;
+                float dz = (grid[g + w] - grid[g - w]) * 0.5f / terrainGridSpacing;
+                glm::vec3 normal = glm::normalize(glm::vec3(dx, 1.0f, dz));
+                bake.normals[texel * 3 + 0] = terrainbake::toByte(normal.x * 0.5f + 0.5f);
+                bake.normals[texel * 3 + 1] = terrainbake::toByte(normal.y * 0.5f + 0.5f);
+                bake.normals[texel * 3 + 2] = terrainbake::toByte(normal.z * 0.5f + 0.5f);
+
+                float ambient = 1.0f - occlusion[lane] / 8.0f;
+                // soft edge around the shadow line
+                float sun = 0.5f + (sunTan - sunHorizon[lane]) * 4.0f;
+                bake.lighting[texel * 2 + 0] = terrainbake::toByte(ambient);
+                bake.lighting[texel * 2 + 1] = terrainbake::toByte(sun);
+            }
+        }
+    }
+}
+#endif
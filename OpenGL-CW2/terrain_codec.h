@@ -0,0 +1,313 @@
+#ifndef TERRAIN_CODEC_H
+#define TERRAIN_CODEC_H
+
+#include "terrain.h"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+using namespace std;
+
+// compact form of a HeightfieldChunk for chunks outside the active radius.
+// heights: 16 bit quantized, predicted from their neighbours (LOCO-I median predictor), residuals split in
+// low/high byte planes and each plane entropy coded with an order-0 rANS coder.
+// biomes: run length encoded (biome, varint run) pairs.
+struct CompressedHeightfieldChunk {
+    glm::ivec2 coord;
+    vector<unsigned char> heightLow;
+    vector<unsigned char> heightHigh;
+    vector<unsigned char> biomeRuns;
+
+    size_t Bytes() const
+    {
+        return sizeof(*this) + heightLow.capacity() + heightHigh.capacity() + biomeRuns.capacity();
+    }
+};
+
+// order-0 byte entropy coder, two interleaved rANS states sharing one byte stream so the decoder has
+// two independent dependency chains. streams that would not shrink are stored raw
+namespace rans
+{
+    const uint32_t probBits = 12;
+    const uint32_t probScale = 1u << probBits;
+    const uint32_t lowerBound = 1u << 23;
+
+    enum StreamMode : unsigned char { STORED = 0, CODED = 1 };
+
+    // scales symbol counts to sum to probScale, every symbol present keeps a frequency of at least 1
+    inline void normaliseFrequencies(const uint32_t* counts, size_t total, uint32_t* freqs)
+    {
+        uint32_t sum = 0;
+        for (int s = 0; s < 256; s++)
+        {
+            freqs[s] = counts[s] ? (uint32_t)(((uint64_t)counts[s] * probScale) / total) : 0;
+            if (counts[s] && freqs[s] == 0)
+                freqs[s] = 1;
+            sum += freqs[s];
+        }
+        // hand the rounding error to the most frequent symbols
+        while (sum != probScale)
+        {
+            int best = 0;
+            for (int s = 1; s < 256; s++)
+                if (freqs[s] > freqs[best])
+                    best = s;
+            if (sum < probScale)
+            {
+                freqs[best] += probScale - sum;
+                sum = probScale;
+            }
+            else
+            {
+                uint32_t take = sum - probScale;
+                if (take > freqs[best] - 1)
+                    take = freqs[best] - 1;
+                freqs[best] -= take;
+                sum -= take;
+            }
+        }
+    }
+
+    inline void Encode(const unsigned char* in, size_t count, vector<unsigned char>& out)
+    {
+        out.clear();
+        uint32_t counts[256] = {};
+        for (size_t i = 0; i < count; i++)
+            counts[in[i]]++;
+
+        int symbols = 0;
+        for (int s = 0; s < 256; s++)
+            symbols += counts[s] != 0;
+
+        // a single symbol (flat terrain, empty high plane) only needs the symbol itself
+        if (count == 0 || symbols == 1)
+        {
+            out.push_back(CODED);
+            out.push_back(0);
+            if (count)
+                out.push_back(in[0]);
+            return;
+        }
+
+        uint32_t freqs[256], starts[256];
+        normaliseFrequencies(counts, count, freqs);
+        uint32_t start = 0;
+        for (int s = 0; s < 256; s++)
+        {
+            starts[s] = start;
+            start += freqs[s];
+        }
+
+        // header: mode, symbol count - 1, then (symbol, 16 bit frequency) triples
+        vector<unsigned char> header;
+        header.push_back(CODED);
+        header.push_back((unsigned char)(symbols - 1));
+        for (int s = 0; s < 256; s++)
+        {
+            if (!freqs[s])
+                continue;
+            header.push_back((unsigned char)s);
+            header.push_back((unsigned char)(freqs[s] & 0xFF));
+            header.push_back((unsigned char)(freqs[s] >> 8));
+        }
+
+        // encode backwards into a scratch buffer so the decoder reads forwards.
+        // the rarest symbol costs 12 bits, so two bytes per symbol is always enough
+        vector<unsigned char> scratch(count * 2 + 8);
+        unsigned char* end = scratch.data() + scratch.size();
+        unsigned char* ptr = end;
+        uint32_t state[2] = { lowerBound, lowerBound };
+        for (size_t i = count; i-- > 0;)
+        {
+            uint32_t& x = state[i & 1];
+            uint32_t freq = freqs[in[i]];
+            uint32_t maxState = ((lowerBound >> probBits) << 8) * freq;
+            while (x >= maxState)
+            {
+                *--ptr = (unsigned char)(x & 0xFF);
+                x >>= 8;
+            }
+            x = ((x / freq) << probBits) + (x % freq) + starts[in[i]];
+        }
+        for (int k = 1; k >= 0; k--)
+        {
+            ptr -= 4;
+            memcpy(ptr, &state[k], 4);
+        }
+
+        size_t coded = end - ptr;
+        if (header.size() + coded >= count)
+        {
+            // incompressible, keep it raw
+            out.push_back(STORED);
+            out.insert(out.end(), in, in + count);
+            return;
+        }
+        out.swap(header);
+        out.insert(out.end(), ptr, end);
+    }
+
+    // decodes exactly count bytes. the stream must come from Encode
+    inline void Decode(const vector<unsigned char>& in, unsigned char* out, size_t count)
+    {
+        const unsigned char* ptr = in.data();
+        if (*ptr++ == STORED)
+        {
+            memcpy(out, ptr, count);
+            return;
+        }
+        int symbols = *ptr++ + 1;
+        if (symbols == 1)
+        {
+            if (count)
+                memset(out, *ptr, count);
+            return;
+        }
+
+        uint32_t freqs[256] = {}, starts[256] = {};
+        unsigned char slotSymbol[probScale];
+        uint32_t start = 0;
+        for (int i = 0; i < symbols; i++)
+        {
+            unsigned char s = ptr[0];
+            freqs[s] = ptr[1] | (ptr[2] << 8);
+            ptr += 3;
+        }
+        for (int s = 0; s < 256; s++)
+        {
+            starts[s] = start;
+            if (freqs[s])
+                memset(slotSymbol + start, s, freqs[s]);
+            start += freqs[s];
+        }
+
+        uint32_t state[2];
+        memcpy(&state[0], ptr, 4);
+        memcpy(&state[1], ptr + 4, 4);
+        ptr += 8;
+        for (size_t i = 0; i < count; i++)
+        {
+            uint32_t& x = state[i & 1];
+            uint32_t slot = x & (probScale - 1);
+            unsigned char s = slotSymbol[slot];
+            out[i] = s;
+            x = freqs[s] * (x >> probBits) + slot - starts[s];
+            while (x < lowerBound)
+                x = (x << 8) | *ptr++;
+        }
+    }
+}
+
+// median edge predictor from LOCO-I, picks the left, upper or planar estimate
+inline int PredictHeight(int left, int up, int upLeft)
+{
+    int lo = left < up ? left : up;
+    int hi = left < up ? up : left;
+    if (upLeft >= hi)
+        return lo;
+    if (upLeft <= lo)
+        return hi;
+    return left + up - upLeft;
+}
+
+inline void CompressHeightfieldChunk(const HeightfieldChunk& chunk, CompressedHeightfieldChunk& packed)
+{
+    const int n = terrainChunkSamples;
+    packed.coord = chunk.coord;
+
+    // quantize, predict and zigzag the residuals
+    vector<unsigned short> q(n * n);
+    for (int i = 0; i < n * n; i++)
+        q[i] = QuantizeHeight(chunk.heights[i]);
+    vector<unsigned char> low(n * n), high(n * n);
+    for (int y = 0; y < n; y++)
+    {
+        for (int x = 0; x < n; x++)
+        {
+            int i = y * n + x;
+            int prediction;
+            if (y == 0)
+                prediction = x == 0 ? 0 : q[i - 1];
+            else if (x == 0)
+                prediction = q[i - n];
+            else
+                prediction = PredictHeight(q[i - 1], q[i - n], q[i - n - 1]);
+            short residual = (short)(unsigned short)(q[i] - prediction);
+            unsigned short zigzag = (unsigned short)((residual << 1) ^ (residual >> 15));
+            low[i] = (unsigned char)(zigzag & 0xFF);
+            high[i] = (unsigned char)(zigzag >> 8);
+        }
+    }
+    rans::Encode(low.data(), low.size(), packed.heightLow);
+    rans::Encode(high.data(), high.size(), packed.heightHigh);
+    packed.heightLow.shrink_to_fit();
+    packed.heightHigh.shrink_to_fit();
+
+    // biome runs
+    packed.biomeRuns.clear();
+    for (size_t i = 0; i < chunk.biomes.size();)
+    {
+        size_t run = 1;
+        while (i + run < chunk.biomes.size() && chunk.biomes[i + run] == chunk.biomes[i])
+            run++;
+        packed.biomeRuns.push_back(chunk.biomes[i]);
+        for (size_t v = run; ; v >>= 7)
+        {
+            packed.biomeRuns.push_back((unsigned char)((v & 0x7F) | (v >= 0x80 ? 0x80 : 0)));
+            if (v < 0x80)
+                break;
+        }
+        i += run;
+    }
+    packed.biomeRuns.shrink_to_fit();
+}
+
+inline void DecompressHeightfieldChunk(const CompressedHeightfieldChunk& packed, HeightfieldChunk& chunk)
+{
+    const int n = terrainChunkSamples;
+    chunk.coord = packed.coord;
+    chunk.heights.resize(n * n);
+    chunk.biomes.resize(n * n);
+
+    unsigned char low[terrainChunkSamples * terrainChunkSamples];
+    unsigned char high[terrainChunkSamples * terrainChunkSamples];
+    rans::Decode(packed.heightLow, low, n * n);
+    rans::Decode(packed.heightHigh, high, n * n);
+
+    vector<unsigned short> q(n * n);
+    for (int y = 0; y < n; y++)
+    {
+        for (int x = 0; x < n; x++)
+        {
+            int i = y * n + x;
+            int prediction;
+            if (y == 0)
+                prediction = x == 0 ? 0 : q[i - 1];
+            else if (x == 0)
+                prediction = q[i - n];
+            else
+                prediction = PredictHeight(q[i - 1], q[i - n], q[i - n - 1]);
+            unsigned short zigzag = (unsigned short)(low[i] | (high[i] << 8));
+            short residual = (short)((zigzag >> 1) ^ (unsigned short)-(short)(zigzag & 1));
+            q[i] = (unsigned short)(prediction + residual);
+            chunk.heights[i] = DequantizeHeight(q[i]);
+        }
+    }
+
+    size_t out = 0;
+    for (size_t i = 0; i < packed.biomeRuns.size();)
+    {
+        unsigned char biome = packed.biomeRuns[i++];
+        size_t run = 0;
+        for (int shift = 0; ; shift += 7)
+        {
+            unsigned char b = packed.biomeRuns[i++];
+            run |= (size_t)(b & 0x7F) << shift;
+            if (!(b & 0x80))
+                break;
+        }
+        memset(&chunk.biomes[out], biome, run);
+        out += run;
+    }
+}
+#endif
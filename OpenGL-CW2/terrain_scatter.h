@@ -0,0 +1,378 @@
+#ifndef TERRAIN_SCATTER_H
+#define TERRAIN_SCATTER_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "frustum.h"
+#include "shader_m.h"
+#include "terrain.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <random>
+#include <vector>
+using namespace std;
+
+enum ScatterKind {
+    SCATTER_TREE,
+    SCATTER_ROCK,
+    SCATTER_SHRUB,
+    SCATTER_KIND_COUNT
+};
+
+// levels of detail per kind, the far one is also used for everything past its switch distance
+const int scatterLodCount = 2;
+
+// minimum spacing between scattered objects, in heightfield samples
+const float scatterSpacing = 0.55f;
+
+// chance of a placement becoming each kind, per biome (tree, rock, shrub)
+const float scatterDensity[BIOME_COUNT][SCATTER_KIND_COUNT] = {
+    { 0.12f, 0.02f, 0.45f }, // swamp
+    { 0.00f, 0.08f, 0.05f }, // desert
+    { 0.22f, 0.03f, 0.30f }, // planes
+    { 0.02f, 0.35f, 0.04f }, // rocks
+};
+// steepest slope (height over distance) each kind grows on
+const float scatterMaxSlope[SCATTER_KIND_COUNT] = { 0.6f, 3.0f, 1.0f };
+// world size range of each kind
+const float scatterMinScale[SCATTER_KIND_COUNT] = { 0.8f, 0.25f, 0.25f };
+const float scatterMaxScale[SCATTER_KIND_COUNT] = { 1.4f, 0.6f, 0.45f };
+// world distance where each kind drops to its far LOD, and where it stops being drawn
+const float scatterLodDistance[SCATTER_KIND_COUNT] = { 25.0f, 12.0f, 10.0f };
+const float scatterDrawDistance[SCATTER_KIND_COUNT] = { 80.0f, 45.0f, 30.0f };
+
+// per instance data, streamed to the GPU as two vec4 attributes
+struct ScatterInstance {
+    // position in the terrain's local space and world scale
+    glm::vec4 positionScale;
+    // cos and sin of the rotation around y, colour tint, unused
+    glm::vec4 rotationTint;
+};
+
+// instances of one chunk, grouped per kind
+struct ChunkScatter {
+    vector<ScatterInstance> instances[SCATTER_KIND_COUNT];
+};
+
+namespace scatter
+{
+    // bilinear height and gradient (per local unit) of the chunk at a fractional sample position
+    inline float sampleHeight(const HeightfieldChunk& chunk, float sx, float sy, float& slope)
+    {
+        const int n = terrainChunkSamples;
+        int x0 = min((int)sx, n - 2), y0 = min((int)sy, n - 2);
+        float fx = sx - x0, fy = sy - y0;
+        float h00 = chunk.heights[y0 * n + x0], h10 = chunk.heights[y0 * n + x0 + 1];
+        float h01 = chunk.heights[(y0 + 1) * n + x0], h11 = chunk.heights[(y0 + 1) * n + x0 + 1];
+        float dx = ((h10 - h00) * (1.0f - fy) + (h11 - h01) * fy) / terrainGridSpacing;
+        float dy = ((h01 - h00) * (1.0f - fx) + (h11 - h10) * fx) / terrainGridSpacing;
+        slope = sqrt(dx * dx + dy * dy);
+        float top = h00 + (h10 - h00) * fx;
+        float bottom = h01 + (h11 - h01) * fx;
+        return top + (bottom - top) * fy;
+    }
+
+    // Bridson's Poisson disk sampling over [0, size)^2
+    inline void poissonDisk(float size, float radius, mt19937& rng, vector<glm::vec2>& points)
+    {
+        const float cellSize = radius / sqrt(2.0f);
+        const int gridSize = (int)ceil(size / cellSize);
+        vector<int> grid(gridSize * gridSize, -1);
+        vector<int> active;
+        uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+        auto insert = [&](const glm::vec2& p)
+        {
+            grid[(int)(p.y / cellSize) * gridSize + (int)(p.x / cellSize)] = (int)points.size();
+            active.push_back((int)points.size());
+            points.push_back(p);
+        };
+        insert(glm::vec2(unit(rng) * size, unit(rng) * size));
+
+        while (!active.empty())
+        {
+            int pick = (int)(unit(rng) * active.size()) % (int)active.size();
+            glm::vec2 origin = points[active[pick]];
+            bool placed = false;
+            for (int attempt = 0; attempt < 20 && !placed; attempt++)
+            {
+                float angle = unit(rng) * 6.2831853f;
+                float distance = radius * (1.0f + unit(rng));
+                glm::vec2 p = origin + glm::vec2(cos(angle), sin(angle)) * distance;
+                if (p.x < 0.0f || p.y < 0.0f || p.x >= size || p.y >= size)
+                    continue;
+                int cx = (int)(p.x / cellSize), cy = (int)(p.y / cellSize);
+                bool clear = true;
+                for (int y = max(cy - 2, 0); y <= min(cy + 2, gridSize - 1) && clear; y++)
+                    for (int x = max(cx - 2, 0); x <= min(cx + 2, gridSize - 1) && clear; x++)
+                    {
+                        int other = grid[y * gridSize + x];
+                        if (other >= 0)
+                        {
+                            glm::vec2 d = points[other] - p;
+                            clear = glm::dot(d, d) >= radius * radius;
+                        }
+                    }
+                if (clear)
+                {
+                    insert(p);
+                    placed = true;
+                }
+            }
+            if (!placed)
+            {
+                active[pick] = active.back();
+                active.pop_back();
+            }
+        }
+    }
+
+    // flat shaded triangle soup, position normal colour per vertex
+    inline void addTriangle(vector<float>& mesh, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, const glm::vec3& colour)
+    {
+        glm::vec3 normal = glm::normalize(glm::cross(b - a, c - a));
+        const glm::vec3* points[3] = { &a, &b, &c };
+        for (const glm::vec3* p : points)
+            mesh.insert(mesh.end(), { p->x, p->y, p->z, normal.x, normal.y, normal.z, colour.r, colour.g, colour.b });
+    }
+
+    // cone (or prism when top radius > 0) around the y axis
+    inline void addCone(vector<float>& mesh, float bottom, float top, float bottomRadius, float topRadius, int sides, const glm::vec3& colour)
+    {
+        for (int i = 0; i < sides; i++)
+        {
+            float a0 = 6.2831853f * i / sides, a1 = 6.2831853f * (i + 1) / sides;
+            glm::vec3 b0(cos(a0) * bottomRadius, bottom, sin(a0) * bottomRadius);
+            glm::vec3 b1(cos(a1) * bottomRadius, bottom, sin(a1) * bottomRadius);
+            glm::vec3 t0(cos(a0) * topRadius, top, sin(a0) * topRadius);
+            glm::vec3 t1(cos(a1) * topRadius, top, sin(a1) * topRadius);
+            addTriangle(mesh, b0, t1, b1, colour);
+            if (topRadius > 0.0f)
+                addTriangle(mesh, b0, t0, t1, colour);
+        }
+    }
+
+    // squashed sphere from a subdivided octahedron
+    inline void addRock(vector<float>& mesh, int subdivisions, const glm::vec3& colour)
+    {
+        vector<glm::vec3> triangles = {
+            {1, 0, 0}, {0, 1, 0}, {0, 0, 1},   {0, 0, 1}, {0, 1, 0}, {-1, 0, 0},
+            {-1, 0, 0}, {0, 1, 0}, {0, 0, -1}, {0, 0, -1}, {0, 1, 0}, {1, 0, 0},
+            {1, 0, 0}, {0, 0, 1}, {0, -1, 0},  {0, 0, 1}, {-1, 0, 0}, {0, -1, 0},
+            {-1, 0, 0}, {0, 0, -1}, {0, -1, 0}, {0, 0, -1}, {1, 0, 0}, {0, -1, 0},
+        };
+        for (int s = 0; s < subdivisions; s++)
+        {
+            vector<glm::vec3> finer;
+            for (size_t i = 0; i < triangles.size(); i += 3)
+            {
+                glm::vec3 a = triangles[i], b = triangles[i + 1], c = triangles[i + 2];
+                glm::vec3 ab = glm::normalize(a + b), bc = glm::normalize(b + c), ca = glm::normalize(c + a);
+                finer.insert(finer.end(), { a, ab, ca, ab, b, bc, ca, bc, c, ab, bc, ca });
+            }
+            triangles.swap(finer);
+        }
+        for (size_t i = 0; i < triangles.size(); i += 3)
+        {
+            glm::vec3 squash(0.5f, 0.3f, 0.45f);
+            addTriangle(mesh, triangles[i] * squash, triangles[i + 1] * squash, triangles[i + 2] * squash, colour);
+        }
+    }
+
+    inline void buildMesh(int kind, int lod, vector<float>& mesh)
+    {
+        mesh.clear();
+        if (kind == SCATTER_TREE)
+        {
+            if (lod == 0)
+                addCone(mesh, 0.0f, 0.3f, 0.05f, 0.05f, 6, glm::vec3(0.35f, 0.22f, 0.1f));
+            addCone(mesh, 0.25f, 1.0f, 0.3f, 0.0f, lod == 0 ? 8 : 4, glm::vec3(0.1f, 0.35f, 0.12f));
+        }
+        else if (kind == SCATTER_ROCK)
+            addRock(mesh, lod == 0 ? 1 : 0, glm::vec3(0.45f, 0.43f, 0.4f));
+        else
+            addCone(mesh, 0.0f, 0.5f, 0.5f, 0.0f, lod == 0 ? 7 : 4, glm::vec3(0.3f, 0.45f, 0.15f));
+    }
+}
+
+// places trees, rocks and shrubs over a chunk from its biomes and slopes. deterministic per chunk,
+// so a chunk reactivated from its compressed form gets the same objects back. runs on a worker thread
+inline void ScatterChunk(const HeightfieldChunk& chunk, ChunkScatter& result)
+{
+    unsigned int seed = (unsigned int)(chunk.coord.x * 73856093) ^ (unsigned int)(chunk.coord.y * 19349663);
+    mt19937 rng(seed);
+    uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+    vector<glm::vec2> points;
+    scatter::poissonDisk((float)terrainChunkQuads, scatterSpacing, rng, points);
+
+    for (int k = 0; k < SCATTER_KIND_COUNT; k++)
+        result.instances[k].clear();
+
+    for (const glm::vec2& p : points)
+    {
+        int nearest = (int)(p.y + 0.5f) * terrainChunkSamples + (int)(p.x + 0.5f);
+        unsigned char biome = chunk.biomes[nearest];
+        float slope;
+        float height = scatter::sampleHeight(chunk, p.x, p.y, slope);
+
+        float roll = unit(rng);
+        int kind = -1;
+        float cumulative = 0.0f;
+        for (int k = 0; k < SCATTER_KIND_COUNT; k++)
+        {
+            cumulative += scatterDensity[biome][k];
+            if (roll < cumulative)
+            {
+                kind = k;
+                break;
+            }
+        }
+        if (kind < 0 || slope > scatterMaxSlope[kind])
+            continue;
+
+        float angle = unit(rng) * 6.2831853f;
+        ScatterInstance instance;
+        instance.positionScale = glm::vec4(
+            terrainStartPosition - (chunk.coord.x * terrainChunkQuads + p.x) * terrainGridSpacing,
+            height,
+            terrainStartPosition - (chunk.coord.y * terrainChunkQuads + p.y) * terrainGridSpacing,
+            scatterMinScale[kind] + (scatterMaxScale[kind] - scatterMinScale[kind]) * unit(rng));
+        instance.rotationTint = glm::vec4(cos(angle), sin(angle), 0.8f + 0.4f * unit(rng), 0.0f);
+        result.instances[kind].push_back(instance);
+    }
+}
+
+// draws the scattered objects of many chunks with one instanced draw per kind and LOD.
+// visible instances are gathered into streamed instance buffers every frame
+class ScatterRenderer
+{
+public:
+    // instances drawn last frame, for the counters
+    size_t drawnInstances = 0;
+
+    // a chunk about to be drawn: its instances and its world space bounds
+    struct VisibleChunk {
+        const ChunkScatter* scatter;
+        glm::vec3 boundsMin, boundsMax;
+    };
+
+    // culls and draws. the caller has the scatter shader bound with view and projection set
+    void Draw(Shader& shader, const glm::mat4& terrainModel, const glm::mat4& viewProjection, const glm::vec3& cameraPosition, const vector<VisibleChunk>& chunks)
+    {
+        if (!VAO[0][0])
+            setup();
+
+        Frustum frustum(viewProjection);
+        for (int k = 0; k < SCATTER_KIND_COUNT; k++)
+            for (int l = 0; l < scatterLodCount; l++)
+                batches[k][l].clear();
+
+        for (const VisibleChunk& chunk : chunks)
+        {
+            if (!frustum.IntersectsBox(chunk.boundsMin, chunk.boundsMax))
+                continue;
+            // distance range from the camera to the chunk
+            glm::vec3 closest = glm::clamp(cameraPosition, chunk.boundsMin, chunk.boundsMax);
+            float nearest = glm::length(closest - cameraPosition);
+            glm::vec3 extent = glm::max(glm::abs(cameraPosition - chunk.boundsMin), glm::abs(cameraPosition - chunk.boundsMax));
+            float furthest = glm::length(extent);
+
+            for (int k = 0; k < SCATTER_KIND_COUNT; k++)
+            {
+                const vector<ScatterInstance>& instances = chunk.scatter->instances[k];
+                if (instances.empty() || nearest > scatterDrawDistance[k])
+                    continue;
+                // whole chunk on one side of the LOD switch, copy it in one go
+                if (furthest < scatterLodDistance[k])
+                    batches[k][0].insert(batches[k][0].end(), instances.begin(), instances.end());
+                else if (nearest >= scatterLodDistance[k] && furthest < scatterDrawDistance[k])
+                    batches[k][1].insert(batches[k][1].end(), instances.begin(), instances.end());
+                else
+                {
+                    for (const ScatterInstance& instance : instances)
+                    {
+                        glm::vec3 world = glm::vec3(terrainModel * glm::vec4(glm::vec3(instance.positionScale), 1.0f));
+                        float distance = glm::length(world - cameraPosition);
+                        if (distance < scatterLodDistance[k])
+                            batches[k][0].push_back(instance);
+                        else if (distance < scatterDrawDistance[k])
+                            batches[k][1].push_back(instance);
+                    }
+                }
+            }
+        }
+
+        shader.setMat4("terrainModel", terrainModel);
+        drawnInstances = 0;
+        for (int k = 0; k < SCATTER_KIND_COUNT; k++)
+        {
+            for (int l = 0; l < scatterLodCount; l++)
+            {
+                const vector<ScatterInstance>& batch = batches[k][l];
+                if (batch.empty())
+                    continue;
+                glBindBuffer(GL_ARRAY_BUFFER, instanceVBO[k][l]);
+                // orphan last frame's storage instead of waiting for the GPU to finish with it
+                glBufferData(GL_ARRAY_BUFFER, batch.size() * sizeof(ScatterInstance), NULL, GL_STREAM_DRAW);
+                glBufferSubData(GL_ARRAY_BUFFER, 0, batch.size() * sizeof(ScatterInstance), &batch[0]);
+                glBindVertexArray(VAO[k][l]);
+                glDrawArraysInstanced(GL_TRIANGLES, 0, meshVertexCount[k][l], (GLsizei)batch.size());
+                drawnInstances += batch.size();
+            }
+        }
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+private:
+    unsigned int VAO[SCATTER_KIND_COUNT][scatterLodCount] = {};
+    unsigned int meshVBO[SCATTER_KIND_COUNT][scatterLodCount] = {};
+    unsigned int instanceVBO[SCATTER_KIND_COUNT][scatterLodCount] = {};
+    int meshVertexCount[SCATTER_KIND_COUNT][scatterLodCount] = {};
+    vector<ScatterInstance> batches[SCATTER_KIND_COUNT][scatterLodCount];
+
+    void setup()
+    {
+        vector<float> mesh;
+        for (int k = 0; k < SCATTER_KIND_COUNT; k++)
+        {
+            for (int l = 0; l < scatterLodCount; l++)
+            {
+                scatter::buildMesh(k, l, mesh);
+                meshVertexCount[k][l] = (int)(mesh.size() / 9);
+
+                glGenVertexArrays(1, &VAO[k][l]);
+                glGenBuffers(1, &meshVBO[k][l]);
+                glGenBuffers(1, &instanceVBO[k][l]);
+                glBindVertexArray(VAO[k][l]);
+
+                glBindBuffer(GL_ARRAY_BUFFER, meshVBO[k][l]);
+                glBufferData(GL_ARRAY_BUFFER, mesh.size() * sizeof(float), &mesh[0], GL_STATIC_DRAW);
+                // vertex position, normal and colour
+                glEnableVertexAttribArray(0);
+                glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 9 * sizeof(float), (void*)0);
+                glEnableVertexAttribArray(1);
+                glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 9 * sizeof(float), (void*)(3 * sizeof(float)));
+                glEnableVertexAttribArray(2);
+                glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 9 * sizeof(float), (void*)(6 * sizeof(float)));
+
+                // per instance position/scale and rotation/tint
+                glBindBuffer(GL_ARRAY_BUFFER, instanceVBO[k][l]);
+                glEnableVertexAttribArray(3);
+                glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(ScatterInstance), (void*)offsetof(ScatterInstance, positionScale));
+                glVertexAttribDivisor(3, 1);
+                glEnableVertexAttribArray(4);
+                glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(ScatterInstance), (void*)offsetof(ScatterInstance, rotationTint));
+                glVertexAttribDivisor(4, 1);
+            }
+        }
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+};
+#endif
@@ -0,0 +1,559 @@
+#ifndef TERRAIN_VOLUME_H
+#define TERRAIN_VOLUME_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "FastNoiseLite.h"
+#include "frame_scheduler.h"
+#include "terrain.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <future>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define TERRAIN_VOLUME_SSE2
+#endif
+
+using namespace std;
+
+// cells along each edge of a chunk, the density grid has one more sample so neighbouring chunks share their border
+const int volumeChunkSize = 32;
+const int volumeChunkSamples = volumeChunkSize + 1;
+// the 3D noise is evaluated every volumeNoiseStep samples and trilinearly filled in between
+const int volumeNoiseStep = 2;
+const int volumeNoiseSamples = volumeChunkSize / volumeNoiseStep + 1;
+
+// edits only reach this many voxels past their radius, so chunks sharing a border sample always agree on it
+const float volumeEditMargin = 1.0f;
+
+// spherical edit carved out of the volume (craters), in voxel units
+struct VolumeEdit {
+    glm::vec3 centre;
+    float radius;
+};
+
+// one streamed chunk of the volume, owned by the main thread
+struct VolumeChunk {
+    glm::ivec3 coord;
+    // (volumeChunkSamples)^3 densities, solid where > 0. moved into a worker while busy
+    vector<float> density;
+    unsigned int VAO = 0, VBO = 0;
+    unsigned int vertexCount = 0;
+    // bumped every time the chunk is (re)created so late results of an unloaded chunk are ignored
+    unsigned int generation = 0;
+    // number of entries of VolumeTerrain::edits baked into density
+    size_t editsApplied = 0;
+    // a worker currently owns density
+    bool busy = false;
+    // edited while busy, remesh again when the worker hands it back
+    bool dirty = false;
+};
+
+// output of a worker job, uploaded by the main thread
+struct VolumeChunkResult {
+    long long key;
+    unsigned int generation;
+    size_t editsApplied;
+    vector<float> density;
+    // interleaved position (voxel units) and colour, non indexed triangles
+    vector<float> vertices;
+};
+
+// volumetric terrain mode: 3D noise densities streamed in chunks around a focus point and
+// polygonised on the worker threads. only chunks touched by an edit are remeshed.
+class VolumeTerrain
+{
+public:
+    // world size of one voxel, matches the spacing of the heightfield grid (0.0625 scaled by 5)
+    float voxelSize = 0.3125f;
+    // chunks kept loaded around the focus, on the xz plane
+    int chunkRadius = 3;
+    // vertical chunk range, covers the heightfield's -6..4 world height band
+    int minChunkY = -1;
+    int maxChunkY = 0;
+    // scheduler estimate for one chunk's mesh upload, until it has measured one
+    float uploadEstimateMs = 0.3f;
+    // caves and overhangs strength, in voxels
+    float caveStrength = 6.0f;
+
+    VolumeTerrain(const FastNoiseLite& terrainNoise, const FastNoiseLite& biomeNoise, int seed, FrameScheduler& scheduler)
+        : terrainNoise(terrainNoise), biomeNoise(biomeNoise), scheduler(scheduler)
+    {
+        caveNoise.SetNoiseType(FastNoiseLite::NoiseType_OpenSimplex2);
+        caveNoise.SetFrequency(0.04f);
+        caveNoise.SetSeed(seed);
+    }
+
+    ~VolumeTerrain()
+    {
+        // jobs still in flight call back into this object
+        for (auto& job : pending)
+            job.wait();
+    }
+
+    // streams chunks in and out around the focus (world position) and uploads finished meshes
+    void Update(const glm::vec3& focus)
+    {
+        glm::ivec3 centre = chunkCoordOf(focus / voxelSize);
+        focusChunk = centre;
+
+        // unload chunks that left the radius
+        for (auto it = chunks.begin(); it != chunks.end();)
+        {
+            glm::ivec3 c = it->second.coord;
+            if (abs(c.x - centre.x) > chunkRadius + 1 || abs(c.z - centre.z) > chunkRadius + 1)
+            {
+                releaseChunk(it->second);
+                it = chunks.erase(it);
+            }
+            else
+                ++it;
+        }
+
+        // request missing chunks, nearest first, without flooding the pool
+        size_t maxInFlight = ThreadPool::Get().Size() * 2;
+        for (int ring = 0; ring <= chunkRadius && pending.size() < maxInFlight; ring++)
+        {
+            for (int z = -ring; z <= ring; z++)
+            {
+                for (int x = -ring; x <= ring; x++)
+                {
+                    if (max(abs(x), abs(z)) != ring)
+                        continue;
+                    for (int y = minChunkY; y <= maxChunkY; y++)
+                    {
+                        glm::ivec3 coord(centre.x + x, y, centre.z + z);
+                        long long key = chunkKey(coord);
+                        if (chunks.count(key) || pending.size() >= maxInFlight)
+                            continue;
+                        VolumeChunk& chunk = chunks[key];
+                        chunk.coord = coord;
+                        chunk.generation = ++generationCounter;
+                        submitGenerate(chunk);
+                    }
+                }
+            }
+        }
+
+        collectResults();
+    }
+
+    // carves a sphere (world units) out of the volume, remeshing only the chunks it overlaps
+    void Blast(const glm::vec3& worldCentre, float worldRadius)
+    {
+        VolumeEdit edit = { worldCentre / voxelSize, worldRadius / voxelSize };
+        edits.push_back(edit);
+
+        for (auto& entry : chunks)
+        {
+            VolumeChunk& chunk = entry.second;
+            if (!editTouchesChunk(edit, chunk.coord))
+                continue;
+            if (chunk.busy)
+                chunk.dirty = true;
+            else if (!chunk.density.empty())
+                submitRemesh(chunk);
+        }
+    }
+
+    // draws every uploaded chunk, the caller sets the shader and view/projection
+    void Draw()
+    {
+        for (auto& entry : chunks)
+        {
+            const VolumeChunk& chunk = entry.second;
+            if (chunk.vertexCount == 0)
+                continue;
+            glBindVertexArray(chunk.VAO);
+            glDrawArrays(GL_TRIANGLES, 0, chunk.vertexCount);
+        }
+        glBindVertexArray(0);
+    }
+
+    // number of chunks generating or waiting for an upload
+    size_t ChunksInFlight() const
+    {
+        return pending.size() + queuedUploads;
+    }
+
+private:
+    FastNoiseLite terrainNoise;
+    FastNoiseLite biomeNoise;
+    FastNoiseLite caveNoise;
+
+    unordered_map<long long, VolumeChunk> chunks;
+    vector<VolumeEdit> edits;
+    deque<future<VolumeChunkResult>> pending;
+    FrameScheduler& scheduler;
+    size_t queuedUploads = 0;
+    glm::ivec3 focusChunk = glm::ivec3(0);
+    unsigned int generationCounter = 0;
+
+    static long long chunkKey(const glm::ivec3& c)
+    {
+        return ((long long)(c.x & 0xFFFFF) << 40) | ((long long)(c.y & 0xFFFFF) << 20) | (long long)(c.z & 0xFFFFF);
+    }
+
+    static glm::ivec3 chunkCoordOf(const glm::vec3& voxel)
+    {
+        return glm::ivec3((int)floor(voxel.x / volumeChunkSize), (int)floor(voxel.y / volumeChunkSize), (int)floor(voxel.z / volumeChunkSize));
+    }
+
+    static bool editTouchesChunk(const VolumeEdit& edit, const glm::ivec3& coord)
+    {
+        glm::vec3 lo = glm::vec3(coord * volumeChunkSize);
+        glm::vec3 hi = lo + glm::vec3((float)volumeChunkSize);
+        glm::vec3 closest = glm::clamp(edit.centre, lo, hi);
+        glm::vec3 d = closest - edit.centre;
+        float reach = edit.radius + volumeEditMargin;
+        return glm::dot(d, d) <= reach * reach;
+    }
+
+    vector<VolumeEdit> editsFor(const glm::ivec3& coord, size_t first) const
+    {
+        vector<VolumeEdit> touching;
+        for (size_t i = first; i < edits.size(); i++)
+            if (editTouchesChunk(edits[i], coord))
+                touching.push_back(edits[i]);
+        return touching;
+    }
+
+    void releaseChunk(VolumeChunk& chunk)
+    {
+        if (chunk.VAO)
+        {
+            glDeleteVertexArrays(1, &chunk.VAO);
+            glDeleteBuffers(1, &chunk.VBO);
+        }
+        chunk.VAO = chunk.VBO = 0;
+        chunk.vertexCount = 0;
+    }
+
+    void submitGenerate(VolumeChunk& chunk)
+    {
+        chunk.busy = true;
+        chunk.dirty = false;
+        glm::ivec3 coord = chunk.coord;
+        long long key = chunkKey(coord);
+        unsigned int generation = chunk.generation;
+        size_t editCount = edits.size();
+        vector<VolumeEdit> chunkEdits = editsFor(coord, 0);
+        pending.push_back(ThreadPool::Get().Submit([this, coord, key, generation, editCount, chunkEdits]()
+        {
+            VolumeChunkResult result;
+            result.key = key;
+            result.generation = generation;
+            result.editsApplied = editCount;
+            generateDensity(coord, result.density);
+            applyEdits(coord, chunkEdits, result.density);
+            polygonise(coord, result.density, result.vertices);
+            return result;
+        }));
+    }
+
+    void submitRemesh(VolumeChunk& chunk)
+    {
+        chunk.busy = true;
+        chunk.dirty = false;
+        glm::ivec3 coord = chunk.coord;
+        long long key = chunkKey(coord);
+        unsigned int generation = chunk.generation;
+        size_t editCount = edits.size();
+        vector<VolumeEdit> newEdits = editsFor(coord, chunk.editsApplied);
+        // hand the densities to the worker, they come back with the result
+        auto density = make_shared<vector<float>>(move(chunk.density));
+        chunk.density.clear();
+        pending.push_back(ThreadPool::Get().Submit([this, coord, key, generation, editCount, newEdits, density]()
+        {
+            VolumeChunkResult result;
+            result.key = key;
+            result.generation = generation;
+            result.editsApplied = editCount;
+            result.density = move(*density);
+            applyEdits(coord, newEdits, result.density);
+            polygonise(coord, result.density, result.vertices);
+            return result;
+        }));
+    }
+
+    // hands finished jobs to the scheduler without blocking. remeshes of drawn chunks go first so
+    // craters show up straight away, new chunks follow nearest first
+    void collectResults()
+    {
+        for (auto it = pending.begin(); it != pending.end();)
+        {
+            if (it->wait_for(chrono::seconds(0)) == future_status::ready)
+            {
+                auto result = make_shared<VolumeChunkResult>(it->get());
+                it = pending.erase(it);
+                auto found = chunks.find(result->key);
+                if (found == chunks.end() || found->second.generation != result->generation)
+                    continue;
+                const VolumeChunk& chunk = found->second;
+                int priority = chunk.VAO ? 1 : -max(abs(chunk.coord.x - focusChunk.x), abs(chunk.coord.z - focusChunk.z));
+                queuedUploads++;
+                scheduler.Schedule("volume chunk upload", priority, uploadEstimateMs, [this, result]()
+                {
+                    queuedUploads--;
+                    applyResult(*result);
+                });
+            }
+            else
+                ++it;
+        }
+    }
+
+    void applyResult(VolumeChunkResult& result)
+    {
+        auto it = chunks.find(result.key);
+        if (it == chunks.end() || it->second.generation != result.generation)
+            return;
+        VolumeChunk& chunk = it->second;
+        chunk.density = move(result.density);
+        chunk.editsApplied = result.editsApplied;
+        chunk.busy = false;
+
+        if (chunk.VAO == 0)
+        {
+            glGenVertexArrays(1, &chunk.VAO);
+            glGenBuffers(1, &chunk.VBO);
+            glBindVertexArray(chunk.VAO);
+            glBindBuffer(GL_ARRAY_BUFFER, chunk.VBO);
+            //Position attribute
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
+            glEnableVertexAttribArray(0);
+            //Colour attribute
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
+            glEnableVertexAttribArray(1);
+            glBindVertexArray(0);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, chunk.VBO);
+        glBufferData(GL_ARRAY_BUFFER, result.vertices.size() * sizeof(float), result.vertices.empty() ? NULL : &result.vertices[0], GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        chunk.vertexCount = (unsigned int)(result.vertices.size() / 6);
+
+        if (chunk.dirty)
+            submitRemesh(chunk);
+    }
+
+    // height of the ground in voxels, the same noise and scale as the heightfield terrain
+    float surfaceHeight(float x, float z) const
+    {
+        return (-1.0f + 5.0f * terrainNoise.GetNoise(x, z)) / voxelSize;
+    }
+
+    // fills the density grid of a chunk. runs on a worker thread
+    void generateDensity(const glm::ivec3& coord, vector<float>& density) const
+    {
+        const int n = volumeChunkSamples;
+        glm::ivec3 origin = coord * volumeChunkSize;
+        density.resize(n * n * n);
+
+        // ground height per column
+        vector<float> surface(n * n);
+        for (int z = 0; z < n; z++)
+            for (int x = 0; x < n; x++)
+                surface[z * n + x] = surfaceHeight((float)(origin.x + x), (float)(origin.z + z));
+
+        // 3D noise on a coarse lattice, it is by far the most expensive part
+        const int c = volumeNoiseSamples;
+        vector<float> coarse(c * c * c);
+        for (int z = 0; z < c; z++)
+            for (int y = 0; y < c; y++)
+                for (int x = 0; x < c; x++)
+                    coarse[(z * c + y) * c + x] = caveNoise.GetNoise((float)(origin.x + x * volumeNoiseStep), (float)(origin.y + y * volumeNoiseStep), (float)(origin.z + z * volumeNoiseStep));
+
+        vector<float> caveRow(n);
+        for (int z = 0; z < n; z++)
+        {
+            int cz = min(z / volumeNoiseStep, c - 2);
+            float tz = (z - cz * volumeNoiseStep) / (float)volumeNoiseStep;
+            for (int y = 0; y < n; y++)
+            {
+                int cy = min(y / volumeNoiseStep, c - 2);
+                float ty = (y - cy * volumeNoiseStep) / (float)volumeNoiseStep;
+                const float* c00 = &coarse[(cz * c + cy) * c];
+                const float* c01 = &coarse[(cz * c + cy + 1) * c];
+                const float* c10 = &coarse[((cz + 1) * c + cy) * c];
+                const float* c11 = &coarse[((cz + 1) * c + cy + 1) * c];
+                for (int x = 0; x < n; x++)
+                {
+                    int cx = min(x / volumeNoiseStep, c - 2);
+                    float tx = (x - cx * volumeNoiseStep) / (float)volumeNoiseStep;
+                    float a = c00[cx] + (c00[cx + 1] - c00[cx]) * tx;
+                    float b = c01[cx] + (c01[cx + 1] - c01[cx]) * tx;
+                    float e = c10[cx] + (c10[cx + 1] - c10[cx]) * tx;
+                    float f = c11[cx] + (c11[cx + 1] - c11[cx]) * tx;
+                    float lower = a + (b - a) * ty;
+                    float upper = e + (f - e) * ty;
+                    caveRow[x] = lower + (upper - lower) * tz;
+                }
+                combineRow(&surface[z * n], &caveRow[0], (float)(origin.y + y), &density[(z * n + y) * n], n);
+            }
+        }
+    }
+
+    // density = ground height - y + caves, 4 samples at a time where SSE2 is available
+    void combineRow(const float* surface, const float* cave, float y, float* out, int count) const
+    {
+        int x = 0;
+#ifdef TERRAIN_VOLUME_SSE2
+        __m128 height = _mm_set1_ps(y);
+        __m128 strength = _mm_set1_ps(caveStrength);
+        for (; x + 4 <= count; x += 4)
+        {
+            __m128 d = _mm_sub_ps(_mm_loadu_ps(surface + x), height);
+            d = _mm_add_ps(d, _mm_mul_ps(_mm_loadu_ps(cave + x), strength));
+            _mm_storeu_ps(out + x, d);
+        }
+#endif
+        for (; x < count; x++)
+            out[x] = surface[x] - y + cave[x] * caveStrength;
+    }
+
+    // subtracts edit spheres from the densities. runs on a worker thread
+    static void applyEdits(const glm::ivec3& coord, const vector<VolumeEdit>& chunkEdits, vector<float>& density)
+    {
+        const int n = volumeChunkSamples;
+        glm::ivec3 origin = coord * volumeChunkSize;
+        for (const VolumeEdit& edit : chunkEdits)
+        {
+            glm::vec3 local = edit.centre - glm::vec3(origin);
+            glm::ivec3 lo = glm::max(glm::ivec3(glm::floor(local - edit.radius - volumeEditMargin)), glm::ivec3(0));
+            glm::ivec3 hi = glm::min(glm::ivec3(glm::ceil(local + edit.radius + volumeEditMargin)), glm::ivec3(n - 1));
+            for (int z = lo.z; z <= hi.z; z++)
+                for (int y = lo.y; y <= hi.y; y++)
+                    for (int x = lo.x; x <= hi.x; x++)
+                    {
+                        float distance = glm::length(glm::vec3((float)x, (float)y, (float)z) - local);
+                        if (distance > edit.radius + volumeEditMargin)
+                            continue;
+                        float& d = density[(z * n + y) * n + x];
+                        d = min(d, distance - edit.radius);
+                    }
+        }
+    }
+
+    // colour of a surface point, the heightfield's biome palette with exposed underground walls as rock
+    glm::vec3 surfaceColour(const glm::vec3& p) const
+    {
+        float height = terrainNoise.GetNoise(p.x, p.z);
+        if ((-1.0f + 5.0f * height) / voxelSize - p.y > 2.0f)
+            return BiomeColour(BIOME_ROCKS);
+        return BiomeColour(ClassifyBiome(height, biomeNoise.GetNoise(p.x, p.z)));
+    }
+
+    // extracts the density = 0 surface. every cell is split into six tetrahedra around its 0-6 diagonal
+    // (marching tetrahedra), which has no ambiguous cases and needs no 256 entry table. runs on a worker thread
+    void polygonise(const glm::ivec3& coord, const vector<float>& density, vector<float>& vertices) const
+    {
+        static const int cornerOffset[8][3] = {
+            {0, 0, 0}, {1, 0, 0}, {1, 1, 0}, {0, 1, 0},
+            {0, 0, 1}, {1, 0, 1}, {1, 1, 1}, {0, 1, 1}
+        };
+        static const int tetrahedra[6][4] = {
+            {0, 6, 1, 2}, {0, 6, 2, 3}, {0, 6, 3, 7},
+            {0, 6, 7, 4}, {0, 6, 4, 5}, {0, 6, 5, 1}
+        };
+
+        const int n = volumeChunkSamples;
+        glm::vec3 origin = glm::vec3(coord * volumeChunkSize);
+        vertices.clear();
+
+        for (int z = 0; z < volumeChunkSize; z++)
+        {
+            for (int y = 0; y < volumeChunkSize; y++)
+            {
+                for (int x = 0; x < volumeChunkSize; x++)
+                {
+                    float value[8];
+                    glm::vec3 corner[8];
+                    int solid = 0;
+                    for (int i = 0; i < 8; i++)
+                    {
+                        int cx = x + cornerOffset[i][0], cy = y + cornerOffset[i][1], cz = z + cornerOffset[i][2];
+                        value[i] = density[(cz * n + cy) * n + cx];
+                        corner[i] = origin + glm::vec3((float)cx, (float)cy, (float)cz);
+                        solid += value[i] > 0.0f;
+                    }
+                    // entirely inside or outside, nothing to emit
+                    if (solid == 0 || solid == 8)
+                        continue;
+
+                    for (int t = 0; t < 6; t++)
+                        polygoniseTetrahedron(corner, value, tetrahedra[t], vertices);
+                }
+            }
+        }
+    }
+
+    void polygoniseTetrahedron(const glm::vec3* corner, const float* value, const int* tet, vector<float>& vertices) const
+    {
+        int inside[4], outside[4];
+        int insideCount = 0, outsideCount = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            if (value[tet[i]] > 0.0f)
+                inside[insideCount++] = tet[i];
+            else
+                outside[outsideCount++] = tet[i];
+        }
+        if (insideCount == 0 || insideCount == 4)
+            return;
+
+        // faces point from the solid corners towards the empty ones
+        glm::vec3 solidCentre(0.0f), emptyCentre(0.0f);
+        for (int i = 0; i < insideCount; i++)
+            solidCentre += corner[inside[i]];
+        for (int i = 0; i < outsideCount; i++)
+            emptyCentre += corner[outside[i]];
+        glm::vec3 outward = emptyCentre / (float)outsideCount - solidCentre / (float)insideCount;
+
+        if (insideCount == 1 || insideCount == 3)
+        {
+            // a single corner differs from the rest, cut it off with one triangle
+            int lone = insideCount == 1 ? inside[0] : outside[0];
+            const int* others = insideCount == 1 ? outside : inside;
+            emitTriangle(edgePoint(corner, value, lone, others[0]), edgePoint(corner, value, lone, others[1]), edgePoint(corner, value, lone, others[2]), outward, vertices);
+        }
+        else
+        {
+            // two and two, the cut is a quad
+            glm::vec3 ac = edgePoint(corner, value, inside[0], outside[0]);
+            glm::vec3 ad = edgePoint(corner, value, inside[0], outside[1]);
+            glm::vec3 bd = edgePoint(corner, value, inside[1], outside[1]);
+            glm::vec3 bc = edgePoint(corner, value, inside[1], outside[0]);
+            emitTriangle(ac, ad, bd, outward, vertices);
+            emitTriangle(ac, bd, bc, outward, vertices);
+        }
+    }
+
+    static glm::vec3 edgePoint(const glm::vec3* corner, const float* value, int a, int b)
+    {
+        float t = value[a] / (value[a] - value[b]);
+        return corner[a] + (corner[b] - corner[a]) * t;
+    }
+
+    void emitTriangle(const glm::vec3& a, glm::vec3 b, glm::vec3 c, const glm::vec3& outward, vector<float>& vertices) const
+    {
+        if (glm::dot(glm::cross(b - a, c - a), outward) < 0.0f)
+            swap(b, c);
+        const glm::vec3* points[3] = { &a, &b, &c };
+        for (const glm::vec3* p : points)
+        {
+            glm::vec3 colour = surfaceColour(*p);
+            vertices.insert(vertices.end(), { p->x, p->y, p->z, colour.r, colour.g, colour.b });
+        }
+    }
+};
+#endif
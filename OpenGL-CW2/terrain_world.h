@@ -0,0 +1,463 @@
+#ifndef TERRAIN_WORLD_H
+#define TERRAIN_WORLD_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "frame_scheduler.h"
+#include "geometry_arena.h"
+#include "shader_m.h"
+#include "terrain.h"
+#include "terrain_bake.h"
+#include "terrain_codec.h"
+#include "terrain_scatter.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+// one heightfield chunk known to the world, owned by the main thread.
+// inside the active radius it holds full heights and a mesh, further out only the compressed form
+struct TerrainChunk {
+    glm::ivec2 coord;
+    HeightfieldChunk data;
+    CompressedHeightfieldChunk packed;
+    bool active = false;
+    bool compressed = false;
+    // a worker currently owns data or packed
+    bool busy = false;
+    unsigned int generation = 0;
+    // mesh vertices in the geometry arena, drawn with the world's shared index range
+    unsigned int geometry = 0;
+    // baked normal and light maps sampled by terrain.frag
+    unsigned int normalMap = 0, lightMap = 0;
+    // trees, rocks and shrubs, only kept while active
+    ChunkScatter scatter;
+    float heightMin = 0.0f, heightMax = 0.0f;
+};
+
+// output of a worker job, applied by the main thread
+struct TerrainChunkResult {
+    enum Kind { GENERATED, DECOMPRESSED, COMPRESSED };
+    Kind kind;
+    long long key;
+    unsigned int generation;
+    HeightfieldChunk data;
+    CompressedHeightfieldChunk packed;
+    vector<float> vertices;
+    TerrainLightingBake bake;
+    ChunkScatter scatter;
+    double seconds = 0.0;
+};
+
+// streamed heightfield world. chunks near the focus are resident at full precision with a mesh and
+// baked lighting, chunks between the active and the resident radius are kept compressed and reactivated on demand
+class TerrainWorld
+{
+public:
+    // chunks (on each side of the focus chunk) kept active and drawn
+    int activeRadius = 3;
+    // chunks kept in memory compressed, beyond this they are dropped and regenerated from noise
+    int residentRadius = 12;
+    // scheduler estimate for one chunk's mesh and bake upload, until it has measured one
+    float uploadEstimateMs = 0.5f;
+    // scale of the terrain model matrix, world units are taken as metres for the memory report
+    float worldScale = 5.0f;
+
+    TerrainWorld(const FastNoiseLite& terrainNoise, const FastNoiseLite& biomeNoise, FrameScheduler& scheduler)
+        : terrainNoise(terrainNoise), biomeNoise(biomeNoise), scheduler(scheduler)
+    {
+    }
+
+    ~TerrainWorld()
+    {
+        // jobs still in flight call back into this object
+        for (auto& job : pending)
+            job.wait();
+    }
+
+    // streams chunks around the focus, given in the terrain's local (model) space
+    void Update(const glm::vec3& localFocus)
+    {
+        glm::ivec2 centre = chunkCoordOf(localFocus);
+        focusChunk = centre;
+
+        // drop or compress chunks that left the active radius
+        for (auto it = chunks.begin(); it != chunks.end();)
+        {
+            TerrainChunk& chunk = it->second;
+            int distance = max(abs(chunk.coord.x - centre.x), abs(chunk.coord.y - centre.y));
+            if (distance > residentRadius)
+            {
+                releaseMesh(chunk);
+                it = chunks.erase(it);
+                continue;
+            }
+            if (distance > activeRadius && chunk.active && !chunk.busy)
+                submitCompress(chunk);
+            ++it;
+        }
+
+        // generate or reactivate the active set, nearest first
+        size_t maxInFlight = ThreadPool::Get().Size() * 2;
+        for (int ring = 0; ring <= activeRadius && pending.size() < maxInFlight; ring++)
+        {
+            for (int y = -ring; y <= ring; y++)
+            {
+                for (int x = -ring; x <= ring; x++)
+                {
+                    if (max(abs(x), abs(y)) != ring || pending.size() >= maxInFlight)
+                        continue;
+                    glm::ivec2 coord(centre.x + x, centre.y + y);
+                    long long key = chunkKey(coord);
+                    auto found = chunks.find(key);
+                    if (found == chunks.end())
+                    {
+                        TerrainChunk& chunk = chunks[key];
+                        chunk.coord = coord;
+                        chunk.generation = ++generationCounter;
+                        submitGenerate(chunk);
+                    }
+                    else if (found->second.compressed && !found->second.busy)
+                        submitDecompress(found->second);
+                }
+            }
+        }
+
+        collectResults();
+    }
+
+    // blocks until the active set around the focus is generated and uploaded, used before the first frame
+    void Prime(const glm::vec3& localFocus)
+    {
+        for (;;)
+        {
+            Update(localFocus);
+            scheduler.Flush();
+            if (pending.empty() && activeSetComplete(chunkCoordOf(localFocus)))
+                break;
+            if (!pending.empty())
+                pending.front().wait();
+        }
+    }
+
+    // draws every active chunk, the caller sets the shader and matrices
+    void Draw(Shader& shader)
+    {
+        shader.setBool("bakedLighting", true);
+        shader.setInt("normalMap", 0);
+        shader.setInt("lightMap", 1);
+        shader.setVec3("sunDirection", TerrainSunDirection());
+        shader.setFloat("gridSpacing", terrainGridSpacing);
+        shader.setFloat("chunkSamples", (float)terrainChunkSamples);
+        for (auto& entry : chunks)
+        {
+            const TerrainChunk& chunk = entry.second;
+            if (!chunk.geometry)
+                continue;
+            // local xz of the chunk's first sample, the vertex shader derives the bake texture coordinates from it
+            shader.setVec2("chunkOrigin", terrainStartPosition - chunk.coord.x * terrainChunkQuads * terrainGridSpacing,
+                terrainStartPosition - chunk.coord.y * terrainChunkQuads * terrainGridSpacing);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, chunk.normalMap);
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, chunk.lightMap);
+            GeometryArena::Get().DrawShared(chunk.geometry, indexGeometry);
+        }
+        glBindVertexArray(0);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // draws the scatter of every active chunk, the caller binds the scatter shader with view and projection set
+    void DrawScatter(Shader& shader, const glm::mat4& terrainModel, const glm::mat4& viewProjection, const glm::vec3& cameraPosition)
+    {
+        shader.setVec3("sunDirection", TerrainSunDirection());
+        visibleScatter.clear();
+        for (auto& entry : chunks)
+        {
+            const TerrainChunk& chunk = entry.second;
+            if (!chunk.geometry)
+                continue;
+            // local bounds of the chunk, raised to cover the tallest tree, then taken to world space
+            float x0 = terrainStartPosition - chunk.coord.x * terrainChunkQuads * terrainGridSpacing;
+            float z0 = terrainStartPosition - chunk.coord.y * terrainChunkQuads * terrainGridSpacing;
+            float size = terrainChunkQuads * terrainGridSpacing;
+            float top = chunk.heightMax + scatterMaxScale[SCATTER_TREE] / worldScale;
+            ScatterRenderer::VisibleChunk visible;
+            visible.scatter = &chunk.scatter;
+            visible.boundsMin = glm::vec3(terrainModel * glm::vec4(x0 - size, chunk.heightMin, z0 - size, 1.0f));
+            visible.boundsMax = glm::vec3(terrainModel * glm::vec4(x0, top, z0, 1.0f));
+            visibleScatter.push_back(visible);
+        }
+        scatterRenderer.Draw(shader, terrainModel, viewProjection, cameraPosition, visibleScatter);
+    }
+
+    // memory used by the resident chunks, uncompressed versus compressed, per square kilometre
+    void PrintMemoryReport() const
+    {
+        size_t activeCount = 0, compressedCount = 0, compressedBytes = 0;
+        for (const auto& entry : chunks)
+        {
+            if (entry.second.active)
+                activeCount++;
+            if (entry.second.compressed)
+            {
+                compressedCount++;
+                compressedBytes += entry.second.packed.Bytes();
+            }
+        }
+        // what a chunk costs held as float heights and float colours
+        const double samples = terrainChunkSamples * terrainChunkSamples;
+        const double rawChunkBytes = samples * 4 * sizeof(float);
+        const double chunkSide = terrainChunkQuads * terrainGridSpacing * worldScale;
+        const double chunksPerKm2 = 1.0e6 / (chunkSide * chunkSide);
+        const double mb = 1024.0 * 1024.0;
+
+        cout << "Terrain memory: " << activeCount << " active chunks, " << compressedCount << " compressed chunks" << endl;
+        cout << "  uncompressed: " << rawChunkBytes * chunksPerKm2 / mb << " MB/km2" << endl;
+        if (compressedCount)
+        {
+            double averageBytes = (double)compressedBytes / compressedCount;
+            cout << "  compressed:   " << averageBytes * chunksPerKm2 / mb << " MB/km2 (" << rawChunkBytes / averageBytes << "x smaller)" << endl;
+        }
+        if (decompressedChunks)
+        {
+            double average = decompressSeconds / decompressedChunks;
+            cout << "  decompression: " << average * 1.0e6 << " us per chunk (" << rawChunkBytes / average / mb << " MB/s)" << endl;
+        }
+    }
+
+private:
+    FastNoiseLite terrainNoise;
+    FastNoiseLite biomeNoise;
+
+    unordered_map<long long, TerrainChunk> chunks;
+    deque<future<TerrainChunkResult>> pending;
+    FrameScheduler& scheduler;
+    glm::ivec2 focusChunk = glm::ivec2(0);
+    unsigned int generationCounter = 0;
+
+    // index range shared by every chunk mesh
+    unsigned int indexGeometry = 0;
+
+    ScatterRenderer scatterRenderer;
+    vector<ScatterRenderer::VisibleChunk> visibleScatter;
+
+    size_t decompressedChunks = 0;
+    double decompressSeconds = 0.0;
+
+    static long long chunkKey(const glm::ivec2& c)
+    {
+        return ((long long)(unsigned int)c.x << 32) | (unsigned int)c.y;
+    }
+
+    // sample x grows towards -x in local space, see BuildHeightfieldVertices
+    static glm::ivec2 chunkCoordOf(const glm::vec3& localFocus)
+    {
+        float sampleX = (terrainStartPosition - localFocus.x) / terrainGridSpacing;
+        float sampleY = (terrainStartPosition - localFocus.z) / terrainGridSpacing;
+        return glm::ivec2((int)floor(sampleX / terrainChunkQuads), (int)floor(sampleY / terrainChunkQuads));
+    }
+
+    bool activeSetComplete(const glm::ivec2& centre) const
+    {
+        for (int y = -activeRadius; y <= activeRadius; y++)
+            for (int x = -activeRadius; x <= activeRadius; x++)
+            {
+                auto found = chunks.find(chunkKey(glm::ivec2(centre.x + x, centre.y + y)));
+                if (found == chunks.end() || !found->second.geometry)
+                    return false;
+            }
+        return true;
+    }
+
+    void releaseMesh(TerrainChunk& chunk)
+    {
+        if (chunk.geometry)
+        {
+            GeometryArena::Get().Free(chunk.geometry);
+            glDeleteTextures(1, &chunk.normalMap);
+            glDeleteTextures(1, &chunk.lightMap);
+        }
+        chunk.geometry = 0;
+        chunk.normalMap = chunk.lightMap = 0;
+    }
+
+    void submitGenerate(TerrainChunk& chunk)
+    {
+        chunk.busy = true;
+        glm::ivec2 coord = chunk.coord;
+        long long key = chunkKey(coord);
+        unsigned int generation = chunk.generation;
+        pending.push_back(ThreadPool::Get().Submit([this, coord, key, generation]()
+        {
+            TerrainChunkResult result;
+            result.kind = TerrainChunkResult::GENERATED;
+            result.key = key;
+            result.generation = generation;
+            GenerateHeightfieldChunk(terrainNoise, biomeNoise, coord, result.data);
+            BuildHeightfieldVertices(result.data, result.vertices);
+            BakeTerrainLighting(terrainNoise, coord, result.bake);
+            ScatterChunk(result.data, result.scatter);
+            return result;
+        }));
+    }
+
+    void submitCompress(TerrainChunk& chunk)
+    {
+        // the mesh is not drawn outside the active radius, free it straight away
+        releaseMesh(chunk);
+        chunk.busy = true;
+        chunk.active = false;
+        long long key = chunkKey(chunk.coord);
+        unsigned int generation = chunk.generation;
+        auto data = make_shared<HeightfieldChunk>(move(chunk.data));
+        chunk.data = HeightfieldChunk();
+        chunk.scatter = ChunkScatter();
+        pending.push_back(ThreadPool::Get().Submit([key, generation, data]()
+        {
+            TerrainChunkResult result;
+            result.kind = TerrainChunkResult::COMPRESSED;
+            result.key = key;
+            result.generation = generation;
+            CompressHeightfieldChunk(*data, result.packed);
+            return result;
+        }));
+    }
+
+    void submitDecompress(TerrainChunk& chunk)
+    {
+        chunk.busy = true;
+        glm::ivec2 coord = chunk.coord;
+        long long key = chunkKey(coord);
+        unsigned int generation = chunk.generation;
+        auto packed = make_shared<CompressedHeightfieldChunk>(move(chunk.packed));
+        chunk.packed = CompressedHeightfieldChunk();
+        chunk.compressed = false;
+        pending.push_back(ThreadPool::Get().Submit([this, coord, key, generation, packed]()
+        {
+            TerrainChunkResult result;
+            result.kind = TerrainChunkResult::DECOMPRESSED;
+            result.key = key;
+            result.generation = generation;
+            auto start = chrono::steady_clock::now();
+            DecompressHeightfieldChunk(*packed, result.data);
+            result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            BuildHeightfieldVertices(result.data, result.vertices);
+            // the bake is cheap next to keeping it around, redo it instead of compressing it too
+            BakeTerrainLighting(terrainNoise, coord, result.bake);
+            ScatterChunk(result.data, result.scatter);
+            return result;
+        }));
+    }
+
+    void collectResults()
+    {
+        for (auto it = pending.begin(); it != pending.end();)
+        {
+            if (it->wait_for(chrono::seconds(0)) == future_status::ready)
+            {
+                auto result = make_shared<TerrainChunkResult>(it->get());
+                it = pending.erase(it);
+                // compressed results need no GL work, meshes go through the frame budget nearest chunk first
+                if (result->kind == TerrainChunkResult::COMPRESSED)
+                {
+                    applyResult(*result);
+                    continue;
+                }
+                glm::ivec2 coord = result->data.coord;
+                int distance = max(abs(coord.x - focusChunk.x), abs(coord.y - focusChunk.y));
+                scheduler.Schedule("terrain chunk upload", -distance, uploadEstimateMs, [this, result]()
+                {
+                    applyResult(*result);
+                });
+            }
+            else
+                ++it;
+        }
+    }
+
+    void applyResult(TerrainChunkResult& result)
+    {
+        auto it = chunks.find(result.key);
+        if (it == chunks.end() || it->second.generation != result.generation)
+            return;
+        TerrainChunk& chunk = it->second;
+        chunk.busy = false;
+
+        if (result.kind == TerrainChunkResult::COMPRESSED)
+        {
+            chunk.packed = move(result.packed);
+            chunk.compressed = true;
+            return;
+        }
+
+        if (result.kind == TerrainChunkResult::DECOMPRESSED)
+        {
+            decompressedChunks++;
+            decompressSeconds += result.seconds;
+        }
+        chunk.data = move(result.data);
+        chunk.scatter = move(result.scatter);
+        auto range = minmax_element(chunk.data.heights.begin(), chunk.data.heights.end());
+        chunk.heightMin = *range.first;
+        chunk.heightMax = *range.second;
+        chunk.active = true;
+        uploadMesh(chunk, result.vertices);
+        uploadBake(chunk, result.bake);
+    }
+
+    void uploadBake(TerrainChunk& chunk, const TerrainLightingBake& bake)
+    {
+        // rows of 33 RGB texels are not 4 byte aligned
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        chunk.normalMap = createBakeTexture(GL_RGB8, GL_RGB, &bake.normals[0]);
+        chunk.lightMap = createBakeTexture(GL_RG8, GL_RG, &bake.lighting[0]);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    }
+
+    static unsigned int createBakeTexture(GLint internalFormat, GLenum format, const unsigned char* pixels)
+    {
+        unsigned int texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, terrainChunkSamples, terrainChunkSamples, 0, format, GL_UNSIGNED_BYTE, pixels);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return texture;
+    }
+
+    // position, then colour. terrain vertices have no normal, so the colour deliberately takes the normal's
+    // location (1), where terrain.vert reads aColour
+    static VertexFormat chunkFormat()
+    {
+        VertexFormat format;
+        format.Add(ATTRIBUTE_POSITION, 3, GL_FLOAT, false);
+        format.Add(ATTRIBUTE_NORMAL, 3, GL_FLOAT, false);
+        return format;
+    }
+
+    void uploadMesh(TerrainChunk& chunk, const vector<float>& vertices)
+    {
+        if (!indexGeometry)
+        {
+            vector<unsigned int> indices;
+            BuildHeightfieldIndices(indices);
+            indexGeometry = GeometryArena::Get().Allocate(chunkFormat(), NULL, 0, &indices[0], indices.size());
+        }
+        chunk.geometry = GeometryArena::Get().Allocate(chunkFormat(), &vertices[0], vertices.size() / 6, NULL, 0);
+    }
+};
+#endif
@@ -0,0 +1,475 @@
+#ifndef TEXTURE_COMPRESS_H
+#define TEXTURE_COMPRESS_H
+
+#include <glad/glad.h>
+
+#include "cache_file.h"
+#include "content_hash.h"
+#include "mapped_file.h"
+#include "texture_mips.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+using namespace std;
+
+// S3TC is an extension glad was generated without, RGTC (BC4/BC5) is core since GL 3.0
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+// which block compressed formats may be used. set on the context thread by DetectTextureCompression before
+// any texture loads, read by the loaders on worker threads
+struct TextureCompressionSettings {
+    // turn off to upload every texture uncompressed
+    atomic<bool> enabled;
+    atomic<bool> s3tc;
+
+    TextureCompressionSettings() : enabled(true), s3tc(false) {}
+};
+
+inline TextureCompressionSettings& TextureCompression()
+{
+    static TextureCompressionSettings settings;
+    return settings;
+}
+
+// looks for the S3TC extension, without it only one and two channel textures are compressed (RGTC)
+inline void DetectTextureCompression()
+{
+    GLint extensionCount = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+    bool s3tc = false;
+    for (GLint i = 0; i < extensionCount; i++)
+    {
+        const char* name = (const char*)glGetStringi(GL_EXTENSIONS, i);
+        if (name && strcmp(name, "GL_EXT_texture_compression_s3tc") == 0)
+            s3tc = true;
+    }
+    TextureCompression().s3tc = s3tc;
+}
+
+// block compressed format for an image with this many channels, 0 when it stays uncompressed.
+// four channels with every pixel opaque use BC1 too
+inline GLenum ChooseCompressedFormat(int components, bool opaque)
+{
+    TextureCompressionSettings& settings = TextureCompression();
+    if (!settings.enabled)
+        return 0;
+    switch (components)
+    {
+    case 1:
+        return GL_COMPRESSED_RED_RGTC1;
+    case 2:
+        return GL_COMPRESSED_RG_RGTC2;
+    case 3:
+        return settings.s3tc ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : 0;
+    case 4:
+        return settings.s3tc ? (opaque ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT) : 0;
+    default:
+        return 0;
+    }
+}
+
+inline size_t CompressedBlockBytes(GLenum format)
+{
+    return format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT || format == GL_COMPRESSED_RED_RGTC1 ? 8 : 16;
+}
+
+namespace bcn
+{
+    inline int expand5(int value) { return (value << 3) | (value >> 2); }
+    inline int expand6(int value) { return (value << 2) | (value >> 4); }
+
+    inline uint16_t to565(const float color[3])
+    {
+        int r = min(31, max(0, (int)(color[0] * 31.0f / 255.0f + 0.5f)));
+        int g = min(63, max(0, (int)(color[1] * 63.0f / 255.0f + 0.5f)));
+        int b = min(31, max(0, (int)(color[2] * 31.0f / 255.0f + 0.5f)));
+        return (uint16_t)((r << 11) | (g << 5) | b);
+    }
+
+    inline void from565(uint16_t packed, int color[3])
+    {
+        color[0] = expand5(packed >> 11);
+        color[1] = expand6((packed >> 5) & 63);
+        color[2] = expand5(packed & 31);
+    }
+
+    // picks the nearest of the four palette entries for every pixel, returns the total squared error
+    inline int assignIndices(const unsigned char pixels[16][4], uint16_t c0, uint16_t c1, uint32_t& indices)
+    {
+        int palette[4][3];
+        from565(c0, palette[0]);
+        from565(c1, palette[1]);
+        for (int k = 0; k < 3; k++)
+        {
+            palette[2][k] = (2 * palette[0][k] + palette[1][k]) / 3;
+            palette[3][k] = (palette[0][k] + 2 * palette[1][k]) / 3;
+        }
+        indices = 0;
+        int error = 0;
+        for (int i = 0; i < 16; i++)
+        {
+            int best = 0, bestDistance = 1 << 30;
+            for (int p = 0; p < 4; p++)
+            {
+                int dr = pixels[i][0] - palette[p][0], dg = pixels[i][1] - palette[p][1], db = pixels[i][2] - palette[p][2];
+                int distance = dr * dr + dg * dg + db * db;
+                if (distance < bestDistance)
+                {
+                    bestDistance = distance;
+                    best = p;
+                }
+            }
+            indices |= (uint32_t)best << (2 * i);
+            error += bestDistance;
+        }
+        return error;
+    }
+
+    // endpoints in four colour mode (c0 > c1), swapping the indices along if the order flips
+    inline void orderEndpoints(uint16_t& c0, uint16_t& c1, uint32_t& indices)
+    {
+        if (c0 >= c1)
+            return;
+        swap(c0, c1);
+        // 0 <-> 1 and 2 <-> 3
+        indices ^= 0x55555555;
+    }
+
+    // BC1 colour block: endpoints from the range of the colours along their principal axis, then one least
+    // squares refinement of the endpoints for the chosen indices
+    inline void encodeColorBlock(const unsigned char pixels[16][4], unsigned char* output)
+    {
+        float mean[3] = { 0, 0, 0 };
+        for (int i = 0; i < 16; i++)
+            for (int k = 0; k < 3; k++)
+                mean[k] += pixels[i][k] / 16.0f;
+        float covariance[6] = { 0, 0, 0, 0, 0, 0 };
+        for (int i = 0; i < 16; i++)
+        {
+            float r = pixels[i][0] - mean[0], g = pixels[i][1] - mean[1], b = pixels[i][2] - mean[2];
+            covariance[0] += r * r; covariance[1] += r * g; covariance[2] += r * b;
+            covariance[3] += g * g; covariance[4] += g * b; covariance[5] += b * b;
+        }
+        // power iteration for the principal axis
+        float axis[3] = { 1.0f, 1.0f, 1.0f };
+        for (int iteration = 0; iteration < 4; iteration++)
+        {
+            float next[3] = {
+                covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2],
+                covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2],
+                covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2] };
+            float length = sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+            if (length < 1e-6f)
+                break;
+            for (int k = 0; k < 3; k++)
+                axis[k] = next[k] / length;
+        }
+        float low = 1e9f, high = -1e9f;
+        for (int i = 0; i < 16; i++)
+        {
+            float t = (pixels[i][0] - mean[0]) * axis[0] + (pixels[i][1] - mean[1]) * axis[1] + (pixels[i][2] - mean[2]) * axis[2];
+            low = min(low, t);
+            high = max(high, t);
+        }
+        float endpoint0[3], endpoint1[3];
+        for (int k = 0; k < 3; k++)
+        {
+            endpoint0[k] = mean[k] + axis[k] * high;
+            endpoint1[k] = mean[k] + axis[k] * low;
+        }
+        uint16_t c0 = to565(endpoint0), c1 = to565(endpoint1);
+        uint32_t indices;
+        int error = assignIndices(pixels, c0, c1, indices);
+        orderEndpoints(c0, c1, indices);
+
+        // least squares endpoints for those indices: pixel = a * e0 + b * e1
+        static const float weight0[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+        float aa = 0, ab = 0, bb = 0, ax[3] = { 0, 0, 0 }, bx[3] = { 0, 0, 0 };
+        for (int i = 0; i < 16; i++)
+        {
+            float a = weight0[(indices >> (2 * i)) & 3], b = 1.0f - a;
+            aa += a * a; ab += a * b; bb += b * b;
+            for (int k = 0; k < 3; k++)
+            {
+                ax[k] += a * pixels[i][k];
+                bx[k] += b * pixels[i][k];
+            }
+        }
+        float determinant = aa * bb - ab * ab;
+        if (fabs(determinant) > 1e-6f)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                endpoint0[k] = (ax[k] * bb - bx[k] * ab) / determinant;
+                endpoint1[k] = (bx[k] * aa - ax[k] * ab) / determinant;
+            }
+            uint16_t refined0 = to565(endpoint0), refined1 = to565(endpoint1);
+            uint32_t refinedIndices;
+            int refinedError = assignIndices(pixels, refined0, refined1, refinedIndices);
+            if (refinedError < error)
+            {
+                orderEndpoints(refined0, refined1, refinedIndices);
+                c0 = refined0;
+                c1 = refined1;
+                indices = refinedIndices;
+            }
+        }
+        // equal endpoints would select three colour mode, every index already points at the one colour
+        if (c0 == c1)
+            indices = 0;
+
+        memcpy(output, &c0, 2);
+        memcpy(output + 2, &c1, 2);
+        memcpy(output + 4, &indices, 4);
+    }
+
+    // BC4 block for one channel, eight value mode between the block's extremes
+    inline void encodeChannelBlock(const unsigned char pixels[16][4], int channel, unsigned char* output)
+    {
+        int low = 255, high = 0;
+        for (int i = 0; i < 16; i++)
+        {
+            low = min(low, (int)pixels[i][channel]);
+            high = max(high, (int)pixels[i][channel]);
+        }
+        output[0] = (unsigned char)high;
+        output[1] = (unsigned char)low;
+        int palette[8] = { high, low };
+        for (int k = 2; k < 8; k++)
+            palette[k] = ((8 - k) * high + (k - 1) * low) / 7;
+        uint64_t bits = 0;
+        if (high != low)
+        {
+            for (int i = 0; i < 16; i++)
+            {
+                int best = 0, bestDistance = 1 << 30;
+                for (int p = 0; p < 8; p++)
+                {
+                    int distance = abs(pixels[i][channel] - palette[p]);
+                    if (distance < bestDistance)
+                    {
+                        bestDistance = distance;
+                        best = p;
+                    }
+                }
+                bits |= (uint64_t)best << (3 * i);
+            }
+        }
+        for (int k = 0; k < 6; k++)
+            output[2 + k] = (unsigned char)(bits >> (8 * k));
+    }
+
+    // the 4x4 block at (bx, by), edge pixels repeated past the image and missing channels filled in
+    inline void readBlock(const unsigned char* pixels, int width, int height, int components, int bx, int by, unsigned char block[16][4])
+    {
+        for (int y = 0; y < 4; y++)
+        {
+            int sy = min(by * 4 + y, height - 1);
+            for (int x = 0; x < 4; x++)
+            {
+                int sx = min(bx * 4 + x, width - 1);
+                const unsigned char* source = pixels + ((size_t)sy * width + sx) * components;
+                unsigned char* target = block[y * 4 + x];
+                target[0] = source[0];
+                target[1] = components > 1 ? source[1] : 0;
+                target[2] = components > 2 ? source[2] : 0;
+                target[3] = components > 3 ? source[3] : 255;
+            }
+        }
+    }
+
+    inline void encodeBlock(GLenum format, const unsigned char block[16][4], unsigned char* output)
+    {
+        switch (format)
+        {
+        case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+            encodeColorBlock(block, output);
+            break;
+        case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+            encodeChannelBlock(block, 3, output);
+            encodeColorBlock(block, output + 8);
+            break;
+        case GL_COMPRESSED_RED_RGTC1:
+            encodeChannelBlock(block, 0, output);
+            break;
+        case GL_COMPRESSED_RG_RGTC2:
+            encodeChannelBlock(block, 0, output);
+            encodeChannelBlock(block, 1, output + 8);
+            break;
+        }
+    }
+}
+
+// encodes every level of an 8 bit mip chain into the format. block rows are spread over the thread pool
+inline shared_ptr<MipChain> CompressImage(const MipChain& source, GLenum format)
+{
+    auto image = make_shared<MipChain>();
+    image->format = format;
+    image->components = source.components;
+    size_t blockBytes = CompressedBlockBytes(format);
+
+    // level sizes first so every level is encoded straight into its place
+    image->Layout(source.levels[0].width, source.levels[0].height, [blockBytes](int w, int h) { return (size_t)((w + 3) / 4) * ((h + 3) / 4) * blockBytes; });
+    image->owned.resize(image->Size());
+
+    for (size_t l = 0; l < image->levels.size(); l++)
+    {
+        const MipChain::Level& level = image->levels[l];
+        const unsigned char* pixels = source.Data() + source.levels[l].offset;
+        int blocksX = (level.width + 3) / 4, blocksY = (level.height + 3) / 4;
+        unsigned char* target = &image->owned[level.offset];
+        ThreadPool::Get().ParallelFor((size_t)blocksY, [&](size_t by)
+        {
+            unsigned char block[16][4];
+            for (int bx = 0; bx < blocksX; bx++)
+            {
+                bcn::readBlock(pixels, level.width, level.height, source.components, bx, (int)by, block);
+                bcn::encodeBlock(format, block, target + (by * blocksX + bx) * blockBytes);
+            }
+        });
+    }
+    return image;
+}
+
+// mip chains, compressed or not, are cached next to the image they came from, keyed by the file's bytes
+const uint32_t textureCacheMagic = 0x58544342; // "BCTX"
+const uint32_t textureCacheVersion = 2;
+// no level 0 is bigger than this, GL_MAX_TEXTURE_SIZE is lower on any context
+const uint32_t textureCacheMaxSize = 1u << 16;
+
+struct TextureCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t sourceHash;
+    // hash of the decoded pixels, so textures loaded from the cache still deduplicate by content
+    uint64_t contentHash;
+    // 0 for 8 bit levels
+    uint32_t format;
+    uint32_t components;
+    uint32_t levelCount;
+    uint32_t reserved;
+    uint64_t dataOffset;
+    uint64_t fileSize;
+};
+
+struct TextureCacheLevel {
+    uint32_t width;
+    uint32_t height;
+    uint64_t offset;
+    uint64_t size;
+};
+
+inline string TextureCachePath(const string& sourcePath)
+{
+    return sourcePath + ".texcache";
+}
+
+// maps a cache file made from a source with this hash, null if missing, stale or in a format this context can't use
+inline shared_ptr<MipChain> ReadTextureCache(const string& cachePath, uint64_t sourceHash, int& components, uint64_t& contentHash)
+{
+    unique_ptr<MappedFile> file(new MappedFile());
+    if (!file->Open(cachePath) || file->Size() < sizeof(TextureCacheHeader))
+        return shared_ptr<MipChain>();
+    const TextureCacheHeader* header = (const TextureCacheHeader*)file->Data();
+    if (header->magic != textureCacheMagic || header->version != textureCacheVersion || header->sourceHash != sourceHash
+        || header->fileSize != file->Size() || header->dataOffset > file->Size() || header->levelCount == 0
+        || header->components < 1 || header->components > 4
+        || sizeof(TextureCacheHeader) + (uint64_t)header->levelCount * sizeof(TextureCacheLevel) > header->dataOffset)
+        return shared_ptr<MipChain>();
+    // written with S3TC on a context that had it, or with compression since turned on or off
+    GLenum expected = ChooseCompressedFormat(header->components, header->format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT);
+    if (expected != header->format)
+        return shared_ptr<MipChain>();
+
+    auto image = make_shared<MipChain>();
+    image->format = header->format;
+    image->components = header->components;
+    const TextureCacheLevel* levels = (const TextureCacheLevel*)(file->Data() + sizeof(TextureCacheHeader));
+    uint64_t dataSize = header->fileSize - header->dataOffset;
+    // the chain has to be the one the loader lays out: each level half the one before down to 1x1, as many bytes
+    // as its size takes in the format, and inside the data
+    if (levels[0].width == 0 || levels[0].height == 0 || levels[0].width > textureCacheMaxSize || levels[0].height > textureCacheMaxSize)
+        return shared_ptr<MipChain>();
+    for (uint32_t l = 0; l < header->levelCount; l++)
+    {
+        uint64_t width = l == 0 ? levels[0].width : max(1u, levels[l - 1].width / 2);
+        uint64_t height = l == 0 ? levels[0].height : max(1u, levels[l - 1].height / 2);
+        uint64_t bytes = header->format ? ((width + 3) / 4) * ((height + 3) / 4) * CompressedBlockBytes(header->format)
+                                        : width * height * header->components;
+        bool last = width == 1 && height == 1;
+        if (levels[l].width != width || levels[l].height != height || levels[l].size != bytes
+            || last != (l + 1 == header->levelCount)
+            || levels[l].offset > dataSize || levels[l].size > dataSize - levels[l].offset)
+            return shared_ptr<MipChain>();
+        MipChain::Level level;
+        level.width = levels[l].width;
+        level.height = levels[l].height;
+        level.offset = (size_t)levels[l].offset;
+        level.size = (size_t)levels[l].size;
+        image->levels.push_back(level);
+    }
+    image->mapped = file->Data() + header->dataOffset;
+    image->mapping = move(file);
+    components = header->components;
+    contentHash = header->contentHash;
+    return image;
+}
+
+inline bool WriteTextureCache(const string& cachePath, uint64_t sourceHash, uint64_t contentHash, int components, const MipChain& image)
+{
+    TextureCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = textureCacheMagic;
+    header.version = textureCacheVersion;
+    header.sourceHash = sourceHash;
+    header.contentHash = contentHash;
+    header.format = image.format;
+    header.components = components;
+    header.levelCount = (uint32_t)image.levels.size();
+    header.dataOffset = (sizeof(TextureCacheHeader) + image.levels.size() * sizeof(TextureCacheLevel) + 15) & ~15ull;
+    header.fileSize = header.dataOffset + image.Size();
+
+    // written under a temporary name of its own so a half written cache is never picked up
+    string temporaryPath = TemporaryCachePath(cachePath);
+    bool complete;
+    {
+        ofstream file(temporaryPath, ios::binary | ios::trunc);
+        if (!file)
+            return false;
+        file.write((const char*)&header, sizeof(header));
+        for (const MipChain::Level& level : image.levels)
+        {
+            TextureCacheLevel stored;
+            stored.width = level.width;
+            stored.height = level.height;
+            stored.offset = level.offset;
+            stored.size = level.size;
+            file.write((const char*)&stored, sizeof(stored));
+        }
+        static const char padding[16] = {};
+        file.write(padding, header.dataOffset - (sizeof(TextureCacheHeader) + image.levels.size() * sizeof(TextureCacheLevel)));
+        file.write((const char*)image.Data(), image.Size());
+        complete = (bool)file;
+    }
+    if (!complete)
+    {
+        remove(temporaryPath.c_str());
+        return false;
+    }
+    return CommitCacheFile(temporaryPath, cachePath);
+}
+#endif
@@ -0,0 +1,222 @@
+#ifndef TEXTURE_LOADER_H
+#define TEXTURE_LOADER_H
+
+#include <glad/glad.h>
+
+#include <stb_image.h>
+
+#include "asset_archive.h"
+#include "content_hash.h"
+#include "gl_staging.h"
+#include "load_profiler.h"
+#include "texture_compress.h"
+
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+using namespace std;
+
+// pixels of an image file decoded on the CPU, or its whole mip chain (block compressed or not) ready to upload
+// level by level. decoding is thread safe, only the upload needs the GL context
+struct DecodedImage {
+    unsigned char* pixels = NULL;
+    // set instead of pixels by LoadTextureImage
+    shared_ptr<MipChain> mips;
+    int width = 0;
+    int height = 0;
+    int components = 0;
+    // hash of the size and pixels, set by loaders that deduplicate textures by content
+    uint64_t contentHash = 0;
+
+    DecodedImage() {}
+
+    // CPU memory the image holds
+    size_t Bytes() const
+    {
+        if (mips)
+            return mips->owned.size();
+        return pixels ? (size_t)width * height * components : 0;
+    }
+    DecodedImage(const DecodedImage&) = delete;
+    DecodedImage& operator=(const DecodedImage&) = delete;
+
+    ~DecodedImage()
+    {
+        if (pixels)
+            stbi_image_free(pixels);
+    }
+};
+
+// decodes an image file, out of the asset archive when it has it, the result has no pixels if it failed. safe to
+// call from worker threads
+inline shared_ptr<DecodedImage> DecodeImage(const string& filename)
+{
+    ProfileScope scope("texture decode");
+    auto image = make_shared<DecodedImage>();
+    AssetData file = OpenAsset(filename);
+    if (file)
+        image->pixels = stbi_load_from_memory(file.Data(), (int)file.Size(), &image->width, &image->height, &image->components, 0);
+    return image;
+}
+
+// hash of the size and pixels, equal images share one texture
+inline uint64_t HashImagePixels(const DecodedImage& image)
+{
+    int size[3] = { image.width, image.height, image.components };
+    uint64_t hash = HashBytes(size, sizeof(size));
+    return image.pixels ? HashBytes(image.pixels, (size_t)image.width * image.height * image.components, hash) : hash;
+}
+
+inline bool ImageIsOpaque(const DecodedImage& image)
+{
+    if (image.components != 4)
+        return true;
+    size_t count = (size_t)image.width * image.height;
+    for (size_t i = 0; i < count; i++)
+        if (image.pixels[i * 4 + 3] != 255)
+            return false;
+    return true;
+}
+
+// the image a texture is made from, with contentHash set: its mip chain from the texture cache when there is a
+// valid one, otherwise the file is decoded, its mips filtered and, if the format allows, block compressed on the
+// thread pool, and the chain cached for the next run. with mapCache a chain just cached is returned mapped from the
+// cache as a warm load returns it, and the decoded copy freed. safe to call from worker threads
+inline shared_ptr<DecodedImage> LoadTextureImage(const string& filename, bool mapCache = false)
+{
+    ProfileScope hashing("texture hash");
+    uint64_t sourceHash = 0;
+    bool cacheable = HashAsset(filename, sourceHash);
+    hashing.End();
+    string cachePath = TextureCachePath(filename);
+    if (cacheable)
+    {
+        ProfileScope scope("texture cache read");
+        auto image = make_shared<DecodedImage>();
+        image->mips = ReadTextureCache(cachePath, sourceHash, image->components, image->contentHash);
+        if (image->mips)
+        {
+            image->width = image->mips->levels[0].width;
+            image->height = image->mips->levels[0].height;
+            return image;
+        }
+    }
+
+    shared_ptr<DecodedImage> image = DecodeImage(filename);
+    if (!image->pixels)
+        return image;
+    ProfileScope mipmapping("texture mips");
+    image->contentHash = HashImagePixels(*image);
+    image->mips = GenerateMipChain(image->pixels, image->width, image->height, image->components);
+    mipmapping.End();
+    GLenum format = ChooseCompressedFormat(image->components, ImageIsOpaque(*image));
+    if (format)
+    {
+        ProfileScope scope("texture compress");
+        image->mips = CompressImage(*image->mips, format);
+    }
+    stbi_image_free(image->pixels);
+    image->pixels = NULL;
+    if (cacheable)
+    {
+        ProfileScope scope("texture cache write");
+        if (!WriteTextureCache(cachePath, sourceHash, image->contentHash, image->components, *image->mips))
+            cout << "Could not write the texture cache for " << filename << endl;
+        else if (mapCache)
+        {
+            int components;
+            uint64_t contentHash;
+            shared_ptr<MipChain> mapped = ReadTextureCache(cachePath, sourceHash, components, contentHash);
+            if (mapped)
+                image->mips = mapped;
+        }
+    }
+    return image;
+}
+
+inline GLenum pixelFormat(int components)
+{
+    switch (components)
+    {
+    case 1:
+        return GL_RED;
+    case 2:
+        return GL_RG;
+    case 4:
+        return GL_RGBA;
+    default:
+        return GL_RGB;
+    }
+}
+
+// (re)specifies one level of the bound texture from the chain's bytes at base. unpack alignment has to be 1
+inline void uploadLevel(const MipChain& image, size_t l, const unsigned char* base)
+{
+    const MipChain::Level& level = image.levels[l];
+    if (image.format)
+        glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)l, image.format, level.width, level.height, 0, (GLsizei)level.size, base + level.offset);
+    else
+        glTexImage2D(GL_TEXTURE_2D, (GLint)l, pixelFormat(image.components), level.width, level.height, 0, pixelFormat(image.components), GL_UNSIGNED_BYTE, base + level.offset);
+}
+
+// repeating, trilinear filtered
+inline void setTextureSampling()
+{
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
+
+// uploads a mip chain level by level, staged through the pixel buffer when there is one
+inline void uploadLevels(const MipChain& image, unsigned int pixelBuffer)
+{
+    const unsigned char* base = image.Data();
+    if (pixelBuffer)
+    {
+        StagePixels(pixelBuffer, image.Size(), base);
+        // offsets into the bound pixel unpack buffer
+        base = NULL;
+    }
+    // levels are tightly packed, the smaller ones have rows of any length
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (size_t l = 0; l < image.levels.size(); l++)
+        uploadLevel(image, l, base);
+    if (pixelBuffer)
+        UnbindPixelStaging();
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)image.levels.size() - 1);
+}
+
+// uploads a decoded image into an existing texture name, mipmapped and repeating. with a pixel buffer the
+// levels are staged through it instead of being read from client memory. path is only used for the error message
+inline void UploadTextureInto(unsigned int textureID, const DecodedImage& image, const string& path, unsigned int pixelBuffer = 0)
+{
+    // bare decoded pixels get their chain here, everything from LoadTextureImage already has one
+    shared_ptr<MipChain> mips = image.mips;
+    if (!mips && image.pixels)
+        mips = GenerateMipChain(image.pixels, image.width, image.height, image.components);
+    if (mips)
+    {
+        ProfileScope scope("texture upload");
+        glBindTexture(GL_TEXTURE_2D, textureID);
+        uploadLevels(*mips, pixelBuffer);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+        setTextureSampling();
+    }
+    else
+    {
+        std::cout << "Texture failed to load at path: " << path << std::endl;
+    }
+}
+
+// uploads a decoded image into a new texture
+inline unsigned int UploadTexture(const DecodedImage& image, const string& path)
+{
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+    UploadTextureInto(textureID, image, path);
+    return textureID;
+}
+#endif
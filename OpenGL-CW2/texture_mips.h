@@ -0,0 +1,180 @@
+#ifndef TEXTURE_MIPS_H
+#define TEXTURE_MIPS_H
+
+#include <glad/glad.h>
+
+#include "mapped_file.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <memory>
+#include <vector>
+using namespace std;
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TEXTURE_MIPS_SSE2 1
+#endif
+
+// full mip chain of a texture ready for upload level by level: 8 bit pixels with components channels, or block
+// compressed when format is set (texture_compress.h). owned, or pointing into a mapped texture cache
+struct MipChain {
+    struct Level {
+        int width = 0;
+        int height = 0;
+        size_t offset = 0;
+        size_t size = 0;
+    };
+
+    GLenum format = 0;
+    int components = 0;
+    vector<Level> levels;
+    vector<unsigned char> owned;
+    unique_ptr<MappedFile> mapping;
+    const unsigned char* mapped = NULL;
+
+    const unsigned char* Data() const { return mapped ? mapped : (owned.empty() ? NULL : &owned[0]); }
+
+    size_t Size() const { return levels.empty() ? 0 : levels.back().offset + levels.back().size; }
+
+    // level sizes for an image of this size down to 1x1, bytesPerLevel gives a level's size from its dimensions
+    template<class LevelBytes>
+    void Layout(int width, int height, LevelBytes bytesPerLevel)
+    {
+        levels.clear();
+        for (int w = width, h = height;; w = max(1, w / 2), h = max(1, h / 2))
+        {
+            Level level;
+            level.width = w;
+            level.height = h;
+            level.offset = levels.empty() ? 0 : levels.back().offset + levels.back().size;
+            level.size = bytesPerLevel(w, h);
+            levels.push_back(level);
+            if (w == 1 && h == 1)
+                break;
+        }
+    }
+};
+
+namespace mips
+{
+    // built once on first use, thread safe as function local statics are
+    inline const float* srgbToLinearTable()
+    {
+        static const vector<float> table = []()
+        {
+            vector<float> values(256);
+            for (int i = 0; i < 256; i++)
+            {
+                float c = i / 255.0f;
+                values[i] = c <= 0.04045f ? c / 12.92f : pow((c + 0.055f) / 1.055f, 2.4f);
+            }
+            return values;
+        }();
+        return &table[0];
+    }
+
+    // linear to sRGB through a 4096 entry table, finer than 8 bit output needs even near black
+    const int linearTableSize = 4096;
+
+    inline const unsigned char* linearToSrgbTable()
+    {
+        static const vector<unsigned char> table = []()
+        {
+            vector<unsigned char> values(linearTableSize + 1);
+            for (int i = 0; i <= linearTableSize; i++)
+            {
+                float c = (float)i / linearTableSize;
+                float encoded = c <= 0.0031308f ? c * 12.92f : 1.055f * pow(c, 1.0f / 2.4f) - 0.055f;
+                values[i] = (unsigned char)min(255.0f, encoded * 255.0f + 0.5f);
+            }
+            return values;
+        }();
+        return &table[0];
+    }
+
+    // channels filtered in linear light: the colour of three and four channel images
+    inline bool isColorChannel(int channel, int components)
+    {
+        return components >= 3 && channel < 3;
+    }
+
+    // 2x2 box filter of a float image to half size, odd edges repeat their last row or column. rows in parallel
+    inline void downsample(const vector<float>& source, int width, int height, int components, vector<float>& target, int nextWidth, int nextHeight)
+    {
+        target.resize((size_t)nextWidth * nextHeight * components);
+        ThreadPool::Get().ParallelFor((size_t)nextHeight, [&](size_t y)
+        {
+            const float* row0 = &source[(size_t)min((int)y * 2, height - 1) * width * components];
+            const float* row1 = &source[(size_t)min((int)y * 2 + 1, height - 1) * width * components];
+            float* output = &target[y * nextWidth * components];
+            for (int x = 0; x < nextWidth; x++)
+            {
+                int x0 = min(x * 2, width - 1) * components, x1 = min(x * 2 + 1, width - 1) * components;
+#ifdef TEXTURE_MIPS_SSE2
+                if (components == 4)
+                {
+                    __m128 sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(row0 + x0), _mm_loadu_ps(row0 + x1)),
+                                            _mm_add_ps(_mm_loadu_ps(row1 + x0), _mm_loadu_ps(row1 + x1)));
+                    _mm_storeu_ps(output + x * 4, _mm_mul_ps(sum, _mm_set1_ps(0.25f)));
+                    continue;
+                }
+#endif
+                for (int c = 0; c < components; c++)
+                    output[x * components + c] = (row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c]) * 0.25f;
+            }
+        });
+    }
+
+    inline void toFloat(const unsigned char* pixels, int width, int height, int components, vector<float>& linear)
+    {
+        const float* toLinear = srgbToLinearTable();
+        size_t rowValues = (size_t)width * components;
+        linear.resize(rowValues * height);
+        ThreadPool::Get().ParallelFor((size_t)height, [&](size_t y)
+        {
+            for (size_t i = y * rowValues; i < (y + 1) * rowValues; i++)
+                linear[i] = isColorChannel((int)(i % components), components) ? toLinear[pixels[i]] : pixels[i] / 255.0f;
+        });
+    }
+
+    inline void toBytes(const vector<float>& linear, int width, int height, int components, unsigned char* pixels)
+    {
+        const unsigned char* toSrgb = linearToSrgbTable();
+        size_t rowValues = (size_t)width * components;
+        ThreadPool::Get().ParallelFor((size_t)height, [&](size_t y)
+        {
+            for (size_t i = y * rowValues; i < (y + 1) * rowValues; i++)
+            {
+                float value = min(1.0f, max(0.0f, linear[i]));
+                pixels[i] = isColorChannel((int)(i % components), components) ? toSrgb[(int)(value * linearTableSize + 0.5f)] : (unsigned char)(value * 255.0f + 0.5f);
+            }
+        });
+    }
+}
+
+// every level from the image itself down to 1x1, as 8 bit pixels
+inline shared_ptr<MipChain> GenerateMipChain(const unsigned char* pixels, int width, int height, int components)
+{
+    auto chain = make_shared<MipChain>();
+    chain->components = components;
+    chain->Layout(width, height, [components](int w, int h) { return (size_t)w * h * components; });
+    chain->owned.resize(chain->Size());
+    copy(pixels, pixels + chain->levels[0].size, chain->owned.begin());
+
+    // each level is filtered from the float copy of the one above, so rounding doesn't build up down the chain
+    vector<float> current, next;
+    mips::toFloat(pixels, width, height, components, current);
+    for (size_t l = 1; l < chain->levels.size(); l++)
+    {
+        const MipChain::Level& above = chain->levels[l - 1];
+        const MipChain::Level& level = chain->levels[l];
+        mips::downsample(current, above.width, above.height, components, next, level.width, level.height);
+        mips::toBytes(next, level.width, level.height, components, &chain->owned[level.offset]);
+        current.swap(next);
+    }
+    return chain;
+}
+#endif
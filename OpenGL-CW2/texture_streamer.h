@@ -0,0 +1,278 @@
+#ifndef TEXTURE_STREAMER_H
+#define TEXTURE_STREAMER_H
+
+#include <glad/glad.h>
+
+#include "frame_scheduler.h"
+#include "resource_cache.h"
+#include "texture_loader.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+using namespace std;
+
+// levels this size and smaller go up as soon as a texture has loaded, finer ones are streamed in on demand
+const int textureStreamTailSize = 64;
+// GPU memory the streamed levels may take together, coarser levels are used past it
+const size_t textureStreamBudgetBytes = 256u << 20;
+// a texture nothing has asked for in this many frames falls back to its tail
+const unsigned int textureStreamIdleFrames = 300;
+// below the model uploads, geometry first
+const int textureStreamPriority = -1;
+
+// mip streaming for model textures. a texture starts as a grey texel while its file loads on the thread pool, then
+// holds only its small tail levels. every frame the instances drawing it say how many screen pixels one repeat of
+// it covers; Update works out the finest level each texture needs, fits them all into the budget and uploads
+// finer levels one at a time through the scheduler (or drops levels nothing needs any more).
+// GL_TEXTURE_BASE_LEVEL and MAX_LEVEL keep sampling within the levels that are there. context thread only
+class TextureStreamer
+{
+public:
+    size_t budgetBytes = textureStreamBudgetBytes;
+
+    struct Stats {
+        size_t levelsStreamed = 0;
+        size_t levelsDropped = 0;
+        // frames in which the budget held back levels that were asked for
+        size_t framesOverBudget = 0;
+    };
+
+    static TextureStreamer& Get()
+    {
+        static TextureStreamer streamer;
+        return streamer;
+    }
+
+    // makes the texture a grey texel and loads its file (or texture cache) in the background. once loaded its tail
+    // levels are queued for upload and the rest is streamed by Update
+    void Load(const shared_ptr<SharedTexture>& texture, const string& filename, FrameScheduler& scheduler)
+    {
+        static const unsigned char grey[4] = { 128, 128, 128, 255 };
+        glBindTexture(GL_TEXTURE_2D, texture->id);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+        setTextureSampling();
+
+        weak_ptr<SharedTexture> weak = texture;
+        scheduler.ScheduleAsync("texture stream load", textureStreamPriority, 0.2f,
+            // the chain is kept for streaming, mapped from the texture cache so only the pages of levels in use
+            // take memory
+            [filename]() { return LoadTextureImage(filename, true); },
+            [this, weak, filename](shared_ptr<DecodedImage> image)
+            {
+                shared_ptr<SharedTexture> loaded = weak.lock();
+                if (!loaded)
+                    return;
+                if (!image->mips)
+                {
+                    cout << "Texture failed to load at path: " << filename << endl;
+                    return;
+                }
+                add(loaded, image->mips);
+            });
+    }
+
+    // this frame the texture covers pixelsPerRepeat screen pixels per repeat of it (one unit of texture coordinates)
+    // somewhere on screen. the finest request of the frame counts
+    void Request(unsigned int textureId, float pixelsPerRepeat)
+    {
+        auto found = entries.find(textureId);
+        if (found == entries.end())
+            return;
+        Entry& entry = found->second;
+        const MipChain::Level& top = entry.chain->levels[0];
+        // level l has max(width, height) >> l texels per repeat, the finest one still at least one per pixel is enough
+        float texels = (float)max(top.width, top.height);
+        int level = pixelsPerRepeat >= texels ? 0 : (int)floor(log2(texels / max(pixelsPerRepeat, 1e-6f)));
+        entry.requested = min(entry.requested, (unsigned int)min(level, (int)entry.tail));
+    }
+
+    // once a frame after the requests: picks every texture's level within the budget and queues the uploads
+    void Update(FrameScheduler& scheduler)
+    {
+        // textures the resource cache deleted
+        for (auto it = entries.begin(); it != entries.end();)
+        {
+            if (it->second.texture.expired())
+                it = entries.erase(it);
+            else
+                ++it;
+        }
+
+        size_t total = 0;
+        for (auto& item : entries)
+        {
+            Entry& entry = item.second;
+            if (entry.requested != UINT_MAX)
+            {
+                entry.wanted = entry.requested;
+                entry.idleFrames = 0;
+            }
+            else if (++entry.idleFrames > textureStreamIdleFrames)
+                entry.wanted = entry.tail;
+            entry.requested = UINT_MAX;
+            total += bytesFrom(entry, entry.wanted);
+        }
+        // over the budget the finest level of the biggest texture goes first, until everything fits
+        if (total > budgetBytes)
+            stats.framesOverBudget++;
+        while (total > budgetBytes)
+        {
+            Entry* biggest = NULL;
+            for (auto& item : entries)
+            {
+                Entry& entry = item.second;
+                if (entry.wanted < entry.tail && (!biggest || entry.chain->levels[entry.wanted].size > biggest->chain->levels[biggest->wanted].size))
+                    biggest = &entry;
+            }
+            if (!biggest)
+                break;
+            total -= biggest->chain->levels[biggest->wanted].size;
+            biggest->wanted++;
+        }
+
+        for (auto& item : entries)
+        {
+            Entry& entry = item.second;
+            if (entry.wanted > entry.resident)
+                drop(entry, entry.wanted);
+            else if (entry.wanted < entry.resident && !entry.streaming)
+                streamLevel(item.first, entry, entry.resident - 1, scheduler);
+        }
+    }
+
+    // GPU memory of the levels uploaded so far
+    size_t ResidentBytes() const
+    {
+        size_t bytes = 0;
+        for (const auto& item : entries)
+            bytes += bytesFrom(item.second, item.second.resident);
+        return bytes;
+    }
+
+    void PrintReport() const
+    {
+        cout << "Texture streamer: " << entries.size() << " textures, " << ResidentBytes() / 1024 << " KB resident of a "
+             << budgetBytes / 1024 << " KB budget, " << stats.levelsStreamed << " levels streamed in, " << stats.levelsDropped
+             << " dropped, " << stats.framesOverBudget << " frames over budget" << endl;
+    }
+
+private:
+    struct Entry {
+        weak_ptr<SharedTexture> texture;
+        // the whole chain, mapped from the texture cache or owned, finer levels are uploaded from it
+        shared_ptr<MipChain> chain;
+        // first level of the tail, always resident
+        unsigned int tail = 0;
+        // finest level on the GPU, BASE_LEVEL
+        unsigned int resident = 0;
+        // finest level it should have
+        unsigned int wanted = 0;
+        // finest level asked for this frame, UINT_MAX if none
+        unsigned int requested = UINT_MAX;
+        unsigned int idleFrames = 0;
+        // an upload is in flight
+        bool streaming = false;
+    };
+
+    unordered_map<unsigned int, Entry> entries;
+    Stats stats;
+
+    TextureStreamer() {}
+
+    static size_t bytesFrom(const Entry& entry, unsigned int level)
+    {
+        const MipChain::Level& finest = entry.chain->levels[level];
+        const MipChain::Level& last = entry.chain->levels.back();
+        return last.offset + last.size - finest.offset;
+    }
+
+    // uploads the tail of a loaded chain, everything for a texture no bigger than the tail size
+    void add(const shared_ptr<SharedTexture>& texture, const shared_ptr<MipChain>& chain)
+    {
+        unsigned int tail = 0;
+        while (tail + 1 < chain->levels.size() && max(chain->levels[tail].width, chain->levels[tail].height) > textureStreamTailSize)
+            tail++;
+        glBindTexture(GL_TEXTURE_2D, texture->id);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        // the grey texel's level 0 goes, unless the tail starts there and replaces it
+        if (tail > 0)
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        for (size_t l = tail; l < chain->levels.size(); l++)
+            uploadLevel(*chain, l, chain->Data());
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, (GLint)tail);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)chain->levels.size() - 1);
+        if (tail == 0)
+            return;
+
+        Entry& entry = entries[texture->id];
+        entry = Entry();
+        entry.texture = texture;
+        entry.chain = chain;
+        entry.tail = entry.resident = entry.wanted = tail;
+    }
+
+    // the level's pages are read in on the thread pool so the upload doesn't fault on a mapped cache file
+    void streamLevel(unsigned int id, Entry& entry, unsigned int level, FrameScheduler& scheduler)
+    {
+        entry.streaming = true;
+        shared_ptr<MipChain> chain = entry.chain;
+        weak_ptr<SharedTexture> weak = entry.texture;
+        const MipChain::Level& bytes = chain->levels[level];
+        float estimatedMs = 0.05f + (float)bytes.size / 1.0e6f;
+        scheduler.ScheduleAsync("texture stream level", textureStreamPriority, estimatedMs,
+            [chain, level]()
+            {
+                const MipChain::Level& bytes = chain->levels[level];
+                const volatile unsigned char* data = chain->Data() + bytes.offset;
+                unsigned int sum = 0;
+                for (size_t i = 0; i < bytes.size; i += 4096)
+                    sum += data[i];
+                return sum;
+            },
+            [this, id, weak, chain, level](unsigned int)
+            {
+                auto found = entries.find(id);
+                if (weak.expired() || found == entries.end() || found->second.chain != chain)
+                    return;
+                Entry& entry = found->second;
+                entry.streaming = false;
+                // dropped or budgeted away while the pages were read
+                if (entry.resident != level + 1 || entry.wanted > level)
+                    return;
+                glBindTexture(GL_TEXTURE_2D, found->first);
+                glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+                uploadLevel(*chain, level, chain->Data());
+                glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, (GLint)level);
+                entry.resident = level;
+                stats.levelsStreamed++;
+            });
+    }
+
+    // makes level the finest and frees the ones above it
+    void drop(Entry& entry, unsigned int level)
+    {
+        shared_ptr<SharedTexture> texture = entry.texture.lock();
+        glBindTexture(GL_TEXTURE_2D, texture->id);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, (GLint)level);
+        for (unsigned int l = entry.resident; l < level; l++)
+        {
+            // a zero sized level holds no memory, and is outside the base to max range
+            if (entry.chain->format)
+                glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)l, entry.chain->format, 0, 0, 0, 0, NULL);
+            else
+                glTexImage2D(GL_TEXTURE_2D, (GLint)l, pixelFormat(entry.chain->components), 0, 0, 0, pixelFormat(entry.chain->components), GL_UNSIGNED_BYTE, NULL);
+        }
+        stats.levelsDropped += level - entry.resident;
+        entry.resident = level;
+    }
+};
+#endif
@@ -0,0 +1,150 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// fixed size pool of worker threads for background work (terrain generation, asset decoding, ...).
+// workers never touch OpenGL, anything that needs the context is handed back to the main thread.
+class ThreadPool
+{
+public:
+    // constructor, defaults to one worker per hardware thread, leaving one for the render thread
+    ThreadPool(unsigned int threadCount = 0)
+    {
+        if (threadCount == 0)
+        {
+            unsigned int hardwareThreads = std::thread::hardware_concurrency();
+            threadCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+        }
+        for (unsigned int i = 0; i < threadCount; i++)
+            workers.emplace_back([this] { workerLoop(); });
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            stopping = true;
+        }
+        queueCondition.notify_all();
+        for (std::thread& worker : workers)
+            worker.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // process wide pool shared by every system
+    static ThreadPool& Get()
+    {
+        static ThreadPool pool;
+        return pool;
+    }
+
+    // queues a job and returns a future holding its result
+    template<class F>
+    auto Submit(F&& job) -> std::future<decltype(job())>
+    {
+        typedef decltype(job()) Result;
+        auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(job));
+        std::future<Result> result = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            jobs.emplace([task] { (*task)(); });
+        }
+        queueCondition.notify_one();
+        return result;
+    }
+
+    // runs body(i) for every i in [0, count) on the workers and the calling thread, returns when all are done.
+    // the caller takes part in the loop, so this is safe to call from inside another job.
+    template<class F>
+    void ParallelFor(size_t count, F body)
+    {
+        if (count == 0)
+            return;
+        if (count == 1 || workers.empty())
+        {
+            for (size_t i = 0; i < count; i++)
+                body(i);
+            return;
+        }
+
+        struct LoopState
+        {
+            std::atomic<size_t> next{ 0 };
+            std::atomic<size_t> finished{ 0 };
+            size_t count = 0;
+            F body;
+            std::mutex doneMutex;
+            std::condition_variable doneCondition;
+            LoopState(size_t n, F&& f) : count(n), body(std::move(f)) {}
+        };
+        auto state = std::make_shared<LoopState>(count, std::move(body));
+        auto runLoop = [state]
+        {
+            size_t i;
+            while ((i = state->next.fetch_add(1)) < state->count)
+            {
+                state->body(i);
+                if (state->finished.fetch_add(1) + 1 == state->count)
+                {
+                    std::lock_guard<std::mutex> lock(state->doneMutex);
+                    state->doneCondition.notify_all();
+                }
+            }
+        };
+
+        size_t helpers = std::min(count - 1, workers.size());
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            for (size_t i = 0; i < helpers; i++)
+                jobs.emplace(runLoop);
+        }
+        queueCondition.notify_all();
+
+        runLoop();
+        std::unique_lock<std::mutex> lock(state->doneMutex);
+        state->doneCondition.wait(lock, [&state] { return state->finished.load() == state->count; });
+    }
+
+    // number of worker threads
+    size_t Size() const
+    {
+        return workers.size();
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> jobs;
+    std::mutex queueMutex;
+    std::condition_variable queueCondition;
+    bool stopping = false;
+
+    void workerLoop()
+    {
+        for (;;)
+        {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(queueMutex);
+                queueCondition.wait(lock, [this] { return stopping || !jobs.empty(); });
+                if (stopping && jobs.empty())
+                    return;
+                job = std::move(jobs.front());
+                jobs.pop();
+            }
+            job();
+        }
+    }
+};
+#endif
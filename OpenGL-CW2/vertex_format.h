@@ -0,0 +1,189 @@
+#ifndef VERTEX_FORMAT_H
+#define VERTEX_FORMAT_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+// attribute locations shared by every mesh layout, matching the full Vertex
+enum VertexAttribute {
+    ATTRIBUTE_POSITION,
+    ATTRIBUTE_NORMAL,
+    ATTRIBUTE_TEXCOORDS,
+    ATTRIBUTE_TANGENT,
+    ATTRIBUTE_BITANGENT,
+    ATTRIBUTE_BONE_IDS,
+    ATTRIBUTE_BONE_WEIGHTS,
+    ATTRIBUTE_COUNT
+};
+
+// how one attribute is stored, straight glVertexAttrib(I)Pointer arguments
+struct VertexAttributeFormat {
+    unsigned char enabled;
+    // integer attributes go through glVertexAttribIPointer
+    unsigned char integer;
+    unsigned char normalized;
+    unsigned char components;
+    GLenum type;
+    unsigned int offset;
+};
+
+// layout of a mesh's vertex and index buffers, chosen per mesh at import. plain data so it can be
+// stored as is in the mesh cache
+struct VertexFormat {
+    VertexAttributeFormat attributes[ATTRIBUTE_COUNT];
+    unsigned int stride;
+    GLenum indexType;
+    // quantized positions are stored as unorm16 over the mesh bounds, the vertex shader applies
+    // position * positionScale + positionOffset. identity for float positions
+    glm::vec3 positionScale;
+    glm::vec3 positionOffset;
+
+    VertexFormat()
+    {
+        memset(this, 0, sizeof(*this));
+        indexType = GL_UNSIGNED_INT;
+        positionScale = glm::vec3(1.0f);
+        positionOffset = glm::vec3(0.0f);
+    }
+
+    void Add(VertexAttribute location, int components, GLenum type, bool normalized, bool integer = false)
+    {
+        VertexAttributeFormat& attribute = attributes[location];
+        attribute.enabled = 1;
+        attribute.integer = integer;
+        attribute.normalized = normalized;
+        attribute.components = (unsigned char)components;
+        attribute.type = type;
+        attribute.offset = stride;
+        stride += (AttributeBytes(components, type) + 3) & ~3u;
+    }
+
+    static unsigned int AttributeBytes(int components, GLenum type)
+    {
+        switch (type)
+        {
+        case GL_INT_2_10_10_10_REV:
+            return 4;
+        case GL_UNSIGNED_BYTE:
+        case GL_BYTE:
+            return components;
+        case GL_HALF_FLOAT:
+        case GL_UNSIGNED_SHORT:
+        case GL_SHORT:
+            return components * 2;
+        default:
+            return components * 4;
+        }
+    }
+
+    size_t IndexSize() const
+    {
+        return indexType == GL_UNSIGNED_SHORT ? 2 : 4;
+    }
+};
+
+// points the enabled attributes of the format at the bound GL_ARRAY_BUFFER, the others read the default (0, 0, 0, 1)
+inline void SetVertexAttributes(const VertexFormat& format)
+{
+    for (unsigned int location = 0; location < ATTRIBUTE_COUNT; location++)
+    {
+        const VertexAttributeFormat& attribute = format.attributes[location];
+        if (!attribute.enabled)
+            continue;
+        glEnableVertexAttribArray(location);
+        if (attribute.integer)
+            glVertexAttribIPointer(location, attribute.components, attribute.type, format.stride, (void*)(size_t)attribute.offset);
+        else
+            glVertexAttribPointer(location, attribute.components, attribute.type, attribute.normalized ? GL_TRUE : GL_FALSE, format.stride, (void*)(size_t)attribute.offset);
+    }
+}
+
+// buffers laid out the same way, the per mesh position dequantization aside
+inline bool SameVertexLayout(const VertexFormat& a, const VertexFormat& b)
+{
+    return a.stride == b.stride && a.indexType == b.indexType && memcmp(a.attributes, b.attributes, sizeof(a.attributes)) == 0;
+}
+
+namespace vertexpack
+{
+    // IEEE half float, rounded to nearest, overflow goes to infinity and tiny values to (signed) zero
+    inline uint16_t toHalf(float value)
+    {
+        uint32_t bits;
+        memcpy(&bits, &value, 4);
+        uint16_t sign = (uint16_t)((bits >> 16) & 0x8000);
+        int exponent = (int)((bits >> 23) & 0xFF) - 127 + 15;
+        uint32_t mantissa = bits & 0x7FFFFF;
+        if (exponent >= 31)
+            return sign | 0x7C00;
+        if (exponent <= 0)
+        {
+            if (exponent < -10)
+                return sign;
+            // subnormal half
+            mantissa |= 0x800000;
+            uint32_t shift = (uint32_t)(14 - exponent);
+            uint16_t half = (uint16_t)(mantissa >> shift);
+            if ((mantissa >> (shift - 1)) & 1)
+                half++;
+            return sign | half;
+        }
+        uint16_t half = (uint16_t)(sign | (exponent << 10) | (mantissa >> 13));
+        // round to nearest, a carry into the exponent is still correct
+        if (mantissa & 0x1000)
+            half++;
+        return half;
+    }
+
+    inline uint32_t packSigned10(float value)
+    {
+        float clamped = value < -1.0f ? -1.0f : (value > 1.0f ? 1.0f : value);
+        return (uint32_t)((int)floor(clamped * 511.0f + 0.5f)) & 0x3FF;
+    }
+
+    // xyz in 10 bit signed normalized components, w (-1 or 1) in the top 2 bits
+    inline uint32_t packNormal(const glm::vec3& v, float w = 0.0f)
+    {
+        uint32_t packedW = (uint32_t)((int)w) & 0x3;
+        return packSigned10(v.x) | (packSigned10(v.y) << 10) | (packSigned10(v.z) << 20) | (packedW << 30);
+    }
+
+    inline float fromHalf(uint16_t half)
+    {
+        int exponent = (half >> 10) & 0x1F;
+        int mantissa = half & 0x3FF;
+        float value;
+        if (exponent == 0)
+            value = ldexp((float)mantissa, -24);
+        else if (exponent == 31)
+            value = mantissa ? NAN : INFINITY;
+        else
+            value = ldexp((float)(mantissa | 0x400), exponent - 25);
+        return (half & 0x8000) ? -value : value;
+    }
+
+    inline float unpackSigned10(uint32_t bits)
+    {
+        int value = (int)(bits & 0x3FF);
+        if (value & 0x200)
+            value -= 1024;
+        return value < -511 ? -1.0f : value / 511.0f;
+    }
+
+    inline glm::vec3 unpackNormal(uint32_t packed)
+    {
+        return glm::vec3(unpackSigned10(packed), unpackSigned10(packed >> 10), unpackSigned10(packed >> 20));
+    }
+
+    inline uint16_t packUnorm16(float value)
+    {
+        float clamped = value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+        return (uint16_t)(clamped * 65535.0f + 0.5f);
+    }
+}
+#endif